@@ -0,0 +1,276 @@
+// File: benchmarks/page_cache.c
+// fconcat-page-cache: puts a benchmark tree into a known page cache state without root. Every
+// regular file is evicted with POSIX_FADV_DONTNEED or read in full, and the result is verified
+// with mincore() instead of being assumed.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MAP_WINDOW (64ULL * 1024 * 1024) // Bytes mapped per mincore() call
+#define READ_BUFFER_SIZE (1024 * 1024)
+
+typedef enum
+{
+    ACTION_STATUS, // Only measure residency
+    ACTION_EVICT,  // Drop every file's pages
+    ACTION_WARM    // Read every file in full
+} Action;
+
+typedef struct
+{
+    Action action;
+    unsigned long long files;
+    unsigned long long bytes;          // File sizes
+    unsigned long long resident_bytes; // Pages found in the page cache afterwards
+    unsigned long long failed;         // Files that could not be opened or measured; fconcat skips them too
+    char *read_buffer;
+    long page_size;
+} Tally;
+
+// Bytes of the file that are in the page cache, or -1 when it cannot be measured
+static long long resident_bytes(int fd, unsigned long long size, long page_size)
+{
+    unsigned long long resident = 0;
+    size_t vector_size = (size_t)(MAP_WINDOW / (unsigned long long)page_size);
+    unsigned char *vector = malloc(vector_size);
+    if (!vector)
+        return -1;
+
+    for (unsigned long long offset = 0; offset < size; offset += MAP_WINDOW)
+    {
+        size_t length = (size_t)(size - offset < MAP_WINDOW ? size - offset : MAP_WINDOW);
+        void *map = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, (off_t)offset);
+        if (map == MAP_FAILED)
+        {
+            free(vector);
+            return -1;
+        }
+        // Mapping does not fault pages in: mincore() sees the cache as it was
+        int measured = mincore(map, length, vector) == 0;
+        munmap(map, length);
+        if (!measured)
+        {
+            free(vector);
+            return -1;
+        }
+
+        size_t pages = (length + (size_t)page_size - 1) / (size_t)page_size;
+        for (size_t i = 0; i < pages; i++)
+        {
+            if (vector[i] & 1)
+                resident += i + 1 < pages ? (unsigned long long)page_size
+                                          : length - i * (size_t)page_size;
+        }
+    }
+    free(vector);
+    return (long long)resident;
+}
+
+static void read_through(int fd, char *buffer)
+{
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+    while (read(fd, buffer, READ_BUFFER_SIZE) > 0)
+        ;
+}
+
+static void handle_file(Tally *tally, const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        tally->failed++;
+        return;
+    }
+    unsigned long long size = (unsigned long long)st.st_size;
+    tally->files++;
+    tally->bytes += size;
+    if (size == 0)
+    {
+        close(fd);
+        return;
+    }
+
+    if (tally->action == ACTION_WARM)
+        read_through(fd, tally->read_buffer);
+    else if (tally->action == ACTION_EVICT)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+
+    long long resident = resident_bytes(fd, size, tally->page_size);
+    if (resident > 0 && tally->action == ACTION_EVICT)
+    {
+        // Dirty pages survive DONTNEED: write them back and drop them again
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        resident = resident_bytes(fd, size, tally->page_size);
+    }
+    close(fd);
+
+    if (resident < 0)
+        tally->failed++;
+    else
+        tally->resident_bytes += (unsigned long long)resident;
+}
+
+// Symlinks are not followed, so the tree is what fconcat sees with its default --symlinks skip
+static void walk(Tally *tally, const char *path)
+{
+    struct stat st;
+    if (lstat(path, &st) != 0)
+    {
+        tally->failed++;
+        return;
+    }
+    if (S_ISREG(st.st_mode))
+    {
+        handle_file(tally, path);
+        return;
+    }
+    if (!S_ISDIR(st.st_mode))
+        return;
+
+    DIR *dir = opendir(path);
+    if (!dir)
+    {
+        tally->failed++;
+        return;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        char child[PATH_MAX];
+        if (snprintf(child, sizeof(child), "%s/%s", path, entry->d_name) >= (int)sizeof(child))
+            continue;
+        walk(tally, child);
+    }
+    closedir(dir);
+}
+
+static void print_usage(const char *program_name)
+{
+    fprintf(stderr,
+            "Usage:\n"
+            "  %s <evict|warm|status> <path>... [options]\n"
+            "\n"
+            "Puts every regular file under <path> into a known page cache state and verifies it\n"
+            "with mincore(). No root needed: files are evicted with POSIX_FADV_DONTNEED and\n"
+            "warmed by reading them in full. Directory entries and inodes stay cached.\n"
+            "\n"
+            "  evict   Drop the files' pages; fails when more than --max-resident stays cached\n"
+            "  warm    Read the files; fails when less than 100%% - --max-resident is cached\n"
+            "  status  Only report how much of the tree is cached\n"
+            "\n"
+            "Options:\n"
+            "  --max-resident <pct>  Tolerance for evict and warm, in percent (default 1)\n"
+            "  --quiet               Print nothing; the exit status tells the result\n"
+            "\n"
+            "Exit status: 0 on success, 2 when the tree did not reach the requested state.\n"
+            "\n"
+            "Example:\n"
+            "  %s evict /usr/include && ./fconcat /usr/include out.txt\n",
+            program_name, program_name);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    Tally tally;
+    memset(&tally, 0, sizeof(tally));
+    if (strcmp(argv[1], "evict") == 0)
+        tally.action = ACTION_EVICT;
+    else if (strcmp(argv[1], "warm") == 0)
+        tally.action = ACTION_WARM;
+    else if (strcmp(argv[1], "status") == 0)
+        tally.action = ACTION_STATUS;
+    else
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    double max_resident = 1.0;
+    int quiet = 0;
+    int first_option = 2;
+    while (first_option < argc && argv[first_option][0] != '-')
+        first_option++;
+    if (first_option == 2)
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    for (int i = first_option; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--max-resident") == 0 && i + 1 < argc)
+        {
+            char *end;
+            max_resident = strtod(argv[++i], &end);
+            if (*end != '\0' || max_resident < 0.0 || max_resident > 100.0)
+            {
+                fprintf(stderr, "Error: --max-resident must be a percentage\n");
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--quiet") == 0)
+        {
+            quiet = 1;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    tally.page_size = sysconf(_SC_PAGESIZE);
+    tally.read_buffer = malloc(READ_BUFFER_SIZE);
+    if (tally.page_size <= 0 || !tally.read_buffer)
+    {
+        fprintf(stderr, "Error: %s\n", strerror(errno ? errno : ENOMEM));
+        free(tally.read_buffer);
+        return EXIT_FAILURE;
+    }
+    for (int i = 2; i < first_option; i++)
+        walk(&tally, argv[i]);
+    free(tally.read_buffer);
+
+    double resident_pct = tally.bytes > 0 ? 100.0 * (double)tally.resident_bytes / (double)tally.bytes : 0.0;
+    int reached = 1;
+    if (tally.action == ACTION_EVICT)
+        reached = resident_pct <= max_resident;
+    else if (tally.action == ACTION_WARM)
+        reached = resident_pct >= 100.0 - max_resident;
+
+    if (!quiet)
+    {
+        static const char *const action_names[] = {"status", "evict", "warm"};
+        printf("%s: %llu files, %.1f MB, %.1f MB cached (%.2f%%)", action_names[tally.action], tally.files,
+               (double)tally.bytes / (1024.0 * 1024.0), (double)tally.resident_bytes / (1024.0 * 1024.0),
+               resident_pct);
+        if (tally.failed > 0)
+            printf(", %llu files not measured", tally.failed);
+        if (tally.action != ACTION_STATUS)
+            printf("%s", reached ? "" : " - requested state not reached");
+        printf("\n");
+    }
+    return reached ? EXIT_SUCCESS : 2;
+}
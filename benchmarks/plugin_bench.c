@@ -0,0 +1,958 @@
+// File: benchmarks/plugin_bench.c
+// fconcat-plugin-bench: replays a corpus through one streaming plugin at several chunk sizes
+// and reports throughput, per-chunk latency, allocations per chunk, and files whose output
+// depends on where the chunk boundaries fall. A plugin that exports process_chunk_spans is
+// replayed through it as well, since fconcat prefers it, and its gathered output is compared
+// with the process_chunk output. An aggregator's map/merge/finalize is measured and checked
+// the same way.
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "../src/concat.h"
+
+#define MAX_CHUNK_SIZES 16
+#define LATENCY_BUCKETS 1024
+#define MAX_REPORTED_DIFFS 10
+
+// Allocation accounting: the bench interposes malloc for itself and the plugin it loaded, and
+// counts only while a plugin callback runs
+static int g_counting = 0;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static unsigned long long g_alloc_calls = 0;
+static unsigned long long g_alloc_bytes = 0;
+
+void *malloc(size_t size)
+{
+    if (g_counting)
+    {
+        g_alloc_calls++;
+        g_alloc_bytes += size;
+    }
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    if (g_counting)
+    {
+        g_alloc_calls++;
+        g_alloc_bytes += count * size;
+    }
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (g_counting)
+    {
+        g_alloc_calls++;
+        g_alloc_bytes += size;
+    }
+    return __libc_realloc(ptr, size);
+}
+#define COUNT_ALLOCS(on) (g_counting = (on))
+#else
+static unsigned long long g_alloc_calls = 0;
+static unsigned long long g_alloc_bytes = 0;
+#define COUNT_ALLOCS(on) ((void)0)
+#endif
+
+typedef enum
+{
+    BOUNDARY_FIXED,  // Every chunk has the configured size
+    BOUNDARY_RANDOM, // Chunk sizes drawn from [1, size]
+    BOUNDARY_SHIFTED // A short first chunk, then fixed: boundaries land mid-token
+} BoundaryMode;
+
+// Which export a pass drives
+typedef enum
+{
+    REPLAY_COPY, // process_chunk: a new buffer per chunk
+    REPLAY_SPANS // process_chunk_spans: spans gathered the way fconcat writes them with writev
+} ReplayPath;
+
+typedef struct
+{
+    char *path; // Relative to the corpus root, as fconcat would pass it
+    char *data;
+    size_t size;
+    char *reference; // Output with the whole file as a single chunk
+    size_t reference_size;
+} CorpusFile;
+
+typedef struct
+{
+    CorpusFile *files;
+    size_t count;
+    size_t capacity;
+    unsigned long long total_bytes;
+} Corpus;
+
+// Log-linear latency histogram: 16 sub-buckets per power of two, about 6% resolution
+typedef struct
+{
+    unsigned long long counts[LATENCY_BUCKETS];
+    unsigned long long samples;
+    unsigned long long max_ns;
+} LatencyHistogram;
+
+static int latency_bucket(unsigned long long ns)
+{
+    if (ns < 32)
+        return (int)ns;
+    int shift = 63 - __builtin_clzll(ns) - 4;
+    return 32 + (shift - 1) * 16 + (int)((ns >> shift) - 16);
+}
+
+static unsigned long long bucket_floor(int bucket)
+{
+    if (bucket < 32)
+        return (unsigned long long)bucket;
+    int shift = (bucket - 32) / 16 + 1;
+    return (unsigned long long)((bucket - 32) % 16 + 16) << shift;
+}
+
+static void latency_record(LatencyHistogram *histogram, unsigned long long ns)
+{
+    histogram->counts[latency_bucket(ns)]++;
+    histogram->samples++;
+    if (ns > histogram->max_ns)
+        histogram->max_ns = ns;
+}
+
+static unsigned long long latency_percentile(const LatencyHistogram *histogram, double percentile)
+{
+    unsigned long long rank = (unsigned long long)(histogram->samples * percentile / 100.0);
+    unsigned long long seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        seen += histogram->counts[i];
+        if (seen > rank)
+            return bucket_floor(i);
+    }
+    return histogram->max_ns;
+}
+
+static unsigned long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+static uint64_t g_rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_random(void)
+{
+    // xorshift64*
+    g_rng_state ^= g_rng_state >> 12;
+    g_rng_state ^= g_rng_state << 25;
+    g_rng_state ^= g_rng_state >> 27;
+    return g_rng_state * 2685821657736338717ULL;
+}
+
+static int read_whole_file(const char *path, char **data, size_t *size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        close(fd);
+        return -1;
+    }
+
+    char *buffer = malloc(st.st_size > 0 ? (size_t)st.st_size : 1);
+    size_t done = 0;
+    while (buffer && done < (size_t)st.st_size)
+    {
+        ssize_t n = read(fd, buffer + done, (size_t)st.st_size - done);
+        if (n <= 0)
+            break;
+        done += (size_t)n;
+    }
+    close(fd);
+    if (!buffer)
+        return -1;
+
+    *data = buffer;
+    *size = done;
+    return 0;
+}
+
+static void corpus_add(Corpus *corpus, const char *full_path, const char *relative_path)
+{
+    char *data;
+    size_t size;
+    if (read_whole_file(full_path, &data, &size) != 0)
+        return;
+
+    if (corpus->count == corpus->capacity)
+    {
+        size_t capacity = corpus->capacity ? corpus->capacity * 2 : 64;
+        CorpusFile *files = realloc(corpus->files, capacity * sizeof(*files));
+        if (!files)
+        {
+            free(data);
+            return;
+        }
+        corpus->files = files;
+        corpus->capacity = capacity;
+    }
+
+    CorpusFile *file = &corpus->files[corpus->count++];
+    memset(file, 0, sizeof(*file));
+    file->path = strdup(relative_path);
+    file->data = data;
+    file->size = size;
+    corpus->total_bytes += size;
+}
+
+static void corpus_scan(Corpus *corpus, const char *full_path, const char *relative_path)
+{
+    struct stat st;
+    if (stat(full_path, &st) != 0)
+        return;
+
+    if (!S_ISDIR(st.st_mode))
+    {
+        corpus_add(corpus, full_path, relative_path[0] ? relative_path : full_path);
+        return;
+    }
+
+    DIR *dir = opendir(full_path);
+    if (!dir)
+        return;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        char child_full[PATH_MAX];
+        char child_relative[PATH_MAX];
+        if (snprintf(child_full, sizeof(child_full), "%s/%s", full_path, entry->d_name) >= (int)sizeof(child_full))
+            continue;
+        if (snprintf(child_relative, sizeof(child_relative), "%s%s%s", relative_path,
+                     relative_path[0] ? "/" : "", entry->d_name) >= (int)sizeof(child_relative))
+            continue;
+        corpus_scan(corpus, child_full, child_relative);
+    }
+    closedir(dir);
+}
+
+// Growable output buffer for one file
+typedef struct
+{
+    char *data;
+    size_t size;
+    size_t capacity;
+} Output;
+
+static void output_append(Output *output, const char *data, size_t size)
+{
+    if (size == 0)
+        return;
+    if (output->size + size > output->capacity)
+    {
+        size_t capacity = output->capacity ? output->capacity : 4096;
+        while (capacity < output->size + size)
+            capacity *= 2;
+        char *grown = realloc(output->data, capacity);
+        if (!grown)
+            return;
+        output->data = grown;
+        output->capacity = capacity;
+    }
+    memcpy(output->data + output->size, data, size);
+    output->size += size;
+}
+
+// A PluginSpanList for one chunk, in place of fconcat's gather list. Its own bookkeeping is
+// not counted as plugin allocations; buffers the plugin asks for with alloc() are.
+typedef struct
+{
+    const char *data;
+    size_t size;
+} BenchSpan;
+
+typedef struct
+{
+    PluginSpanList list; // First, so the callbacks can cast back
+    BenchSpan *spans;
+    size_t count;
+    size_t capacity;
+    char **owned;
+    size_t owned_count;
+    size_t owned_capacity;
+} SpanCollector;
+
+static int collector_add(PluginSpanList *list, const char *data, size_t size)
+{
+    SpanCollector *collector = (SpanCollector *)list;
+    if (size == 0)
+        return 0;
+    if (collector->count == collector->capacity)
+    {
+        int counting = g_counting;
+        g_counting = 0;
+        size_t capacity = collector->capacity ? collector->capacity * 2 : 16;
+        BenchSpan *spans = realloc(collector->spans, capacity * sizeof(*spans));
+        g_counting = counting;
+        if (!spans)
+            return -1;
+        collector->spans = spans;
+        collector->capacity = capacity;
+    }
+    collector->spans[collector->count].data = data;
+    collector->spans[collector->count].size = size;
+    collector->count++;
+    return 0;
+}
+
+static char *collector_alloc(PluginSpanList *list, size_t size)
+{
+    SpanCollector *collector = (SpanCollector *)list;
+    char *buffer = malloc(size > 0 ? size : 1);
+    if (!buffer)
+        return NULL;
+    if (collector->owned_count == collector->owned_capacity)
+    {
+        int counting = g_counting;
+        g_counting = 0;
+        size_t capacity = collector->owned_capacity ? collector->owned_capacity * 2 : 8;
+        char **owned = realloc(collector->owned, capacity * sizeof(*owned));
+        g_counting = counting;
+        if (!owned)
+        {
+            free(buffer);
+            return NULL;
+        }
+        collector->owned = owned;
+        collector->owned_capacity = capacity;
+    }
+    collector->owned[collector->owned_count++] = buffer;
+    return buffer;
+}
+
+static void collector_reset(SpanCollector *collector)
+{
+    for (size_t i = 0; i < collector->owned_count; i++)
+        free(collector->owned[i]);
+    collector->owned_count = 0;
+    collector->count = 0;
+}
+
+static void collector_free(SpanCollector *collector)
+{
+    collector_reset(collector);
+    free(collector->spans);
+    free(collector->owned);
+}
+
+typedef struct
+{
+    LatencyHistogram latency;
+    unsigned long long chunks;
+    unsigned long long input_bytes;
+    unsigned long long output_bytes;
+    unsigned long long elapsed_ns; // file_start through file_cleanup
+    unsigned long long alloc_calls;
+    unsigned long long alloc_bytes;
+    unsigned long long failed_chunks;
+    unsigned long long fallback_chunks; // process_chunk_spans returned 1: process_chunk took the chunk
+} RunStats;
+
+static size_t next_chunk_size(BoundaryMode mode, size_t chunk_size, size_t offset)
+{
+    switch (mode)
+    {
+    case BOUNDARY_RANDOM:
+        return 1 + (size_t)(next_random() % chunk_size);
+    case BOUNDARY_SHIFTED:
+        return offset == 0 && chunk_size > 1 ? chunk_size / 2 + 1 : chunk_size;
+    default:
+        return chunk_size;
+    }
+}
+
+// One pass of a file through the plugin, the way plugin_session_* drives it in fconcat: a NULL
+// chunk output passes the input through, file_end output is appended. chunk_size 0 = one chunk.
+// REPLAY_SPANS follows gather_stage_spans(): 1 hands the chunk to process_chunk, and an error
+// passes it through unchanged.
+static void replay_file(StreamingPlugin *plugin, ReplayPath path, const CorpusFile *file, size_t chunk_size,
+                        BoundaryMode mode, RunStats *stats, Output *output)
+{
+    unsigned long long start = now_ns();
+    unsigned long long calls_before = g_alloc_calls;
+    unsigned long long bytes_before = g_alloc_bytes;
+    SpanCollector collector;
+    memset(&collector, 0, sizeof(collector));
+    collector.list.add = collector_add;
+    collector.list.alloc = collector_alloc;
+    collector.list.engine = &collector;
+
+    COUNT_ALLOCS(1);
+    PluginContext *context = plugin->file_start ? plugin->file_start(file->path) : NULL;
+    COUNT_ALLOCS(0);
+
+    int (*chunk_callback)(PluginContext *, const char *, size_t, char **, size_t *) = plugin->process_chunk;
+    int replays = path == REPLAY_SPANS ? plugin->process_chunk_spans != NULL : chunk_callback != NULL;
+    size_t offset = 0;
+    while (context && replays && offset < file->size)
+    {
+        size_t size = chunk_size ? next_chunk_size(mode, chunk_size, offset) : file->size;
+        if (size > file->size - offset)
+            size = file->size - offset;
+        const char *input = file->data + offset;
+
+        char *chunk_output = NULL;
+        size_t chunk_output_size = 0;
+        int failed = 0, fallback = 0;
+        collector_reset(&collector);
+        unsigned long long chunk_start = now_ns();
+        COUNT_ALLOCS(1);
+        if (path == REPLAY_SPANS)
+        {
+            int result = plugin->process_chunk_spans(context, input, size, &collector.list);
+            if (result != 0)
+            {
+                collector.count = 0;
+                fallback = result > 0 && chunk_callback;
+                failed = !fallback || chunk_callback(context, input, size, &chunk_output, &chunk_output_size) != 0;
+            }
+        }
+        else
+        {
+            failed = chunk_callback(context, input, size, &chunk_output, &chunk_output_size) != 0;
+        }
+        COUNT_ALLOCS(0);
+        unsigned long long chunk_ns = now_ns() - chunk_start;
+
+        int gathered = path == REPLAY_SPANS && !fallback && !failed;
+        if (gathered)
+        {
+            chunk_output_size = 0;
+            for (size_t i = 0; i < collector.count; i++)
+            {
+                chunk_output_size += collector.spans[i].size;
+                if (output)
+                    output_append(output, collector.spans[i].data, collector.spans[i].size);
+            }
+        }
+        else if (failed || !chunk_output)
+        {
+            chunk_output_size = size;
+            if (output)
+                output_append(output, input, size);
+        }
+        else if (output)
+        {
+            output_append(output, chunk_output, chunk_output_size);
+        }
+        if (stats)
+        {
+            latency_record(&stats->latency, chunk_ns);
+            stats->chunks++;
+            stats->input_bytes += size;
+            stats->output_bytes += chunk_output_size;
+            stats->failed_chunks += failed;
+            stats->fallback_chunks += fallback;
+        }
+        free(chunk_output);
+        offset += size;
+    }
+    collector_free(&collector);
+
+    // Nothing drives the chunks: fconcat writes the body unchanged
+    if (context && !replays && output)
+        output_append(output, file->data, file->size);
+
+    if (context)
+    {
+        char *final_output = NULL;
+        size_t final_size = 0;
+        COUNT_ALLOCS(1);
+        int ended = plugin->file_end && plugin->file_end(context, &final_output, &final_size) == 0;
+        COUNT_ALLOCS(0);
+        if (ended && final_output)
+        {
+            if (output)
+                output_append(output, final_output, final_size);
+            if (stats)
+                stats->output_bytes += final_size;
+        }
+        free(final_output);
+        if (plugin->file_cleanup)
+            plugin->file_cleanup(context);
+    }
+    else if (output)
+    {
+        // No context: fconcat writes the file unchanged
+        output_append(output, file->data, file->size);
+    }
+
+    if (stats)
+    {
+        stats->elapsed_ns += now_ns() - start;
+        stats->alloc_calls += g_alloc_calls - calls_before;
+        stats->alloc_bytes += g_alloc_bytes - bytes_before;
+    }
+}
+
+// One pass of the corpus through the plugin's aggregator, the way fconcat's content pass feeds
+// it: each file's raw chunks, then a NULL end-of-file call. With split set, files alternate
+// between two partials that are merged before finalize(), as two --jobs workers would be.
+static void aggregate_corpus(const PluginAggregator *aggregator, const Corpus *corpus, size_t chunk_size,
+                             BoundaryMode mode, int split, RunStats *stats, Output *summary)
+{
+    unsigned long long start = now_ns();
+    unsigned long long calls_before = g_alloc_calls;
+    unsigned long long bytes_before = g_alloc_bytes;
+
+    void *partials[2] = {NULL, NULL};
+    COUNT_ALLOCS(1);
+    for (int k = 0; k < (split ? 2 : 1); k++)
+        partials[k] = aggregator->create();
+    COUNT_ALLOCS(0);
+
+    for (size_t f = 0; f < corpus->count; f++)
+    {
+        const CorpusFile *file = &corpus->files[f];
+        void *partial = partials[split ? f % 2 : 0];
+        if (!partial)
+            continue;
+
+        size_t offset = 0;
+        while (offset < file->size)
+        {
+            size_t size = chunk_size ? next_chunk_size(mode, chunk_size, offset) : file->size;
+            if (size > file->size - offset)
+                size = file->size - offset;
+            unsigned long long chunk_start = now_ns();
+            COUNT_ALLOCS(1);
+            aggregator->map(partial, file->path, file->data + offset, size);
+            COUNT_ALLOCS(0);
+            if (stats)
+            {
+                latency_record(&stats->latency, now_ns() - chunk_start);
+                stats->chunks++;
+                stats->input_bytes += size;
+            }
+            offset += size;
+        }
+        COUNT_ALLOCS(1);
+        aggregator->map(partial, file->path, NULL, 0);
+        COUNT_ALLOCS(0);
+    }
+
+    COUNT_ALLOCS(1);
+    if (partials[0] && partials[1])
+    {
+        aggregator->merge(partials[0], partials[1]);
+        aggregator->destroy(partials[1]);
+    }
+    char *text = NULL;
+    size_t text_size = 0;
+    int finalized = partials[0] && aggregator->finalize && aggregator->finalize(partials[0], &text, &text_size) == 0;
+    if (partials[0])
+        aggregator->destroy(partials[0]);
+    COUNT_ALLOCS(0);
+    if (finalized && text && summary)
+        output_append(summary, text, text_size);
+    if (finalized && stats)
+        stats->output_bytes += text_size;
+    free(text);
+
+    if (stats)
+    {
+        stats->elapsed_ns += now_ns() - start;
+        stats->alloc_calls += g_alloc_calls - calls_before;
+        stats->alloc_bytes += g_alloc_bytes - bytes_before;
+    }
+}
+
+static size_t first_difference(const char *a, size_t a_size, const char *b, size_t b_size)
+{
+    size_t common = a_size < b_size ? a_size : b_size;
+    for (size_t i = 0; i < common; i++)
+    {
+        if (a[i] != b[i])
+            return i;
+    }
+    return common;
+}
+
+static int parse_size(const char *text, size_t *value)
+{
+    char *end;
+    errno = 0;
+    unsigned long long parsed = strtoull(text, &end, 10);
+    if (errno || end == text)
+        return -1;
+    if (*end == 'K' || *end == 'k')
+        parsed *= 1024, end++;
+    else if (*end == 'M' || *end == 'm')
+        parsed *= 1024 * 1024, end++;
+    if (*end != '\0' || parsed == 0)
+        return -1;
+    *value = (size_t)parsed;
+    return 0;
+}
+
+static void print_usage(const char *program_name)
+{
+    fprintf(stderr,
+            "Usage:\n"
+            "  %s <plugin> <corpus>... [options]\n"
+            "\n"
+            "Replays every file under <corpus> through the plugin's file_start/process_chunk/\n"
+            "file_end and reports throughput, per-chunk latency and allocations per chunk size.\n"
+            "A process_chunk_spans export is replayed as well, and its gathered output is\n"
+            "compared with process_chunk's. Output at each chunk size is compared with the\n"
+            "output of a single whole-file chunk. An aggregator is fed the corpus through\n"
+            "map on two partials, merged and finalized; its summary is compared the same way.\n"
+            "\n"
+            "Options:\n"
+            "  --chunk-sizes <list>  Comma-separated chunk sizes, K/M suffixes (default 1,61,4K,64K)\n"
+            "  --boundaries <mode>   fixed (default), random (sizes drawn from 1..size) or\n"
+            "                        shifted (a short first chunk, then fixed)\n"
+            "  --iterations <n>      Timed passes over the corpus per chunk size (default 3)\n"
+            "  --seed <n>            Seed for random boundaries (default fixed)\n"
+            "  --show-plugin-output  Keep the plugin's own stdout/stderr messages\n"
+            "\n"
+            "Example:\n"
+            "  %s ./plugins/remove_main.so ./src --chunk-sizes 1,7,4K --boundaries random\n",
+            program_name, program_name);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char *plugin_path = argv[1];
+    size_t chunk_sizes[MAX_CHUNK_SIZES] = {1, 61, 4096, 65536};
+    int chunk_size_count = 4;
+    BoundaryMode mode = BOUNDARY_FIXED;
+    int iterations = 3;
+    int show_plugin_output = 0;
+    int first_option = 2;
+    while (first_option < argc && argv[first_option][0] != '-')
+        first_option++;
+
+    for (int i = first_option; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--chunk-sizes") == 0 && i + 1 < argc)
+        {
+            chunk_size_count = 0;
+            char *list = strdup(argv[++i]);
+            for (char *token = strtok(list, ","); token && chunk_size_count < MAX_CHUNK_SIZES;
+                 token = strtok(NULL, ","))
+            {
+                if (parse_size(token, &chunk_sizes[chunk_size_count]) != 0)
+                {
+                    fprintf(stderr, "Error: invalid chunk size '%s'\n", token);
+                    free(list);
+                    return EXIT_FAILURE;
+                }
+                chunk_size_count++;
+            }
+            free(list);
+        }
+        else if (strcmp(argv[i], "--boundaries") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "fixed") == 0)
+                mode = BOUNDARY_FIXED;
+            else if (strcmp(argv[i], "random") == 0)
+                mode = BOUNDARY_RANDOM;
+            else if (strcmp(argv[i], "shifted") == 0)
+                mode = BOUNDARY_SHIFTED;
+            else
+            {
+                fprintf(stderr, "Error: --boundaries must be fixed, random or shifted\n");
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+        {
+            iterations = atoi(argv[++i]);
+            if (iterations < 1)
+                iterations = 1;
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            g_rng_state = strtoull(argv[++i], NULL, 0) | 1;
+        }
+        else if (strcmp(argv[i], "--show-plugin-output") == 0)
+        {
+            show_plugin_output = 1;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    Corpus corpus;
+    memset(&corpus, 0, sizeof(corpus));
+    for (int i = 2; i < first_option; i++)
+        corpus_scan(&corpus, argv[i], first_option - 2 > 1 ? argv[i] : "");
+    if (corpus.count == 0)
+    {
+        fprintf(stderr, "Error: no readable files in the corpus\n");
+        return EXIT_FAILURE;
+    }
+
+    // The same loader fconcat uses: dlopen, get_plugin, init
+    PluginManager manager;
+    if (init_plugin_manager(&manager) != 0 || load_plugin(&manager, plugin_path) != 0)
+        return EXIT_FAILURE;
+    StreamingPlugin *plugin = manager.plugins[0];
+
+    // fconcat prefers process_chunk_spans; process_chunk is measured too when both are exported
+    ReplayPath paths[2];
+    int path_count = 0;
+    if (plugin->process_chunk)
+        paths[path_count++] = REPLAY_COPY;
+    if (plugin->process_chunk_spans)
+        paths[path_count++] = REPLAY_SPANS;
+    const PluginAggregator *aggregator = plugin->aggregator;
+    if (path_count == 0 && !aggregator)
+    {
+        fprintf(stderr, "Error: %s exports no process_chunk, process_chunk_spans or aggregator to measure\n",
+                plugin_path);
+        destroy_plugin_manager(&manager);
+        return EXIT_FAILURE;
+    }
+
+    printf("Corpus          : %zu files, %.2f MB\n", corpus.count, corpus.total_bytes / (1024.0 * 1024.0));
+    printf("Chunk callbacks : %s%s\n",
+           path_count == 2 ? "process_chunk, process_chunk_spans"
+           : path_count == 0 ? ""
+           : paths[0] == REPLAY_SPANS ? "process_chunk_spans" : "process_chunk",
+           !aggregator ? "" : path_count ? ", aggregator map" : "aggregator map");
+    printf("Boundaries      : %s, %d iterations per chunk size\n\n",
+           mode == BOUNDARY_RANDOM ? "random" : mode == BOUNDARY_SHIFTED ? "shifted" : "fixed", iterations);
+    fflush(stdout);
+
+    // Plugins log per file; keep that out of the report unless asked for
+    int saved_stdout = -1, saved_stderr = -1;
+    if (!show_plugin_output)
+    {
+        int null_fd = open("/dev/null", O_WRONLY);
+        if (null_fd >= 0)
+        {
+            fflush(stderr);
+            saved_stdout = dup(STDOUT_FILENO);
+            saved_stderr = dup(STDERR_FILENO);
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+            close(null_fd);
+        }
+    }
+
+    // Reference: the whole file as one chunk, through process_chunk when there is one
+    for (size_t f = 0; f < corpus.count && path_count > 0; f++)
+    {
+        Output output = {0};
+        replay_file(plugin, paths[0], &corpus.files[f], 0, mode, NULL, &output);
+        corpus.files[f].reference = output.data;
+        corpus.files[f].reference_size = output.size;
+    }
+
+    // The aggregator's reference: whole files into a single partial, so a merge that depends on
+    // how files were split between workers shows up as a difference too
+    Output summary_reference = {0};
+    if (aggregator)
+        aggregate_corpus(aggregator, &corpus, 0, mode, 0, NULL, &summary_reference);
+
+    RunStats runs[MAX_CHUNK_SIZES][2];
+    RunStats aggregate_runs[MAX_CHUNK_SIZES];
+    char summary_notes[MAX_CHUNK_SIZES][96];
+    size_t differing[MAX_CHUNK_SIZES][2];
+    size_t mismatched[MAX_CHUNK_SIZES];
+    char diff_notes[MAX_CHUNK_SIZES][2][MAX_REPORTED_DIFFS][PATH_MAX + 64];
+    char mismatch_notes[MAX_CHUNK_SIZES][MAX_REPORTED_DIFFS][PATH_MAX + 64];
+    memset(runs, 0, sizeof(runs));
+    memset(differing, 0, sizeof(differing));
+    memset(mismatched, 0, sizeof(mismatched));
+    memset(aggregate_runs, 0, sizeof(aggregate_runs));
+    memset(summary_notes, 0, sizeof(summary_notes));
+
+    for (int c = 0; c < chunk_size_count; c++)
+    {
+        // Output comparison on an untimed pass, so the copies do not skew the numbers
+        for (size_t f = 0; f < corpus.count; f++)
+        {
+            const CorpusFile *file = &corpus.files[f];
+            Output outputs[2] = {{0}, {0}};
+            for (int p = 0; p < path_count; p++)
+            {
+                Output *output = &outputs[p];
+                replay_file(plugin, paths[p], file, chunk_sizes[c], mode, NULL, output);
+                if (output->size != file->reference_size ||
+                    (output->size && memcmp(output->data, file->reference, output->size) != 0))
+                {
+                    if (differing[c][p] < MAX_REPORTED_DIFFS)
+                        snprintf(diff_notes[c][p][differing[c][p]], sizeof(diff_notes[c][p][0]),
+                                 "%s: differs at byte %zu (%zu vs %zu bytes)", file->path,
+                                 first_difference(output->data, output->size, file->reference, file->reference_size),
+                                 output->size, file->reference_size);
+                    differing[c][p]++;
+                }
+            }
+
+            // Both exports must produce the same bytes for the same chunks
+            if (path_count == 2 && (outputs[0].size != outputs[1].size ||
+                                    (outputs[0].size && memcmp(outputs[0].data, outputs[1].data, outputs[0].size) != 0)))
+            {
+                if (mismatched[c] < MAX_REPORTED_DIFFS)
+                    snprintf(mismatch_notes[c][mismatched[c]], sizeof(mismatch_notes[c][0]),
+                             "%s: spans differ at byte %zu (%zu vs %zu bytes)", file->path,
+                             first_difference(outputs[1].data, outputs[1].size, outputs[0].data, outputs[0].size),
+                             outputs[1].size, outputs[0].size);
+                mismatched[c]++;
+            }
+            free(outputs[0].data);
+            free(outputs[1].data);
+        }
+
+        for (int p = 0; p < path_count; p++)
+        {
+            for (int it = 0; it < iterations; it++)
+            {
+                for (size_t f = 0; f < corpus.count; f++)
+                    replay_file(plugin, paths[p], &corpus.files[f], chunk_sizes[c], mode, &runs[c][p], NULL);
+            }
+        }
+
+        if (aggregator)
+        {
+            Output summary = {0};
+            aggregate_corpus(aggregator, &corpus, chunk_sizes[c], mode, 1, NULL, &summary);
+            if (summary.size != summary_reference.size ||
+                (summary.size && memcmp(summary.data, summary_reference.data, summary.size) != 0))
+                snprintf(summary_notes[c], sizeof(summary_notes[c]), "differs at byte %zu (%zu vs %zu bytes)",
+                         first_difference(summary.data, summary.size, summary_reference.data, summary_reference.size),
+                         summary.size, summary_reference.size);
+            free(summary.data);
+            for (int it = 0; it < iterations; it++)
+                aggregate_corpus(aggregator, &corpus, chunk_sizes[c], mode, 1, &aggregate_runs[c], NULL);
+        }
+    }
+
+    if (saved_stdout >= 0)
+    {
+        fflush(stdout);
+        dup2(saved_stdout, STDOUT_FILENO);
+        dup2(saved_stderr, STDERR_FILENO);
+        close(saved_stdout);
+        close(saved_stderr);
+    }
+
+    printf("%10s %6s %10s %10s %10s %10s %12s %12s %10s\n", "chunk", "path", "MB/s", "p50 us", "p99 us", "max us",
+           "allocs/chk", "bytes/chk", "diffs");
+    for (int c = 0; c < chunk_size_count; c++)
+    {
+        for (int p = 0; p < path_count; p++)
+        {
+            RunStats *run = &runs[c][p];
+            double seconds = run->elapsed_ns / 1e9;
+            double chunks = run->chunks ? (double)run->chunks : 1.0;
+            printf("%10zu %6s %10.1f %10.2f %10.2f %10.2f %12.2f %12.1f %10zu\n", chunk_sizes[c],
+                   paths[p] == REPLAY_SPANS ? "spans" : "copy",
+                   seconds > 0 ? run->input_bytes / (1024.0 * 1024.0) / seconds : 0.0,
+                   latency_percentile(&run->latency, 50.0) / 1000.0, latency_percentile(&run->latency, 99.0) / 1000.0,
+                   run->latency.max_ns / 1000.0, run->alloc_calls / chunks, run->alloc_bytes / chunks, differing[c][p]);
+        }
+        if (aggregator)
+        {
+            RunStats *run = &aggregate_runs[c];
+            double seconds = run->elapsed_ns / 1e9;
+            double chunks = run->chunks ? (double)run->chunks : 1.0;
+            printf("%10zu %6s %10.1f %10.2f %10.2f %10.2f %12.2f %12.1f %10d\n", chunk_sizes[c], "map",
+                   seconds > 0 ? run->input_bytes / (1024.0 * 1024.0) / seconds : 0.0,
+                   latency_percentile(&run->latency, 50.0) / 1000.0, latency_percentile(&run->latency, 99.0) / 1000.0,
+                   run->latency.max_ns / 1000.0, run->alloc_calls / chunks, run->alloc_bytes / chunks,
+                   summary_notes[c][0] != '\0');
+        }
+    }
+
+    int boundary_sensitive = 0;
+    for (int c = 0; c < chunk_size_count; c++)
+    {
+        for (int p = 0; p < path_count; p++)
+        {
+            if (differing[c][p] == 0)
+                continue;
+            boundary_sensitive = 1;
+            printf("\nChunk size %zu (%s): %zu files differ from whole-file output\n", chunk_sizes[c],
+                   paths[p] == REPLAY_SPANS ? "process_chunk_spans" : "process_chunk", differing[c][p]);
+            for (size_t d = 0; d < differing[c][p] && d < MAX_REPORTED_DIFFS; d++)
+                printf("  %s\n", diff_notes[c][p][d]);
+        }
+        if (summary_notes[c][0])
+        {
+            boundary_sensitive = 1;
+            printf("\nChunk size %zu (aggregator): the summary %s from whole files in one partial\n",
+                   chunk_sizes[c], summary_notes[c]);
+        }
+        if (mismatched[c] == 0)
+            continue;
+        boundary_sensitive = 1;
+        printf("\nChunk size %zu: %zu files differ between process_chunk_spans and process_chunk\n", chunk_sizes[c],
+               mismatched[c]);
+        for (size_t d = 0; d < mismatched[c] && d < MAX_REPORTED_DIFFS; d++)
+            printf("  %s\n", mismatch_notes[c][d]);
+    }
+    for (int c = 0; c < chunk_size_count; c++)
+    {
+        for (int p = 0; p < path_count; p++)
+        {
+            if (runs[c][p].failed_chunks)
+                printf("\nChunk size %zu: %llu %s calls failed\n", chunk_sizes[c], runs[c][p].failed_chunks,
+                       paths[p] == REPLAY_SPANS ? "process_chunk_spans" : "process_chunk");
+            if (runs[c][p].fallback_chunks)
+                printf("\nChunk size %zu: process_chunk_spans handed %llu chunks to process_chunk\n", chunk_sizes[c],
+                       runs[c][p].fallback_chunks);
+        }
+    }
+#ifndef __GLIBC__
+    printf("\nAllocation counts need glibc and are reported as 0\n");
+#endif
+
+    destroy_plugin_manager(&manager);
+    for (size_t f = 0; f < corpus.count; f++)
+    {
+        free(corpus.files[f].path);
+        free(corpus.files[f].data);
+        free(corpus.files[f].reference);
+    }
+    free(corpus.files);
+    free(summary_reference.data);
+
+    // Non-zero when the output depends on chunk boundaries, for use in CI
+    return boundary_sensitive ? 2 : EXIT_SUCCESS;
+}
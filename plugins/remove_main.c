@@ -13,6 +13,7 @@
  * - Handles string literals and comments correctly (won't remove "main" inside them)
  * - Streaming processing with chunk boundary handling
  * - Memory efficient with 300-byte carry-over buffer
+ * - Scatter-gather output (process_chunk_spans): kept bytes are never copied
  * - Replaces removed functions with descriptive comments
  */
 
@@ -44,6 +45,13 @@ typedef struct
     void (*file_cleanup)(PluginContext *ctx);
 } StreamingPlugin;
 
+typedef struct PluginSpanList
+{
+    int (*add)(struct PluginSpanList *list, const char *data, size_t size);
+    char *(*alloc)(struct PluginSpanList *list, size_t size);
+    void *engine;
+} PluginSpanList;
+
 // Plugin state structure
 typedef struct
 {
@@ -193,74 +201,127 @@ static bool is_main_function_start(const char *text, size_t pos, size_t len)
     return false;
 }
 
+// Look-behind that is_main_function_start() needs before "main(" (150 bytes plus a keyword)
+#define MAIN_LOOKBEHIND 160
+
 /**
- * @brief Process a chunk of input data and remove main functions
- * @param ctx Plugin context
- * @param input Input data chunk
- * @param input_size Size of input chunk
- * @param output Pointer to output buffer (allocated by this function)
- * @param output_size Pointer to output size
- * @return 0 on success, -1 on error
- * 
- * This function processes input in chunks while maintaining state across
- * chunk boundaries. It handles:
- * - String literals and comments (to avoid false positives)
- * - Main function detection with proper return type checking
- * - Brace counting for accurate function boundaries
- * - Carry-over buffer for functions spanning multiple chunks
+ * @brief Test for a main function at input[pos], with the carry-over as look-behind
+ * @param carry Tail of the previous chunks
+ * @param carried Size of carry
+ * @param input Current chunk
+ * @param input_size Size of the current chunk
+ * @param pos Position in the current chunk
+ * @return true if main function starts at this position
+ *
+ * Only positions near the start of the chunk copy a small window; the rest are tested in place.
  */
-static int remove_main_process_chunk(PluginContext *ctx, const char *input, size_t input_size,
-                                     char **output, size_t *output_size)
+static bool main_starts_at(const char *carry, size_t carried, const char *input, size_t input_size, size_t pos)
 {
-    if (!ctx || !ctx->private_data || !input || input_size == 0)
-    {
-        *output = NULL;
-        *output_size = 0;
-        return 0;
-    }
+    if (pos >= MAIN_LOOKBEHIND)
+        return is_main_function_start(input, pos, input_size);
+
+    char window[MAIN_LOOKBEHIND + 6];
+    size_t from_carry = carried < MAIN_LOOKBEHIND - pos ? carried : MAIN_LOOKBEHIND - pos;
+    size_t ahead = input_size < pos + 6 ? input_size : pos + 6;
+    memcpy(window, carry + carried - from_carry, from_carry);
+    memcpy(window + from_carry, input, ahead);
+    return is_main_function_start(window, from_carry + pos, from_carry + ahead);
+}
 
-    RemoveMainState *state = (RemoveMainState *)ctx->private_data;
+// Where the kept bytes go: a new buffer (process_chunk) or spans into the input (process_chunk_spans)
+typedef struct
+{
+    const char *input;
+    PluginSpanList *spans; // NULL = buffer mode
+    char *buffer;
+    size_t size;
+    size_t capacity;
+    size_t run_start; // Kept input bytes not yet appended: [run_start, run_end)
+    size_t run_end;
+    bool failed;
+} ChunkWriter;
+
+static void writer_append(ChunkWriter *writer, const char *data, size_t len)
+{
+    if (len == 0 || writer->failed)
+        return;
 
-    // If not a C file, pass through unchanged
-    if (!state->is_c_file)
+    if (writer->spans)
     {
-        *output = malloc(input_size);
-        if (!*output)
-            return -1;
-        memcpy(*output, input, input_size);
-        *output_size = input_size;
-        return 0;
+        writer->failed = writer->spans->add(writer->spans, data, len) != 0;
+        return;
     }
 
-    // Combine carry over with new input
-    size_t total_size = state->carry_over_size + input_size;
-    char *combined = malloc(total_size);
-    if (!combined)
-        return -1;
-
-    if (state->carry_over_size > 0)
+    if (writer->size + len > writer->capacity)
     {
-        memcpy(combined, state->carry_over, state->carry_over_size);
-        free(state->carry_over);
-        state->carry_over = NULL;
-        state->carry_over_size = 0;
+        size_t capacity = writer->capacity ? writer->capacity : 4096;
+        while (capacity < writer->size + len)
+            capacity *= 2;
+        char *buffer = realloc(writer->buffer, capacity);
+        if (!buffer)
+        {
+            writer->failed = true;
+            return;
+        }
+        writer->buffer = buffer;
+        writer->capacity = capacity;
     }
-    memcpy(combined + state->carry_over_size, input, input_size);
+    memcpy(writer->buffer + writer->size, data, len);
+    writer->size += len;
+}
 
-    // Prepare output buffer - estimate conservatively
-    size_t max_output_size = total_size + 1000;  // Add space for potential replacement comment
-    char *out = malloc(max_output_size);
-    if (!out)
+static void writer_flush_run(ChunkWriter *writer)
+{
+    writer_append(writer, writer->input + writer->run_start, writer->run_end - writer->run_start);
+    writer->run_start = writer->run_end;
+}
+
+// Keep input[pos]; consecutive kept bytes become one span
+static void writer_keep(ChunkWriter *writer, size_t pos)
+{
+    if (pos != writer->run_end)
     {
-        free(combined);
-        return -1;
+        writer_flush_run(writer);
+        writer->run_start = pos;
     }
-    size_t out_pos = 0;
+    writer->run_end = pos + 1;
+}
+
+// Insert text that is not in the input; it must outlive the call (string literals do)
+static void writer_insert(ChunkWriter *writer, const char *text)
+{
+    writer_flush_run(writer);
+    writer_append(writer, text, strlen(text));
+}
+
+/**
+ * @brief Scan a chunk of a C/C++ file and keep everything outside main functions
+ * @param state Per-file plugin state
+ * @param input Input data chunk
+ * @param input_size Size of input chunk
+ * @param writer Receives the kept bytes and the replacement comment
+ * @return 0 on success, -1 on error
+ *
+ * This function processes input in chunks while maintaining state across
+ * chunk boundaries. It handles:
+ * - String literals and comments (to avoid false positives)
+ * - Main function detection with proper return type checking
+ * - Brace counting for accurate function boundaries
+ * - Carry-over buffer for functions spanning multiple chunks
+ */
+static int remove_main_scan(RemoveMainState *state, const char *input, size_t input_size, ChunkWriter *writer)
+{
+    // The carry-over was already emitted: it is only look-behind context for main() detection.
+    // Positions below are in carry + input coordinates, processing starts after the carry.
+    const char *carry = state->carry_over;
+    size_t carried = state->carry_over_size;
+    size_t total_size = carried + input_size;
+#define CHUNK_BYTE(k) ((k) < carried ? carry[(k)] : input[(k) - carried])
 
     // Process character by character
-    for (size_t i = 0; i < total_size && out_pos < max_output_size - 100; i++)
+    for (size_t i = carried; i < total_size; i++)
     {
-        char c = combined[i];
+        char c = input[i - carried];
 
         // Handle string literals
         if (!state->in_comment && !state->in_single_comment)
@@ -276,7 +337,7 @@ static int remove_main_process_chunk(PluginContext *ctx, const char *input, size
                 {
                     // Check if it's escaped
                     int escape_count = 0;
-                    for (int j = i - 1; j >= 0 && combined[j] == '\\'; j--)
+                    for (size_t j = i; j > 0 && CHUNK_BYTE(j - 1) == '\\'; j--)
                     {
                         escape_count++;
                     }
@@ -294,27 +355,24 @@ static int remove_main_process_chunk(PluginContext *ctx, const char *input, size
         {
             if (c == '/' && i + 1 < total_size)
             {
-                if (combined[i + 1] == '*' && !state->in_single_comment)
+                if (input[i + 1 - carried] == '*' && !state->in_single_comment)
                 {
                     state->in_comment = true;
                 }
-                else if (combined[i + 1] == '/' && !state->in_comment)
+                else if (input[i + 1 - carried] == '/' && !state->in_comment)
                 {
                     state->in_single_comment = true;
                 }
             }
-            else if (c == '*' && i + 1 < total_size && combined[i + 1] == '/' && state->in_comment)
+            else if (c == '*' && i + 1 < total_size && input[i + 1 - carried] == '/' && state->in_comment)
             {
                 state->in_comment = false;
                 if (!state->in_main_function)
                 {
-                    out[out_pos++] = c;
-                    out[out_pos++] = combined[++i]; // Add the '/'
-                }
-                else
-                {
-                    i++; // Skip the '/'
+                    writer_keep(writer, i - carried);
+                    writer_keep(writer, i + 1 - carried); // Add the '/'
                 }
+                i++; // Skip the '/'
                 continue;
             }
             else if (c == '\n' && state->in_single_comment)
@@ -329,25 +387,25 @@ static int remove_main_process_chunk(PluginContext *ctx, const char *input, size
             // Add character to output if we're not inside main function
             if (!state->in_main_function)
             {
-                out[out_pos++] = c;
+                writer_keep(writer, i - carried);
             }
             continue;
         }
 
         // Look for main function
-        if (!state->in_main_function && is_main_function_start(combined, i, total_size))
+        if (!state->in_main_function && c == 'm' && main_starts_at(carry, carried, input, input_size, i - carried))
         {
             state->in_main_function = true;
             state->main_found = true;
             state->main_start_brace_level = state->brace_count;
 
             // Skip to opening brace
-            while (i < total_size && combined[i] != '{')
+            while (i < total_size && input[i - carried] != '{')
             {
                 i++;
             }
 
-            if (i < total_size && combined[i] == '{')
+            if (i < total_size && input[i - carried] == '{')
             {
                 state->brace_count++;
                 state->main_start_brace_level = state->brace_count - 1;
@@ -368,12 +426,9 @@ static int remove_main_process_chunk(PluginContext *ctx, const char *input, size
             if (state->in_main_function && state->brace_count == state->main_start_brace_level)
             {
                 state->in_main_function = false;
-                
+
                 // Add a comment where main function was
-                const char *comment = "\n// [main function removed by remove_main plugin]\n";
-                size_t comment_len = strlen(comment);
-                memcpy(out + out_pos, comment, comment_len);
-                out_pos += comment_len;
+                writer_insert(writer, "\n// [main function removed by remove_main plugin]\n");
                 continue;
             }
         }
@@ -381,51 +436,88 @@ static int remove_main_process_chunk(PluginContext *ctx, const char *input, size
         // Add character to output if we're not inside main function
         if (!state->in_main_function)
         {
-            out[out_pos++] = c;
+            writer_keep(writer, i - carried);
         }
     }
+    writer_flush_run(writer);
 
     // Save carry over for next chunk to handle function detection at boundaries
-    if (total_size > CARRY_OVER_SIZE)
+    size_t keep = total_size > CARRY_OVER_SIZE ? CARRY_OVER_SIZE : total_size;
+    char *next_carry = keep > 0 ? malloc(keep) : NULL;
+    if (next_carry)
     {
-        free(state->carry_over); // Free previous carry-over if any
-        state->carry_over = malloc(CARRY_OVER_SIZE);
-        if (state->carry_over)
-        {
-            memcpy(state->carry_over, combined + total_size - CARRY_OVER_SIZE, CARRY_OVER_SIZE);
-            state->carry_over_size = CARRY_OVER_SIZE;
-        }
-        else
-        {
-            state->carry_over_size = 0; // Reset on allocation failure
-        }
+        for (size_t k = 0; k < keep; k++)
+            next_carry[k] = CHUNK_BYTE(total_size - keep + k);
     }
-    else
+#undef CHUNK_BYTE
+    free(state->carry_over);
+    state->carry_over = next_carry;
+    state->carry_over_size = next_carry ? keep : 0; // Reset on allocation failure
+
+    return writer->failed ? -1 : 0;
+}
+
+/**
+ * @brief Process a chunk of input data and remove main functions
+ * @param ctx Plugin context
+ * @param input Input data chunk
+ * @param input_size Size of input chunk
+ * @param output Pointer to output buffer (allocated by this function)
+ * @param output_size Pointer to output size
+ * @return 0 on success, -1 on error
+ */
+static int remove_main_process_chunk(PluginContext *ctx, const char *input, size_t input_size,
+                                     char **output, size_t *output_size)
+{
+    *output = NULL;
+    *output_size = 0;
+    if (!ctx || !ctx->private_data || !input || input_size == 0)
+        return 0;
+
+    // If not a C file, pass through unchanged
+    RemoveMainState *state = (RemoveMainState *)ctx->private_data;
+    if (!state->is_c_file)
+        return 0;
+
+    ChunkWriter writer;
+    memset(&writer, 0, sizeof(writer));
+    writer.input = input;
+    if (remove_main_scan(state, input, input_size, &writer) != 0)
     {
-        // If remaining data is smaller than carry-over size, keep it all
-        if (total_size > 0)
-        {
-            free(state->carry_over);
-            state->carry_over = malloc(total_size);
-            if (state->carry_over)
-            {
-                memcpy(state->carry_over, combined, total_size);
-                state->carry_over_size = total_size;
-            }
-            else
-            {
-                state->carry_over_size = 0;
-            }
-        }
+        free(writer.buffer);
+        return -1;
     }
 
-    free(combined);
+    // An empty result still replaces the input
+    *output = writer.buffer ? writer.buffer : malloc(1);
+    *output_size = writer.size;
+    return *output ? 0 : -1;
+}
 
-    // Return the processed output immediately
-    *output = out;
-    *output_size = out_pos;
+/**
+ * @brief Scatter-gather form of remove_main_process_chunk()
+ * @param ctx Plugin context
+ * @param input Input data chunk
+ * @param input_size Size of input chunk
+ * @param spans Receives spans into the input plus the replacement comments
+ * @return 0 on success, -1 on error
+ *
+ * Kept bytes are referenced, not copied: a chunk without a main function becomes one span.
+ */
+int process_chunk_spans(PluginContext *ctx, const char *input, size_t input_size, PluginSpanList *spans)
+{
+    if (!ctx || !ctx->private_data || input_size == 0)
+        return 0;
 
-    return 0;
+    RemoveMainState *state = (RemoveMainState *)ctx->private_data;
+    if (!state->is_c_file)
+        return spans->add(spans, input, input_size);
+
+    ChunkWriter writer;
+    memset(&writer, 0, sizeof(writer));
+    writer.input = input;
+    writer.spans = spans;
+    return remove_main_scan(state, input, input_size, &writer);
 }
 
 /**
@@ -0,0 +1,283 @@
+/**
+ * @file todo_index.c
+ * @brief fconcat plugin that indexes TODO, FIXME and XXX markers across all files
+ * @version 1.0.0
+ * @author fconcat project
+ *
+ * This plugin leaves file content untouched and uses the aggregation API instead:
+ * every content pass thread counts markers in its own partial index, the partials
+ * are merged once all files were read, and the index is appended to the output as
+ * a summary section.
+ *
+ * Features:
+ * - Lock-free under --jobs: each thread only touches its own partial
+ * - Markers split across chunk boundaries are still counted
+ * - Deterministic summary: files are listed by path whatever thread read them
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+// Plugin API structures
+typedef struct
+{
+    void *private_data;
+    const char *file_path;
+    size_t total_processed;
+    int plugin_index;
+} PluginContext;
+
+typedef struct
+{
+    const char *name;
+    const char *version;
+    int (*init)(void);
+    void (*cleanup)(void);
+    PluginContext *(*file_start)(const char *relative_path);
+    int (*process_chunk)(PluginContext *ctx, const char *input, size_t input_size,
+                         char **output, size_t *output_size);
+    int (*file_end)(PluginContext *ctx, char **final_output, size_t *final_size);
+    void (*file_cleanup)(PluginContext *ctx);
+} StreamingPlugin;
+
+typedef struct
+{
+    void *(*create)(void);
+    void (*map)(void *partial, const char *relative_path, const char *data, size_t size);
+    void (*merge)(void *into, void *from);
+    int (*finalize)(void *partial, char **summary, size_t *summary_size);
+    void (*destroy)(void *partial);
+} PluginAggregator;
+
+#define MARKER_COUNT 3
+
+static const char *const markers[MARKER_COUNT] = {"TODO", "FIXME", "XXX"};
+
+// Marker counts of one file
+typedef struct
+{
+    char *path;
+    unsigned long counts[MARKER_COUNT];
+} TodoEntry;
+
+// One thread's partial index, plus the matcher state of the file it is reading
+typedef struct
+{
+    TodoEntry *entries;
+    size_t count;
+    size_t capacity;
+
+    unsigned long current[MARKER_COUNT];
+    int active;         // Marker being matched, -1 = none
+    size_t matched;     // Bytes of it matched so far
+    bool previous_word; // The last byte belongs to a word
+} TodoIndex;
+
+static void *todo_create(void)
+{
+    TodoIndex *index = calloc(1, sizeof(TodoIndex));
+    if (index)
+        index->active = -1;
+    return index;
+}
+
+static bool is_word_byte(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static void todo_add_current(TodoIndex *index, const char *relative_path)
+{
+    bool any = false;
+    for (int m = 0; m < MARKER_COUNT; m++)
+        any = any || index->current[m] > 0;
+    if (!any)
+        return;
+
+    if (index->count == index->capacity)
+    {
+        size_t capacity = index->capacity ? index->capacity * 2 : 64;
+        TodoEntry *entries = realloc(index->entries, capacity * sizeof(*entries));
+        if (!entries)
+            return;
+        index->entries = entries;
+        index->capacity = capacity;
+    }
+
+    TodoEntry *entry = &index->entries[index->count];
+    entry->path = strdup(relative_path);
+    if (!entry->path)
+        return;
+    memcpy(entry->counts, index->current, sizeof(entry->counts));
+    index->count++;
+}
+
+/**
+ * @brief Count whole-word markers in one chunk of a file. The matcher state lives in the
+ *        partial, so a marker split across chunks is still found; a NULL chunk ends the file.
+ */
+static void todo_map(void *partial, const char *relative_path, const char *data, size_t size)
+{
+    TodoIndex *index = partial;
+
+    if (!data)
+    {
+        if (index->active >= 0 && index->matched == strlen(markers[index->active]))
+            index->current[index->active]++;
+        todo_add_current(index, relative_path);
+        memset(index->current, 0, sizeof(index->current));
+        index->active = -1;
+        index->matched = 0;
+        index->previous_word = false;
+        return;
+    }
+
+    for (size_t i = 0; i < size; i++)
+    {
+        char c = data[i];
+        if (index->active >= 0)
+        {
+            const char *marker = markers[index->active];
+            if (index->matched == strlen(marker))
+            {
+                // Complete: it counts unless the word goes on
+                if (!is_word_byte(c))
+                    index->current[index->active]++;
+                index->active = -1;
+            }
+            else if (c == marker[index->matched])
+            {
+                index->matched++;
+                index->previous_word = true;
+                continue;
+            }
+            else
+            {
+                index->active = -1;
+            }
+        }
+
+        if (!index->previous_word)
+        {
+            for (int m = 0; m < MARKER_COUNT; m++)
+            {
+                if (c == markers[m][0])
+                {
+                    index->active = m;
+                    index->matched = 1;
+                    break;
+                }
+            }
+        }
+        index->previous_word = is_word_byte(c);
+    }
+}
+
+static void todo_merge(void *into, void *from)
+{
+    TodoIndex *target = into;
+    TodoIndex *source = from;
+
+    for (size_t i = 0; i < source->count; i++)
+    {
+        if (target->count == target->capacity)
+        {
+            size_t capacity = target->capacity ? target->capacity * 2 : 64;
+            TodoEntry *entries = realloc(target->entries, capacity * sizeof(*entries));
+            if (!entries)
+                break;
+            target->entries = entries;
+            target->capacity = capacity;
+        }
+        target->entries[target->count++] = source->entries[i];
+        source->entries[i].path = NULL;
+    }
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    return strcmp(((const TodoEntry *)a)->path, ((const TodoEntry *)b)->path);
+}
+
+static int todo_finalize(void *partial, char **summary, size_t *summary_size)
+{
+    TodoIndex *index = partial;
+    *summary = NULL;
+    *summary_size = 0;
+
+    char *text = NULL;
+    size_t text_size = 0;
+    FILE *out = open_memstream(&text, &text_size);
+    if (!out)
+        return -1;
+
+    unsigned long totals[MARKER_COUNT] = {0};
+    qsort(index->entries, index->count, sizeof(*index->entries), compare_entries);
+    for (size_t i = 0; i < index->count; i++)
+    {
+        fprintf(out, "%s:", index->entries[i].path);
+        for (int m = 0; m < MARKER_COUNT; m++)
+        {
+            if (index->entries[i].counts[m] > 0)
+                fprintf(out, " %lu %s", index->entries[i].counts[m], markers[m]);
+            totals[m] += index->entries[i].counts[m];
+        }
+        fputc('\n', out);
+    }
+    if (index->count == 0)
+        fputs("(no markers)\n", out);
+    fprintf(out, "\nTotal: %lu TODO, %lu FIXME, %lu XXX in %zu files\n",
+            totals[0], totals[1], totals[2], index->count);
+
+    if (fclose(out) != 0)
+    {
+        free(text);
+        return -1;
+    }
+    *summary = text;
+    *summary_size = text_size;
+    return 0;
+}
+
+static void todo_destroy(void *partial)
+{
+    TodoIndex *index = partial;
+    for (size_t i = 0; i < index->count; i++)
+        free(index->entries[i].path);
+    free(index->entries);
+    free(index);
+}
+
+// Plugin declaration: no per-file callbacks, the content passes through unchanged
+static StreamingPlugin todo_index_plugin = {
+    .name = "todo_index",
+    .version = "1.0.0",
+};
+
+static PluginAggregator todo_index_aggregator = {
+    .create = todo_create,
+    .map = todo_map,
+    .merge = todo_merge,
+    .finalize = todo_finalize,
+    .destroy = todo_destroy,
+};
+
+/**
+ * @brief Plugin entry point - returns plugin interface
+ * @return Pointer to plugin structure
+ */
+StreamingPlugin *get_plugin(void)
+{
+    return &todo_index_plugin;
+}
+
+/**
+ * @brief Aggregation entry point - returns the map/merge/finalize callbacks
+ * @return Pointer to aggregator structure
+ */
+PluginAggregator *get_plugin_aggregator(void)
+{
+    return &todo_index_aggregator;
+}
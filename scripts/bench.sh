@@ -2,15 +2,29 @@
 
 # fconcat Simple Benchmark Suite
 # Tests fconcat performance against traditional tools using existing files
-# Run with: ./benchmark.sh <test_directory>
+# Run with: ./benchmark.sh [--cache cold|warm|both] [--iterations <n>] [--jobs <n>] <test_directory>
 
 set -euo pipefail
 
 # Configuration
-BENCHMARK_DIR="${1:-}"
 RESULTS_DIR="./benchmark_results"
 FCONCAT_BINARY="${FCONCAT_BINARY:-./fconcat}"
+PAGE_CACHE_BINARY="${PAGE_CACHE_BINARY:-./fconcat-page-cache}"
 ITERATIONS=5
+CACHE_MODE=""  # cold, warm or both: cache-controlled fconcat runs instead of the tool comparison
+CACHE_JOBS=1
+
+# Options come before the test directory
+while [[ $# -gt 1 && "$1" == --* ]]; do
+    case "$1" in
+        --cache) CACHE_MODE="$2" ;;
+        --iterations) ITERATIONS="$2" ;;
+        --jobs) CACHE_JOBS="$2" ;;
+        *) echo "Unknown option: $1"; exit 1 ;;
+    esac
+    shift 2
+done
+BENCHMARK_DIR="${1:-}"
 WARMUP_RUNS=1
 TIMESTAMP=$(date +"%Y%m%d_%H%M%S")
 
@@ -48,16 +62,22 @@ print_header() {
 }
 
 print_usage() {
-    echo "Usage: $0 <test_directory>"
+    echo "Usage: $0 [--cache cold|warm|both] [--iterations <n>] [--jobs <n>] <test_directory>"
     echo ""
     echo "Examples:"
     echo "  $0 /usr/src/linux-headers-\$(uname -r)  # Linux kernel headers"
     echo "  $0 /usr/include                         # System headers"
     echo "  $0 ./my_project                        # Your project"
     echo "  $0 /opt/homebrew/include               # macOS headers"
+    echo "  $0 --cache both --iterations 10 /usr/include  # Cold vs. warm page cache"
     echo ""
     echo "The script will benchmark fconcat against traditional tools"
     echo "using the files in the specified directory."
+    echo ""
+    echo "With --cache, only fconcat is timed. Before each cold run the tree is evicted from"
+    echo "the page cache, before each warm run it is read in full, both verified with mincore()"
+    echo "by fconcat-page-cache (make page-cache). No root needed. Cold and warm runs alternate"
+    echo "and are reported separately with variance and 95% confidence intervals."
 }
 
 check_directory() {
@@ -193,7 +213,7 @@ run_benchmark() {
     for threads in "${THREAD_COUNTS[@]}"; do
         if [[ $threads -le $MAX_THREADS ]]; then
             measure_command \
-                "$FCONCAT_BINARY \"$BENCHMARK_DIR\" \"$RESULTS_DIR/fconcat_${threads}t.txt\" --threads $threads --binary-skip" \
+                "$FCONCAT_BINARY \"$BENCHMARK_DIR\" \"$RESULTS_DIR/fconcat_${threads}t.txt\" --jobs $threads --binary-skip" \
                 "fconcat_${threads}t" \
                 "$RESULTS_DIR/fconcat_${threads}t.txt"
         fi
@@ -490,6 +510,126 @@ display_summary() {
     fi
 }
 
+# n, mean, median, sample variance, standard deviation, 95% CI half-width (Student's t),
+# min, max and coefficient of variation of a list of times
+summarize_times() {
+    printf '%s\n' "$@" | sort -n | awk '
+        { x[NR] = $1; sum += $1 }
+        END {
+            n = NR; mean = sum / n
+            for (i = 1; i <= n; i++) ss += (x[i] - mean) ^ 2
+            variance = n > 1 ? ss / (n - 1) : 0
+            sd = sqrt(variance)
+            split("12.706 4.303 3.182 2.776 2.571 2.447 2.365 2.306 2.262 2.228 " \
+                  "2.201 2.179 2.160 2.145 2.131 2.120 2.110 2.101 2.093 2.086 " \
+                  "2.080 2.074 2.069 2.064 2.060 2.056 2.052 2.048 2.045 2.042", t, " ")
+            df = n - 1
+            half = df < 1 ? 0 : (df <= 30 ? t[df] : 1.960) * sd / sqrt(n)
+            median = n % 2 ? x[(n + 1) / 2] : (x[n / 2] + x[n / 2 + 1]) / 2
+            cv = mean > 0 ? 100 * sd / mean : 0
+            printf "%d %.4f %.4f %.6f %.4f %.4f %.4f %.4f %.1f\n",
+                   n, mean, median, variance, sd, half, x[1], x[n], cv
+        }'
+}
+
+run_cache_benchmark() {
+    local states=()
+    case "$CACHE_MODE" in
+        cold) states=(cold) ;;
+        warm) states=(warm) ;;
+        both) states=(cold warm) ;;
+    esac
+
+    local output_file="$RESULTS_DIR/fconcat_cache.txt"
+    local report_file="$RESULTS_DIR/cache_report_$TIMESTAMP.md"
+    declare -A times unverified means
+    local state
+    for state in "${states[@]}"; do
+        times[$state]=""
+        unverified[$state]=0
+    done
+
+    echo -e "${PURPLE}${BOLD}🧊 Cache-controlled runs on: $(basename "$BENCHMARK_DIR")${NC}"
+    echo "  $("$PAGE_CACHE_BINARY" status "$BENCHMARK_DIR" || true)"
+    echo ""
+
+    # Cold and warm runs alternate, so drift on the box affects both alike
+    for ((i=1; i<=ITERATIONS; i++)); do
+        for state in "${states[@]}"; do
+            echo -n "    Iteration $i/$ITERATIONS ($state)... "
+            rm -f "$output_file"
+            # The previous output's writeback must not overlap the timed run
+            sync
+
+            local action=warm
+            [[ "$state" == "cold" ]] && action=evict
+            local cache_line
+            if ! cache_line=$("$PAGE_CACHE_BINARY" "$action" "$BENCHMARK_DIR"); then
+                unverified[$state]=$((unverified[$state] + 1))
+                echo -ne "${YELLOW}(${cache_line}) ${NC}"
+            fi
+
+            local start_time=$(date +%s.%N)
+            if timeout 300 "$FCONCAT_BINARY" "$BENCHMARK_DIR" "$output_file" --jobs "$CACHE_JOBS" >/dev/null 2>&1; then
+                local end_time=$(date +%s.%N)
+                local iteration_time=$(echo "$end_time - $start_time" | bc -l)
+                times[$state]+="$iteration_time "
+                echo -e "${GREEN}OK${NC} (${iteration_time}s)"
+            else
+                echo -e "${RED}FAILED/TIMEOUT${NC}"
+            fi
+        done
+    done
+    rm -f "$output_file"
+
+    cat > "$report_file" << EOF
+# fconcat Cold vs. Warm Cache Report
+*Generated on $(date)*
+
+- **Test Directory**: $BENCHMARK_DIR
+- **Command**: fconcat <dir> <out> --jobs $CACHE_JOBS
+- **Iterations per state**: $ITERATIONS, cold and warm interleaved
+- **Cache control**: per-file POSIX_FADV_DONTNEED (cold) or a full read (warm), verified with mincore().
+  Directory entries and inodes stay cached.
+
+| Cache | Runs | Mean | Median | Variance | Std Dev | 95% CI | Min | Max | CV | Unverified |
+|-------|------|------|--------|----------|---------|--------|-----|-----|----|------------|
+EOF
+
+    echo ""
+    echo -e "${CYAN}${BOLD}🧊 COLD VS. WARM${NC}"
+    printf "  %-5s %4s %9s %9s %10s %9s %18s %6s\n" "Cache" "Runs" "Mean" "Median" "Variance" "Std Dev" "95% CI" "CV"
+    for state in "${states[@]}"; do
+        if [[ -z "${times[$state]}" ]]; then
+            echo "  $state: no successful runs"
+            continue
+        fi
+        local n mean median variance sd half min_time max_time cv
+        # shellcheck disable=SC2086
+        read -r n mean median variance sd half min_time max_time cv <<<"$(summarize_times ${times[$state]})"
+        means[$state]=$mean
+        local low=$(echo "$mean - $half" | bc -l)
+        local high=$(echo "$mean + $half" | bc -l)
+        printf "  %-5s %4d %8.3fs %8.3fs %10.6f %8.3fs [%7.3f, %7.3f] %5.1f%%\n" \
+            "$state" "$n" "$mean" "$median" "$variance" "$sd" "$low" "$high" "$cv"
+        printf "| %s | %d | %.3fs | %.3fs | %.6f | %.3fs | %.3fs ± %.3fs | %.3fs | %.3fs | %.1f%% | %d |\n" \
+            "$state" "$n" "$mean" "$median" "$variance" "$sd" "$mean" "$half" "$min_time" "$max_time" "$cv" \
+            "${unverified[$state]}" >> "$report_file"
+        if [[ "${unverified[$state]}" -gt 0 ]]; then
+            echo -e "  ${YELLOW}⚠️  ${unverified[$state]} $state runs started without reaching the requested cache state${NC}"
+        fi
+    done
+
+    if [[ -n "${means[cold]:-}" && -n "${means[warm]:-}" ]]; then
+        local ratio=$(echo "scale=2; ${means[cold]} / ${means[warm]}" | bc -l)
+        echo -e "  ${BOLD}Cold runs take ${ratio}x the warm time (mean)${NC}"
+        echo "" >> "$report_file"
+        echo "- **Cold / warm (mean)**: ${ratio}x" >> "$report_file"
+    fi
+    echo ""
+    echo -e "${GREEN}✅ Report generated: $report_file${NC}"
+}
+
 cleanup() {
     echo -e "${YELLOW}🧹 Cleaning up temporary files...${NC}"
     rm -f "$RESULTS_DIR"/*.tmp
@@ -513,6 +653,21 @@ main() {
         echo -e "${RED}❌ bc calculator not found. Install it with: sudo apt install bc${NC}"
         exit 1
     fi
+
+    if [[ -n "$CACHE_MODE" ]]; then
+        if [[ "$CACHE_MODE" != "cold" && "$CACHE_MODE" != "warm" && "$CACHE_MODE" != "both" ]]; then
+            echo -e "${RED}❌ --cache must be cold, warm or both${NC}"
+            exit 1
+        fi
+        if [[ ! -x "$PAGE_CACHE_BINARY" ]]; then
+            echo -e "${RED}❌ fconcat-page-cache not found: $PAGE_CACHE_BINARY${NC}"
+            echo "Build it first with: make page-cache"
+            exit 1
+        fi
+        mkdir -p "$RESULTS_DIR"
+        run_cache_benchmark
+        exit 0
+    fi
     
     # Adjust thread counts based on available cores
     if [[ $MAX_THREADS -lt 8 ]]; then
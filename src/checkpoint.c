@@ -0,0 +1,94 @@
+// File: src/checkpoint.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "checkpoint.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#define CHECKPOINT_MAGIC "fconcat-checkpoint 1"
+
+// Write to "<path>.tmp", sync it, then rename over the old checkpoint so a crash never leaves a torn file
+int checkpoint_save(const char *path, const CheckpointCursor *cursor)
+{
+    char tmp_path[CHECKPOINT_PATH_MAX + 8];
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= (int)sizeof(tmp_path))
+        return -1;
+
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Error writing checkpoint '%s': %s\n", tmp_path, strerror(errno));
+        return -1;
+    }
+
+    fprintf(file, "%s\nentries %llu\noffset %llu\noptions %016llx\npath %s\n", CHECKPOINT_MAGIC,
+            cursor->entries_done, cursor->output_offset, cursor->options_hash, cursor->last_path);
+
+    int failed = fflush(file) != 0;
+#if defined(_WIN32) || defined(_WIN64)
+    failed |= _commit(_fileno(file)) != 0;
+#else
+    failed |= fsync(fileno(file)) != 0;
+#endif
+    failed |= fclose(file) != 0;
+
+#if defined(_WIN32) || defined(_WIN64)
+    if (!failed && !MoveFileExA(tmp_path, path, MOVEFILE_REPLACE_EXISTING))
+        failed = 1;
+#else
+    if (!failed && rename(tmp_path, path) != 0)
+        failed = 1;
+#endif
+
+    if (failed)
+    {
+        fprintf(stderr, "Error writing checkpoint '%s': %s\n", path, strerror(errno));
+        remove(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+int checkpoint_load(const char *path, CheckpointCursor *cursor)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return -1;
+
+    char line[CHECKPOINT_PATH_MAX + 16];
+    int fields = 0;
+    memset(cursor, 0, sizeof(*cursor));
+
+    if (!fgets(line, sizeof(line), file) || strncmp(line, CHECKPOINT_MAGIC, strlen(CHECKPOINT_MAGIC)) != 0)
+    {
+        fclose(file);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), file))
+    {
+        line[strcspn(line, "\n")] = '\0';
+        if (sscanf(line, "entries %llu", &cursor->entries_done) == 1)
+            fields |= 1;
+        else if (sscanf(line, "offset %llu", &cursor->output_offset) == 1)
+            fields |= 2;
+        else if (sscanf(line, "options %llx", &cursor->options_hash) == 1)
+            fields |= 4;
+        else if (strncmp(line, "path ", 5) == 0)
+        {
+            strncpy(cursor->last_path, line + 5, sizeof(cursor->last_path) - 1);
+            cursor->last_path[sizeof(cursor->last_path) - 1] = '\0';
+            fields |= 8;
+        }
+    }
+
+    fclose(file);
+    return fields == 15 ? 0 : -1;
+}
@@ -0,0 +1,35 @@
+// File: src/checkpoint.h
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <time.h>
+
+#define CHECKPOINT_PATH_MAX 4096
+#define CHECKPOINT_DEFAULT_INTERVAL 10 // Seconds between periodic checkpoints
+
+// Emit cursor: the content pass is resumable at any completed file section
+typedef struct
+{
+    unsigned long long entries_done;   // Content-pass entries fully written, in traversal order
+    unsigned long long output_offset;  // Output size right after the last completed entry
+    unsigned long long options_hash;   // Fingerprint of the input and output-shaping options
+    char last_path[CHECKPOINT_PATH_MAX]; // Relative path of the last completed entry
+} CheckpointCursor;
+
+typedef struct
+{
+    const char *path; // Checkpoint file, replaced atomically via "<path>.tmp"
+    int interval;     // Seconds between periodic checkpoints
+    time_t last_write;
+
+    CheckpointCursor progress; // This run's cursor
+    CheckpointCursor resume;   // Cursor loaded by --resume; its entries are skipped
+    int resuming;
+    unsigned long long ordinal; // Content-pass entries seen so far
+    int mismatch;               // The tree no longer matches the resumed cursor
+} Checkpoint;
+
+int checkpoint_save(const char *path, const CheckpointCursor *cursor);
+int checkpoint_load(const char *path, CheckpointCursor *cursor);
+
+#endif
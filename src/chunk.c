@@ -0,0 +1,426 @@
+// File: src/chunk.c
+#include <stdlib.h>
+#include <string.h>
+#include "chunk.h"
+#include "template.h"
+
+// Languages whose blocks are braces and whose comments are // and /* */
+static const char *const brace_languages[] = {
+    "c", "cpp", "objectivec", "csharp", "java", "kotlin", "scala", "go", "rust", "swift", "zig", "dart",
+    "javascript", "jsx", "typescript", "tsx", "php", "css", "scss", "less", "json", "protobuf", "graphql",
+};
+
+static int is_brace_language(const char *path)
+{
+    const char *lang = language_for_path(path);
+    for (size_t i = 0; i < sizeof(brace_languages) / sizeof(brace_languages[0]); i++)
+    {
+        if (strcmp(lang, brace_languages[i]) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+void chunker_begin(Chunker *chunker, const ChunkOptions *options, const char *path)
+{
+    memset(chunker, 0, sizeof(*chunker));
+    chunker->options = options;
+    chunker->path = path;
+    chunker->line = 1;
+    chunker->braces = is_brace_language(path);
+    chunker->previous = -1;
+    chunker->line_blank = 1;
+}
+
+// Length of the well-formed UTF-8 sequence at p, 0 when it is not one
+static size_t utf8_sequence_length(const unsigned char *p, size_t available)
+{
+    size_t length;
+    unsigned char low = 0x80, high = 0xBF;
+    if (p[0] >= 0xC2 && p[0] <= 0xDF)
+        length = 2;
+    else if (p[0] >= 0xE0 && p[0] <= 0xEF)
+    {
+        length = 3;
+        if (p[0] == 0xE0)
+            low = 0xA0; // Overlong
+        else if (p[0] == 0xED)
+            high = 0x9F; // Surrogates
+    }
+    else if (p[0] >= 0xF0 && p[0] <= 0xF4)
+    {
+        length = 4;
+        if (p[0] == 0xF0)
+            low = 0x90;
+        else if (p[0] == 0xF4)
+            high = 0x8F; // Above U+10FFFF
+    }
+    else
+        return 0;
+
+    if (available < length || p[1] < low || p[1] > high)
+        return 0;
+    for (size_t i = 2; i < length; i++)
+    {
+        if ((p[i] & 0xC0) != 0x80)
+            return 0;
+    }
+    return length;
+}
+
+// A JSON string; bytes that are not UTF-8 become U+FFFD, so every record parses. Escapes are
+// staged in a local buffer: one stdio call per escape costs more than the scan itself.
+static void write_json_string(FILE *out, const char *data, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    const unsigned char *p = (const unsigned char *)data;
+    char buffer[4096];
+    size_t used = 0;
+    size_t i = 0;
+    buffer[used++] = '"';
+    while (i < len)
+    {
+        if (used > sizeof(buffer) - 8)
+        {
+            fwrite(buffer, 1, used, out);
+            used = 0;
+        }
+        unsigned char c = p[i];
+        if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\')
+        {
+            buffer[used++] = (char)c;
+            i++;
+            continue;
+        }
+        size_t sequence = c >= 0x80 ? utf8_sequence_length(p + i, len - i) : 0;
+        if (sequence > 0)
+        {
+            memcpy(buffer + used, p + i, sequence);
+            used += sequence;
+            i += sequence;
+            continue;
+        }
+
+        const char *escape = NULL;
+        switch (c)
+        {
+        case '"':
+            escape = "\\\"";
+            break;
+        case '\\':
+            escape = "\\\\";
+            break;
+        case '\n':
+            escape = "\\n";
+            break;
+        case '\r':
+            escape = "\\r";
+            break;
+        case '\t':
+            escape = "\\t";
+            break;
+        default:
+            if (c >= 0x20)
+                escape = "\\ufffd";
+            break;
+        }
+        if (escape)
+        {
+            size_t escape_length = strlen(escape);
+            memcpy(buffer + used, escape, escape_length);
+            used += escape_length;
+        }
+        else
+        {
+            memcpy(buffer + used, "\\u00", 4);
+            buffer[used + 4] = hex[c >> 4];
+            buffer[used + 5] = hex[c & 0xF];
+            used += 6;
+        }
+        i++;
+    }
+    buffer[used++] = '"';
+    fwrite(buffer, 1, used, out);
+}
+
+static void write_record(Chunker *chunker, const char *text, size_t length, FILE *out)
+{
+    // A newline ending the text ends the record's last line
+    unsigned long long last_line = chunker->line;
+    const char *p = text;
+    const char *end = length > 0 ? text + length - 1 : text;
+    while ((p = memchr(p, '\n', (size_t)(end - p))) != NULL)
+    {
+        last_line++;
+        p++;
+    }
+
+    fputs("{\"path\":", out);
+    write_json_string(out, chunker->path, strlen(chunker->path));
+    fprintf(out, ",\"chunk\":%llu,\"lines\":[%llu,%llu],\"bytes\":[%llu,%llu],\"text\":", chunker->index,
+            chunker->line, last_line, chunker->offset, chunker->offset + length);
+    write_json_string(out, text, length);
+    fputs("}\n", out);
+    chunker->index++;
+}
+
+// Move the start of the pending text forward by length bytes
+static void advance(Chunker *chunker, const char *text, size_t length)
+{
+    const char *p = text;
+    const char *end = text + length;
+    while ((p = memchr(p, '\n', (size_t)(end - p))) != NULL)
+    {
+        chunker->line++;
+        p++;
+    }
+    chunker->offset += length;
+}
+
+static void add_break(Chunker *chunker, size_t offset, ChunkBreakKind kind)
+{
+    if (chunker->break_count == chunker->break_capacity)
+    {
+        size_t capacity = chunker->break_capacity ? chunker->break_capacity * 2 : 64;
+        ChunkBreak *breaks = realloc(chunker->breaks, capacity * sizeof(ChunkBreak));
+        if (!breaks)
+            return; // The cut falls back to a line that was recorded, or a hard cut
+        chunker->breaks = breaks;
+        chunker->break_capacity = capacity;
+    }
+    chunker->breaks[chunker->break_count].offset = offset;
+    chunker->breaks[chunker->break_count].kind = kind;
+    chunker->break_count++;
+}
+
+// Bytes the lexer acts on outside strings and comments; the rest only end a blank line
+static int lexer_byte(unsigned char c)
+{
+    return c == '\n' || c == '/' || c == '*' || c == '"' || c == '\'' || c == '`' || c == '{' || c == '}';
+}
+
+// Run the lexer over new pending bytes and record a break at every line end. The state lives
+// in locals while the loop runs: stores through the text pointer would otherwise reload it.
+static void scan(Chunker *chunker, size_t from, size_t count)
+{
+    const unsigned char *text = (const unsigned char *)chunker->text;
+    const unsigned char *end = text + from + count;
+    const unsigned char *p = text + from;
+    int braces = chunker->braces;
+    int depth = chunker->depth;
+    int quote = (unsigned char)chunker->quote;
+    int escaped = chunker->escaped;
+    int block_comment = chunker->block_comment;
+    int line_comment = chunker->line_comment;
+    int previous = chunker->previous;
+    int line_blank = chunker->line_blank;
+    int line_closed_block = chunker->line_closed_block;
+
+    while (p < end)
+    {
+        unsigned char c = *p;
+        if (!line_blank && (!braces || line_comment))
+        {
+            // Nothing before the line end matters
+            const unsigned char *newline = memchr(p, '\n', (size_t)(end - p));
+            if (!newline)
+                break;
+            p = newline;
+            c = '\n';
+        }
+        else if (!line_blank && !quote && !block_comment && !lexer_byte(c))
+        {
+            previous = c;
+            p++;
+            continue;
+        }
+
+        if (c == '\n')
+        {
+            ChunkBreakKind kind = CHUNK_BREAK_LINE;
+            if (!block_comment && line_closed_block && depth == 0)
+                kind = CHUNK_BREAK_BLOCK;
+            else if (!block_comment && !quote && line_blank)
+                kind = depth == 0 ? CHUNK_BREAK_PARAGRAPH : CHUNK_BREAK_BLANK;
+            add_break(chunker, (size_t)(p - text) + 1, kind);
+
+            // Only template literals span lines without an escaped newline
+            if (quote != '`' && !escaped)
+                quote = 0;
+            escaped = 0;
+            line_comment = 0;
+            line_blank = 1;
+            line_closed_block = 0;
+            previous = -1;
+            p++;
+            continue;
+        }
+        p++;
+        if (c != ' ' && c != '\t' && c != '\r' && c != '\f' && c != '\v')
+            line_blank = 0;
+        if (!braces || line_comment)
+            continue;
+
+        if (quote)
+        {
+            if (escaped)
+                escaped = 0;
+            else if (c == '\\')
+                escaped = 1;
+            else if (c == quote)
+                quote = 0;
+            continue;
+        }
+        if (block_comment)
+        {
+            if (previous == '*' && c == '/')
+            {
+                block_comment = 0;
+                previous = -1;
+            }
+            else
+                previous = c;
+            continue;
+        }
+
+        if (previous == '/' && c == '/')
+            line_comment = 1;
+        else if (previous == '/' && c == '*')
+            block_comment = 1;
+        else if (c == '"' || c == '\'' || c == '`')
+            quote = c;
+        else if (c == '{')
+            depth++;
+        else if (c == '}' && depth > 0 && --depth == 0)
+            line_closed_block = 1;
+        previous = block_comment || quote ? -1 : c;
+    }
+
+    chunker->depth = depth;
+    chunker->quote = (char)quote;
+    chunker->escaped = escaped;
+    chunker->block_comment = block_comment;
+    chunker->line_comment = line_comment;
+    chunker->previous = previous;
+    chunker->line_blank = line_blank;
+    chunker->line_closed_block = line_closed_block;
+}
+
+// The full pending text becomes a record: cut at the best break in its second half, else at
+// the last line end, else inside the line but not inside a UTF-8 sequence
+static size_t choose_cut(const Chunker *chunker)
+{
+    size_t minimum = chunker->options->size / 2;
+    const ChunkBreak *best = NULL;
+    const ChunkBreak *last = NULL;
+    for (size_t i = 0; i < chunker->break_count; i++)
+    {
+        const ChunkBreak *candidate = &chunker->breaks[i];
+        if (candidate->offset <= chunker->repeated)
+            continue; // A record must add text to the overlap
+        last = candidate;
+        if (candidate->offset >= minimum && (!best || candidate->kind >= best->kind))
+            best = candidate;
+    }
+    if (best)
+        return best->offset;
+    if (last)
+        return last->offset;
+
+    const unsigned char *text = (const unsigned char *)chunker->text;
+    size_t length = chunker->length;
+    for (size_t back = 1; back <= 3 && back <= length; back++)
+    {
+        unsigned char c = text[length - back];
+        if ((c & 0xC0) == 0x80)
+            continue;
+        size_t needed = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+        if (needed > back && length - back > chunker->repeated)
+            return length - back;
+        break;
+    }
+    return length;
+}
+
+static void cut_record(Chunker *chunker, FILE *out)
+{
+    size_t cut = choose_cut(chunker);
+    write_record(chunker, chunker->text, cut, out);
+
+    // The next record starts with the whole lines that end the overlap window
+    size_t start = cut;
+    size_t overlap = chunker->options->overlap;
+    for (size_t i = 0; overlap > 0 && i < chunker->break_count; i++)
+    {
+        size_t offset = chunker->breaks[i].offset;
+        if (offset > 0 && offset < cut && offset + overlap >= cut)
+        {
+            start = offset;
+            break;
+        }
+    }
+
+    advance(chunker, chunker->text, start);
+    memmove(chunker->text, chunker->text + start, chunker->length - start);
+    chunker->length -= start;
+    chunker->repeated = cut - start;
+
+    size_t kept = 0;
+    for (size_t i = 0; i < chunker->break_count; i++)
+    {
+        if (chunker->breaks[i].offset > start)
+        {
+            chunker->breaks[kept] = chunker->breaks[i];
+            chunker->breaks[kept].offset -= start;
+            kept++;
+        }
+    }
+    chunker->break_count = kept;
+}
+
+void chunker_feed(Chunker *chunker, const char *data, size_t len, FILE *out)
+{
+    size_t size = chunker->options->size;
+    if (!chunker->text && len > 0)
+        chunker->text = malloc(size);
+    if (!chunker->text)
+    {
+        // Out of memory: records of the incoming bytes as they are, cut at the size
+        while (len > 0)
+        {
+            size_t take = len < size ? len : size;
+            write_record(chunker, data, take, out);
+            advance(chunker, data, take);
+            data += take;
+            len -= take;
+        }
+        return;
+    }
+
+    while (len > 0)
+    {
+        size_t take = size - chunker->length;
+        if (take > len)
+            take = len;
+        memcpy(chunker->text + chunker->length, data, take);
+        scan(chunker, chunker->length, take);
+        chunker->length += take;
+        data += take;
+        len -= take;
+        if (chunker->length == size)
+            cut_record(chunker, out);
+    }
+}
+
+void chunker_end(Chunker *chunker, FILE *out)
+{
+    if (chunker->length > chunker->repeated)
+        write_record(chunker, chunker->text, chunker->length, out);
+    free(chunker->text);
+    free(chunker->breaks);
+    chunker->text = NULL;
+    chunker->breaks = NULL;
+    chunker->length = 0;
+    chunker->break_count = 0;
+    chunker->break_capacity = 0;
+}
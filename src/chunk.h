@@ -0,0 +1,68 @@
+// File: src/chunk.h
+#ifndef CHUNK_H
+#define CHUNK_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// --format chunks: each file section becomes JSON Lines records of at most --chunk-size bytes,
+// cut while the file streams. A cut prefers the end of a top-level block, then a blank line,
+// then any line end; the next record repeats up to --chunk-overlap bytes of whole lines.
+#define CHUNK_SIZE_DEFAULT 2048
+#define CHUNK_SIZE_MIN 64
+#define CHUNK_OVERLAP_DEFAULT 256
+
+typedef struct
+{
+    size_t size;    // Most bytes of text per record
+    size_t overlap; // Below size / 2
+} ChunkOptions;
+
+// Where a cut may go, best last
+typedef enum
+{
+    CHUNK_BREAK_LINE,      // Any line end
+    CHUNK_BREAK_BLANK,     // A blank line inside a block
+    CHUNK_BREAK_PARAGRAPH, // A blank line at the top level
+    CHUNK_BREAK_BLOCK      // The line that closed a top-level block
+} ChunkBreakKind;
+
+typedef struct
+{
+    size_t offset; // Start of a line in the pending text
+    ChunkBreakKind kind;
+} ChunkBreak;
+
+// One sink's chunker for the file being streamed; the pending text is freed by chunker_end()
+typedef struct
+{
+    const ChunkOptions *options;
+    const char *path;
+    unsigned long long index; // Records written for this file
+    char *text;               // Pending text: the overlap kept from the last record, then new bytes
+    size_t length;
+    size_t repeated;         // Leading bytes of text already written in the last record
+    unsigned long long offset; // Offset of text[0] in the section body
+    unsigned long long line;   // Line number of text[0], from 1
+    ChunkBreak *breaks;
+    size_t break_count;
+    size_t break_capacity;
+
+    // Lexer state after the last byte fed. Brace languages track string literals, comments
+    // and brace depth so that braces in strings and comments do not count.
+    int braces;
+    int depth;
+    char quote; // Delimiter of the open string literal, 0 = none
+    int escaped;
+    int block_comment;
+    int line_comment;
+    int previous; // Previous byte outside string literals, for "//", "/*" and "*/"
+    int line_blank;
+    int line_closed_block; // A '}' on this line brought the depth back to 0
+} Chunker;
+
+void chunker_begin(Chunker *chunker, const ChunkOptions *options, const char *path);
+void chunker_feed(Chunker *chunker, const char *data, size_t len, FILE *out);
+void chunker_end(Chunker *chunker, FILE *out);
+
+#endif
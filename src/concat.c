@@ -10,14 +10,24 @@
 #include <unistd.h>
 #include <errno.h>
 #include <time.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <signal.h>
 #include "concat.h"
+#include "encode.h"
+#include "dirscan.h"
+#include "generated.h"
+#include "hash.h"
+#include "metadata.h"
+#include "probes.h"
+#include "structure.h"
+#include "template.h"
 
 #if defined(_WIN32) || defined(_WIN64)
 #include <windows.h>
 #include <wchar.h>
+#include <io.h>
 #define PATH_SEP '\\'
 #ifdef WITH_PLUGINS
 #define dlopen(lib, flags) LoadLibraryA(lib)
@@ -48,6 +58,16 @@ static const char *win_dlerror(void)
 #endif
 #endif
 
+#ifdef __linux__
+#include <sys/vfs.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <linux/fs.h>
+#ifdef FICLONERANGE
+#define HAVE_REFLINK 1
+#endif
+#endif
+
 // Global verbose flag
 static int g_verbose = 0;
 
@@ -173,10 +193,25 @@ int load_plugin(PluginManager *manager, const char *plugin_path)
         return -1;
     }
 
-    *plugin = *plugin_template;
+    // Only the fields every plugin exports are copied: a plugin built against the older struct
+    // ends at index, and aggregation, spans and metrics come from separate exports
+    memset(plugin, 0, sizeof(*plugin));
+    memcpy(plugin, plugin_template, offsetof(StreamingPlugin, aggregator));
     plugin->handle = handle;
     plugin->index = manager->count;
 
+    void *aggregator_ptr = dlsym(handle, "get_plugin_aggregator");
+    const PluginAggregator *(*get_aggregator)(void) = (const PluginAggregator * (*)(void)) aggregator_ptr;
+    plugin->aggregator = get_aggregator ? get_aggregator() : NULL;
+    void *spans_ptr = dlsym(handle, "process_chunk_spans");
+    plugin->process_chunk_spans = (int (*)(PluginContext *, const char *, size_t, PluginSpanList *))spans_ptr;
+    if (plugin->aggregator && (!plugin->aggregator->create || !plugin->aggregator->map ||
+                               !plugin->aggregator->merge || !plugin->aggregator->destroy))
+    {
+        fprintf(stderr, "Ignoring incomplete aggregator of plugin %s\n", plugin_path);
+        plugin->aggregator = NULL;
+    }
+
     // Initialize the plugin
     if (plugin->init && plugin->init() != 0)
     {
@@ -196,135 +231,433 @@ int load_plugin(PluginManager *manager, const char *plugin_path)
     return 0;
 }
 
-int process_file_through_plugins(PluginManager *manager, const char *relative_path,
-                                 const char *input_data, size_t input_size,
-                                 char **output_data, size_t *output_size)
+// --metrics: time a plugin callback when the plugin has a slot
+static unsigned long long plugin_call_begin(const StreamingPlugin *plugin)
+{
+    return plugin->metrics ? metrics_now_ns() : 0;
+}
+
+static void plugin_call_end(const StreamingPlugin *plugin, unsigned long long started)
 {
+    if (plugin->metrics)
+        metrics_plugin_add(plugin->metrics, metrics_now_ns() - started);
+}
+
+// Start a file: every plugin gets its context once, before the first chunk
+void plugin_session_begin(PluginManager *manager, PluginSession *session, const char *relative_path)
+{
+    memset(session, 0, sizeof(*session));
     if (!manager || !manager->initialized || manager->count == 0)
+        return;
+
+    pthread_mutex_lock(&manager->mutex);
+    for (int i = 0; i < manager->count; i++)
     {
-        // No plugins, pass through unchanged
-        *output_data = malloc(input_size);
-        if (!*output_data)
-            return -1;
-        memcpy(*output_data, input_data, input_size);
-        *output_size = input_size;
-        return 0;
+        if (manager->plugins[i] && manager->plugins[i]->file_start)
+        {
+            FCONCAT_PROBE4(plugin_enter, manager->plugins[i]->name, "file_start", relative_path, 0);
+            unsigned long long started = plugin_call_begin(manager->plugins[i]);
+            session->contexts[i] = manager->plugins[i]->file_start(relative_path);
+            plugin_call_end(manager->plugins[i], started);
+            FCONCAT_PROBE4(plugin_exit, manager->plugins[i]->name, "file_start", 0, session->contexts[i] != NULL);
+            if (session->contexts[i])
+                session->contexts[i]->plugin_index = i;
+        }
     }
+    session->active = 1;
+    pthread_mutex_unlock(&manager->mutex);
+}
 
-    pthread_mutex_lock(&manager->mutex);
+// Run data through plugins [first, count) of the chain. Takes ownership of a malloc'ed input
+// when owned is set; the result is always malloc'ed (or NULL when empty).
+static void plugin_chain_run(PluginManager *manager, PluginSession *session, int first,
+                             char *data, size_t size, int owned, char **output, size_t *output_size)
+{
+    for (int i = first; i < manager->count; i++)
+    {
+        StreamingPlugin *plugin = manager->plugins[i];
+        if (!plugin || !plugin->process_chunk || !session->contexts[i])
+            continue;
 
-    // Create local plugin contexts for this processing session
-    PluginContext *local_contexts[MAX_PLUGINS];
-    for (int i = 0; i < MAX_PLUGINS; i++)
+        char *plugin_output = NULL;
+        size_t plugin_output_size = 0;
+        FCONCAT_PROBE4(plugin_enter, plugin->name, "process_chunk", session->contexts[i]->file_path, size);
+        unsigned long long started = plugin_call_begin(plugin);
+        int result = plugin->process_chunk(session->contexts[i], data, size, &plugin_output, &plugin_output_size);
+        plugin_call_end(plugin, started);
+        FCONCAT_PROBE4(plugin_exit, plugin->name, "process_chunk", plugin_output ? plugin_output_size : size, result);
+        if (result != 0)
+        {
+            if (is_verbose())
+                fprintf(stderr, "[fconcat] Plugin %s failed processing chunk\n", plugin->name);
+            // Skip this plugin but continue with others
+            free(plugin_output);
+            continue;
+        }
+
+        // NULL passes the input through; an allocated buffer replaces it, even when empty
+        if (plugin_output)
+        {
+            if (owned)
+                free(data);
+            data = plugin_output;
+            size = plugin_output_size;
+            owned = 1;
+            session->contexts[i]->total_processed += size;
+        }
+    }
+
+    if (!owned)
     {
-        local_contexts[i] = NULL;
+        char *copy = size > 0 ? malloc(size) : NULL;
+        if (copy)
+            memcpy(copy, data, size);
+        data = copy;
+        size = copy ? size : 0;
     }
+    *output = data;
+    *output_size = size;
+}
 
-    // Start file processing for all plugins
-    for (int i = 0; i < manager->count; i++)
+int plugin_session_chunk(PluginManager *manager, PluginSession *session, const char *input, size_t input_size,
+                         char **output, size_t *output_size)
+{
+    *output = NULL;
+    *output_size = 0;
+    if (!session->active)
+        return -1;
+
+    // Chunks only touch the session's own contexts: --jobs workers run them concurrently
+    plugin_chain_run(manager, session, 0, (char *)input, input_size, 0, output, output_size);
+    return input_size > 0 && !*output ? -1 : 0;
+}
+
+void plugin_gather_init(PluginGather *gather)
+{
+    memset(gather, 0, sizeof(*gather));
+}
+
+void plugin_gather_free(PluginGather *gather)
+{
+    for (size_t i = 0; i < gather->owned_count; i++)
+        free(gather->owned[i]);
+    free(gather->owned);
+    free(gather->lists[0]);
+    free(gather->lists[1]);
+    memset(gather, 0, sizeof(*gather));
+}
+
+static int gather_push(PluginGather *gather, int list, const char *data, size_t size)
+{
+    if (size == 0)
+        return 0;
+
+    if (gather->counts[list] == gather->capacities[list])
     {
-        if (manager->plugins[i] && manager->plugins[i]->file_start)
+        size_t capacity = gather->capacities[list] ? gather->capacities[list] * 2 : 16;
+        GatherSpan *spans = realloc(gather->lists[list], capacity * sizeof(*spans));
+        if (!spans)
         {
-            local_contexts[i] = manager->plugins[i]->file_start(relative_path);
+            gather->failed = 1;
+            return -1;
         }
+        gather->lists[list] = spans;
+        gather->capacities[list] = capacity;
     }
 
-    // Create a copy of input data to work with
-    char *current_input = malloc(input_size);
-    if (!current_input)
+    GatherSpan *span = &gather->lists[list][gather->counts[list]++];
+    span->iov_base = (void *)data;
+    span->iov_len = size;
+    return 0;
+}
+
+// Keep a malloc'ed buffer alive until the next chunk; frees it on failure
+static int gather_own(PluginGather *gather, char *buffer)
+{
+    if (gather->owned_count == gather->owned_capacity)
     {
-        // Cleanup contexts
-        for (int i = 0; i < manager->count; i++)
+        size_t capacity = gather->owned_capacity ? gather->owned_capacity * 2 : 8;
+        char **owned = realloc(gather->owned, capacity * sizeof(*owned));
+        if (!owned)
         {
-            if (local_contexts[i] && manager->plugins[i] && manager->plugins[i]->file_cleanup)
-            {
-                manager->plugins[i]->file_cleanup(local_contexts[i]);
-            }
+            free(buffer);
+            gather->failed = 1;
+            return -1;
         }
-        pthread_mutex_unlock(&manager->mutex);
+        gather->owned = owned;
+        gather->owned_capacity = capacity;
+    }
+    gather->owned[gather->owned_count++] = buffer;
+    return 0;
+}
+
+// PluginSpanList callbacks: span plugins append to the stage after the current one
+static int gather_list_add(PluginSpanList *list, const char *data, size_t size)
+{
+    PluginGather *gather = list->engine;
+    return gather_push(gather, !gather->current, data, size);
+}
+
+static char *gather_list_alloc(PluginSpanList *list, size_t size)
+{
+    char *buffer = malloc(size > 0 ? size : 1);
+    if (!buffer || gather_own(list->engine, buffer) != 0)
+        return NULL;
+    return buffer;
+}
+
+// Join the current spans for a plugin that only takes contiguous input
+static int gather_flatten(PluginGather *gather, const char **data, size_t *size)
+{
+    int list = gather->current;
+    size_t count = gather->counts[list];
+    if (count <= 1)
+    {
+        *data = count ? gather->lists[list][0].iov_base : "";
+        *size = count ? gather->lists[list][0].iov_len : 0;
+        return 0;
+    }
+
+    size_t total = 0;
+    for (size_t i = 0; i < count; i++)
+        total += gather->lists[list][i].iov_len;
+    char *joined = malloc(total);
+    if (!joined || gather_own(gather, joined) != 0)
+    {
+        gather->failed = 1;
         return -1;
     }
-    memcpy(current_input, input_data, input_size);
-    size_t current_size = input_size;
+    size_t offset = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        memcpy(joined + offset, gather->lists[list][i].iov_base, gather->lists[list][i].iov_len);
+        offset += gather->lists[list][i].iov_len;
+    }
 
-    // Process through each plugin in sequence
-    for (int i = 0; i < manager->count; i++)
+    gather->counts[list] = 0;
+    gather_push(gather, list, joined, total);
+    *data = joined;
+    *size = total;
+    return 0;
+}
+
+// A process_chunk plugin: the current spans are joined (no copy for a single span) and its
+// output buffer becomes the only span
+static void gather_stage_chunk(PluginGather *gather, StreamingPlugin *plugin, PluginContext *context)
+{
+    const char *data;
+    size_t size;
+    if (gather_flatten(gather, &data, &size) != 0)
+        return;
+
+    char *output = NULL;
+    size_t output_size = 0;
+    FCONCAT_PROBE4(plugin_enter, plugin->name, "process_chunk", context->file_path, size);
+    unsigned long long started = plugin_call_begin(plugin);
+    int result = plugin->process_chunk(context, data, size, &output, &output_size);
+    plugin_call_end(plugin, started);
+    FCONCAT_PROBE4(plugin_exit, plugin->name, "process_chunk", output ? output_size : size, result);
+    if (result != 0)
     {
-        if (manager->plugins[i] && manager->plugins[i]->process_chunk && local_contexts[i])
-        {
-            char *plugin_output = NULL;
-            size_t plugin_output_size = 0;
+        if (is_verbose())
+            fprintf(stderr, "[fconcat] Plugin %s failed processing chunk\n", plugin->name);
+        free(output);
+        return;
+    }
+    if (!output || gather_own(gather, output) != 0)
+        return;
+
+    gather->counts[gather->current] = 0;
+    gather_push(gather, gather->current, output, output_size);
+    context->total_processed += output_size;
+}
+
+// A span plugin gets every current span as a consecutive piece of the chunk, so spans from
+// an earlier span plugin are passed down without being joined
+static void gather_stage_spans(PluginGather *gather, StreamingPlugin *plugin, PluginContext *context)
+{
+    int from = gather->current;
+    int to = !from;
+    gather->counts[to] = 0;
+#if FCONCAT_PROBES_ENABLED
+    size_t bytes_in = 0;
+    for (size_t i = 0; i < gather->counts[from]; i++)
+        bytes_in += gather->lists[from][i].iov_len;
+    FCONCAT_PROBE4(plugin_enter, plugin->name, "process_chunk_spans", context->file_path, bytes_in);
+#endif
+    unsigned long long started = plugin_call_begin(plugin);
 
-            int result = manager->plugins[i]->process_chunk(local_contexts[i],
-                                                            current_input, current_size,
-                                                            &plugin_output, &plugin_output_size);
+    for (size_t i = 0; i < gather->counts[from]; i++)
+    {
+        const char *data = gather->lists[from][i].iov_base;
+        size_t size = gather->lists[from][i].iov_len;
+        size_t mark = gather->counts[to];
+        int result = plugin->process_chunk_spans(context, data, size, &gather->list);
+        if (result == 0)
+            continue;
 
-            if (result != 0)
+        gather->counts[to] = mark;
+        if (result > 0 && plugin->process_chunk)
+        {
+            char *output = NULL;
+            size_t output_size = 0;
+            if (plugin->process_chunk(context, data, size, &output, &output_size) == 0)
             {
-                if (is_verbose())
-                    fprintf(stderr, "[fconcat] Plugin %s failed processing chunk\n", manager->plugins[i]->name);
-                // Skip this plugin but continue with others
-                if (plugin_output)
-                {
-                    free(plugin_output);
-                }
+                if (!output)
+                    gather_push(gather, to, data, size);
+                else if (gather_own(gather, output) == 0)
+                    gather_push(gather, to, output, output_size);
                 continue;
             }
+            free(output);
+        }
 
-            // If plugin produced output, use it as input for next plugin
-            if (plugin_output && plugin_output_size > 0)
-            {
-                // Free previous input
-                free(current_input);
+        if (is_verbose())
+            fprintf(stderr, "[fconcat] Plugin %s failed processing chunk\n", plugin->name);
+        gather_push(gather, to, data, size);
+    }
 
-                // Use plugin output as new input
-                current_input = plugin_output;
-                current_size = plugin_output_size;
+    plugin_call_end(plugin, started);
+    size_t bytes = 0;
+    for (size_t i = 0; i < gather->counts[to]; i++)
+        bytes += gather->lists[to][i].iov_len;
+    context->total_processed += bytes;
+    gather->current = to;
+    FCONCAT_PROBE4(plugin_exit, plugin->name, "process_chunk_spans", bytes, 0);
+}
 
-                // Update plugin context
-                local_contexts[i]->total_processed += current_size;
-            }
-            else
-            {
-                // Plugin didn't produce output, continue with current input
-                if (plugin_output)
-                {
-                    free(plugin_output);
-                }
-            }
-        }
+// Scatter-gather form of plugin_session_chunk(): the chunk's output is left in
+// gather->lists[gather->current], valid until the next call with the same gather
+int plugin_session_gather(PluginManager *manager, PluginSession *session, const char *input, size_t input_size,
+                          PluginGather *gather)
+{
+    // The previous chunk's spans were written by now
+    for (size_t i = 0; i < gather->owned_count; i++)
+        free(gather->owned[i]);
+    gather->owned_count = 0;
+    gather->counts[0] = gather->counts[1] = 0;
+    gather->current = 0;
+    gather->failed = 0;
+    gather->list.add = gather_list_add;
+    gather->list.alloc = gather_list_alloc;
+    gather->list.engine = gather;
+    if (!session->active)
+        return -1;
+
+    gather_push(gather, 0, input, input_size);
+    for (int i = 0; i < manager->count && !gather->failed; i++)
+    {
+        StreamingPlugin *plugin = manager->plugins[i];
+        if (!plugin || !session->contexts[i])
+            continue;
+        if (plugin->process_chunk_spans)
+            gather_stage_spans(gather, plugin, session->contexts[i]);
+        else if (plugin->process_chunk)
+            gather_stage_chunk(gather, plugin, session->contexts[i]);
     }
+    return gather->failed ? -1 : 0;
+}
+
+// Finish a file: what a plugin's file_end flushes still runs through the plugins after it
+int plugin_session_end(PluginManager *manager, PluginSession *session, char **output, size_t *output_size)
+{
+    *output = NULL;
+    *output_size = 0;
+    if (!session->active)
+        return 0;
 
-    // End file processing for all plugins
+    pthread_mutex_lock(&manager->mutex);
     for (int i = 0; i < manager->count; i++)
     {
-        if (manager->plugins[i] && local_contexts[i])
+        StreamingPlugin *plugin = manager->plugins[i];
+        if (!plugin || !session->contexts[i])
+            continue;
+
+        char *final_output = NULL;
+        size_t final_size = 0;
+        int result = -1;
+        if (plugin->file_end)
         {
-            if (manager->plugins[i]->file_end)
-            {
-                char *final_output = NULL;
-                size_t final_size = 0;
-                int result = manager->plugins[i]->file_end(local_contexts[i], &final_output, &final_size);
-                if (result == 0 && final_output && final_size > 0)
-                {
-                    // For now, we'll ignore final output from file_end
-                    // In a more sophisticated implementation, we'd append it
-                    free(final_output);
-                }
-            }
+            FCONCAT_PROBE4(plugin_enter, plugin->name, "file_end", session->contexts[i]->file_path, 0);
+            unsigned long long started = plugin_call_begin(plugin);
+            result = plugin->file_end(session->contexts[i], &final_output, &final_size);
+            plugin_call_end(plugin, started);
+            FCONCAT_PROBE4(plugin_exit, plugin->name, "file_end", final_output ? final_size : 0, result);
+        }
+        if (result == 0 && final_output && final_size > 0)
+        {
+            char *flushed = NULL;
+            size_t flushed_size = 0;
+            plugin_chain_run(manager, session, i + 1, final_output, final_size, 1, &flushed, &flushed_size);
 
-            if (manager->plugins[i]->file_cleanup)
+            char *joined = flushed_size > 0 ? realloc(*output, *output_size + flushed_size) : NULL;
+            if (joined)
             {
-                manager->plugins[i]->file_cleanup(local_contexts[i]);
+                memcpy(joined + *output_size, flushed, flushed_size);
+                *output = joined;
+                *output_size += flushed_size;
             }
+            free(flushed);
+        }
+        else
+        {
+            free(final_output);
         }
+
+        if (plugin->file_cleanup)
+            plugin->file_cleanup(session->contexts[i]);
+        session->contexts[i] = NULL;
+    }
+    session->active = 0;
+    pthread_mutex_unlock(&manager->mutex);
+    return 0;
+}
+
+// One-shot processing of a whole buffer as a single-chunk file
+int process_file_through_plugins(PluginManager *manager, const char *relative_path,
+                                 const char *input_data, size_t input_size,
+                                 char **output_data, size_t *output_size)
+{
+    if (!manager || !manager->initialized || manager->count == 0)
+    {
+        // No plugins, pass through unchanged
+        *output_data = malloc(input_size);
+        if (!*output_data)
+            return -1;
+        memcpy(*output_data, input_data, input_size);
+        *output_size = input_size;
+        return 0;
     }
 
-    // Set final output
-    *output_data = current_input;
-    *output_size = current_size;
+    PluginSession session;
+    char *body = NULL, *tail = NULL;
+    size_t body_size = 0, tail_size = 0;
+    plugin_session_begin(manager, &session, relative_path);
+    int result = plugin_session_chunk(manager, &session, input_data, input_size, &body, &body_size);
+    plugin_session_end(manager, &session, &tail, &tail_size);
+    if (result != 0)
+    {
+        free(tail);
+        return -1;
+    }
 
-    pthread_mutex_unlock(&manager->mutex);
+    if (tail_size > 0)
+    {
+        char *joined = realloc(body, body_size + tail_size);
+        if (!joined)
+        {
+            free(body);
+            free(tail);
+            return -1;
+        }
+        memcpy(joined + body_size, tail, tail_size);
+        body = joined;
+        body_size += tail_size;
+    }
+    free(tail);
+
+    *output_data = body;
+    *output_size = body_size;
     return 0;
 }
 #endif // WITH_PLUGINS
@@ -491,6 +824,7 @@ int is_excluded(const char *path, ExcludeList *excludes)
         {
             if (match_pattern(current->pattern, path))
             {
+                FCONCAT_PROBE3(exclude, path, 1, current->pattern);
                 if (is_verbose())
                     fprintf(stderr, "[fconcat] Excluded (full path match): %s\n", path);
                 pthread_mutex_unlock(&excludes->mutex);
@@ -521,6 +855,7 @@ int is_excluded(const char *path, ExcludeList *excludes)
             {
                 if (match_pattern(current->pattern, basename))
                 {
+                    FCONCAT_PROBE3(exclude, path, 2, current->pattern);
                     if (is_verbose())
                         fprintf(stderr, "[fconcat] Excluded (basename match): %s\n", path);
                     pthread_mutex_unlock(&excludes->mutex);
@@ -532,6 +867,7 @@ int is_excluded(const char *path, ExcludeList *excludes)
     }
 
     pthread_mutex_unlock(&excludes->mutex);
+    FCONCAT_PROBE3(exclude, path, 0, NULL);
     return 0;
 }
 
@@ -564,9 +900,81 @@ static int safe_path_join(char *dest, size_t dest_size, const char *path1, const
     return 0;
 }
 
+// Integer rendering of "%llu B" / "%.2f <unit>": hundredths are rounded half-to-even like printf,
+// so the text matches the floating-point form exactly. Returns the length written (no terminator).
+size_t format_size_into(unsigned long long size, char *buffer)
+{
+    static const char *units[] = {"B", "KB", "MB", "GB", "TB", "PB", "EB"};
+    char digits[24];
+    char *end = digits + sizeof(digits);
+    char *start = end;
+    size_t length = 0;
+
+    if (size < 1024)
+    {
+        do
+        {
+            *--start = (char)('0' + size % 10);
+            size /= 10;
+        } while (size);
+        memcpy(buffer, start, (size_t)(end - start));
+        length = (size_t)(end - start);
+        memcpy(buffer + length, " B", 2);
+        return length + 2;
+    }
+
+    // Beyond 2^53 the double conversion itself rounds, so defer to printf to stay byte-identical
+    if (size >= (1ULL << 53))
+    {
+        char text[64];
+        format_size(size, text, sizeof(text));
+        length = strlen(text);
+        memcpy(buffer, text, length);
+        return length;
+    }
+
+    int unit_index = 0;
+    while (unit_index < 6 && (size >> (10 * (unit_index + 1))) > 0)
+        unit_index++;
+
+    int shift = 10 * unit_index;
+    unsigned long long scaled = size * 100; // < 2^60
+    unsigned long long hundredths = scaled >> shift;
+    unsigned long long remainder = scaled & ((1ULL << shift) - 1);
+    unsigned long long half = 1ULL << (shift - 1);
+    if (remainder > half || (remainder == half && (hundredths & 1)))
+        hundredths++;
+
+    unsigned long long whole = hundredths / 100;
+    unsigned long long fraction = hundredths % 100;
+    *--start = (char)('0' + fraction % 10);
+    *--start = (char)('0' + fraction / 10);
+    *--start = '.';
+    do
+    {
+        *--start = (char)('0' + whole % 10);
+        whole /= 10;
+    } while (whole);
+
+    length = (size_t)(end - start);
+    memcpy(buffer, start, length);
+    buffer[length++] = ' ';
+    size_t unit_length = strlen(units[unit_index]);
+    memcpy(buffer + length, units[unit_index], unit_length);
+    return length + unit_length;
+}
+
 void format_size(unsigned long long size, char *buffer, size_t buffer_size)
 {
     static const char *units[] = {"B", "KB", "MB", "GB", "TB", "PB", "EB"};
+
+    if (size < (1ULL << 53) && buffer_size >= 32)
+    {
+        size_t length = format_size_into(size, buffer);
+        buffer[length] = '\0';
+        return;
+    }
+
     int unit_index = 0;
     double size_d = (double)size;
 
@@ -586,24 +994,9 @@ void format_size(unsigned long long size, char *buffer, size_t buffer_size)
     }
 }
 
-int is_binary_file(const char *filepath)
+// Binary verdict for the first bytes of a file
+static int sniff_is_binary(const unsigned char *buffer, size_t bytes_read)
 {
-#ifdef _WIN32
-    // On Windows, use binary mode and handle file access differently
-    FILE *file = fopen(filepath, "rb");
-#else
-    FILE *file = fopen(filepath, "rb");
-#endif
-
-    if (!file)
-    {
-        return -1;
-    }
-
-    unsigned char buffer[BINARY_CHECK_SIZE];
-    size_t bytes_read = fread(buffer, 1, sizeof(buffer), file);
-    fclose(file);
-
     if (bytes_read == 0)
     {
         return 0; // Empty file is considered text
@@ -648,79 +1041,167 @@ int is_binary_file(const char *filepath)
     return 0;
 }
 
-// Inode tracker implementation for symlink loop detection
+int is_binary_file(const char *filepath)
+{
+#ifdef _WIN32
+    // On Windows, use binary mode and handle file access differently
+    FILE *file = fopen(filepath, "rb");
+#else
+    FILE *file = fopen(filepath, "rb");
+#endif
+
+    if (!file)
+    {
+        return -1;
+    }
+
+    unsigned char buffer[BINARY_CHECK_SIZE];
+    size_t bytes_read = fread(buffer, 1, sizeof(buffer), file);
+    fclose(file);
+
+    return sniff_is_binary(buffer, bytes_read);
+}
+
+// Inode tracker implementation for symlink loop detection and duplicate detection
+#define INODE_INITIAL_BUCKETS 1024
+
 int init_inode_tracker(InodeTracker *tracker)
 {
-    tracker->head = NULL;
+    tracker->buckets = calloc(INODE_INITIAL_BUCKETS, sizeof(InodeNode *));
+    if (!tracker->buckets)
+        return -1;
+    tracker->bucket_count = INODE_INITIAL_BUCKETS;
+    tracker->count = 0;
     if (pthread_mutex_init(&tracker->mutex, NULL) != 0)
+    {
+        free(tracker->buckets);
         return -1;
+    }
     return 0;
 }
 
-int add_inode(InodeTracker *tracker, dev_t device, ino_t inode)
+static size_t inode_bucket(const InodeTracker *tracker, dev_t device, ino_t inode)
 {
-    pthread_mutex_lock(&tracker->mutex);
+    uint64_t key = ((uint64_t)inode * 0x9E3779B97F4A7C15ULL) ^ ((uint64_t)device * 0xC2B2AE3D27D4EB4FULL);
+    key ^= key >> 29;
+    return (size_t)key & (tracker->bucket_count - 1);
+}
 
-    // Check if inode already exists
-    InodeNode *current = tracker->head;
+static InodeNode *find_inode_node(const InodeTracker *tracker, dev_t device, ino_t inode)
+{
+    InodeNode *current = tracker->buckets[inode_bucket(tracker, device, inode)];
     while (current)
     {
         if (current->device == device && current->inode == inode)
-        {
-            pthread_mutex_unlock(&tracker->mutex);
-            return 1; // Already exists (loop detected)
-        }
+            return current;
         current = current->next;
     }
+    return NULL;
+}
 
-    // Add new inode
-    InodeNode *new_node = malloc(sizeof(InodeNode));
-    if (!new_node)
+// Double the bucket array once the load factor reaches 1
+static void grow_inode_tracker(InodeTracker *tracker)
+{
+    size_t old_count = tracker->bucket_count;
+    InodeNode **old_buckets = tracker->buckets;
+    InodeNode **buckets = calloc(old_count * 2, sizeof(InodeNode *));
+    if (!buckets)
+        return; // Keep the longer chains
+
+    tracker->buckets = buckets;
+    tracker->bucket_count = old_count * 2;
+    for (size_t i = 0; i < old_count; i++)
     {
-        pthread_mutex_unlock(&tracker->mutex);
-        return -1;
+        InodeNode *current = old_buckets[i];
+        while (current)
+        {
+            InodeNode *next = current->next;
+            size_t bucket = inode_bucket(tracker, current->device, current->inode);
+            current->next = buckets[bucket];
+            buckets[bucket] = current;
+            current = next;
+        }
     }
+    free(old_buckets);
+}
 
-    new_node->device = device;
+int add_inode_path(InodeTracker *tracker, dev_t device, ino_t inode, const char *path)
+{
+    pthread_mutex_lock(&tracker->mutex);
+
+    // Check if inode already exists
+    if (find_inode_node(tracker, device, inode))
+    {
+        pthread_mutex_unlock(&tracker->mutex);
+        return 1; // Already exists (loop or duplicate detected)
+    }
+
+    if (tracker->count >= tracker->bucket_count)
+        grow_inode_tracker(tracker);
+
+    // Add new inode
+    InodeNode *new_node = malloc(sizeof(InodeNode));
+    char *path_copy = path ? strdup(path) : NULL;
+    if (!new_node || (path && !path_copy))
+    {
+        free(new_node);
+        free(path_copy);
+        pthread_mutex_unlock(&tracker->mutex);
+        return -1;
+    }
+
+    size_t bucket = inode_bucket(tracker, device, inode);
+    new_node->device = device;
     new_node->inode = inode;
-    new_node->next = tracker->head;
-    tracker->head = new_node;
+    new_node->path = path_copy;
+    new_node->next = tracker->buckets[bucket];
+    tracker->buckets[bucket] = new_node;
+    tracker->count++;
 
     pthread_mutex_unlock(&tracker->mutex);
     return 0; // Added successfully
 }
 
+int add_inode(InodeTracker *tracker, dev_t device, ino_t inode)
+{
+    return add_inode_path(tracker, device, inode, NULL);
+}
+
 int has_inode(InodeTracker *tracker, dev_t device, ino_t inode)
 {
     pthread_mutex_lock(&tracker->mutex);
+    int found = find_inode_node(tracker, device, inode) != NULL;
+    pthread_mutex_unlock(&tracker->mutex);
+    return found;
+}
 
-    InodeNode *current = tracker->head;
-    while (current)
-    {
-        if (current->device == device && current->inode == inode)
-        {
-            pthread_mutex_unlock(&tracker->mutex);
-            return 1; // Found
-        }
-        current = current->next;
-    }
-
+const char *find_inode_path(InodeTracker *tracker, dev_t device, ino_t inode)
+{
+    pthread_mutex_lock(&tracker->mutex);
+    InodeNode *node = find_inode_node(tracker, device, inode);
     pthread_mutex_unlock(&tracker->mutex);
-    return 0; // Not found
+    return node ? node->path : NULL;
 }
 
 void free_inode_tracker(InodeTracker *tracker)
 {
     pthread_mutex_lock(&tracker->mutex);
 
-    InodeNode *current = tracker->head;
-    while (current)
+    for (size_t i = 0; i < tracker->bucket_count; i++)
     {
-        InodeNode *next = current->next;
-        free(current);
-        current = next;
+        InodeNode *current = tracker->buckets[i];
+        while (current)
+        {
+            InodeNode *next = current->next;
+            free(current->path);
+            free(current);
+            current = next;
+        }
     }
-    tracker->head = NULL;
+    free(tracker->buckets);
+    tracker->buckets = NULL;
+    tracker->bucket_count = 0;
+    tracker->count = 0;
 
     pthread_mutex_unlock(&tracker->mutex);
     pthread_mutex_destroy(&tracker->mutex);
@@ -774,592 +1255,2322 @@ char *wide_to_utf8(const wchar_t *wide_path)
 
 #endif
 
-// Enhanced directory processing with proper symlink handling
-static void process_directory_recursive(const char *base_path, const char *current_path,
-                                        ExcludeList *excludes, BinaryHandling binary_handling,
-                                        SymlinkHandling symlink_handling, FILE *output_file,
-                                        InodeTracker *inode_tracker, int show_size, int level,
-                                        unsigned long long *total_size, int write_structure
-#ifdef WITH_PLUGINS
-                                        ,
-                                        PluginManager *plugin_manager
-#endif
-)
+// Filesystem types that can be denied with --exclude-fs (statfs f_type magic numbers)
+typedef struct
 {
-    char path[MAX_PATH];
-    if (safe_path_join(path, sizeof(path), base_path, current_path) < 0)
+    const char *name;
+    unsigned long magic;
+    const char *group; // "network" or "pseudo", NULL if not part of a group
+} FsTypeEntry;
+
+static const FsTypeEntry fs_type_table[] = {
+    {"nfs", 0x6969UL, "network"},
+    {"smb", 0x517BUL, "network"},
+    {"cifs", 0xFF534D42UL, "network"},
+    {"smb2", 0xFE534D42UL, "network"},
+    {"9p", 0x01021997UL, "network"},
+    {"ceph", 0x00C36400UL, "network"},
+    {"afs", 0x5346414FUL, "network"},
+    {"coda", 0x73757245UL, "network"},
+    {"fuse", 0x65735546UL, "network"},
+    {"proc", 0x9FA0UL, "pseudo"},
+    {"sysfs", 0x62656572UL, "pseudo"},
+    {"devpts", 0x1CD1UL, "pseudo"},
+    {"debugfs", 0x64626720UL, "pseudo"},
+    {"tracefs", 0x74726163UL, "pseudo"},
+    {"securityfs", 0x73636673UL, "pseudo"},
+    {"cgroup", 0x27E0EBUL, "pseudo"},
+    {"cgroup2", 0x63677270UL, "pseudo"},
+    {"bpf", 0xCAFE4A11UL, "pseudo"},
+    {"pstore", 0x6165676CUL, "pseudo"},
+    {"mqueue", 0x19800202UL, "pseudo"},
+    {"configfs", 0x62656570UL, "pseudo"},
+    {"efivarfs", 0xDE5E81E4UL, "pseudo"},
+    {"binfmt_misc", 0x42494E4DUL, "pseudo"},
+    {"autofs", 0x0187UL, NULL},
+    {"tmpfs", 0x01021994UL, NULL},
+    {"overlay", 0x794C7630UL, NULL},
+    {"hugetlbfs", 0x958458F6UL, NULL},
+};
+
+#define FS_TYPE_COUNT (sizeof(fs_type_table) / sizeof(fs_type_table[0]))
+
+static int add_excluded_fs_magic(ProcessingContext *ctx, unsigned long magic)
+{
+    for (int i = 0; i < ctx->excluded_fs_count; i++)
     {
-        return;
+        if (ctx->excluded_fs[i] == magic)
+            return 0;
     }
 
-#if defined(_WIN32) || defined(_WIN64)
-    WIN32_FIND_DATAW findData;
-    HANDLE hFind;
-
-    wchar_t *wide_path = utf8_to_wide(path);
-    if (!wide_path)
-        return;
-
-    wchar_t search_pattern[MAX_PATH];
-    swprintf(search_pattern, MAX_PATH, L"%ls\\*", wide_path);
-    free(wide_path);
+    if (ctx->excluded_fs_count >= MAX_EXCLUDED_FS)
+    {
+        fprintf(stderr, "Maximum number of excluded filesystem types (%d) reached\n", MAX_EXCLUDED_FS);
+        return -1;
+    }
 
-    hFind = FindFirstFileW(search_pattern, &findData);
-    if (hFind == INVALID_HANDLE_VALUE)
-        return;
+    ctx->excluded_fs[ctx->excluded_fs_count++] = magic;
+    return 0;
+}
 
-    do
+// Accepts a type name ("nfs"), a group ("network", "pseudo") or a raw magic ("0x6969")
+int add_excluded_fs_type(ProcessingContext *ctx, const char *name)
+{
+#ifndef __linux__
+    (void)ctx;
+    fprintf(stderr, "Filesystem type exclusion is only supported on Linux (ignoring '%s')\n", name);
+    return 0;
+#else
+    if (strncmp(name, "0x", 2) == 0 || strncmp(name, "0X", 2) == 0)
     {
-        if (wcscmp(findData.cFileName, L".") == 0 || wcscmp(findData.cFileName, L"..") == 0)
-            continue;
-
-        char *utf8_filename = wide_to_utf8(findData.cFileName);
-        if (!utf8_filename)
-            continue;
+        char *end;
+        unsigned long magic = strtoul(name + 2, &end, 16);
+        if (*end != '\0' || end == name + 2)
+            return -1;
+        return add_excluded_fs_magic(ctx, magic);
+    }
 
-        char new_relative_path[MAX_PATH];
-        if (strlen(current_path) > 0)
-        {
-            if (safe_path_join(new_relative_path, sizeof(new_relative_path), current_path, utf8_filename) < 0)
-            {
-                free(utf8_filename);
-                continue;
-            }
-        }
-        else
+    int matched = 0;
+    for (size_t i = 0; i < FS_TYPE_COUNT; i++)
+    {
+        if (strcasecmp(fs_type_table[i].name, name) == 0 ||
+            (fs_type_table[i].group && strcasecmp(fs_type_table[i].group, name) == 0))
         {
-            strncpy(new_relative_path, utf8_filename, sizeof(new_relative_path) - 1);
-            new_relative_path[sizeof(new_relative_path) - 1] = '\0';
+            if (add_excluded_fs_magic(ctx, fs_type_table[i].magic) != 0)
+                return -1;
+            matched = 1;
         }
+    }
 
-        if (is_excluded(new_relative_path, excludes))
-        {
-            free(utf8_filename);
-            continue;
-        }
+    return matched ? 0 : -1;
+#endif
+}
 
-        if (write_structure)
+const char *fs_type_name(unsigned long magic, int *network)
+{
+    for (size_t i = 0; i < FS_TYPE_COUNT; i++)
+    {
+        if (fs_type_table[i].magic == magic)
         {
-            // Generate structure output
-            char structure_line[MAX_PATH + 100];
-            int indent_len = level * 2;
+            *network = fs_type_table[i].group && strcmp(fs_type_table[i].group, "network") == 0;
+            return fs_type_table[i].name;
+        }
+    }
+    *network = 0;
+    return NULL;
+}
 
-            if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
-            {
-                snprintf(structure_line, sizeof(structure_line), "%*s📁 %s/\n",
-                         indent_len, "", utf8_filename);
-                fprintf(output_file, "%s", structure_line);
+// Files a --delta-from run found added or modified, in traversal order
+typedef struct
+{
+    char status; // '+' added, '~' modified, '-' deleted
+    char *path;
+    unsigned long long size;
+} DeltaChange;
 
-                // Recurse into subdirectory
-                process_directory_recursive(base_path, new_relative_path, excludes, binary_handling,
-                                            symlink_handling, output_file, inode_tracker, show_size, level + 1, total_size, write_structure
-#ifdef WITH_PLUGINS
-                                            ,
-                                            plugin_manager
-#endif
-                );
-            }
-            else
-            {
-                LARGE_INTEGER fileSize;
-                fileSize.LowPart = findData.nFileSizeLow;
-                fileSize.HighPart = findData.nFileSizeHigh;
+typedef struct
+{
+    DeltaChange *items;
+    size_t count;
+    size_t capacity;
+    unsigned long long counts[3]; // Added, modified, deleted
+    unsigned long long unchanged;
+} DeltaChanges;
+
+static void delta_record(DeltaChanges *changes, char status, const char *relative_path, unsigned long long size)
+{
+    if (changes->count == changes->capacity)
+    {
+        size_t capacity = changes->capacity ? changes->capacity * 2 : 64;
+        DeltaChange *items = realloc(changes->items, capacity * sizeof(*items));
+        if (!items)
+            return;
+        changes->items = items;
+        changes->capacity = capacity;
+    }
 
-                if (show_size)
-                {
-                    char size_buf[32];
-                    format_size(fileSize.QuadPart, size_buf, sizeof(size_buf));
-                    snprintf(structure_line, sizeof(structure_line), "%*s📄 [%s] %s\n",
-                             indent_len, "", size_buf, utf8_filename);
-                }
-                else
-                {
-                    snprintf(structure_line, sizeof(structure_line), "%*s📄 %s\n",
-                             indent_len, "", utf8_filename);
-                }
+    char *path = strdup(relative_path);
+    if (!path)
+        return;
+    changes->items[changes->count].status = status;
+    changes->items[changes->count].path = path;
+    changes->items[changes->count].size = size;
+    changes->count++;
+    changes->counts[status == '+' ? 0 : status == '~' ? 1 : 2]++;
+}
 
-                fprintf(output_file, "%s", structure_line);
-                *total_size += fileSize.QuadPart;
-            }
-        }
-        else
-        {
-            // File content processing
-            if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
-            {
-                char new_full_path[MAX_PATH];
-                if (safe_path_join(new_full_path, sizeof(new_full_path), base_path, new_relative_path) < 0)
-                {
-                    free(utf8_filename);
-                    continue;
-                }
+// Per-pass traversal state, shared by every level of the recursion
+typedef struct
+{
+    InodeTracker *inode_tracker;
+    InodeTracker *emitted; // Files already written, for cross-root dedupe (content pass, several roots)
+    StructureTree *tree;   // Structure pass only
+    DeltaChanges *changes; // Structure pass of a --delta-from run
+    int write_structure;
+    const char *label;   // Root label prefixed to relative paths, NULL with a single root
+    size_t label_length; // strlen("<label>/"), 0 with a single root
+#if !defined(_WIN32) && !defined(_WIN64)
+    struct EmitPool *pool; // Content pass with --jobs: renders file sections, NULL = serial
+    dev_t root_dev;
+    dev_t dir_dev; // Device of the directory being listed
+    // statfs magic per device, so statfs runs once per mount
+    dev_t fs_dev[64];
+    unsigned long fs_magic[64];
+    int fs_count;
+#endif
+} TraversalState;
 
-                // Check if file is binary
-                int is_binary = is_binary_file(new_full_path);
-                if (is_binary == 1)
-                {
-                    if (binary_handling == BINARY_SKIP)
-                    {
-                        if (is_verbose())
-                            fprintf(stderr, "[fconcat] Skipping binary file: %s\n", new_relative_path);
-                        free(utf8_filename);
-                        continue;
-                    }
-                    else if (binary_handling == BINARY_PLACEHOLDER)
-                    {
-                        fprintf(output_file, "// File: %s\n// [Binary file - content not displayed]\n\n", new_relative_path);
-                        free(utf8_filename);
-                        continue;
-                    }
-                }
+#if !defined(_WIN32) && !defined(_WIN64)
+static unsigned long device_fs_magic(TraversalState *state, const char *full_path, dev_t device)
+{
+#ifdef __linux__
+    for (int i = 0; i < state->fs_count; i++)
+    {
+        if (state->fs_dev[i] == device)
+            return state->fs_magic[i];
+    }
 
-                // Read and process file content
-                FILE *file = fopen(new_full_path, "rb");
-                if (file)
-                {
-                    fprintf(output_file, "// File: %s\n", new_relative_path);
+    struct statfs fs_info;
+    unsigned long magic = 0;
+    if (statfs(full_path, &fs_info) == 0)
+        magic = (unsigned long)fs_info.f_type & 0xFFFFFFFFUL;
 
-                    char buffer[PLUGIN_CHUNK_SIZE];
-                    size_t bytes_read;
-                    while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0)
-                    {
-#ifdef WITH_PLUGINS
-                        char *processed_data = NULL;
-                        size_t processed_size = 0;
-
-                        // Process through plugins if available
-                        if (plugin_manager)
-                        {
-                            if (process_file_through_plugins(plugin_manager, new_relative_path,
-                                                             buffer, bytes_read, &processed_data, &processed_size) == 0)
-                            {
-                                if (processed_data && processed_size > 0)
-                                {
-                                    fwrite(processed_data, 1, processed_size, output_file);
-                                    free(processed_data);
-                                }
-                            }
-                            else
-                            {
-                                // Plugin processing failed, write original data
-                                fwrite(buffer, 1, bytes_read, output_file);
-                            }
-                        }
-                        else
-                        {
-                            // No plugins, write original data
-                            fwrite(buffer, 1, bytes_read, output_file);
-                        }
+    if (state->fs_count < (int)(sizeof(state->fs_dev) / sizeof(state->fs_dev[0])))
+    {
+        state->fs_dev[state->fs_count] = device;
+        state->fs_magic[state->fs_count] = magic;
+        state->fs_count++;
+    }
+    return magic;
 #else
-                        // No plugin support, write original data
-                        fwrite(buffer, 1, bytes_read, output_file);
+    (void)state;
+    (void)full_path;
+    (void)device;
+    return 0;
 #endif
-                    }
+}
 
-                    fprintf(output_file, "\n\n");
-                    fclose(file);
-                }
-                else
-                {
-                    if (is_verbose())
-                        fprintf(stderr, "[fconcat] Cannot open file: %s\n", new_full_path);
-                }
-            }
-            else
-            {
-                // Recurse into subdirectory
-                process_directory_recursive(base_path, new_relative_path, excludes, binary_handling,
-                                            symlink_handling, output_file, inode_tracker, show_size, level + 1, total_size, write_structure
-#ifdef WITH_PLUGINS
-                                            ,
-                                            plugin_manager
-#endif
-                );
-            }
-        }
+static int is_excluded_filesystem(ProcessingContext *ctx, TraversalState *state,
+                                  const char *full_path, dev_t device)
+{
+    // The input directory's own filesystem is always allowed
+    if (device == state->root_dev)
+        return 0;
 
-        free(utf8_filename);
-    } while (FindNextFileW(hFind, &findData));
+    unsigned long magic = device_fs_magic(state, full_path, device);
+    for (int i = 0; i < ctx->excluded_fs_count; i++)
+    {
+        if (ctx->excluded_fs[i] == magic)
+        {
+            if (is_verbose())
+                fprintf(stderr, "[fconcat] Excluded filesystem (type 0x%lx): %s\n", magic, full_path);
+            return 1;
+        }
+    }
+    return 0;
+}
 
-    FindClose(hFind);
-#else
-    DIR *dir = opendir(path);
-    if (!dir)
-        return;
+// Network filesystems get AT_STATX_DONT_SYNC, so listing does not force attribute revalidation
+static int is_network_filesystem(TraversalState *state, const char *full_path, dev_t device)
+{
+    unsigned long magic = device_fs_magic(state, full_path, device);
+    for (size_t i = 0; i < FS_TYPE_COUNT; i++)
+    {
+        if (fs_type_table[i].magic == magic)
+            return fs_type_table[i].group && strcmp(fs_type_table[i].group, "network") == 0;
+    }
+    return 0;
+}
 
-    struct dirent *dp;
-    struct stat statbuf;
+// Metadata for a directory entry at the cheapest level this pass needs. d_type answers most
+// questions without a syscall: directories only need a stat for their device when a
+// filesystem boundary is enforced, and files only need one when their size is used.
+static int lookup_entry(ProcessingContext *ctx, int write_structure, TraversalState *state, int dir_fd,
+                        const DirEntry *de, int dont_sync, EntryMeta *entry)
+{
+    mode_t type = entry_type_from_dirent(de->type);
+    int need_stat;
+
+    if (type == 0)
+        need_stat = 1;
+    else if (S_ISDIR(type))
+        need_stat = ctx->one_file_system || ctx->excluded_fs_count > 0;
+    else if (S_ISLNK(type))
+        need_stat = 0; // The target is looked up separately
+    else
+        need_stat = !write_structure || ctx->show_size || ctx->delta_base;
 
-    while ((dp = readdir(dir)) != NULL)
+    if (!need_stat)
     {
-        if (strcmp(dp->d_name, ".") == 0 || strcmp(dp->d_name, "..") == 0)
-            continue;
+        memset(entry, 0, sizeof(*entry));
+        entry->mode = type;
+        entry->dev = state->dir_dev;
+        return 0;
+    }
 
-        char new_relative_path[MAX_PATH];
-        char new_full_path[MAX_PATH];
+    // Cross-root dedupe keys files by inode, manifests and deltas by mtime
+    MetaLevel level = (type != 0 && S_ISDIR(type))                           ? META_TYPE
+                      : state->emitted || ctx->delta_base || ctx->manifest ? META_FULL
+                                                                           : META_SIZE;
+    return entry_metadata(dir_fd, de->name, 0, level, dont_sync, entry);
+}
 
-        if (strlen(current_path) > 0)
-        {
-            if (safe_path_join(new_relative_path, sizeof(new_relative_path), current_path, dp->d_name) < 0)
-                continue;
-        }
-        else
-        {
-            strncpy(new_relative_path, dp->d_name, sizeof(new_relative_path) - 1);
-            new_relative_path[sizeof(new_relative_path) - 1] = '\0';
-        }
+// Symlink targets: loop detection needs the inode, placeholders only the size
+static MetaLevel symlink_target_level(SymlinkHandling symlink_handling)
+{
+    switch (symlink_handling)
+    {
+    case SYMLINK_FOLLOW:
+    case SYMLINK_INCLUDE:
+        return META_FULL;
+    case SYMLINK_PLACEHOLDER:
+        return META_SIZE;
+    default:
+        return META_TYPE;
+    }
+}
+#endif
 
-        if (safe_path_join(new_full_path, sizeof(new_full_path), path, dp->d_name) < 0)
-            continue;
+static int depth_exhausted(ProcessingContext *ctx, int level)
+{
+    return ctx->max_depth > 0 && level + 1 >= ctx->max_depth;
+}
 
-        if (is_excluded(new_relative_path, excludes))
-        {
-            continue;
-        }
+#if !defined(_WIN32) && !defined(_WIN64)
+// Returns STRUCTURE_NOTE_NONE when the directory may be entered, otherwise the reason shown in the structure
+static StructureNote descend_blocked_reason(ProcessingContext *ctx, TraversalState *state,
+                                            const char *full_path, dev_t device, int level)
+{
+    StructureNote note = STRUCTURE_NOTE_NONE;
+    if (depth_exhausted(ctx, level))
+        note = STRUCTURE_NOTE_MAX_DEPTH;
+    else if (ctx->one_file_system && device != state->root_dev)
+        note = STRUCTURE_NOTE_OTHER_FILESYSTEM;
+    else if (ctx->excluded_fs_count > 0 && is_excluded_filesystem(ctx, state, full_path, device))
+        note = STRUCTURE_NOTE_EXCLUDED_FILESYSTEM;
+
+    if (note != STRUCTURE_NOTE_NONE)
+        FCONCAT_PROBE2(dir_blocked, full_path, note);
+    return note;
+}
+#endif
 
-        // Use lstat to handle symlinks properly
-        if (lstat(new_full_path, &statbuf) == -1)
-        {
-            if (is_verbose())
-                fprintf(stderr, "[fconcat] Cannot access: %s (%s)\n", new_full_path, strerror(errno));
-            continue;
-        }
+static volatile sig_atomic_t g_stop_requested = 0;
 
-        if (write_structure)
-        {
-            // Generate structure output
-            char structure_line[MAX_PATH + 100];
-            int indent_len = level * 2;
+void request_processing_stop(void)
+{
+    g_stop_requested = 1;
+}
 
-            if (S_ISLNK(statbuf.st_mode))
-            {
-                // Handle symbolic link
-                struct stat target_stat;
-                int stat_result = stat(new_full_path, &target_stat);
+int processing_stop_requested(void)
+{
+    return g_stop_requested != 0;
+}
 
-                if (stat_result == -1)
-                {
-                    // Broken symlink
-                    snprintf(structure_line, sizeof(structure_line), "%*s🔗 %s -> [BROKEN LINK]\n",
-                             indent_len, "", dp->d_name);
-                    fprintf(output_file, "%s", structure_line);
-                }
-                else
-                {
-                    // Valid symlink
-                    if (symlink_handling == SYMLINK_SKIP)
-                    {
-                        snprintf(structure_line, sizeof(structure_line), "%*s🔗 %s -> [SYMLINK SKIPPED]\n",
-                                 indent_len, "", dp->d_name);
-                        fprintf(output_file, "%s", structure_line);
-                    }
-                    else if (symlink_handling == SYMLINK_PLACEHOLDER)
-                    {
-                        if (S_ISDIR(target_stat.st_mode))
-                        {
-                            snprintf(structure_line, sizeof(structure_line), "%*s🔗 %s/ -> [SYMLINK TO DIR]\n",
-                                     indent_len, "", dp->d_name);
-                        }
-                        else
-                        {
-                            if (show_size)
-                            {
-                                char size_buf[32];
-                                format_size(target_stat.st_size, size_buf, sizeof(size_buf));
-                                snprintf(structure_line, sizeof(structure_line), "%*s🔗 [%s] %s -> [SYMLINK]\n",
-                                         indent_len, "", size_buf, dp->d_name);
-                            }
-                            else
-                            {
-                                snprintf(structure_line, sizeof(structure_line), "%*s🔗 %s -> [SYMLINK]\n",
-                                         indent_len, "", dp->d_name);
-                            }
-                            *total_size += target_stat.st_size;
-                        }
-                        fprintf(output_file, "%s", structure_line);
-                    }
-                    else if (symlink_handling == SYMLINK_FOLLOW || symlink_handling == SYMLINK_INCLUDE)
-                    {
-                        // Check for loops
-                        if (has_inode(inode_tracker, target_stat.st_dev, target_stat.st_ino))
-                        {
-                            snprintf(structure_line, sizeof(structure_line), "%*s🔗 %s -> [LOOP DETECTED]\n",
-                                     indent_len, "", dp->d_name);
-                            fprintf(output_file, "%s", structure_line);
-                        }
-                        else
-                        {
-                            // Add inode to tracker
-                            add_inode(inode_tracker, target_stat.st_dev, target_stat.st_ino);
-
-                            if (S_ISDIR(target_stat.st_mode) && symlink_handling == SYMLINK_FOLLOW)
-                            {
-                                snprintf(structure_line, sizeof(structure_line), "%*s🔗 %s/ -> [FOLLOWING]\n",
-                                         indent_len, "", dp->d_name);
-                                fprintf(output_file, "%s", structure_line);
-
-                                // Recurse into symlinked directory
-                                process_directory_recursive(base_path, new_relative_path, excludes, binary_handling,
-                                                            symlink_handling, output_file, inode_tracker, show_size, level + 1, total_size, write_structure
 #ifdef WITH_PLUGINS
-                                                            ,
-                                                            plugin_manager
+// Set once plugin spans went to an output through writev(), behind stdio's cached offset
+static int g_spans_written = 0;
 #endif
-                                );
-                            }
-                            else if (!S_ISDIR(target_stat.st_mode))
-                            {
-                                if (show_size)
-                                {
-                                    char size_buf[32];
-                                    format_size(target_stat.st_size, size_buf, sizeof(size_buf));
-                                    snprintf(structure_line, sizeof(structure_line), "%*s🔗 [%s] %s\n",
-                                             indent_len, "", size_buf, dp->d_name);
-                                }
-                                else
-                                {
-                                    snprintf(structure_line, sizeof(structure_line), "%*s🔗 %s\n",
-                                             indent_len, "", dp->d_name);
-                                }
-                                fprintf(output_file, "%s", structure_line);
-                                *total_size += target_stat.st_size;
-                            }
-                        }
-                    }
-                }
-            }
-            else if (S_ISDIR(statbuf.st_mode))
-            {
-                snprintf(structure_line, sizeof(structure_line), "%*s📁 %s/\n",
-                         indent_len, "", dp->d_name);
-                fprintf(output_file, "%s", structure_line);
 
-                // Recurse into subdirectory
-                process_directory_recursive(base_path, new_relative_path, excludes, binary_handling,
-                                            symlink_handling, output_file, inode_tracker, show_size, level + 1, total_size, write_structure
+static unsigned long long output_position(FILE *output)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    return (unsigned long long)_ftelli64(output);
+#else
 #ifdef WITH_PLUGINS
-                                            ,
-                                            plugin_manager
+    if (g_spans_written && fileno(output) >= 0 && fflush(output) == 0)
+    {
+        off_t position = lseek(fileno(output), 0, SEEK_CUR);
+        if (position >= 0)
+            return (unsigned long long)position;
+    }
 #endif
-                );
-            }
-            else
-            {
-                if (show_size)
-                {
-                    char size_buf[32];
-                    format_size(statbuf.st_size, size_buf, sizeof(size_buf));
-                    snprintf(structure_line, sizeof(structure_line), "%*s📄 [%s] %s\n",
-                             indent_len, "", size_buf, dp->d_name);
-                }
-                else
-                {
-                    snprintf(structure_line, sizeof(structure_line), "%*s📄 %s\n",
-                             indent_len, "", dp->d_name);
-                }
-
-                fprintf(output_file, "%s", structure_line);
-                *total_size += statbuf.st_size;
-            }
-        }
-        else
-        {
-            // File content processing
-            if (S_ISLNK(statbuf.st_mode))
-            {
-                if (symlink_handling == SYMLINK_SKIP)
-                {
-                    continue;
-                }
+    return (unsigned long long)ftello(output);
+#endif
+}
 
-                // Check if symlink is valid
-                struct stat target_stat;
-                if (stat(new_full_path, &target_stat) == -1)
-                {
-                    // Broken symlink
-                    if (symlink_handling == SYMLINK_PLACEHOLDER)
-                    {
-                        fprintf(output_file, "// File: %s\n// [Broken symlink - target not accessible]\n\n", new_relative_path);
-                    }
-                    continue;
+// Make everything up to the cursor durable, then record the cursor
+static void checkpoint_sync(ProcessingContext *ctx)
+{
+    Checkpoint *checkpoint = ctx->checkpoint;
+    fflush(ctx->output_file);
+#if defined(_WIN32) || defined(_WIN64)
+    _commit(_fileno(ctx->output_file));
+#else
+    fsync(fileno(ctx->output_file));
+#endif
+    checkpoint_save(checkpoint->path, &checkpoint->progress);
+    checkpoint->last_write = time(NULL);
+}
+
+// Content-pass cursor. Returns 1 when the entry was already written by the run being resumed.
+static int cursor_skip_entry(ProcessingContext *ctx, const char *relative_path)
+{
+    Checkpoint *checkpoint = ctx->checkpoint;
+    if (!checkpoint)
+        return 0;
+
+    checkpoint->ordinal++;
+    if (!checkpoint->resuming || checkpoint->ordinal > checkpoint->resume.entries_done)
+        return 0;
+
+    if (checkpoint->ordinal == checkpoint->resume.entries_done &&
+        strcmp(relative_path, checkpoint->resume.last_path) != 0)
+    {
+        fprintf(stderr, "Error: entry %llu is '%s', but checkpoint '%s' expects '%s'\n",
+                checkpoint->ordinal, relative_path, checkpoint->path, checkpoint->resume.last_path);
+        checkpoint->mismatch = 1;
+        request_processing_stop();
+    }
+    return 1;
+}
+
+// Record the entry with the given traversal ordinal as written. With --jobs the walk is ahead of
+// the output, so the ordinal is the one the entry got when it was submitted.
+static void cursor_entry_done_at(ProcessingContext *ctx, const char *relative_path, unsigned long long ordinal)
+{
+    Checkpoint *checkpoint = ctx->checkpoint;
+    // An entry cut short by a stop request is not complete; resume truncates it away
+    if (!checkpoint || processing_stop_requested())
+        return;
+
+    checkpoint->progress.entries_done = ordinal;
+    checkpoint->progress.output_offset = output_position(ctx->output_file);
+    strncpy(checkpoint->progress.last_path, relative_path, sizeof(checkpoint->progress.last_path) - 1);
+    checkpoint->progress.last_path[sizeof(checkpoint->progress.last_path) - 1] = '\0';
+
+    if (time(NULL) - checkpoint->last_write >= checkpoint->interval)
+        checkpoint_sync(ctx);
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+static void cursor_entry_done(ProcessingContext *ctx, const char *relative_path)
+{
+    if (ctx->checkpoint)
+        cursor_entry_done_at(ctx, relative_path, ctx->checkpoint->ordinal);
+}
+#endif
+
+// Write part of a file section to one sink and remember its last byte for {eol}
+static void write_body(OutputSink *sink, const void *data, size_t len)
+{
+    if (len == 0)
+        return;
+    FCONCAT_PROBE3(chunk_write, sink->fields.path, len, 1);
+    if (sink->chunked)
+        chunker_feed(&sink->chunker, data, len, sink->file);
+    else if (sink->xml_escaped)
+        template_write_xml(data, len, 0, sink->file);
+    else
+        fwrite(data, 1, len, sink->file);
+    sink->fields.last_byte = ((const unsigned char *)data)[len - 1];
+}
+
+#ifdef WITH_PLUGINS
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// Write a plugin chain's gather list. Outputs with a descriptor get the spans through writev()
+// once stdio's buffer is flushed, so unchanged bytes are never copied; memory streams and the
+// --direct-io writer take them through fwrite(). Chunk records and XML sections escape the
+// spans through write_body().
+static void write_spans(OutputSink *sink, GatherSpan *spans, size_t count)
+{
+    if (count == 0)
+        return;
+    if (sink->chunked || sink->xml_escaped)
+    {
+        for (size_t i = 0; i < count; i++)
+            write_body(sink, spans[i].iov_base, spans[i].iov_len);
+        return;
+    }
+    const GatherSpan *last = &spans[count - 1];
+    int last_byte = ((const unsigned char *)last->iov_base)[last->iov_len - 1];
+#if FCONCAT_PROBES_ENABLED
+    size_t bytes = 0;
+    for (size_t i = 0; i < count; i++)
+        bytes += spans[i].iov_len;
+    FCONCAT_PROBE3(chunk_write, sink->fields.path, bytes, count);
+#endif
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    int fd = fileno(sink->file);
+    if (fd >= 0 && fflush(sink->file) == 0)
+    {
+        g_spans_written = 1;
+        while (count > 0)
+        {
+            ssize_t written = writev(fd, spans, count < IOV_MAX ? (int)count : IOV_MAX);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+                break; // What is left goes through stdio, which records the error
+            while (count > 0 && (size_t)written >= spans->iov_len)
+            {
+                written -= (ssize_t)spans->iov_len;
+                spans++;
+                count--;
+            }
+            if (count > 0)
+            {
+                spans->iov_base = (char *)spans->iov_base + written;
+                spans->iov_len -= (size_t)written;
+            }
+        }
+    }
+#endif
+
+    for (size_t i = 0; i < count; i++)
+        fwrite(spans[i].iov_base, 1, spans[i].iov_len, sink->file);
+    sink->fields.last_byte = last_byte;
+}
+#endif
+
+// Write the same bytes to every sink
+static void write_body_all(ProcessingContext *ctx, const void *data, size_t len)
+{
+    for (int i = 0; i < ctx->sink_count; i++)
+        write_body(&ctx->sinks[i], data, len);
+}
+
+// Write section-independent text (structure, section titles) to every sink that has sections
+static void write_text_all(ProcessingContext *ctx, const char *text)
+{
+    for (int i = 0; i < ctx->sink_count; i++)
+    {
+        if (!ctx->sinks[i].chunked)
+            fputs(text, ctx->sinks[i].file);
+    }
+}
+
+// {lines}/{hash}/{fence} demand across every sink's templates
+typedef struct
+{
+    int header_lines;
+    int header_hash;
+    int footer_lines;
+    int footer_hash;
+    int fence; // The header opens the fence the footer closes, so either one needs the pre-scan
+} TemplateNeeds;
+
+static void sink_template_needs(ProcessingContext *ctx, TemplateNeeds *needs)
+{
+    memset(needs, 0, sizeof(*needs));
+    for (int i = 0; i < ctx->sink_count; i++)
+    {
+        if (ctx->sinks[i].chunked)
+            continue;
+        needs->header_lines |= ctx->sinks[i].header_template->needs_lines;
+        needs->header_hash |= ctx->sinks[i].header_template->needs_hash;
+        needs->footer_lines |= ctx->sinks[i].footer_template->needs_lines;
+        needs->footer_hash |= ctx->sinks[i].footer_template->needs_hash;
+        needs->fence |= ctx->sinks[i].header_template->needs_fence || ctx->sinks[i].footer_template->needs_fence;
+    }
+}
+
+// Line, hash and backtick accounting over the raw file bytes, for templates that reference them
+typedef struct
+{
+    int count_lines;
+    int hash_content;
+    int measure_fence;
+    unsigned long long newlines;
+    int last_byte;
+    ContentHash hash;
+    unsigned int backticks;         // Length of the backtick run at the end of the bytes so far
+    unsigned int longest_backticks;
+} ContentStats;
+
+static void content_stats_init(ContentStats *stats, int count_lines, int hash_content)
+{
+    stats->count_lines = count_lines;
+    stats->hash_content = hash_content;
+    stats->measure_fence = 0;
+    stats->newlines = 0;
+    stats->last_byte = -1;
+    stats->backticks = 0;
+    stats->longest_backticks = 0;
+    if (hash_content)
+        content_hash_init(&stats->hash);
+}
+
+// Backtick runs, which may continue across reads
+static void content_stats_backticks(ContentStats *stats, const char *data, size_t len)
+{
+    const char *p = data;
+    const char *end = data + len;
+    while (p < end)
+    {
+        if (*p != '`')
+        {
+            stats->backticks = 0;
+            p = memchr(p, '`', (size_t)(end - p));
+            if (!p)
+                return;
+        }
+        while (p < end && *p == '`')
+        {
+            stats->backticks++;
+            p++;
+        }
+        if (stats->backticks > stats->longest_backticks)
+            stats->longest_backticks = stats->backticks;
+    }
+}
+
+static void content_stats_update(ContentStats *stats, const char *data, size_t len)
+{
+    if (len == 0)
+        return;
+
+    if (stats->count_lines)
+    {
+        const char *p = data;
+        const char *end = data + len;
+        while ((p = memchr(p, '\n', (size_t)(end - p))) != NULL)
+        {
+            stats->newlines++;
+            p++;
+        }
+        stats->last_byte = (unsigned char)data[len - 1];
+    }
+
+    if (stats->hash_content)
+        content_hash_update(&stats->hash, data, len);
+    if (stats->measure_fence)
+        content_stats_backticks(stats, data, len);
+}
+
+static void content_stats_apply(const ContentStats *stats, TemplateFields *fields)
+{
+    if (stats->count_lines)
+        fields->lines = stats->newlines + (stats->last_byte != -1 && stats->last_byte != '\n' ? 1 : 0);
+    if (stats->hash_content)
+        fields->hash = content_hash_final(&stats->hash);
+    if (stats->measure_fence)
+        fields->fence = stats->longest_backticks + 1;
+}
+
+// A file's content; for an s3:// root, a stream of ranged GETs over the object
+static FILE *open_content(ProcessingContext *ctx, const char *full_path, unsigned long long size)
+{
+    if (ctx->object_store && is_object_url(full_path))
+        return object_store_open(ctx->object_store, full_path, size);
+    return fopen(full_path, "rb");
+}
+
+// Pre-read a file when the header itself needs {lines}, {hash} or {fence}
+static void scan_content_stats(ProcessingContext *ctx, const char *full_path, unsigned long long size,
+                               TemplateFields *fields, int count_lines, int hash_content, int measure_fence)
+{
+    FILE *file = open_content(ctx, full_path, size);
+    if (!file)
+        return;
+
+    ContentStats stats;
+    content_stats_init(&stats, count_lines, hash_content);
+    stats.measure_fence = measure_fence;
+
+    char buffer[BUFFER_SIZE * 16];
+    size_t bytes_read;
+    while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        content_stats_update(&stats, buffer, bytes_read);
+
+    content_stats_apply(&stats, fields);
+    fclose(file);
+}
+
+static void init_file_fields(TemplateFields *fields, const char *relative_path, int is_symlink,
+                             unsigned long long size, const TemplateFields *precomputed)
+{
+    memset(fields, 0, sizeof(*fields));
+    if (precomputed)
+    {
+        fields->lines = precomputed->lines;
+        fields->hash = precomputed->hash;
+        fields->fence = precomputed->fence;
+    }
+    fields->path = relative_path;
+    fields->size = size;
+    fields->is_symlink = is_symlink;
+    fields->last_byte = -1;
+}
+
+static void begin_file(ProcessingContext *ctx, const char *relative_path, int is_symlink,
+                       unsigned long long size, const TemplateFields *precomputed)
+{
+    for (int i = 0; i < ctx->sink_count; i++)
+    {
+        OutputSink *sink = &ctx->sinks[i];
+        init_file_fields(&sink->fields, relative_path, is_symlink, size, precomputed);
+        if (sink->chunked)
+            chunker_begin(&sink->chunker, &ctx->chunking, relative_path);
+        else
+            template_render(sink->header_template, &sink->fields, sink->file);
+    }
+}
+
+// Footer fields gathered while streaming apply to every sink
+static void apply_content_stats(ProcessingContext *ctx, const ContentStats *stats)
+{
+    for (int i = 0; i < ctx->sink_count; i++)
+        content_stats_apply(stats, &ctx->sinks[i].fields);
+}
+
+static void end_file(ProcessingContext *ctx)
+{
+    for (int i = 0; i < ctx->sink_count; i++)
+    {
+        OutputSink *sink = &ctx->sinks[i];
+        if (sink->chunked)
+            chunker_end(&sink->chunker, sink->file);
+        else
+            template_render(sink->footer_template, &sink->fields, sink->file);
+    }
+}
+
+// A file section whose body is a one-line note instead of the content
+static void emit_placeholder(ProcessingContext *ctx, const char *relative_path, unsigned long long size,
+                             const char *note)
+{
+    begin_file(ctx, relative_path, 0, size, NULL);
+    write_body_all(ctx, note, strlen(note));
+    end_file(ctx);
+}
+
+#ifdef WITH_PLUGINS
+static int sink_has_plugins(const OutputSink *sink)
+{
+    return sink->plugin_manager && sink->plugin_manager->count > 0;
+}
+
+// Aggregating plugins of every sink, in sink then chain order: the k-th owns partials[k]
+#define MAX_AGGREGATORS ((MAX_SINKS + 1) * MAX_PLUGINS)
+
+static const PluginAggregator *aggregator_at(const ProcessingContext *ctx, int sink, int plugin)
+{
+    PluginManager *manager = ctx->sinks[sink].plugin_manager;
+    if (!manager || plugin >= manager->count || !manager->plugins[plugin])
+        return NULL;
+    return manager->plugins[plugin]->aggregator;
+}
+
+// One partial per aggregating plugin for the calling thread. Returns the number of partials.
+static int aggregate_start(ProcessingContext *ctx, void **partials)
+{
+    int count = 0;
+    for (int i = 0; i < ctx->sink_count; i++)
+    {
+        for (int j = 0; j < MAX_PLUGINS; j++)
+        {
+            const PluginAggregator *aggregator = aggregator_at(ctx, i, j);
+            if (aggregator)
+                partials[count++] = aggregator->create();
+        }
+    }
+    ctx->aggregate_partials = count > 0 ? partials : NULL;
+    return count;
+}
+
+static void aggregate_chunk(ProcessingContext *ctx, const char *relative_path, const char *data, size_t size)
+{
+    if (!ctx->aggregate_partials)
+        return;
+
+    int k = 0;
+    for (int i = 0; i < ctx->sink_count; i++)
+    {
+        for (int j = 0; j < MAX_PLUGINS; j++)
+        {
+            const PluginAggregator *aggregator = aggregator_at(ctx, i, j);
+            if (!aggregator)
+                continue;
+            void *partial = ctx->aggregate_partials[k++];
+            if (partial)
+                aggregator->map(partial, relative_path, data, size);
+        }
+    }
+}
+
+// Fold a worker's partials into the calling thread's and destroy them
+static void aggregate_merge(ProcessingContext *ctx, void **from)
+{
+    if (!ctx->aggregate_partials)
+        return;
+
+    int k = 0;
+    for (int i = 0; i < ctx->sink_count; i++)
+    {
+        for (int j = 0; j < MAX_PLUGINS; j++)
+        {
+            const PluginAggregator *aggregator = aggregator_at(ctx, i, j);
+            if (!aggregator)
+                continue;
+            void **into = &ctx->aggregate_partials[k];
+            if (*into && from[k])
+                aggregator->merge(*into, from[k]);
+            if (from[k])
+                aggregator->destroy(from[k]);
+            from[k] = NULL;
+            k++;
+        }
+    }
+}
+
+// Append each aggregating plugin's summary to its sink when the run completed, then free the partials
+static void aggregate_finish(ProcessingContext *ctx, int write_summaries)
+{
+    if (!ctx->aggregate_partials)
+        return;
+
+    int k = 0;
+    for (int i = 0; i < ctx->sink_count; i++)
+    {
+        for (int j = 0; j < MAX_PLUGINS; j++)
+        {
+            const PluginAggregator *aggregator = aggregator_at(ctx, i, j);
+            if (!aggregator)
+                continue;
+            void *partial = ctx->aggregate_partials[k++];
+            if (!partial)
+                continue;
+
+            // A summary is not a file: chunked outputs carry none
+            char *summary = NULL;
+            size_t summary_size = 0;
+            if (write_summaries && !ctx->sinks[i].chunked && aggregator->finalize &&
+                aggregator->finalize(partial, &summary, &summary_size) == 0 && summary && summary_size > 0)
+            {
+                FILE *out = ctx->sinks[i].file;
+                const char *name = ctx->sinks[i].plugin_manager->plugins[j]->name;
+                int title_length = fprintf(out, "\nSummary (%s):\n", name) - 2;
+                for (int c = 0; c < title_length; c++)
+                    fputc('=', out);
+                fputs("\n\n", out);
+                fwrite(summary, 1, summary_size, out);
+                if (summary[summary_size - 1] != '\n')
+                    fputc('\n', out);
+            }
+            free(summary);
+            aggregator->destroy(partial);
+        }
+    }
+    ctx->aggregate_partials = NULL;
+}
+#endif
+
+// Stream a file's content in chunks: each chunk is read once and handed to every sink's
+// plugin chain by reference. Stops after limit bytes, 0 = the whole file.
+static void stream_file_content(ProcessingContext *ctx, FILE *file, const char *relative_path,
+                                ContentStats *stats, unsigned long long limit)
+{
+#ifdef WITH_PLUGINS
+    for (int i = 0; i < ctx->sink_count; i++)
+    {
+        if (sink_has_plugins(&ctx->sinks[i]))
+            plugin_session_begin(ctx->sinks[i].plugin_manager, &ctx->sinks[i].session, relative_path);
+    }
+    PluginGather gather;
+    plugin_gather_init(&gather);
+#else
+    (void)relative_path;
+#endif
+
+    char buffer[PLUGIN_CHUNK_SIZE];
+    size_t bytes_read;
+    size_t want = limit > 0 && limit < sizeof(buffer) ? (size_t)limit : sizeof(buffer);
+    while (!g_stop_requested && want > 0 && (bytes_read = fread(buffer, 1, want, file)) > 0)
+    {
+        if (limit > 0)
+        {
+            limit -= bytes_read;
+            want = limit < sizeof(buffer) ? (size_t)limit : sizeof(buffer);
+        }
+        content_stats_update(stats, buffer, bytes_read);
+#ifdef WITH_PLUGINS
+        aggregate_chunk(ctx, relative_path, buffer, bytes_read);
+#endif
+
+        for (int i = 0; i < ctx->sink_count; i++)
+        {
+            OutputSink *sink = &ctx->sinks[i];
+#ifdef WITH_PLUGINS
+            // Process through the sink's plugins if it has any
+            if (sink_has_plugins(sink))
+            {
+                if (plugin_session_gather(sink->plugin_manager, &sink->session, buffer, bytes_read, &gather) == 0)
+                    write_spans(sink, gather.lists[gather.current], gather.counts[gather.current]);
+                else
+                {
+                    // Plugin processing failed, write original data
+                    write_body(sink, buffer, bytes_read);
                 }
+                continue;
+            }
+#endif
+            write_body(sink, buffer, bytes_read);
+        }
+    }
+
+#ifdef WITH_PLUGINS
+    aggregate_chunk(ctx, relative_path, NULL, 0);
+
+    // Whatever the plugins held back is flushed before the footer
+    for (int i = 0; i < ctx->sink_count; i++)
+    {
+        OutputSink *sink = &ctx->sinks[i];
+        if (!sink_has_plugins(sink))
+            continue;
+
+        char *final_data = NULL;
+        size_t final_size = 0;
+        plugin_session_end(sink->plugin_manager, &sink->session, &final_data, &final_size);
+        write_body(sink, final_data, final_size);
+        free(final_data);
+    }
+    plugin_gather_free(&gather);
+#endif
+}
+
+#define ENCODE_READ_SIZE (64 * 1024)
+
+// Include a binary file as base64 or hex lines, followed by its content hash. Returns 1 with the
+// hash when the content was read, 0 for a placeholder, -1 when the file could not be opened.
+static int emit_encoded_file(ProcessingContext *ctx, const char *full_path, const char *relative_path,
+                             int is_symlink, unsigned long long size, uint64_t *content_hash)
+{
+    BinaryEncoding encoding = ctx->binary_handling == BINARY_HEX ? ENCODING_HEX : ENCODING_BASE64;
+    const char *encoding_name = encoding == ENCODING_HEX ? "hex" : "base64";
+    char note[160];
+
+    if (ctx->binary_max_size > 0 && size > ctx->binary_max_size)
+    {
+        char size_buf[32], limit_buf[32];
+        format_size(size, size_buf, sizeof(size_buf));
+        format_size(ctx->binary_max_size, limit_buf, sizeof(limit_buf));
+        snprintf(note, sizeof(note), "// [Binary file - %s exceeds the %s %s limit]",
+                 size_buf, limit_buf, encoding_name);
+        emit_placeholder(ctx, relative_path, size, note);
+        return 0;
+    }
+
+    FILE *file = open_content(ctx, full_path, size);
+    if (!file)
+    {
+        if (is_verbose())
+            fprintf(stderr, "[fconcat] Cannot open file: %s\n", full_path);
+        return -1;
+    }
+
+    size_t buffers_size = ENCODE_READ_SIZE + stream_encoder_bound(encoding, ENCODE_READ_SIZE);
+    unsigned char *input = malloc(ENCODE_READ_SIZE);
+    char *encoded = malloc(stream_encoder_bound(encoding, ENCODE_READ_SIZE));
+    if (!input || !encoded)
+    {
+        fprintf(stderr, "Memory allocation failed encoding %s\n", relative_path);
+        free(input);
+        free(encoded);
+        fclose(file);
+        return -1;
+    }
+    if (ctx->governor)
+        governor_charge(ctx->governor, buffers_size);
+
+    TemplateNeeds needs;
+    sink_template_needs(ctx, &needs);
+    TemplateFields precomputed;
+    memset(&precomputed, 0, sizeof(precomputed));
+    if (needs.header_lines || needs.header_hash)
+        scan_content_stats(ctx, full_path, size, &precomputed, needs.header_lines, 1, 0);
+
+    begin_file(ctx, relative_path, is_symlink, size, &precomputed);
+
+    snprintf(note, sizeof(note), "// [Binary file - %s, %llu bytes]\n", encoding_name, size);
+    write_body_all(ctx, note, strlen(note));
+
+    StreamEncoder encoder;
+    ContentStats stats;
+    stream_encoder_init(&encoder, encoding);
+    content_stats_init(&stats, needs.footer_lines && !needs.header_lines, 1);
+
+    size_t bytes_read;
+    while (!g_stop_requested && (bytes_read = fread(input, 1, ENCODE_READ_SIZE, file)) > 0)
+    {
+        content_stats_update(&stats, (const char *)input, bytes_read);
+        size_t encoded_len = stream_encoder_update(&encoder, input, bytes_read, encoded);
+        write_body_all(ctx, encoded, encoded_len);
+    }
+    size_t encoded_len = stream_encoder_finish(&encoder, encoded);
+    write_body_all(ctx, encoded, encoded_len);
+
+    apply_content_stats(ctx, &stats);
+    *content_hash = content_hash_final(&stats.hash);
+    snprintf(note, sizeof(note), "// [xxh64: %016llx]", (unsigned long long)*content_hash);
+    write_body_all(ctx, note, strlen(note));
+    end_file(ctx);
+
+    free(input);
+    free(encoded);
+    if (ctx->governor)
+        governor_release(ctx->governor, buffers_size);
+    fclose(file);
+    return 1;
+}
+
+#ifdef HAVE_REFLINK
+// Reflink assembly: block size and device of the output, 0 when clones are not attempted
+static unsigned long g_reflink_block = 0;
+static dev_t g_reflink_dev = 0;
+
+// Pad before the header so the body starts on a block boundary, clone the block-aligned part
+// of the body from the input with FICLONERANGE, then copy the unaligned tail. Returns -1 when
+// the file was left untouched and must be emitted normally.
+static int emit_reflinked(ProcessingContext *ctx, const char *full_path, const char *relative_path,
+                          int is_symlink, unsigned long long size)
+{
+    int src = open(full_path, O_RDONLY | O_CLOEXEC);
+    if (src < 0)
+        return -1;
+
+    struct stat src_stat;
+    unsigned long long block = g_reflink_block;
+    if (fstat(src, &src_stat) != 0 || src_stat.st_dev != g_reflink_dev ||
+        (unsigned long long)src_stat.st_size < block)
+    {
+        close(src);
+        return -1;
+    }
+    unsigned long long aligned = (unsigned long long)src_stat.st_size / block * block;
+
+    // The body is never streamed in full, so template line counts and hashes come from a pre-scan.
+    // Reflink runs have a single sink.
+    OutputSink *sink = &ctx->sinks[0];
+    int count_lines = sink->header_template->needs_lines || sink->footer_template->needs_lines;
+    int hash_content = sink->header_template->needs_hash || sink->footer_template->needs_hash;
+    int measure_fence = sink->header_template->needs_fence || sink->footer_template->needs_fence;
+    TemplateFields precomputed;
+    memset(&precomputed, 0, sizeof(precomputed));
+    if (count_lines || hash_content || measure_fence)
+        scan_content_stats(ctx, full_path, size, &precomputed, count_lines, hash_content, measure_fence);
+
+    // Render the header first: its length decides the padding
+    init_file_fields(&sink->fields, relative_path, is_symlink, size, &precomputed);
+    char *header_text = NULL;
+    size_t header_length = 0;
+    FILE *header_stream = open_memstream(&header_text, &header_length);
+    if (!header_stream)
+    {
+        close(src);
+        return -1;
+    }
+    template_render(sink->header_template, &sink->fields, header_stream);
+    fclose(header_stream);
+
+    // The padding is a single line of spaces
+    FILE *out = sink->file;
+    unsigned long long start = output_position(out);
+    unsigned long long pad = (block - (start + header_length) % block) % block;
+    for (unsigned long long i = 1; i < pad; i++)
+        fputc(' ', out);
+    if (pad > 0)
+        fputc('\n', out);
+    fwrite(header_text, 1, header_length, out);
+    free(header_text);
+    fflush(out);
+
+    unsigned long long body = start + pad + header_length;
+    struct file_clone_range range;
+    range.src_fd = src;
+    range.src_offset = 0;
+    range.src_length = aligned;
+    range.dest_offset = body;
+
+    unsigned long long tail = 0;
+    if (ioctl(fileno(out), FICLONERANGE, &range) == 0)
+    {
+        fseeko(out, (off_t)(body + aligned), SEEK_SET);
+        tail = aligned;
+
+        unsigned char last;
+        if (pread(src, &last, 1, (off_t)(aligned - 1)) == 1)
+            sink->fields.last_byte = last;
+    }
+    else
+    {
+        // The output filesystem cannot share extents: copy from now on
+        if (is_verbose())
+            fprintf(stderr, "[fconcat] Reflink unavailable (%s), copying file bodies\n", strerror(errno));
+        g_reflink_block = 0;
+    }
+
+    FILE *file = fdopen(src, "rb");
+    if (!file)
+    {
+        close(src);
+        end_file(ctx);
+        return 0;
+    }
+    if (tail > 0)
+        fseeko(file, (off_t)tail, SEEK_SET);
+
+    ContentStats stats;
+    content_stats_init(&stats, 0, 0);
+    stream_file_content(ctx, file, relative_path, &stats, 0);
+
+    end_file(ctx);
+    fclose(file);
+    return 0;
+}
+#endif
+
+// Enable reflink assembly when the output is a regular file, the only sink, and no plugin rewrites the bodies
+static void reflink_prepare(ProcessingContext *ctx)
+{
+    if (!ctx->reflink)
+        return;
+
+#ifdef HAVE_REFLINK
+    struct stat out_stat;
+    g_reflink_block = 0;
+    if (ctx->sink_count > 1)
+    {
+        if (is_verbose())
+            fprintf(stderr, "[fconcat] Reflink disabled: --sink outputs need the bodies copied\n");
+        return;
+    }
+    if (ctx->sinks[0].chunked || ctx->sinks[0].xml_escaped)
+    {
+        if (is_verbose())
+            fprintf(stderr, "[fconcat] Reflink disabled: %s escape the file bodies\n",
+                    ctx->sinks[0].chunked ? "chunk records" : "XML sections");
+        return;
+    }
+    if (ctx->jobs > 1)
+    {
+        if (is_verbose())
+            fprintf(stderr, "[fconcat] Reflink disabled: --jobs workers render sections in memory\n");
+        return;
+    }
+#ifdef WITH_PLUGINS
+    if (ctx->plugin_manager && ctx->plugin_manager->count > 0)
+    {
+        if (is_verbose())
+            fprintf(stderr, "[fconcat] Reflink disabled: plugins rewrite file bodies\n");
+        return;
+    }
+#endif
+    if (fstat(fileno(ctx->output_file), &out_stat) != 0 || !S_ISREG(out_stat.st_mode) || out_stat.st_blksize <= 0)
+    {
+        if (is_verbose())
+            fprintf(stderr, "[fconcat] Reflink disabled: output is not a regular file\n");
+        return;
+    }
+    g_reflink_block = (unsigned long)out_stat.st_blksize;
+    g_reflink_dev = out_stat.st_dev;
+    if (is_verbose())
+        fprintf(stderr, "[fconcat] Reflink assembly: %lu-byte blocks\n", g_reflink_block);
+#else
+    if (is_verbose())
+        fprintf(stderr, "[fconcat] Reflink is not supported on this platform, copying file bodies\n");
+#endif
+}
+
+// Close the section of a truncated file with a note after the kept bytes
+static void write_truncation_note(ProcessingContext *ctx, const char *note)
+{
+    for (int i = 0; i < ctx->sink_count; i++)
+    {
+        OutputSink *sink = &ctx->sinks[i];
+        if (sink->fields.last_byte != -1 && sink->fields.last_byte != '\n')
+            write_body(sink, "\n", 1);
+        write_body(sink, note, strlen(note));
+        write_body(sink, "\n", 1);
+    }
+}
+
+// Write one file's header, content and footer according to the binary and generated-file
+// handling modes. Returns 1 with the content hash when the content was read and a manifest is
+// being written, 0 when the file was handled without one, -1 when it could not be opened.
+static int emit_file(ProcessingContext *ctx, const char *full_path, const char *relative_path,
+                     int is_symlink, unsigned long long size, uint64_t *content_hash)
+{
+    // One open serves the sniff window and the content
+    FILE *file = open_content(ctx, full_path, size);
+    if (!file)
+    {
+        if (is_verbose())
+            fprintf(stderr, "[fconcat] Cannot open file: %s\n", full_path);
+        return -1;
+    }
+    FCONCAT_PROBE2(file_open, relative_path, size);
+    unsigned char sniff[BINARY_CHECK_SIZE];
+    size_t sniffed = fread(sniff, 1, sizeof(sniff), file);
+
+    int is_binary = sniff_is_binary(sniff, sniffed);
+    GeneratedReason reason = GENERATED_REASON_NONE;
+    GeneratedSignals signals;
+    if (ctx->generated_handling != GENERATED_INCLUDE && !is_binary)
+        reason = detect_generated(relative_path, sniff, sniffed, &signals);
+    FCONCAT_PROBE3(file_classify, relative_path, is_binary, reason);
+    if (is_binary && ctx->binary_handling != BINARY_INCLUDE)
+    {
+        fclose(file);
+        if (ctx->binary_handling == BINARY_BASE64 || ctx->binary_handling == BINARY_HEX)
+            return emit_encoded_file(ctx, full_path, relative_path, is_symlink, size, content_hash);
+        if (ctx->binary_handling == BINARY_PLACEHOLDER)
+            emit_placeholder(ctx, relative_path, size,
+                             is_symlink ? "// [Binary symlink file - content not displayed]"
+                                        : "// [Binary file - content not displayed]");
+        else if (is_verbose())
+            fprintf(stderr, "[fconcat] Skipping binary file: %s\n", relative_path);
+        return 0;
+    }
+
+    // Generated files are decided from the same window, before the rest is read
+    unsigned long long limit = 0;
+    char note[160];
+    if (reason != GENERATED_REASON_NONE)
+    {
+        const char *label = generated_reason_name(reason);
+        if (is_verbose() && reason >= GENERATED_REASON_MINIFIED)
+            fprintf(stderr, "[fconcat] Generated file (%s; max line %zu, average %zu, entropy %.2f): %s\n",
+                    label, signals.max_line, signals.average_line, signals.entropy, relative_path);
+        else if (is_verbose())
+            fprintf(stderr, "[fconcat] Generated file (%s): %s\n", label, relative_path);
+
+        if (ctx->generated_handling == GENERATED_SKIP)
+        {
+            fclose(file);
+            return 0;
+        }
+        if (ctx->generated_handling == GENERATED_PLACEHOLDER)
+        {
+            fclose(file);
+            snprintf(note, sizeof(note), "// [Generated file (%s) - content not displayed]", label);
+            emit_placeholder(ctx, relative_path, size, note);
+            return 0;
+        }
+        if (size > ctx->generated_keep)
+        {
+            char kept_buf[32], size_buf[32];
+            format_size(ctx->generated_keep, kept_buf, sizeof(kept_buf));
+            format_size(size, size_buf, sizeof(size_buf));
+            snprintf(note, sizeof(note), "// [Generated file (%s) truncated - %s of %s shown]", label,
+                     kept_buf, size_buf);
+            limit = ctx->generated_keep;
+        }
+    }
+
+#ifdef HAVE_REFLINK
+    if (limit == 0 && g_reflink_block > 0 && size >= g_reflink_block && !is_object_url(full_path) &&
+        emit_reflinked(ctx, full_path, relative_path, is_symlink, size) == 0)
+    {
+        fclose(file);
+        return 0;
+    }
+#endif
+
+    // Read and process file content
+    if (sniffed > 0 && fseek(file, 0, SEEK_SET) != 0)
+    {
+        fclose(file);
+        return -1;
+    }
+
+    TemplateNeeds needs;
+    sink_template_needs(ctx, &needs);
+    int want_hash = ctx->manifest != NULL && limit == 0;
+    TemplateFields precomputed;
+    memset(&precomputed, 0, sizeof(precomputed));
+    if (needs.header_lines || needs.header_hash || needs.fence)
+        scan_content_stats(ctx, full_path, size, &precomputed, needs.header_lines, needs.header_hash, needs.fence);
+
+    begin_file(ctx, relative_path, is_symlink, size, &precomputed);
+
+    // Footer fields not already known from the pre-scan are gathered while streaming
+    ContentStats stats;
+    content_stats_init(&stats, needs.footer_lines && !needs.header_lines,
+                       (needs.footer_hash || want_hash) && !needs.header_hash);
+    stream_file_content(ctx, file, relative_path, &stats, limit);
+    apply_content_stats(ctx, &stats);
+    if (limit > 0)
+        write_truncation_note(ctx, note);
+
+    end_file(ctx);
+    fclose(file);
+
+    // A truncated section is recorded without a hash: it does not show the whole content
+    if (!want_hash)
+        return 0;
+    *content_hash = needs.header_hash ? precomputed.hash : content_hash_final(&stats.hash);
+    return 1;
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+// A content pass entry: what to write for it and what to record once it is written
+typedef enum
+{
+    SECTION_FILE, // emit_file()
+    SECTION_NOTE, // A placeholder section
+    SECTION_NONE  // Nothing written (unchanged in a delta), only recorded
+} SectionKind;
+
+typedef struct
+{
+    SectionKind kind;
+    char *full_path;
+    char *relative_path;
+    const char *note; // SECTION_NOTE body, owned by the pool when queued
+    int is_symlink;
+    unsigned long long size;
+    int record; // Add to the --manifest with the stamp below
+    long long mtime_sec;
+    long mtime_nsec;
+    int hashed; // emit_file() result, or the carried-over hash of SECTION_NONE
+    uint64_t content_hash;
+
+    // --jobs: the section rendered by a worker, one buffer per sink
+    char *outputs[MAX_SINKS + 1];
+    size_t output_sizes[MAX_SINKS + 1];
+    int deferred; // Rendered by the walking thread when its turn comes instead
+    int done;
+    unsigned long long reserved; // Bytes held from the memory governor until written
+    unsigned long long ordinal;  // Checkpoint ordinal of the entry, taken when submitted
+} Section;
+
+static void render_section(ProcessingContext *ctx, Section *section)
+{
+    switch (section->kind)
+    {
+    case SECTION_FILE:
+    {
+        unsigned long long started = ctx->metrics ? metrics_now_ns() : 0;
+        section->hashed = emit_file(ctx, section->full_path, section->relative_path, section->is_symlink,
+                                    section->size, &section->content_hash);
+        if (ctx->metrics)
+            metrics_file_done(ctx->metrics, section->size, section->hashed < 0, metrics_now_ns() - started);
+        break;
+    }
+    case SECTION_NOTE:
+        emit_placeholder(ctx, section->relative_path, section->size, section->note);
+        break;
+    case SECTION_NONE:
+        break;
+    }
+}
+
+// --metrics: count what the primary output grew by since the last count
+static void metrics_count_output(ProcessingContext *ctx)
+{
+    unsigned long long position = output_position(ctx->output_file);
+    if (position > ctx->metrics_output_mark)
+        metrics_add(&ctx->metrics->output_bytes, position - ctx->metrics_output_mark);
+    ctx->metrics_output_mark = position;
+}
+
+// Bookkeeping once a section is in the output, in traversal order
+static void finish_section(ProcessingContext *ctx, const Section *section)
+{
+    if (ctx->manifest && section->record && section->hashed >= 0)
+        manifest_writer_add(ctx->manifest, section->relative_path, section->size, section->mtime_sec,
+                            section->mtime_nsec, section->hashed, section->content_hash);
+    cursor_entry_done_at(ctx, section->relative_path, section->ordinal);
+    if (ctx->metrics)
+        metrics_count_output(ctx);
+}
+
+// --jobs: worker threads render file sections into memory, the walking thread writes them in
+// traversal order. Files above EMIT_INLINE_SIZE are streamed by the walking thread instead of
+// being held in memory, and so are sections that do not fit the --max-memory budget.
+#define EMIT_QUEUE_PER_WORKER 4
+#define EMIT_SECTION_SLACK 1024 // Header and footer bytes assumed per sink before rendering
+
+typedef struct EmitPool EmitPool;
+
+typedef struct
+{
+    EmitPool *pool;
+    pthread_t thread;
+    ProcessingContext ctx; // The run's context, writing to this worker's sinks
+    OutputSink sinks[MAX_SINKS + 1];
+#ifdef WITH_PLUGINS
+    void *partials[MAX_AGGREGATORS];
+#endif
+    unsigned long long rendered_bytes; // Primary output rendered, for --stats=hw
+} EmitWorker;
+
+struct EmitPool
+{
+    ProcessingContext *ctx;
+    Section *ring;
+    size_t capacity;
+    size_t head; // Oldest section not yet written
+    size_t next; // Next section for a worker
+    size_t tail; // Next free slot
+    int stopping;
+    pthread_mutex_t mutex;
+    pthread_cond_t work; // Workers: a section was queued or the pool is stopping
+    pthread_cond_t done; // Walker: a section was rendered
+    EmitWorker *workers;
+    int worker_count;
+};
+
+// --metrics queue depths; called with the pool mutex held
+static void emit_pool_note_depth(EmitPool *pool)
+{
+    Metrics *metrics = pool->ctx->metrics;
+    if (!metrics)
+        return;
+    metrics_gauge_set(&metrics->sections_queued, (long long)(pool->tail > pool->next ? pool->tail - pool->next : 0));
+    metrics_gauge_set(&metrics->sections_in_flight, (long long)(pool->tail - pool->head));
+}
+
+// Render a section into one memory stream per sink; without memory streams it is deferred
+static void render_section_buffered(EmitWorker *worker, Section *section)
+{
+    ProcessingContext *ctx = &worker->ctx;
+    int opened = 0;
+    for (; opened < ctx->sink_count; opened++)
+    {
+        worker->sinks[opened].file = open_memstream(&section->outputs[opened], &section->output_sizes[opened]);
+        if (!worker->sinks[opened].file)
+            break;
+    }
+
+    if (opened == ctx->sink_count)
+        render_section(ctx, section);
+    else
+        section->deferred = 1;
+
+    unsigned long long rendered = 0;
+    for (int i = 0; i < opened; i++)
+    {
+        fclose(worker->sinks[i].file);
+        worker->sinks[i].file = NULL;
+        if (section->deferred)
+        {
+            free(section->outputs[i]);
+            section->outputs[i] = NULL;
+            section->output_sizes[i] = 0;
+        }
+        rendered += section->output_sizes[i];
+    }
+    worker->rendered_bytes += section->output_sizes[0];
+
+    // Replace the estimate with what is actually held; plugins and encodings change the size
+    if (ctx->governor && rendered > section->reserved)
+        governor_charge(ctx->governor, rendered - section->reserved);
+    else if (ctx->governor)
+        governor_release(ctx->governor, section->reserved - rendered);
+    section->reserved = rendered;
+}
+
+static void *emit_worker_thread(void *arg)
+{
+    EmitWorker *worker = arg;
+    EmitPool *pool = worker->pool;
+    HwThreadCounters counters;
+    if (worker->ctx.hw_stats)
+    {
+        hw_thread_open(worker->ctx.hw_stats, &counters);
+        hw_stage_begin(&counters);
+    }
+    Metrics *metrics = worker->ctx.metrics;
+    if (metrics)
+        metrics_gauge_add(&metrics->workers, 1);
+
+    pthread_mutex_lock(&pool->mutex);
+    for (;;)
+    {
+        while (pool->next == pool->tail && !pool->stopping)
+            pthread_cond_wait(&pool->work, &pool->mutex);
+        if (pool->next == pool->tail)
+            break;
+
+        Section *section = &pool->ring[pool->next++ % pool->capacity];
+        emit_pool_note_depth(pool);
+        if (section->done)
+            continue; // Deferred or nothing to render: the walking thread handles it
+        pthread_mutex_unlock(&pool->mutex);
+
+        if (metrics)
+            metrics_gauge_add(&metrics->workers_busy, 1);
+        render_section_buffered(worker, section);
+        if (metrics)
+            metrics_gauge_add(&metrics->workers_busy, -1);
+
+        pthread_mutex_lock(&pool->mutex);
+        section->done = 1;
+        pthread_cond_broadcast(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (metrics)
+        metrics_gauge_add(&metrics->workers, -1);
+    if (worker->ctx.hw_stats)
+    {
+        hw_stage_end(worker->ctx.hw_stats, &counters, HW_STAGE_RENDER, worker->rendered_bytes);
+        hw_thread_close(&counters);
+    }
+    return NULL;
+}
+
+static int emit_pool_head_done(EmitPool *pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    int done = pool->head != pool->tail && pool->ring[pool->head % pool->capacity].done;
+    pthread_mutex_unlock(&pool->mutex);
+    return done;
+}
+
+// Wait for the oldest section, write it to every sink and record it
+static void emit_pool_write_head(EmitPool *pool)
+{
+    ProcessingContext *ctx = pool->ctx;
+    Section *section = &pool->ring[pool->head % pool->capacity];
+
+    pthread_mutex_lock(&pool->mutex);
+    while (!section->done)
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (section->deferred)
+        render_section(ctx, section);
+    for (int i = 0; i < ctx->sink_count; i++)
+    {
+        if (section->output_sizes[i] > 0)
+            fwrite(section->outputs[i], 1, section->output_sizes[i], ctx->sinks[i].file);
+        free(section->outputs[i]);
+    }
+    if (ctx->governor)
+        governor_release(ctx->governor, section->reserved);
+    finish_section(ctx, section);
+
+    free(section->full_path);
+    free(section->relative_path);
+    free((char *)section->note);
+
+    // Sections the workers never picked up were written by this thread: they are not theirs anymore
+    pthread_mutex_lock(&pool->mutex);
+    memset(section, 0, sizeof(*section));
+    pool->head++;
+    if (pool->next < pool->head)
+        pool->next = pool->head;
+    emit_pool_note_depth(pool);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+static void emit_pool_flush(EmitPool *pool)
+{
+    while (pool->head != pool->tail)
+        emit_pool_write_head(pool);
+}
+
+// Reserve a buffered section's estimated size. Near the limit the sections in flight are written
+// first, which holds back reading ahead; a section that still does not fit is not buffered.
+static int emit_pool_reserve(EmitPool *pool, unsigned long long size, unsigned long long *reserved)
+{
+    MemoryGovernor *governor = pool->ctx->governor;
+    unsigned long long estimate = (size + EMIT_SECTION_SLACK) * (unsigned long long)pool->ctx->sink_count;
+    if (!governor)
+        return 0;
+
+    if (governor_try_acquire(governor, estimate) != 0)
+    {
+        governor_note_throttled(governor);
+        do
+        {
+            if (pool->head == pool->tail)
+            {
+                governor_note_streamed(governor);
+                if (is_verbose())
+                    fprintf(stderr, "[fconcat] Memory budget: streaming a %llu-byte section without buffering\n", size);
+                return -1;
+            }
+            emit_pool_write_head(pool);
+        } while (governor_try_acquire(governor, estimate) != 0);
+    }
+    *reserved = estimate;
+    return 0;
+}
+
+// Queue a section behind the ones already in flight, writing finished ones as they become ready
+static void emit_pool_submit(EmitPool *pool, const Section *request)
+{
+    if (pool->tail - pool->head == pool->capacity)
+        emit_pool_write_head(pool);
+
+    unsigned long long reserved = 0;
+    int deferred = request->kind == SECTION_FILE && request->size > EMIT_INLINE_SIZE;
+    if (request->kind == SECTION_FILE && !deferred)
+        deferred = emit_pool_reserve(pool, request->size, &reserved) != 0;
+
+    Section *section = &pool->ring[pool->tail % pool->capacity];
+    *section = *request;
+    section->full_path = request->full_path ? strdup(request->full_path) : NULL;
+    section->relative_path = strdup(request->relative_path);
+    section->note = request->note ? strdup(request->note) : NULL;
+    if ((request->full_path && !section->full_path) || !section->relative_path || (request->note && !section->note))
+    {
+        // Out of memory: write everything in flight, then this section directly
+        if (pool->ctx->governor)
+            governor_release(pool->ctx->governor, reserved);
+        free(section->full_path);
+        free(section->relative_path);
+        free((char *)section->note);
+        memset(section, 0, sizeof(*section));
+        emit_pool_flush(pool);
+        Section direct = *request;
+        render_section(pool->ctx, &direct);
+        finish_section(pool->ctx, &direct);
+        return;
+    }
+
+    section->deferred = deferred;
+    section->done = request->kind == SECTION_NONE || section->deferred;
+    section->reserved = reserved;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->tail++;
+    emit_pool_note_depth(pool);
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->mutex);
+
+    while (emit_pool_head_done(pool))
+        emit_pool_write_head(pool);
+}
+
+// Start up to ctx->jobs workers. Returns 0 with at least one running, -1 to stay serial.
+static int emit_pool_start(EmitPool *pool, ProcessingContext *ctx)
+{
+    int jobs = ctx->jobs < MAX_JOBS ? ctx->jobs : MAX_JOBS;
+    memset(pool, 0, sizeof(*pool));
+    pool->ctx = ctx;
+    pool->capacity = (size_t)jobs * EMIT_QUEUE_PER_WORKER;
+    pool->ring = calloc(pool->capacity, sizeof(*pool->ring));
+    pool->workers = calloc((size_t)jobs, sizeof(*pool->workers));
+    if (!pool->ring || !pool->workers)
+    {
+        free(pool->ring);
+        free(pool->workers);
+        return -1;
+    }
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (int i = 0; i < jobs; i++)
+    {
+        EmitWorker *worker = &pool->workers[pool->worker_count];
+        worker->pool = pool;
+        worker->ctx = *ctx;
+        worker->ctx.checkpoint = NULL;
+        for (int s = 0; s < ctx->sink_count; s++)
+        {
+            worker->sinks[s] = ctx->sinks[s];
+            worker->sinks[s].file = NULL;
+        }
+        worker->ctx.sinks = worker->sinks;
+#ifdef WITH_PLUGINS
+        aggregate_start(&worker->ctx, worker->partials);
+#endif
+        if (pthread_create(&worker->thread, NULL, emit_worker_thread, worker) != 0)
+        {
+#ifdef WITH_PLUGINS
+            aggregate_merge(ctx, worker->partials);
+#endif
+            break;
+        }
+        pool->worker_count++;
+    }
+
+    if (pool->worker_count == 0)
+    {
+        pthread_cond_destroy(&pool->done);
+        pthread_cond_destroy(&pool->work);
+        pthread_mutex_destroy(&pool->mutex);
+        free(pool->ring);
+        free(pool->workers);
+        return -1;
+    }
+    if (is_verbose())
+        fprintf(stderr, "[fconcat] Content pass: %d worker threads, %zu sections in flight\n",
+                pool->worker_count, pool->capacity);
+    return 0;
+}
+
+// Write what is still queued, stop the workers and fold their aggregation partials into the run's
+static void emit_pool_stop(EmitPool *pool)
+{
+    emit_pool_flush(pool);
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (int i = 0; i < pool->worker_count; i++)
+    {
+        pthread_join(pool->workers[i].thread, NULL);
+#ifdef WITH_PLUGINS
+        aggregate_merge(pool->ctx, pool->workers[i].partials);
+#endif
+    }
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool->ring);
+    free(pool->workers);
+}
+
+static void submit_section(ProcessingContext *ctx, TraversalState *state, Section *section)
+{
+    section->ordinal = ctx->checkpoint ? ctx->checkpoint->ordinal : 0;
+    if (state->pool)
+    {
+        emit_pool_submit(state->pool, section);
+        return;
+    }
+    render_section(ctx, section);
+    finish_section(ctx, section);
+}
+
+// A content pass entry written as a placeholder note (symlinks not followed, broken symlinks)
+static void emit_note_entry(ProcessingContext *ctx, TraversalState *state, const char *relative_path,
+                            unsigned long long size, const char *note)
+{
+    if (cursor_skip_entry(ctx, relative_path))
+        return;
+
+    Section section;
+    memset(&section, 0, sizeof(section));
+    section.kind = SECTION_NOTE;
+    section.relative_path = (char *)relative_path;
+    section.note = note;
+    section.size = size;
+    submit_section(ctx, state, &section);
+}
+
+// With several roots, a file reachable more than once (overlapping roots, hard links) is written
+// once. Returns the path it was first written under, or NULL after recording this one.
+static const char *duplicate_of(TraversalState *state, const EntryMeta *meta, const char *relative_path)
+{
+    if (!state->emitted)
+        return NULL;
+
+    const char *original = find_inode_path(state->emitted, meta->dev, meta->ino);
+    if (original)
+        return original;
+
+    add_inode_path(state->emitted, meta->dev, meta->ino, relative_path);
+    return NULL;
+}
+
+// Structure pass of a --delta-from run: compare a file with the previous manifest. Only a file
+// whose size is unchanged but whose mtime moved is read, to compare content hashes.
+static void delta_classify(ProcessingContext *ctx, TraversalState *state, const char *full_path,
+                           const char *relative_path, const EntryMeta *meta)
+{
+    if (!state->changes)
+        return;
+
+    ManifestEntry *previous = manifest_find(ctx->delta_base, relative_path);
+    if (!previous)
+    {
+        if (ctx->metrics)
+            metrics_add(&ctx->metrics->cache_misses, 1);
+        delta_record(state->changes, '+', relative_path, meta->size);
+        return;
+    }
+    if (previous->status != MANIFEST_UNSEEN)
+        return;
+
+    int unchanged = 0;
+    if (previous->size == meta->size)
+    {
+        if (previous->mtime_sec == meta->mtime_sec && previous->mtime_nsec == meta->mtime_nsec)
+        {
+            unchanged = 1;
+        }
+        else if (previous->has_hash)
+        {
+            TemplateFields scanned;
+            memset(&scanned, 0, sizeof(scanned));
+            scan_content_stats(ctx, full_path, meta->size, &scanned, 0, 1, 0);
+            unchanged = scanned.hash == previous->hash;
+        }
+    }
+
+    previous->status = unchanged ? MANIFEST_UNCHANGED : MANIFEST_MODIFIED;
+    if (ctx->metrics)
+        metrics_add(unchanged ? &ctx->metrics->cache_hits : &ctx->metrics->cache_misses, 1);
+    if (unchanged)
+        state->changes->unchanged++;
+    else
+        delta_record(state->changes, '~', relative_path, meta->size);
+}
+
+// Content pass: the file section of a regular file or symlink target. A --delta-from run skips
+// files the structure pass found unchanged; --manifest records every file either way.
+static void emit_entry(ProcessingContext *ctx, TraversalState *state, const char *full_path,
+                       const char *relative_path, int is_symlink, const EntryMeta *meta)
+{
+    const char *original = duplicate_of(state, meta, relative_path);
+    if (cursor_skip_entry(ctx, relative_path))
+        return;
+
+    ManifestEntry *previous = ctx->delta_base ? manifest_find(ctx->delta_base, relative_path) : NULL;
+    char note[MAX_PATH + 32];
+    Section section;
+    memset(&section, 0, sizeof(section));
+    section.full_path = (char *)full_path;
+    section.relative_path = (char *)relative_path;
+    section.is_symlink = is_symlink;
+    section.size = meta->size;
+    section.record = 1;
+    section.mtime_sec = meta->mtime_sec;
+    section.mtime_nsec = meta->mtime_nsec;
+
+    if (previous && previous->status == MANIFEST_UNCHANGED)
+    {
+        section.kind = SECTION_NONE;
+        section.content_hash = previous->hash;
+        section.hashed = previous->has_hash;
+    }
+    else if (original)
+    {
+        snprintf(note, sizeof(note), "// [Duplicate of %s]", original);
+        section.kind = SECTION_NOTE;
+        section.note = note;
+    }
+    else
+    {
+        section.kind = SECTION_FILE;
+    }
+    submit_section(ctx, state, &section);
+}
+#endif
+
+// Relative path of a child entry; with several roots it starts with the root's label
+static int child_relative_path(TraversalState *state, char *dest, size_t dest_size,
+                               const char *current_path, const char *name)
+{
+    if (current_path[0])
+        return safe_path_join(dest, dest_size, current_path, name);
+    if (state->label)
+        return safe_path_join(dest, dest_size, state->label, name);
+
+    strncpy(dest, name, dest_size - 1);
+    dest[dest_size - 1] = '\0';
+    return 0;
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+// Enhanced directory processing with proper symlink handling
+static void process_directory_recursive(ProcessingContext *ctx, TraversalState *state,
+                                        const char *current_path, int level)
+{
+    const char *base_path = ctx->base_path;
+    int write_structure = state->write_structure;
+
+    // Relative paths carry the root label; the filesystem and exclude patterns see them without it
+    char path[MAX_PATH];
+    if (safe_path_join(path, sizeof(path), base_path, current_path + (current_path[0] ? state->label_length : 0)) < 0)
+    {
+        return;
+    }
+
+    int listed = 0;
+
+    WIN32_FIND_DATAW findData;
+    HANDLE hFind;
+
+    wchar_t *wide_path = utf8_to_wide(path);
+    if (!wide_path)
+        return;
+
+    wchar_t search_pattern[MAX_PATH];
+    swprintf(search_pattern, MAX_PATH, L"%ls\\*", wide_path);
+    free(wide_path);
+
+    hFind = FindFirstFileW(search_pattern, &findData);
+    if (hFind == INVALID_HANDLE_VALUE)
+        return;
+
+    do
+    {
+        if (g_stop_requested)
+            break;
+
+        if (wcscmp(findData.cFileName, L".") == 0 || wcscmp(findData.cFileName, L"..") == 0)
+            continue;
+
+        char *utf8_filename = wide_to_utf8(findData.cFileName);
+        if (!utf8_filename)
+            continue;
+
+        char new_relative_path[MAX_PATH];
+        if (child_relative_path(state, new_relative_path, sizeof(new_relative_path), current_path, utf8_filename) < 0)
+        {
+            free(utf8_filename);
+            continue;
+        }
+
+        if (is_excluded(new_relative_path + state->label_length, ctx->excludes))
+        {
+            free(utf8_filename);
+            continue;
+        }
+
+        if (ctx->max_dir_entries > 0 && listed >= ctx->max_dir_entries)
+        {
+            free(utf8_filename);
+            if (write_structure)
+            {
+                unsigned long omitted = 1;
+                while (FindNextFileW(hFind, &findData))
+                    omitted++;
+                structure_tree_add_omitted(state->tree, level, omitted);
+            }
+            break;
+        }
+        listed++;
 
-                // Valid symlink
-                if (symlink_handling == SYMLINK_FOLLOW || symlink_handling == SYMLINK_INCLUDE)
-                {
-                    // Check for loops
-                    if (has_inode(inode_tracker, target_stat.st_dev, target_stat.st_ino))
-                    {
-                        if (is_verbose())
-                            fprintf(stderr, "[fconcat] Symlink loop detected: %s\n", new_relative_path);
-                        continue;
-                    }
-
-                    add_inode(inode_tracker, target_stat.st_dev, target_stat.st_ino);
-
-                    if (S_ISDIR(target_stat.st_mode) && symlink_handling == SYMLINK_FOLLOW)
-                    {
-                        process_directory_recursive(base_path, new_relative_path, excludes, binary_handling,
-                                                    symlink_handling, output_file, inode_tracker, show_size, level + 1, total_size, write_structure
-#ifdef WITH_PLUGINS
-                                                    ,
-                                                    plugin_manager
-#endif
-                        );
-                    }
-                    else if (!S_ISDIR(target_stat.st_mode))
-                    {
-                        // Process symlinked file
-                        int is_binary = is_binary_file(new_full_path);
-                        if (is_binary == 1)
-                        {
-                            if (binary_handling == BINARY_SKIP)
-                            {
-                                continue;
-                            }
-                            else if (binary_handling == BINARY_PLACEHOLDER)
-                            {
-                                fprintf(output_file, "// File: %s\n// [Binary symlink file - content not displayed]\n\n", new_relative_path);
-                                continue;
-                            }
-                        }
-
-                        FILE *file = fopen(new_full_path, "rb");
-                        if (file)
-                        {
-                            fprintf(output_file, "// File: %s (symlink)\n", new_relative_path);
-
-                            char buffer[PLUGIN_CHUNK_SIZE];
-                            size_t bytes_read;
-                            while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0)
-                            {
-#ifdef WITH_PLUGINS
-                                char *processed_data = NULL;
-                                size_t processed_size = 0;
-
-                                // Process through plugins if available
-                                if (plugin_manager)
-                                {
-                                    if (process_file_through_plugins(plugin_manager, new_relative_path,
-                                                                     buffer, bytes_read, &processed_data, &processed_size) == 0)
-                                    {
-                                        if (processed_data && processed_size > 0)
-                                        {
-                                            fwrite(processed_data, 1, processed_size, output_file);
-                                            free(processed_data);
-                                        }
-                                    }
-                                    else
-                                    {
-                                        // Plugin processing failed, write original data
-                                        fwrite(buffer, 1, bytes_read, output_file);
-                                    }
-                                }
-                                else
-                                {
-                                    // No plugins, write original data
-                                    fwrite(buffer, 1, bytes_read, output_file);
-                                }
-#else
-                                // No plugin support, write original data
-                                fwrite(buffer, 1, bytes_read, output_file);
-#endif
-                            }
+        if (write_structure)
+        {
+            // Record the entry in the structure tree
+            StructureTree *tree = state->tree;
 
-                            fprintf(output_file, "\n\n");
-                            fclose(file);
-                        }
-                    }
+            if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            {
+                if (depth_exhausted(ctx, level))
+                {
+                    structure_tree_add(tree, level, STRUCTURE_DIR, utf8_filename, STRUCTURE_FLAG_SLASH,
+                                       0, STRUCTURE_NOTE_MAX_DEPTH);
                 }
-                else if (symlink_handling == SYMLINK_PLACEHOLDER)
+                else
                 {
-                    fprintf(output_file, "// File: %s\n// [Symlink - content not followed]\n\n", new_relative_path);
+                    structure_tree_add(tree, level, STRUCTURE_DIR, utf8_filename,
+                                       STRUCTURE_FLAG_SLASH | STRUCTURE_FLAG_CONTAINER, 0, STRUCTURE_NOTE_NONE);
+
+                    // Recurse into subdirectory
+                    process_directory_recursive(ctx, state, new_relative_path, level + 1);
                 }
             }
-            else if (S_ISDIR(statbuf.st_mode))
+            else
             {
-                process_directory_recursive(base_path, new_relative_path, excludes, binary_handling,
-                                            symlink_handling, output_file, inode_tracker, show_size, level + 1, total_size, write_structure
-#ifdef WITH_PLUGINS
-                                            ,
-                                            plugin_manager
-#endif
-                );
+                LARGE_INTEGER fileSize;
+                fileSize.LowPart = findData.nFileSizeLow;
+                fileSize.HighPart = findData.nFileSizeHigh;
+
+                structure_tree_add(tree, level, STRUCTURE_FILE, utf8_filename, STRUCTURE_FLAG_SIZED,
+                                   fileSize.QuadPart, STRUCTURE_NOTE_NONE);
             }
-            else
+        }
+        else
+        {
+            // File content processing
+            if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
             {
-                // Process regular file
-                int is_binary = is_binary_file(new_full_path);
-                if (is_binary == 1)
+                char new_full_path[MAX_PATH];
+                if (safe_path_join(new_full_path, sizeof(new_full_path), base_path,
+                                   new_relative_path + state->label_length) < 0)
                 {
-                    if (binary_handling == BINARY_SKIP)
-                    {
-                        continue;
-                    }
-                    else if (binary_handling == BINARY_PLACEHOLDER)
-                    {
-                        fprintf(output_file, "// File: %s\n// [Binary file - content not displayed]\n\n", new_relative_path);
-                        continue;
-                    }
+                    free(utf8_filename);
+                    continue;
                 }
 
-                FILE *file = fopen(new_full_path, "rb");
-                if (file)
+                LARGE_INTEGER fileSize;
+                fileSize.LowPart = findData.nFileSizeLow;
+                fileSize.HighPart = findData.nFileSizeHigh;
+                if (!cursor_skip_entry(ctx, new_relative_path))
                 {
-                    fprintf(output_file, "// File: %s\n", new_relative_path);
+                    uint64_t content_hash;
+                    emit_file(ctx, new_full_path, new_relative_path, 0, fileSize.QuadPart, &content_hash);
+                    cursor_entry_done(ctx, new_relative_path);
+                }
+            }
+            else if (!depth_exhausted(ctx, level))
+            {
+                // Recurse into subdirectory
+                process_directory_recursive(ctx, state, new_relative_path, level + 1);
+            }
+        }
 
-                    char buffer[PLUGIN_CHUNK_SIZE];
-                    size_t bytes_read;
-                    while ((bytes_read = fread(buffer, 1, sizeof(buffer), file)) > 0)
-                    {
-#ifdef WITH_PLUGINS
-                        char *processed_data = NULL;
-                        size_t processed_size = 0;
-
-                        // Process through plugins if available
-                        if (plugin_manager)
-                        {
-                            if (process_file_through_plugins(plugin_manager, new_relative_path,
-                                                             buffer, bytes_read, &processed_data, &processed_size) == 0)
-                            {
-                                if (processed_data && processed_size > 0)
-                                {
-                                    fwrite(processed_data, 1, processed_size, output_file);
-                                    free(processed_data);
-                                }
-                            }
-                            else
-                            {
-                                // Plugin processing failed, write original data
-                                fwrite(buffer, 1, bytes_read, output_file);
-                            }
-                        }
-                        else
-                        {
-                            // No plugins, write original data
-                            fwrite(buffer, 1, bytes_read, output_file);
-                        }
+        free(utf8_filename);
+    } while (FindNextFileW(hFind, &findData));
+
+    FindClose(hFind);
+}
+#else
+// Specialized Unix walk kernels, one per pass and symlink mode (see walk_kernel.h)
+typedef void (*WalkKernel)(ProcessingContext *ctx, TraversalState *state, const char *current_path, int level);
+
+#define WALK_KERNEL_NAME walk_structure_skip
+#define WALK_STRUCTURE 1
+#define WALK_SYMLINKS SYMLINK_SKIP
+#include "walk_kernel.h"
+
+#define WALK_KERNEL_NAME walk_structure_follow
+#define WALK_STRUCTURE 1
+#define WALK_SYMLINKS SYMLINK_FOLLOW
+#include "walk_kernel.h"
+
+#define WALK_KERNEL_NAME walk_structure_include
+#define WALK_STRUCTURE 1
+#define WALK_SYMLINKS SYMLINK_INCLUDE
+#include "walk_kernel.h"
+
+#define WALK_KERNEL_NAME walk_structure_placeholder
+#define WALK_STRUCTURE 1
+#define WALK_SYMLINKS SYMLINK_PLACEHOLDER
+#include "walk_kernel.h"
+
+#define WALK_KERNEL_NAME walk_content_skip
+#define WALK_STRUCTURE 0
+#define WALK_SYMLINKS SYMLINK_SKIP
+#include "walk_kernel.h"
+
+#define WALK_KERNEL_NAME walk_content_follow
+#define WALK_STRUCTURE 0
+#define WALK_SYMLINKS SYMLINK_FOLLOW
+#include "walk_kernel.h"
+
+#define WALK_KERNEL_NAME walk_content_include
+#define WALK_STRUCTURE 0
+#define WALK_SYMLINKS SYMLINK_INCLUDE
+#include "walk_kernel.h"
+
+#define WALK_KERNEL_NAME walk_content_placeholder
+#define WALK_STRUCTURE 0
+#define WALK_SYMLINKS SYMLINK_PLACEHOLDER
+#include "walk_kernel.h"
+
+// Indexed by [write_structure][symlink_handling]
+static const WalkKernel walk_kernels[2][4] = {
+    [0] = {
+        [SYMLINK_SKIP] = walk_content_skip,
+        [SYMLINK_FOLLOW] = walk_content_follow,
+        [SYMLINK_INCLUDE] = walk_content_include,
+        [SYMLINK_PLACEHOLDER] = walk_content_placeholder,
+    },
+    [1] = {
+        [SYMLINK_SKIP] = walk_structure_skip,
+        [SYMLINK_FOLLOW] = walk_structure_follow,
+        [SYMLINK_INCLUDE] = walk_structure_include,
+        [SYMLINK_PLACEHOLDER] = walk_structure_placeholder,
+    },
+};
+
+// Walk one root with the kernel for this pass and mode, chosen once
+static void process_directory_recursive(ProcessingContext *ctx, TraversalState *state,
+                                        const char *current_path, int level)
+{
+    walk_kernels[state->write_structure != 0][ctx->symlink_handling](ctx, state, current_path, level);
+}
+
+// Walk an s3:// root's listing like a directory tree. Objects have no symlinks, devices or
+// inodes: the inode used for cross-root dedupe is a hash of the object URL.
+static void walk_objects(ProcessingContext *ctx, TraversalState *state, const ObjectDir *dir,
+                         const char *current_path, int level)
+{
+    int listed = 0;
+    FCONCAT_PROBE3(dir_enter, dir->prefix, level, state->write_structure);
+
+    for (size_t i = 0; i < dir->count && !g_stop_requested; i++)
+    {
+        const ObjectEntry *object = &dir->entries[i];
+        char new_relative_path[MAX_PATH];
+        char new_full_path[MAX_PATH];
+
+        if (child_relative_path(state, new_relative_path, sizeof(new_relative_path), current_path, object->name) < 0)
+            continue;
+
+        if (safe_path_join(new_full_path, sizeof(new_full_path), ctx->base_path,
+                           new_relative_path + state->label_length) < 0)
+            continue;
+
+        if (is_excluded(new_relative_path + state->label_length, ctx->excludes))
+            continue;
+
+        if (ctx->max_dir_entries > 0 && listed >= ctx->max_dir_entries)
+        {
+            if (state->write_structure)
+                structure_tree_add_omitted(state->tree, level, (unsigned long)(dir->count - i));
+            else if (is_verbose())
+                fprintf(stderr, "[fconcat] Entry limit reached in: %s\n", dir->prefix);
+            break;
+        }
+        listed++;
+
+        if (object->is_dir)
+        {
+            StructureNote blocked = depth_exhausted(ctx, level) ? STRUCTURE_NOTE_MAX_DEPTH : STRUCTURE_NOTE_NONE;
+            if (blocked)
+                FCONCAT_PROBE2(dir_blocked, new_full_path, blocked);
+            if (state->write_structure)
+                structure_tree_add(state->tree, level, STRUCTURE_DIR, object->name,
+                                   blocked ? STRUCTURE_FLAG_SLASH : STRUCTURE_FLAG_SLASH | STRUCTURE_FLAG_CONTAINER, 0,
+                                   blocked);
+            if (!blocked)
+                walk_objects(ctx, state, object->dir, new_relative_path, level + 1);
+            continue;
+        }
+
+        EntryMeta meta;
+        memset(&meta, 0, sizeof(meta));
+        meta.mode = S_IFREG;
+        meta.size = object->size;
+        meta.mtime_sec = object->mtime_sec;
+        if (state->emitted)
+        {
+            ContentHash url_hash;
+            content_hash_init(&url_hash);
+            content_hash_update(&url_hash, new_full_path, strlen(new_full_path));
+            meta.ino = (ino_t)content_hash_final(&url_hash);
+        }
+
+        if (state->write_structure)
+        {
+            structure_tree_add(state->tree, level, STRUCTURE_FILE, object->name, STRUCTURE_FLAG_SIZED, object->size,
+                               STRUCTURE_NOTE_NONE);
+            delta_classify(ctx, state, new_full_path, new_relative_path, &meta);
+        }
+        else
+        {
+            emit_entry(ctx, state, new_full_path, new_relative_path, 0, &meta);
+        }
+    }
+
+    FCONCAT_PROBE3(dir_exit, dir->prefix, level, listed);
+}
+#endif
+
+static void init_traversal_state(ProcessingContext *ctx, TraversalState *state, InodeTracker *inode_tracker,
+                                 int write_structure)
+{
+    memset(state, 0, sizeof(*state));
+    state->inode_tracker = inode_tracker;
+    state->write_structure = write_structure;
+#if !defined(_WIN32) && !defined(_WIN64)
+    struct stat root_stat;
+    if (stat(ctx->base_path, &root_stat) == 0)
+        state->root_dev = root_stat.st_dev;
+    state->dir_dev = state->root_dev;
 #else
-                        // No plugin support, write original data
-                        fwrite(buffer, 1, bytes_read, output_file);
+    (void)ctx;
 #endif
-                    }
+}
 
-                    fprintf(output_file, "\n\n");
-                    fclose(file);
-                }
+// Run one pass over every input root. With several roots each gets a label line in the
+// structure and its relative paths are prefixed with the label.
+static void traverse_roots(ProcessingContext *ctx, InodeTracker *inode_tracker, InodeTracker *emitted,
+                           StructureTree *tree, DeltaChanges *changes, struct EmitPool *pool)
+{
+#if defined(_WIN32) || defined(_WIN64)
+    (void)pool;
+#endif
+    const char *single_root = ctx->base_path;
+    int root_count = ctx->root_count > 1 ? ctx->root_count : 1;
+
+    for (int i = 0; i < root_count && !g_stop_requested; i++)
+    {
+        TraversalState state;
+        if (ctx->root_count > 1)
+            ctx->base_path = ctx->roots[i];
+        init_traversal_state(ctx, &state, inode_tracker, tree != NULL);
+        state.tree = tree;
+        state.emitted = emitted;
+        state.changes = changes;
+#if !defined(_WIN32) && !defined(_WIN64)
+        state.pool = pool;
+#endif
+
+        if (ctx->root_count > 1)
+        {
+            state.label = ctx->root_labels[i];
+            state.label_length = strlen(state.label) + 1;
+            if (tree)
+            {
+                tree->base_depth = 0;
+                structure_tree_add(tree, 0, STRUCTURE_ROOT, state.label,
+                                   STRUCTURE_FLAG_SLASH | STRUCTURE_FLAG_CONTAINER, 0, STRUCTURE_NOTE_NONE);
+                tree->base_depth = 1;
+            }
+        }
+
+#if !defined(_WIN32) && !defined(_WIN64)
+        if (ctx->object_trees && ctx->object_trees[i])
+        {
+            walk_objects(ctx, &state, ctx->object_trees[i], "", 0);
+            continue;
+        }
+#endif
+        process_directory_recursive(ctx, &state, "", 0);
+    }
+
+    if (tree)
+        tree->base_depth = 0;
+    ctx->base_path = single_root;
+}
+
+// The structure section of a --delta-from run: one line per added, modified or deleted file
+static void write_delta_structure(ProcessingContext *ctx, DeltaChanges *changes)
+{
+    // Files of the previous manifest that the walk never reached were deleted
+    for (size_t i = 0; i < ctx->delta_base->count; i++)
+    {
+        const ManifestEntry *previous = &ctx->delta_base->entries[i];
+        if (previous->status == MANIFEST_UNSEEN)
+            delta_record(changes, '-', previous->path, previous->size);
+    }
+
+    write_text_all(ctx, "Delta Structure:\n================\n\n");
+    for (int s = 0; s < ctx->sink_count; s++)
+    {
+        if (ctx->sinks[s].chunked)
+            continue;
+        FILE *out = ctx->sinks[s].file;
+        if (changes->count == 0)
+            fputs("(no changes)\n", out);
+        for (size_t i = 0; i < changes->count; i++)
+        {
+            fprintf(out, "%c %s", changes->items[i].status, changes->items[i].path);
+            if (ctx->show_size)
+            {
+                char size_buf[32];
+                format_size(changes->items[i].size, size_buf, sizeof(size_buf));
+                fprintf(out, " (%s)", size_buf);
             }
+            fputc('\n', out);
+        }
+        fprintf(out, "\nChanges: %llu added, %llu modified, %llu deleted, %llu unchanged\n",
+                changes->counts[0], changes->counts[1], changes->counts[2], changes->unchanged);
+    }
+
+    if (is_verbose())
+        fprintf(stderr, "[fconcat] Delta: %llu added, %llu modified, %llu deleted, %llu unchanged\n",
+                changes->counts[0], changes->counts[1], changes->counts[2], changes->unchanged);
+}
+
+// A --delta-from run ends with one record per deleted file
+static void emit_deletions(ProcessingContext *ctx)
+{
+    for (size_t i = 0; i < ctx->delta_base->count && !g_stop_requested; i++)
+    {
+        const ManifestEntry *previous = &ctx->delta_base->entries[i];
+        if (previous->status == MANIFEST_UNSEEN)
+            emit_placeholder(ctx, previous->path, 0, "// [Deleted]");
+    }
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+static int object_prefix_excluded(const char *relative_path, void *excludes)
+{
+    return is_excluded(relative_path, excludes);
+}
+
+static void count_objects(const ObjectDir *dir, unsigned long long *objects, unsigned long long *prefixes)
+{
+    for (size_t i = 0; i < dir->count; i++)
+    {
+        if (dir->entries[i].is_dir)
+        {
+            (*prefixes)++;
+            count_objects(dir->entries[i].dir, objects, prefixes);
+        }
+        else
+        {
+            (*objects)++;
         }
     }
+}
+#endif
+
+// List every s3:// root once per run: both passes walk the same snapshot. Excluded prefixes
+// and those beyond --max-depth are never listed.
+static int list_object_roots(ProcessingContext *ctx, ObjectDir **trees)
+{
+    int root_count = ctx->root_count > 1 ? ctx->root_count : 1;
+    for (int i = 0; i < MAX_ROOTS; i++)
+        trees[i] = NULL;
+    ctx->object_trees = NULL;
+    if (!ctx->object_store)
+        return 0;
+
+    ctx->object_trees = trees;
+    for (int i = 0; i < root_count; i++)
+    {
+        const char *root = ctx->root_count > 1 ? ctx->roots[i] : ctx->base_path;
+        if (!is_object_url(root))
+            continue;
 
-    closedir(dir);
+        char error[1024];
+        unsigned long long started = metrics_now_ns();
+        unsigned long long requests = ctx->object_store->requests;
+#if !defined(_WIN32) && !defined(_WIN64)
+        trees[i] = object_store_list(ctx->object_store, root, ctx->max_depth, object_prefix_excluded, ctx->excludes,
+                                     error, sizeof(error));
+#else
+        trees[i] = object_store_list(ctx->object_store, root, ctx->max_depth, NULL, NULL, error, sizeof(error));
+#endif
+        if (!trees[i])
+        {
+            fprintf(stderr, "Error: %s\n", error);
+            return -1;
+        }
+#if !defined(_WIN32) && !defined(_WIN64)
+        if (is_verbose())
+        {
+            unsigned long long objects = 0, prefixes = 0;
+            count_objects(trees[i], &objects, &prefixes);
+            fprintf(stderr, "[fconcat] Listed %s: %llu objects, %llu prefixes, %llu requests on %d threads in %.1f ms\n",
+                    root, objects, prefixes, ctx->object_store->requests - requests, ctx->object_store->connections,
+                    (double)(metrics_now_ns() - started) / 1e6);
+        }
 #endif
+    }
+    return 0;
 }
 
-int process_directory(ProcessingContext *ctx)
+static void free_object_roots(ProcessingContext *ctx)
 {
+    if (!ctx->object_trees)
+        return;
+    for (int i = 0; i < MAX_ROOTS; i++)
+        object_dir_free(ctx->object_trees[i]);
+    ctx->object_trees = NULL;
+
+    ObjectStore *store = ctx->object_store;
     if (is_verbose())
-        fprintf(stderr, "[fconcat] Starting directory processing\n");
+        fprintf(stderr, "[fconcat] Object store: %llu requests, %llu bytes received, %llu retries\n",
+                store->requests, store->bytes, store->retries);
+}
+
+// --stats=hw: bracket a stage on the walking thread; the bytes are what it added to the primary output
+static unsigned long long stage_begin(ProcessingContext *ctx, HwThreadCounters *counters)
+{
+    if (!ctx->hw_stats)
+        return 0;
+    unsigned long long position = output_position(ctx->output_file);
+    hw_stage_begin(counters);
+    return position;
+}
+
+static void stage_end(ProcessingContext *ctx, HwThreadCounters *counters, HwStage stage, unsigned long long start)
+{
+    if (!ctx->hw_stats)
+        return;
+    unsigned long long position = output_position(ctx->output_file);
+    hw_stage_end(ctx->hw_stats, counters, stage, position > start ? position - start : 0);
+}
+
+static int process_directory_passes(ProcessingContext *ctx, HwThreadCounters *counters)
+{
+    Checkpoint *checkpoint = ctx->checkpoint;
+    int resuming = checkpoint && checkpoint->resuming;
 
     // Initialize inode tracker for symlink loop detection
     InodeTracker inode_tracker;
@@ -1369,52 +3580,248 @@ int process_directory(ProcessingContext *ctx)
         return -1;
     }
 
-    // Write directory structure header
-    fprintf(ctx->output_file, "Directory Structure:\n==================\n\n");
+    // A resumed run already has the structure section in the truncated output
+    if (!resuming)
+    {
+        unsigned long long stage_start = stage_begin(ctx, counters);
 
-    // Process directory structure
-    unsigned long long total_size = 0;
-    process_directory_recursive(ctx->base_path, "", ctx->excludes, ctx->binary_handling,
-                                ctx->symlink_handling, ctx->output_file, &inode_tracker, ctx->show_size, 0, &total_size, 1
-#ifdef WITH_PLUGINS
-                                ,
-                                ctx->plugin_manager
-#endif
-    );
+        // Build the structure tree, then render it with sizes aggregated bottom-up
+        StructureTree tree;
+        structure_tree_init(&tree);
+        DeltaChanges changes;
+        memset(&changes, 0, sizeof(changes));
+
+        traverse_roots(ctx, &inode_tracker, NULL, &tree, ctx->delta_base ? &changes : NULL, NULL);
+
+        if (ctx->delta_base)
+        {
+            // A delta lists what changed instead of the whole tree
+            write_delta_structure(ctx, &changes);
+            for (size_t i = 0; i < changes.count; i++)
+                free(changes.items[i].path);
+            free(changes.items);
+        }
+        else
+        {
+            write_text_all(ctx, "Directory Structure:\n==================\n\n");
+            structure_tree_aggregate(&tree);
+            for (int i = 0; i < ctx->sink_count; i++)
+            {
+                if (!ctx->sinks[i].chunked)
+                    structure_tree_render(&tree, ctx->sinks[i].file, ctx->show_size);
+            }
+        }
+
+        // Write total size if requested
+        if (ctx->show_size && !ctx->delta_base)
+        {
+            char size_buf[32];
+            format_size(tree.total_size, size_buf, sizeof(size_buf));
+            for (int i = 0; i < ctx->sink_count; i++)
+            {
+                if (!ctx->sinks[i].chunked)
+                    fprintf(ctx->sinks[i].file, "\nTotal Size: %s (%llu bytes)\n", size_buf, tree.total_size);
+            }
+        }
+
+        if (is_verbose())
+            fprintf(stderr, "[fconcat] Structure: %zu entries, %llu files\n", tree.count, tree.total_files);
+        structure_tree_free(&tree);
+
+        // Write file contents header
+        write_text_all(ctx, "\nFile Contents:\n=============\n\n");
+
+        // Reset inode tracker for file concatenation
+        free_inode_tracker(&inode_tracker);
+        if (init_inode_tracker(&inode_tracker) != 0)
+        {
+            fprintf(stderr, "Error reinitializing inode tracker\n");
+            return -1;
+        }
+        stage_end(ctx, counters, HW_STAGE_STRUCTURE, stage_start);
+    }
+
+    // Interrupted before any file was written: there is no cursor worth keeping
+    if (g_stop_requested)
+    {
+        free_inode_tracker(&inode_tracker);
+        return PROCESS_INTERRUPTED;
+    }
 
-    // Write total size if requested
-    if (ctx->show_size)
+    if (checkpoint)
     {
-        char size_buf[32];
-        format_size(total_size, size_buf, sizeof(size_buf));
-        fprintf(ctx->output_file, "\nTotal Size: %s (%llu bytes)\n", size_buf, total_size);
+        if (resuming)
+        {
+            checkpoint->progress = checkpoint->resume;
+            if (is_verbose())
+                fprintf(stderr, "[fconcat] Resuming after %llu entries (last: %s)\n",
+                        checkpoint->resume.entries_done, checkpoint->resume.last_path);
+        }
+        else
+        {
+            checkpoint->progress.entries_done = 0;
+            checkpoint->progress.output_offset = output_position(ctx->output_file);
+            checkpoint->progress.last_path[0] = '\0';
+        }
+        checkpoint->ordinal = 0;
+        checkpoint_sync(ctx);
     }
 
-    // Write file contents header
-    fprintf(ctx->output_file, "\nFile Contents:\n=============\n\n");
+    // Process file contents; with several roots, files reachable from more than one are written once
+    InodeTracker emitted;
+    int dedupe = 0;
+    unsigned long long stage_start = stage_begin(ctx, counters);
+#if !defined(_WIN32) && !defined(_WIN64)
+    dedupe = ctx->root_count > 1 && init_inode_tracker(&emitted) == 0;
+    EmitPool pool;
+    int parallel = ctx->jobs > 1 && emit_pool_start(&pool, ctx) == 0;
+    traverse_roots(ctx, &inode_tracker, dedupe ? &emitted : NULL, NULL, NULL, parallel ? &pool : NULL);
+    if (parallel)
+        emit_pool_stop(&pool);
+#else
+    traverse_roots(ctx, &inode_tracker, dedupe ? &emitted : NULL, NULL, NULL, NULL);
+#endif
+    if (ctx->delta_base)
+        emit_deletions(ctx);
+    stage_end(ctx, counters, HW_STAGE_CONTENT, stage_start);
 
-    // Reset inode tracker for file concatenation
+    // Cleanup inode trackers
+    if (dedupe)
+        free_inode_tracker(&emitted);
     free_inode_tracker(&inode_tracker);
-    if (init_inode_tracker(&inode_tracker) != 0)
+
+    if (checkpoint)
     {
-        fprintf(stderr, "Error reinitializing inode tracker\n");
-        return -1;
+        if (resuming && !g_stop_requested && checkpoint->ordinal < checkpoint->resume.entries_done)
+        {
+            fprintf(stderr, "Error: only %llu entries found, but checkpoint '%s' records %llu\n",
+                    checkpoint->ordinal, checkpoint->path, checkpoint->resume.entries_done);
+            checkpoint->mismatch = 1;
+        }
+        if (checkpoint->mismatch)
+            return -1;
+    }
+
+    if (g_stop_requested)
+    {
+        if (checkpoint)
+            checkpoint_sync(ctx);
+        return PROCESS_INTERRUPTED;
+    }
+
+    return 0;
+}
+
+int process_directory(ProcessingContext *ctx)
+{
+    if (is_verbose())
+        fprintf(stderr, "[fconcat] Starting directory processing\n");
+
+    // Fall back to the classic "// File:" layout when no templates were configured
+    OutputTemplate default_header, default_footer;
+    char template_error[128];
+    const OutputTemplate *configured_header = ctx->header_template;
+    const OutputTemplate *configured_footer = ctx->footer_template;
+    if (!configured_header)
+    {
+        if (template_compile(&default_header, template_preset_header(OUTPUT_FORMAT_DEFAULT),
+                             template_error, sizeof(template_error)) != 0)
+            return -1;
+        ctx->header_template = &default_header;
+    }
+    if (!configured_footer)
+    {
+        if (template_compile(&default_footer, template_preset_footer(OUTPUT_FORMAT_DEFAULT),
+                             template_error, sizeof(template_error)) != 0)
+        {
+            if (!configured_header)
+                template_free(&default_header);
+            return -1;
+        }
+        ctx->footer_template = &default_footer;
     }
 
-    // Process file contents
-    process_directory_recursive(ctx->base_path, "", ctx->excludes, ctx->binary_handling,
-                                ctx->symlink_handling, ctx->output_file, &inode_tracker, ctx->show_size, 0, &total_size, 0
+    // The primary output is sink 0; --sink outputs follow and share every read
+    OutputSink run_sinks[MAX_SINKS + 1];
+    memset(&run_sinks[0], 0, sizeof(run_sinks[0]));
+    run_sinks[0].file = ctx->output_file;
+    run_sinks[0].header_template = ctx->header_template;
+    run_sinks[0].footer_template = ctx->footer_template;
+    run_sinks[0].chunked = ctx->chunked;
+    run_sinks[0].xml_escaped = ctx->xml_escaped;
 #ifdef WITH_PLUGINS
-                                ,
-                                ctx->plugin_manager
+    run_sinks[0].plugin_manager = ctx->plugin_manager;
 #endif
-    );
+    int extra_sinks = ctx->extra_sink_count < MAX_SINKS ? ctx->extra_sink_count : MAX_SINKS;
+    for (int i = 0; i < extra_sinks; i++)
+    {
+        run_sinks[i + 1] = ctx->extra_sinks[i];
+        // A sink without format= takes the run's layout, escaping included
+        if (!run_sinks[i + 1].header_template)
+        {
+            run_sinks[i + 1].header_template = ctx->header_template;
+            run_sinks[i + 1].xml_escaped = ctx->xml_escaped;
+        }
+        if (!run_sinks[i + 1].footer_template)
+            run_sinks[i + 1].footer_template = ctx->footer_template;
+    }
+    ctx->sinks = run_sinks;
+    ctx->sink_count = extra_sinks + 1;
 
-    // Cleanup inode tracker
-    free_inode_tracker(&inode_tracker);
+    reflink_prepare(ctx);
+    if (ctx->metrics)
+    {
+        ctx->metrics_output_mark = output_position(ctx->output_file);
+        metrics_run_begin(ctx->metrics);
+    }
+    HwThreadCounters counters;
+    if (ctx->hw_stats)
+        hw_thread_open(ctx->hw_stats, &counters);
+#ifdef WITH_PLUGINS
+    void *aggregate_partials[MAX_AGGREGATORS];
+    aggregate_start(ctx, aggregate_partials);
+#endif
+    ObjectDir *object_trees[MAX_ROOTS];
+    int result = list_object_roots(ctx, object_trees);
+    if (result == 0)
+        result = process_directory_passes(ctx, &counters);
+#ifdef WITH_PLUGINS
+    if (ctx->aggregate_partials)
+    {
+        unsigned long long stage_start = stage_begin(ctx, &counters);
+        aggregate_finish(ctx, result == 0);
+        stage_end(ctx, &counters, HW_STAGE_SUMMARY, stage_start);
+    }
+#endif
+    free_object_roots(ctx);
+    if (ctx->hw_stats)
+        hw_thread_close(&counters);
+    if (ctx->metrics)
+    {
+        // The structure and the summaries are counted here, the file sections as they are written
+        metrics_count_output(ctx);
+        metrics_run_end(ctx->metrics,
+                        result == 0                     ? METRICS_RUN_OK
+                        : result == PROCESS_INTERRUPTED ? METRICS_RUN_INTERRUPTED
+                                                        : METRICS_RUN_FAILED);
+    }
 
-    if (is_verbose())
+    ctx->sinks = NULL;
+    ctx->sink_count = 0;
+
+    if (!configured_header)
+    {
+        template_free(&default_header);
+        ctx->header_template = NULL;
+    }
+    if (!configured_footer)
+    {
+        template_free(&default_footer);
+        ctx->footer_template = NULL;
+    }
+
+    if (is_verbose() && result == 0)
         fprintf(stderr, "[fconcat] Directory processing complete\n");
 
-    return 0;
-}
\ No newline at end of file
+    return result;
+}
@@ -8,9 +8,19 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "checkpoint.h"
+#include "chunk.h"
+#include "governor.h"
+#include "hwcounters.h"
+#include "manifest.h"
+#include "metrics.h"
+#include "objstore.h"
+#include "template.h"
+
 #ifdef WITH_PLUGINS
 #if !defined(_WIN32) && !defined(_WIN64)
 #include <dlfcn.h>
+#include <sys/uio.h>
 #endif
 #endif
 
@@ -27,7 +37,13 @@
 
 #define BUFFER_SIZE 4096
 #define MAX_EXCLUDES 1000
-#define BINARY_CHECK_SIZE 8192
+#define BINARY_CHECK_SIZE 8192 // Sniff window for binary and generated-file detection
+#define GENERATED_KEEP_DEFAULT 2048
+#define MAX_EXCLUDED_FS 32
+#define MAX_ROOTS 64
+#define MAX_SINKS 8
+#define MAX_JOBS 64
+#define EMIT_INLINE_SIZE (4ULL * 1024 * 1024) // --jobs: larger files are streamed by the walking thread
 
 #ifdef WITH_PLUGINS
 #define MAX_PLUGINS 32
@@ -52,6 +68,32 @@ typedef struct PluginContext
     int plugin_index;
 } PluginContext;
 
+// Optional cross-file aggregation, exported by a plugin as get_plugin_aggregator(). Every
+// thread of the content pass owns one partial, so map() needs no locks; the partials are
+// merged once every file was read and finalize() may return a summary for the plugin's output.
+typedef struct PluginAggregator
+{
+    void *(*create)(void);
+    // A file's raw content, chunk by chunk; data is NULL once the file is complete
+    void (*map)(void *partial, const char *relative_path, const char *data, size_t size);
+    // Fold from into into; from is destroyed afterwards. Must not depend on the order of files.
+    void (*merge)(void *into, void *from);
+    // Optional malloc'ed summary section body, NULL for none
+    int (*finalize)(void *partial, char **summary, size_t *summary_size);
+    void (*destroy)(void *partial);
+} PluginAggregator;
+
+// Scatter-gather chunk output for an optional process_chunk_spans() export: the plugin appends
+// spans that point into its input, into static data or into memory from alloc(), so unchanged
+// bytes are never copied. The engine may call it several times per chunk, once per span of the
+// previous plugin's output, and writes the spans once the whole chain has run.
+typedef struct PluginSpanList
+{
+    int (*add)(struct PluginSpanList *list, const char *data, size_t size);
+    char *(*alloc)(struct PluginSpanList *list, size_t size); // Freed by the engine after the write
+    void *engine;
+} PluginSpanList;
+
 typedef struct StreamingPlugin
 {
     const char *name;
@@ -69,8 +111,13 @@ typedef struct StreamingPlugin
     void (*file_cleanup)(PluginContext *ctx);
 
     // Plugin metadata
-    void *handle; // dlopen handle
-    int index;    // Plugin index in array
+    void *handle;                       // dlopen handle
+    int index;                          // Plugin index in array
+    const PluginAggregator *aggregator; // From get_plugin_aggregator(), NULL = none
+    // From process_chunk_spans(), NULL = none. Returns 0 with spans added, 1 to have this chunk
+    // go through process_chunk instead, -1 on error (the chunk passes through unchanged).
+    int (*process_chunk_spans)(PluginContext *ctx, const char *input, size_t input_size, PluginSpanList *spans);
+    MetricsPluginSlot *metrics; // Engine-owned: callback time for --metrics, NULL = untimed
 } StreamingPlugin;
 
 typedef struct PluginManager
@@ -80,8 +127,58 @@ typedef struct PluginManager
     int initialized;
     pthread_mutex_t mutex;
 } PluginManager;
+
+// Per-file state of a plugin chain: contexts live from file_start to file_end
+typedef struct PluginSession
+{
+    PluginContext *contexts[MAX_PLUGINS];
+    int active;
+} PluginSession;
+
+#if defined(_WIN32) || defined(_WIN64)
+typedef struct
+{
+    void *iov_base;
+    size_t iov_len;
+} GatherSpan;
+#else
+typedef struct iovec GatherSpan; // Handed to writev() as is
+#endif
+
+// One chunk's output through a plugin chain as a gather list: spans into the input chunk,
+// plugin memory and buffers owned here. Reused from chunk to chunk.
+typedef struct PluginGather
+{
+    GatherSpan *lists[2]; // The current stage's spans and the next stage's
+    size_t counts[2];
+    size_t capacities[2];
+    int current; // lists[current] holds the result of plugin_session_gather()
+    char **owned;
+    size_t owned_count;
+    size_t owned_capacity;
+    PluginSpanList list; // Handed to span plugins, appends to the next stage
+    int failed;
+} PluginGather;
 #endif
 
+// One output variant: destination, file section layout and plugin chain. Every sink is fed
+// from the same read of each file.
+typedef struct OutputSink
+{
+    const char *path;
+    FILE *file;
+    const OutputTemplate *header_template; // NULL = the run's header template
+    const OutputTemplate *footer_template; // NULL = the run's footer template
+    int chunked;                           // JSON Lines chunk records instead of file sections
+    int xml_escaped;                       // File bodies escaped as XML text (format xml)
+#ifdef WITH_PLUGINS
+    PluginManager *plugin_manager; // NULL or empty = raw content
+    PluginSession session;         // Engine-owned: plugin contexts of the current file
+#endif
+    TemplateFields fields; // Engine-owned: fields of the current file section
+    Chunker chunker;       // Engine-owned: the current file's pending chunk, when chunked
+} OutputSink;
+
 // Hash table for efficient exclude pattern storage
 typedef struct ExcludeNode
 {
@@ -100,9 +197,20 @@ typedef enum
 {
     BINARY_SKIP,
     BINARY_INCLUDE,
-    BINARY_PLACEHOLDER
+    BINARY_PLACEHOLDER,
+    BINARY_BASE64, // Encoded inclusion with content hash
+    BINARY_HEX
 } BinaryHandling;
 
+// What to do with text files that detect_generated() flags (lockfiles, minified bundles, ...)
+typedef enum
+{
+    GENERATED_INCLUDE, // No detection
+    GENERATED_SKIP,
+    GENERATED_PLACEHOLDER,
+    GENERATED_TRUNCATE // The first generated_keep bytes, then a note
+} GeneratedHandling;
+
 typedef enum
 {
     SYMLINK_SKIP,
@@ -111,33 +219,72 @@ typedef enum
     SYMLINK_PLACEHOLDER
 } SymlinkHandling;
 
-// Inode tracking for symlink loop detection
+// Inode tracking for symlink loop detection and cross-root duplicate detection
 typedef struct InodeNode
 {
     dev_t device;
     ino_t inode;
+    char *path; // First relative path seen for this inode, NULL when not recorded
     struct InodeNode *next;
 } InodeNode;
 
 typedef struct
 {
-    InodeNode *head;
+    InodeNode **buckets; // Chained hash table, bucket count is a power of two
+    size_t bucket_count;
+    size_t count;
     pthread_mutex_t mutex;
 } InodeTracker;
 
 // Processing context
 typedef struct
 {
-    const char *base_path;
+    const char *base_path; // Root being traversed
+    const char **roots;    // All input roots, traversed in order
+    const char **root_labels;
+    int root_count;
     ExcludeList *excludes;
     BinaryHandling binary_handling;
+    unsigned long long binary_max_size; // Encoded binaries above this size get a placeholder, 0 = unlimited
+    GeneratedHandling generated_handling;
+    unsigned long long generated_keep; // Bytes kept by GENERATED_TRUNCATE
     SymlinkHandling symlink_handling;
     int show_size;
     FILE *output_file;
+    const OutputTemplate *header_template; // Compiled file header, NULL = "// File: {path}"
+    const OutputTemplate *footer_template; // Compiled file footer, NULL = blank line
 #ifdef WITH_PLUGINS
     PluginManager *plugin_manager;
 #endif
     int interactive_mode;
+    Checkpoint *checkpoint; // Periodic emit-cursor checkpoints, NULL = disabled
+    int reflink;            // Clone block-aligned file bodies into the output (FICLONERANGE)
+    OutputSink *extra_sinks; // Additional outputs from --sink
+    int extra_sink_count;
+    OutputSink *sinks; // Set by process_directory(): the primary output, then the extra sinks
+    int sink_count;
+    Manifest *delta_base;     // --delta-from: previous run's manifest, NULL = full output
+    ManifestWriter *manifest; // --manifest: records this run's file sections, NULL = none
+    int chunked;              // --format chunks: the primary output is chunk records
+    int xml_escaped;          // --format xml: the primary output's file bodies are escaped
+    ChunkOptions chunking;    // --chunk-size and --chunk-overlap of every chunked output
+    int jobs;                 // Content pass threads rendering file sections, 0 or 1 = serial
+    MemoryGovernor *governor; // --max-memory budget for buffered file data, NULL = unaccounted
+    HwStats *hw_stats;        // --stats=hw: per-stage perf counters, NULL = not collected
+    Metrics *metrics;         // --metrics: endpoint counters, NULL = not collected
+    unsigned long long metrics_output_mark; // Engine-owned: primary output offset already counted
+    ObjectStore *object_store; // s3:// roots are read through it, NULL when every root is local
+    ObjectDir **object_trees;  // Engine-owned: each root's listing for this run, NULL for local roots
+#ifdef WITH_PLUGINS
+    void **aggregate_partials; // Engine-owned: this thread's partial per aggregating plugin
+#endif
+
+    // Traversal budget: prune subtrees that are expensive to walk
+    int one_file_system;                        // Do not cross into other devices (st_dev)
+    int max_depth;                              // Maximum directory depth, 0 = unlimited
+    int max_dir_entries;                        // Entries listed per directory, 0 = unlimited
+    unsigned long excluded_fs[MAX_EXCLUDED_FS]; // statfs magic numbers never entered
+    int excluded_fs_count;
 } ProcessingContext;
 
 #ifdef WITH_PLUGINS
@@ -148,6 +295,14 @@ int load_plugin(PluginManager *manager, const char *plugin_path);
 int process_file_through_plugins(PluginManager *manager, const char *relative_path,
                                  const char *input_data, size_t input_size,
                                  char **output_data, size_t *output_size);
+void plugin_session_begin(PluginManager *manager, PluginSession *session, const char *relative_path);
+int plugin_session_chunk(PluginManager *manager, PluginSession *session, const char *input, size_t input_size,
+                         char **output, size_t *output_size);
+int plugin_session_end(PluginManager *manager, PluginSession *session, char **output, size_t *output_size);
+void plugin_gather_init(PluginGather *gather);
+int plugin_session_gather(PluginManager *manager, PluginSession *session, const char *input, size_t input_size,
+                          PluginGather *gather);
+void plugin_gather_free(PluginGather *gather);
 #endif
 
 // Core functions
@@ -156,13 +311,26 @@ void add_exclude_pattern(ExcludeList *excludes, const char *pattern);
 void free_exclude_list(ExcludeList *excludes);
 int is_excluded(const char *path, ExcludeList *excludes);
 void format_size(unsigned long long size, char *buffer, size_t buffer_size);
+size_t format_size_into(unsigned long long size, char *buffer);
 int is_binary_file(const char *filepath);
 int init_inode_tracker(InodeTracker *tracker);
 int add_inode(InodeTracker *tracker, dev_t device, ino_t inode);
 int has_inode(InodeTracker *tracker, dev_t device, ino_t inode);
+int add_inode_path(InodeTracker *tracker, dev_t device, ino_t inode, const char *path);
+const char *find_inode_path(InodeTracker *tracker, dev_t device, ino_t inode);
 void free_inode_tracker(InodeTracker *tracker);
+int add_excluded_fs_type(ProcessingContext *ctx, const char *name);
+// Name of a statfs magic from the --exclude-fs table, NULL if unknown; network is set either way
+const char *fs_type_name(unsigned long magic, int *network);
 int process_directory(ProcessingContext *ctx);
 
+// process_directory() result when a stop was requested and the run unwound early
+#define PROCESS_INTERRUPTED 1
+
+// Async-signal-safe: asks the traversal to stop at the next entry or read chunk
+void request_processing_stop(void);
+int processing_stop_requested(void);
+
 #if defined(_WIN32) || defined(_WIN64)
 wchar_t *utf8_to_wide(const char *utf8_path);
 char *wide_to_utf8(const wchar_t *wide_path);
@@ -0,0 +1,275 @@
+// File: src/directio.c
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "directio.h"
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+typedef struct
+{
+    int fd;
+    size_t align;    // O_DIRECT alignment of buffer addresses, offsets and lengths
+    size_t capacity; // Bytes per buffer, a multiple of align
+    char *buffers[DIRECT_BUFFER_COUNT];
+    size_t lengths[DIRECT_BUFFER_COUNT];            // Bytes queued for the writer, 0 = free
+    unsigned long long offsets[DIRECT_BUFFER_COUNT]; // File offset of each queued buffer
+
+    // Producer side (the stdio cookie)
+    int current;                   // Buffer being filled
+    size_t filled;                 // Bytes in the current buffer
+    unsigned long long offset;     // File offset of the current buffer
+    unsigned long long position;   // Stream position reported to ftello()
+
+    // Writer thread
+    int next_write;
+    int stopping;
+    int error; // errno of the first failed write; later writes are dropped
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} DirectWriter;
+
+// Some filesystems accept O_DIRECT at open but reject the writes; those continue buffered
+static int write_fully(int fd, const char *data, size_t len, unsigned long long offset)
+{
+    while (len > 0)
+    {
+        ssize_t written = pwrite(fd, data, len, (off_t)offset);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written < 0 && errno == EINVAL)
+        {
+            int flags = fcntl(fd, F_GETFL);
+            if (flags != -1 && (flags & O_DIRECT) && fcntl(fd, F_SETFL, flags & ~O_DIRECT) == 0)
+                continue;
+        }
+        if (written <= 0)
+            return written < 0 ? errno : EIO;
+        data += written;
+        len -= (size_t)written;
+        offset += (unsigned long long)written;
+    }
+    return 0;
+}
+
+static void *direct_writer_thread(void *arg)
+{
+    DirectWriter *writer = arg;
+
+    pthread_mutex_lock(&writer->mutex);
+    for (;;)
+    {
+        while (writer->lengths[writer->next_write] == 0 && !writer->stopping)
+            pthread_cond_wait(&writer->cond, &writer->mutex);
+        if (writer->lengths[writer->next_write] == 0)
+            break;
+
+        int index = writer->next_write;
+        size_t len = writer->lengths[index];
+        unsigned long long offset = writer->offsets[index];
+        int failed = writer->error;
+        pthread_mutex_unlock(&writer->mutex);
+
+        int error = failed ? 0 : write_fully(writer->fd, writer->buffers[index], len, offset);
+
+        pthread_mutex_lock(&writer->mutex);
+        if (error && !writer->error)
+            writer->error = error;
+        writer->lengths[index] = 0;
+        writer->next_write = (index + 1) % DIRECT_BUFFER_COUNT;
+        pthread_cond_broadcast(&writer->cond);
+    }
+    pthread_mutex_unlock(&writer->mutex);
+    return NULL;
+}
+
+// Hand the first len bytes of the current buffer to the writer thread and wait for the next
+// buffer to be free
+static int direct_submit(DirectWriter *writer, size_t len)
+{
+    pthread_mutex_lock(&writer->mutex);
+    writer->lengths[writer->current] = len;
+    writer->offsets[writer->current] = writer->offset;
+    pthread_cond_broadcast(&writer->cond);
+
+    writer->offset += len;
+    writer->current = (writer->current + 1) % DIRECT_BUFFER_COUNT;
+    while (writer->lengths[writer->current] != 0)
+        pthread_cond_wait(&writer->cond, &writer->mutex);
+    int error = writer->error;
+    pthread_mutex_unlock(&writer->mutex);
+
+    writer->filled = 0;
+    return error;
+}
+
+static ssize_t direct_cookie_write(void *cookie, const char *data, size_t size)
+{
+    DirectWriter *writer = cookie;
+    size_t remaining = size;
+
+    while (remaining > 0)
+    {
+        size_t space = writer->capacity - writer->filled;
+        size_t chunk = remaining < space ? remaining : space;
+        memcpy(writer->buffers[writer->current] + writer->filled, data, chunk);
+        writer->filled += chunk;
+        data += chunk;
+        remaining -= chunk;
+
+        if (writer->filled == writer->capacity)
+        {
+            int error = direct_submit(writer, writer->capacity);
+            if (error)
+            {
+                errno = error;
+                return -1;
+            }
+        }
+    }
+
+    writer->position += size;
+    return (ssize_t)size;
+}
+
+// Only position queries (ftello) are supported
+static int direct_cookie_seek(void *cookie, off64_t *offset, int whence)
+{
+    DirectWriter *writer = cookie;
+    if (whence != SEEK_CUR || *offset != 0)
+    {
+        errno = ESPIPE;
+        return -1;
+    }
+    *offset = (off64_t)writer->position;
+    return 0;
+}
+
+static void direct_writer_free(DirectWriter *writer)
+{
+    for (int i = 0; i < DIRECT_BUFFER_COUNT; i++)
+        free(writer->buffers[i]);
+    pthread_cond_destroy(&writer->cond);
+    pthread_mutex_destroy(&writer->mutex);
+    free(writer);
+}
+
+// Write the aligned part of the last buffer directly, then the tail with O_DIRECT cleared
+static int direct_cookie_close(void *cookie)
+{
+    DirectWriter *writer = cookie;
+    int last = writer->current;
+    size_t filled = writer->filled;
+    size_t aligned = filled - filled % writer->align;
+    unsigned long long tail_offset = writer->offset + aligned;
+
+    if (aligned > 0)
+        direct_submit(writer, aligned);
+
+    pthread_mutex_lock(&writer->mutex);
+    writer->stopping = 1;
+    pthread_cond_broadcast(&writer->cond);
+    pthread_mutex_unlock(&writer->mutex);
+    pthread_join(writer->thread, NULL);
+
+    int error = writer->error;
+    if (!error && filled > aligned)
+    {
+        int flags = fcntl(writer->fd, F_GETFL);
+        if (flags == -1 || fcntl(writer->fd, F_SETFL, flags & ~O_DIRECT) != 0)
+            error = errno;
+        else
+            error = write_fully(writer->fd, writer->buffers[last] + aligned, filled - aligned, tail_offset);
+    }
+    if (close(writer->fd) != 0 && !error)
+        error = errno;
+
+    direct_writer_free(writer);
+    if (error)
+    {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+FILE *direct_output_open(const char *path, size_t buffer_size)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT | O_CLOEXEC, 0666);
+    if (fd < 0)
+        return NULL;
+
+    DirectWriter *writer = calloc(1, sizeof(*writer));
+    if (!writer)
+    {
+        close(fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+    writer->fd = fd;
+    pthread_mutex_init(&writer->mutex, NULL);
+    pthread_cond_init(&writer->cond, NULL);
+
+    // Filesystem block size, at least the 4 KiB that covers common logical sector sizes
+    struct stat st;
+    writer->align = 4096;
+    if (fstat(fd, &st) == 0 && st.st_blksize > 4096 && (st.st_blksize & (st.st_blksize - 1)) == 0)
+        writer->align = (size_t)st.st_blksize;
+    writer->capacity = buffer_size - buffer_size % writer->align;
+    if (writer->capacity == 0)
+        writer->capacity = writer->align;
+
+    int error = 0;
+    for (int i = 0; i < DIRECT_BUFFER_COUNT && !error; i++)
+    {
+        void *buffer = NULL;
+        error = posix_memalign(&buffer, writer->align, writer->capacity);
+        writer->buffers[i] = buffer;
+    }
+    if (!error)
+        error = pthread_create(&writer->thread, NULL, direct_writer_thread, writer);
+    if (error)
+    {
+        close(fd);
+        direct_writer_free(writer);
+        errno = error;
+        return NULL;
+    }
+
+    cookie_io_functions_t io = {
+        .read = NULL,
+        .write = direct_cookie_write,
+        .seek = direct_cookie_seek,
+        .close = direct_cookie_close,
+    };
+    FILE *file = fopencookie(writer, "w", io);
+    if (!file)
+    {
+        error = errno;
+        direct_cookie_close(writer);
+        errno = error;
+        return NULL;
+    }
+
+    // stdio batches small writes before they reach the aligned buffers
+    setvbuf(file, NULL, _IOFBF, 64 * 1024);
+    return file;
+}
+
+#else
+FILE *direct_output_open(const char *path, size_t buffer_size)
+{
+    (void)path;
+    (void)buffer_size;
+    errno = ENOTSUP;
+    return NULL;
+}
+#endif
@@ -0,0 +1,16 @@
+// File: src/directio.h
+#ifndef DIRECTIO_H
+#define DIRECTIO_H
+
+#include <stdio.h>
+
+#define DIRECT_BUFFER_SIZE (8 * 1024 * 1024) // Default bytes per aligned buffer
+#define DIRECT_BUFFER_COUNT 2                // Buffers in flight: one filling, one being written
+
+// Open <path> for writing through O_DIRECT, bypassing the page cache. The stream is write-only
+// and cannot seek; ftello() works. Full aligned buffers are written by a background thread, the
+// unaligned tail on fclose(). buffer_size is rounded down to the alignment, but never below one
+// block. NULL with errno set when direct I/O is not available.
+FILE *direct_output_open(const char *path, size_t buffer_size);
+
+#endif
@@ -0,0 +1,153 @@
+// File: src/dirscan.c
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "dirscan.h"
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef DIRSCAN_GETDENTS
+#include <sys/syscall.h>
+
+// Record layout returned by getdents64
+struct linux_dirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// Readers nest with the recursion, so each nesting depth owns one buffer, reused by every
+// directory listed at that depth on this thread
+static __thread char **dir_buffers = NULL;
+static __thread int dir_buffer_count = 0;
+static __thread int dir_depth = 0;
+
+static char *dir_buffer_for_depth(int depth)
+{
+    if (depth >= dir_buffer_count)
+    {
+        int count = dir_buffer_count ? dir_buffer_count * 2 : 16;
+        while (count <= depth)
+            count *= 2;
+        char **buffers = realloc(dir_buffers, (size_t)count * sizeof(char *));
+        if (!buffers)
+            return NULL;
+        memset(buffers + dir_buffer_count, 0, (size_t)(count - dir_buffer_count) * sizeof(char *));
+        dir_buffers = buffers;
+        dir_buffer_count = count;
+    }
+
+    if (!dir_buffers[depth])
+        dir_buffers[depth] = malloc(DIRSCAN_BUFFER_SIZE);
+    return dir_buffers[depth];
+}
+
+int dir_reader_open(DirReader *reader, const char *path)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->buffer = dir_buffer_for_depth(dir_depth);
+    if (!reader->buffer)
+        return -1;
+
+    reader->fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (reader->fd < 0)
+        return -1;
+
+    reader->depth = dir_depth++;
+    return 0;
+}
+
+int dir_reader_next(DirReader *reader, DirEntry *entry)
+{
+    for (;;)
+    {
+        if (reader->pos >= reader->end)
+        {
+            if (reader->eof)
+                return 0;
+            long bytes = syscall(SYS_getdents64, reader->fd, reader->buffer, DIRSCAN_BUFFER_SIZE);
+            if (bytes <= 0)
+            {
+                reader->eof = 1;
+                return 0;
+            }
+            reader->pos = 0;
+            reader->end = (size_t)bytes;
+        }
+
+        // Parse the record in place. Records are 8-byte aligned, so the name's terminator lies in
+        // the last 8 bytes of the d_reclen-sized slot; the padding after it is not zeroed.
+        struct linux_dirent64 *record = (struct linux_dirent64 *)(reader->buffer + reader->pos);
+        reader->pos += record->d_reclen;
+
+        size_t slot = record->d_reclen - offsetof(struct linux_dirent64, d_name);
+        size_t tail = slot > 8 ? slot - 8 : 0;
+        const char *terminator = memchr(record->d_name + tail, '\0', slot - tail);
+        size_t length = terminator ? (size_t)(terminator - record->d_name) : strnlen(record->d_name, slot);
+
+        if (record->d_name[0] == '.' && (length == 1 || (length == 2 && record->d_name[1] == '.')))
+            continue;
+
+        entry->name = record->d_name;
+        entry->name_length = length;
+        entry->type = record->d_type;
+        return 1;
+    }
+}
+
+void dir_reader_close(DirReader *reader)
+{
+    if (reader->fd >= 0)
+    {
+        close(reader->fd);
+        reader->fd = -1;
+        dir_depth = reader->depth;
+    }
+}
+#else
+int dir_reader_open(DirReader *reader, const char *path)
+{
+    reader->dir = opendir(path);
+    if (!reader->dir)
+        return -1;
+    reader->fd = dirfd(reader->dir);
+    return 0;
+}
+
+int dir_reader_next(DirReader *reader, DirEntry *entry)
+{
+    struct dirent *dp;
+    while ((dp = readdir(reader->dir)) != NULL)
+    {
+        if (strcmp(dp->d_name, ".") == 0 || strcmp(dp->d_name, "..") == 0)
+            continue;
+        entry->name = dp->d_name;
+        entry->name_length = strlen(dp->d_name);
+#ifdef DT_UNKNOWN
+        entry->type = dp->d_type;
+#else
+        entry->type = 0;
+#endif
+        return 1;
+    }
+    return 0;
+}
+
+void dir_reader_close(DirReader *reader)
+{
+    if (reader->dir)
+    {
+        closedir(reader->dir);
+        reader->dir = NULL;
+        reader->fd = -1;
+    }
+}
+#endif
+#endif
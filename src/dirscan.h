@@ -0,0 +1,42 @@
+// File: src/dirscan.h
+#ifndef DIRSCAN_H
+#define DIRSCAN_H
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <stddef.h>
+#include <dirent.h>
+
+#ifdef __linux__
+#define DIRSCAN_GETDENTS 1
+#define DIRSCAN_BUFFER_SIZE (256 * 1024) // Bytes of dirent records fetched per getdents64 call
+#endif
+
+// One directory entry; name points into the reader's buffer and is valid until the next call
+typedef struct
+{
+    const char *name;
+    size_t name_length;
+    unsigned char type; // d_type, DT_UNKNOWN if the filesystem does not report it
+} DirEntry;
+
+typedef struct
+{
+    int fd;
+#ifdef DIRSCAN_GETDENTS
+    char *buffer; // Per-thread buffer for this nesting depth
+    size_t pos;
+    size_t end;
+    int depth;
+    int eof;
+#else
+    DIR *dir;
+#endif
+} DirReader;
+
+int dir_reader_open(DirReader *reader, const char *path);
+// Returns 1 with the next entry ("." and ".." are skipped), 0 at the end of the directory
+int dir_reader_next(DirReader *reader, DirEntry *entry);
+void dir_reader_close(DirReader *reader);
+#endif
+
+#endif
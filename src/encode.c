@@ -0,0 +1,248 @@
+// File: src/encode.c
+#include <stdint.h>
+#include <string.h>
+#include "encode.h"
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define ENCODE_SSSE3 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ENCODE_NEON 1
+#endif
+
+static const char base64_alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static const char hex_digits[] = "0123456789abcdef";
+
+// Scalar base64 for any length, padding the final group
+static size_t base64_scalar(const unsigned char *in, size_t len, char *out)
+{
+    char *start = out;
+
+    while (len >= 3)
+    {
+        uint32_t v = ((uint32_t)in[0] << 16) | ((uint32_t)in[1] << 8) | in[2];
+        out[0] = base64_alphabet[(v >> 18) & 0x3F];
+        out[1] = base64_alphabet[(v >> 12) & 0x3F];
+        out[2] = base64_alphabet[(v >> 6) & 0x3F];
+        out[3] = base64_alphabet[v & 0x3F];
+        in += 3;
+        len -= 3;
+        out += 4;
+    }
+
+    if (len > 0)
+    {
+        uint32_t v = (uint32_t)in[0] << 16;
+        if (len == 2)
+            v |= (uint32_t)in[1] << 8;
+        out[0] = base64_alphabet[(v >> 18) & 0x3F];
+        out[1] = base64_alphabet[(v >> 12) & 0x3F];
+        out[2] = len == 2 ? base64_alphabet[(v >> 6) & 0x3F] : '=';
+        out[3] = '=';
+        out += 4;
+    }
+
+    return (size_t)(out - start);
+}
+
+static size_t hex_scalar(const unsigned char *in, size_t len, char *out)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        out[2 * i] = hex_digits[in[i] >> 4];
+        out[2 * i + 1] = hex_digits[in[i] & 0x0F];
+    }
+    return len * 2;
+}
+
+#ifdef ENCODE_SSSE3
+// Spread 12 input bytes over 16 lanes of 6-bit values (bytes 12..15 of the load are ignored)
+static inline __m128i base64_reshuffle(__m128i in)
+{
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+
+    const __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00));
+    const __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    const __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003F03F0));
+    const __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t1, t3);
+}
+
+// Map 6-bit values to the alphabet by adding a per-range offset picked with pshufb
+static inline __m128i base64_translate(__m128i in)
+{
+    const __m128i lut = _mm_setr_epi8(65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0);
+    __m128i indices = _mm_subs_epu8(in, _mm_set1_epi8(51));
+    __m128i mask = _mm_cmpgt_epi8(in, _mm_set1_epi8(25));
+    indices = _mm_sub_epi8(indices, mask);
+    return _mm_add_epi8(in, _mm_shuffle_epi8(lut, indices));
+}
+#endif
+
+// One full line of BASE64_LINE_BYTES input bytes, newline included
+static size_t base64_line(const unsigned char *in, char *out)
+{
+    size_t done = 0;
+    char *start = out;
+
+#if defined(ENCODE_SSSE3)
+    // Each 16-byte load consumes 12 bytes; the last load ends at byte 52 of 57
+    for (; done + 16 <= BASE64_LINE_BYTES; done += 12)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + done));
+        _mm_storeu_si128((__m128i *)out, base64_translate(base64_reshuffle(v)));
+        out += 16;
+    }
+#elif defined(ENCODE_NEON)
+    {
+        static const unsigned char alphabet[64] =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        uint8x16x4_t lut = {{vld1q_u8(alphabet), vld1q_u8(alphabet + 16),
+                             vld1q_u8(alphabet + 32), vld1q_u8(alphabet + 48)}};
+        uint8x16x3_t src = vld3q_u8(in);
+        uint8x16x4_t idx;
+        idx.val[0] = vshrq_n_u8(src.val[0], 2);
+        idx.val[1] = vorrq_u8(vshlq_n_u8(vandq_u8(src.val[0], vdupq_n_u8(0x03)), 4), vshrq_n_u8(src.val[1], 4));
+        idx.val[2] = vorrq_u8(vshlq_n_u8(vandq_u8(src.val[1], vdupq_n_u8(0x0F)), 2), vshrq_n_u8(src.val[2], 6));
+        idx.val[3] = vandq_u8(src.val[2], vdupq_n_u8(0x3F));
+        uint8x16x4_t enc;
+        enc.val[0] = vqtbl4q_u8(lut, idx.val[0]);
+        enc.val[1] = vqtbl4q_u8(lut, idx.val[1]);
+        enc.val[2] = vqtbl4q_u8(lut, idx.val[2]);
+        enc.val[3] = vqtbl4q_u8(lut, idx.val[3]);
+        vst4q_u8((uint8_t *)out, enc);
+        out += 64;
+        done = 48;
+    }
+#endif
+
+    out += base64_scalar(in + done, BASE64_LINE_BYTES - done, out);
+    *out++ = '\n';
+    return (size_t)(out - start);
+}
+
+// One full line of HEX_LINE_BYTES input bytes, newline included
+static size_t hex_line(const unsigned char *in, char *out)
+{
+    size_t done = 0;
+    char *start = out;
+
+#if defined(ENCODE_SSSE3)
+    const __m128i lut = _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7',
+                                      '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    for (; done + 16 <= HEX_LINE_BYTES; done += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(in + done));
+        __m128i hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+        __m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(v, nibble));
+        _mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128((__m128i *)(out + 16), _mm_unpackhi_epi8(hi, lo));
+        out += 32;
+    }
+#elif defined(ENCODE_NEON)
+    const uint8x16_t lut = vld1q_u8((const uint8_t *)hex_digits);
+    for (; done + 16 <= HEX_LINE_BYTES; done += 16)
+    {
+        uint8x16_t v = vld1q_u8(in + done);
+        uint8x16x2_t pair;
+        pair.val[0] = vqtbl1q_u8(lut, vshrq_n_u8(v, 4));
+        pair.val[1] = vqtbl1q_u8(lut, vandq_u8(v, vdupq_n_u8(0x0F)));
+        vst2q_u8((uint8_t *)out, pair);
+        out += 32;
+    }
+#endif
+
+    out += hex_scalar(in + done, HEX_LINE_BYTES - done, out);
+    *out++ = '\n';
+    return (size_t)(out - start);
+}
+
+static size_t line_bytes(BinaryEncoding encoding)
+{
+    return encoding == ENCODING_HEX ? HEX_LINE_BYTES : BASE64_LINE_BYTES;
+}
+
+static size_t encode_line(BinaryEncoding encoding, const unsigned char *in, char *out)
+{
+    return encoding == ENCODING_HEX ? hex_line(in, out) : base64_line(in, out);
+}
+
+void stream_encoder_init(StreamEncoder *enc, BinaryEncoding encoding)
+{
+    enc->encoding = encoding;
+    enc->pending_len = 0;
+}
+
+// Worst case output of one update (plus a carried partial line) or of finish
+size_t stream_encoder_bound(BinaryEncoding encoding, size_t input_len)
+{
+    size_t lines = input_len / line_bytes(encoding) + 2;
+    return lines * (encoding == ENCODING_HEX ? HEX_LINE_BYTES * 2 + 1 : 77);
+}
+
+size_t stream_encoder_update(StreamEncoder *enc, const unsigned char *input, size_t len, char *output)
+{
+    size_t line = line_bytes(enc->encoding);
+    size_t written = 0;
+
+    // Top up a partial line carried from the previous update
+    if (enc->pending_len > 0)
+    {
+        size_t fill = line - enc->pending_len;
+        if (fill > len)
+            fill = len;
+        memcpy(enc->pending + enc->pending_len, input, fill);
+        enc->pending_len += fill;
+        input += fill;
+        len -= fill;
+
+        if (enc->pending_len < line)
+            return 0;
+
+        written += encode_line(enc->encoding, enc->pending, output);
+        enc->pending_len = 0;
+    }
+
+    // Full lines are encoded straight from the caller's buffer
+    while (len >= line)
+    {
+        written += encode_line(enc->encoding, input, output + written);
+        input += line;
+        len -= line;
+    }
+
+    memcpy(enc->pending, input, len);
+    enc->pending_len = len;
+    return written;
+}
+
+size_t stream_encoder_finish(StreamEncoder *enc, char *output)
+{
+    if (enc->pending_len == 0)
+        return 0;
+
+    size_t written;
+    if (enc->encoding == ENCODING_HEX)
+        written = hex_scalar(enc->pending, enc->pending_len, output);
+    else
+        written = base64_scalar(enc->pending, enc->pending_len, output);
+
+    output[written++] = '\n';
+    enc->pending_len = 0;
+    return written;
+}
+
+const char *stream_encoder_backend(void)
+{
+#if defined(ENCODE_SSSE3)
+    return "ssse3";
+#elif defined(ENCODE_NEON)
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,31 @@
+// File: src/encode.h
+#ifndef ENCODE_H
+#define ENCODE_H
+
+#include <stddef.h>
+
+// Input bytes per output line: 57 bytes -> 76 base64 columns, 32 bytes -> 64 hex columns
+#define BASE64_LINE_BYTES 57
+#define HEX_LINE_BYTES 32
+
+typedef enum
+{
+    ENCODING_BASE64,
+    ENCODING_HEX
+} BinaryEncoding;
+
+// Line-wrapped streaming encoder; carries a partial line between updates
+typedef struct
+{
+    BinaryEncoding encoding;
+    unsigned char pending[BASE64_LINE_BYTES];
+    size_t pending_len;
+} StreamEncoder;
+
+void stream_encoder_init(StreamEncoder *enc, BinaryEncoding encoding);
+size_t stream_encoder_bound(BinaryEncoding encoding, size_t input_len);
+size_t stream_encoder_update(StreamEncoder *enc, const unsigned char *input, size_t len, char *output);
+size_t stream_encoder_finish(StreamEncoder *enc, char *output);
+const char *stream_encoder_backend(void);
+
+#endif
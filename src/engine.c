@@ -0,0 +1,305 @@
+// File: src/engine.c
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include "concat.h"
+#include "dirscan.h"
+#include "engine.h"
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
+#endif
+
+// A complete sample at most this large is a small tree: thread start-up costs more than it saves
+#define ENGINE_SMALL_FILES 256
+#define ENGINE_SMALL_BYTES (16ULL * 1024 * 1024)
+// Mean metadata lookup above this is cold or remote storage, where workers overlap the waits
+#define ENGINE_SLOW_STAT_US 50.0
+#define ENGINE_MAX_CPU_JOBS 16
+#define ENGINE_MAX_IO_JOBS 32
+
+static unsigned long long monotonic_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+}
+
+int engine_online_cpus(void)
+{
+#if defined(_SC_NPROCESSORS_ONLN)
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+#else
+    return 1;
+#endif
+}
+
+int engine_parallel_jobs(int cpus)
+{
+    if (cpus < 2)
+        return 2;
+    return cpus < ENGINE_MAX_CPU_JOBS ? cpus : ENGINE_MAX_CPU_JOBS;
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+typedef struct
+{
+    char **paths;
+    size_t *root_lengths; // Length of the root each path starts with
+    size_t head;
+    size_t count;
+    size_t capacity;
+} DirQueue;
+
+static int queue_push(DirQueue *queue, const char *parent, size_t root_length, const char *name, size_t name_length)
+{
+    if (queue->count == queue->capacity)
+    {
+        size_t capacity = queue->capacity ? queue->capacity * 2 : 64;
+        char **paths = realloc(queue->paths, capacity * sizeof(char *));
+        if (!paths)
+            return -1;
+        queue->paths = paths;
+        size_t *root_lengths = realloc(queue->root_lengths, capacity * sizeof(size_t));
+        if (!root_lengths)
+            return -1;
+        queue->root_lengths = root_lengths;
+        queue->capacity = capacity;
+    }
+    size_t parent_length = strlen(parent);
+    char *path = malloc(parent_length + name_length + 2);
+    if (!path)
+        return -1;
+    memcpy(path, parent, parent_length);
+    size_t used = parent_length;
+    if (name_length > 0)
+    {
+        if (used > 0 && path[used - 1] != '/')
+            path[used++] = '/';
+        memcpy(path + used, name, name_length);
+        used += name_length;
+    }
+    path[used] = '\0';
+    queue->root_lengths[queue->count] = root_length;
+    queue->paths[queue->count++] = path;
+    return 0;
+}
+
+// The entry's path below its root, as the walk passes it to is_excluded()
+static int sample_excluded(ExcludeList *excludes, const char *path, size_t root_length, const char *name)
+{
+    if (!excludes)
+        return 0;
+    const char *relative_dir = path + root_length;
+    while (*relative_dir == '/')
+        relative_dir++;
+    char relative[PATH_MAX];
+    int written = snprintf(relative, sizeof(relative), "%s%s%s", relative_dir, *relative_dir ? "/" : "", name);
+    return written > 0 && (size_t)written < sizeof(relative) && is_excluded(relative, excludes);
+}
+
+// Breadth first, so a wide top level is seen before one deep subtree. Symlinks are counted
+// but not followed. Excluded entries, the auto-excluded outputs among them, are skipped as the
+// walk skips them.
+void engine_sample(const char *const *roots, int root_count, ExcludeList *excludes, EngineSample *sample)
+{
+    memset(sample, 0, sizeof(*sample));
+    unsigned long long started = monotonic_ns();
+    unsigned long long deadline = started + ENGINE_SAMPLE_BUDGET_MS * 1000000ULL;
+    unsigned long long stat_ns = 0, stats = 0;
+
+    for (int r = 0; r < root_count; r++)
+        if (is_object_url(roots[r]))
+            sample->object_store = 1;
+    if (sample->object_store)
+    {
+        sample->elapsed_ms = (double)(monotonic_ns() - started) / 1e6;
+        return;
+    }
+
+#ifdef __linux__
+    struct statfs fs_info;
+    if (root_count > 0 && statfs(roots[0], &fs_info) == 0)
+    {
+        sample->fs_magic = (unsigned long)fs_info.f_type & 0xFFFFFFFFUL;
+        fs_type_name(sample->fs_magic, &sample->network);
+    }
+#endif
+
+    DirQueue queue;
+    memset(&queue, 0, sizeof(queue));
+    int truncated = 0;
+    for (int r = 0; r < root_count && !truncated; r++)
+        truncated = queue_push(&queue, roots[r], strlen(roots[r]), "", 0) != 0;
+
+    while (queue.head < queue.count && !truncated)
+    {
+        const char *path = queue.paths[queue.head];
+        size_t root_length = queue.root_lengths[queue.head++];
+        DirReader dir;
+        if (dir_reader_open(&dir, path) != 0)
+            continue;
+        sample->directories++;
+
+        DirEntry de;
+        while (dir_reader_next(&dir, &de))
+        {
+            if (sample->entries >= ENGINE_SAMPLE_ENTRIES ||
+                ((sample->entries & 63) == 63 && monotonic_ns() > deadline))
+            {
+                truncated = 1;
+                break;
+            }
+            sample->entries++;
+            if (sample_excluded(excludes, path, root_length, de.name))
+                continue;
+
+            if (de.type == DT_DIR)
+            {
+                if (queue_push(&queue, path, root_length, de.name, de.name_length) != 0)
+                {
+                    truncated = 1;
+                    break;
+                }
+                continue;
+            }
+            if (de.type != DT_REG && de.type != DT_UNKNOWN)
+                continue;
+
+            struct stat st;
+            unsigned long long before = monotonic_ns();
+            int found = fstatat(dir.fd, de.name, &st, AT_SYMLINK_NOFOLLOW) == 0;
+            stat_ns += monotonic_ns() - before;
+            stats++;
+            if (!found)
+                continue;
+            if (S_ISREG(st.st_mode))
+            {
+                sample->files++;
+                sample->bytes += (unsigned long long)st.st_size;
+            }
+            else if (S_ISDIR(st.st_mode) && queue_push(&queue, path, root_length, de.name, de.name_length) != 0)
+            {
+                truncated = 1;
+                break;
+            }
+        }
+        dir_reader_close(&dir);
+    }
+
+    sample->complete = !truncated && queue.head == queue.count;
+    for (size_t i = 0; i < queue.count; i++)
+        free(queue.paths[i]);
+    free(queue.paths);
+    free(queue.root_lengths);
+
+    sample->stat_us = stats > 0 ? (double)stat_ns / (double)stats / 1000.0 : 0.0;
+    sample->elapsed_ms = (double)(monotonic_ns() - started) / 1e6;
+}
+#else
+void engine_sample(const char *const *roots, int root_count, ExcludeList *excludes, EngineSample *sample)
+{
+    (void)roots;
+    (void)root_count;
+    (void)excludes;
+    memset(sample, 0, sizeof(*sample));
+}
+#endif
+
+void engine_choose(const EngineSample *sample, int cpus, EngineChoice *choice)
+{
+    choice->engine = ENGINE_SERIAL;
+    choice->jobs = 1;
+
+#if defined(_WIN32) || defined(_WIN64)
+    (void)sample;
+    (void)cpus;
+    choice->reason = "--jobs is not supported on Windows";
+#else
+    if (sample->object_store)
+    {
+        // Every read is a request with network latency: keep many in flight
+        int jobs = cpus * 4;
+        choice->engine = ENGINE_PARALLEL;
+        choice->jobs = jobs < 8 ? 8 : jobs > ENGINE_MAX_IO_JOBS ? ENGINE_MAX_IO_JOBS : jobs;
+        choice->reason = "object store";
+        return;
+    }
+
+    int small = sample->complete && sample->files <= ENGINE_SMALL_FILES && sample->bytes <= ENGINE_SMALL_BYTES;
+    if (small)
+    {
+        choice->reason = "small tree";
+    }
+    else if (sample->network || sample->stat_us >= ENGINE_SLOW_STAT_US)
+    {
+        // Waiting on storage, not the CPU: more workers than CPUs keep more requests in flight
+        int jobs = cpus * 4;
+        choice->engine = ENGINE_PARALLEL;
+        choice->jobs = jobs < 8 ? 8 : jobs > ENGINE_MAX_IO_JOBS ? ENGINE_MAX_IO_JOBS : jobs;
+        choice->reason = sample->network ? "network filesystem" : "slow metadata lookups";
+    }
+    else if (sample->files > 0 && sample->bytes / sample->files > EMIT_INLINE_SIZE)
+    {
+        choice->reason = "mostly large files, which the walking thread streams anyway";
+    }
+    else if (cpus < 2)
+    {
+        choice->reason = "one CPU";
+    }
+    else
+    {
+        choice->engine = ENGINE_PARALLEL;
+        choice->jobs = engine_parallel_jobs(cpus);
+        choice->reason = sample->complete ? "many files" : "tree larger than the sample";
+    }
+#endif
+}
+
+int parse_engine(const char *name, EngineKind *engine)
+{
+    static const struct
+    {
+        const char *name;
+        EngineKind engine;
+    } names[] = {
+        {"auto", ENGINE_AUTO},
+        {"serial", ENGINE_SERIAL},
+        {"parallel", ENGINE_PARALLEL},
+        {"reflink", ENGINE_REFLINK},
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        if (strcasecmp(name, names[i].name) == 0)
+        {
+            *engine = names[i].engine;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *engine_name(EngineKind engine)
+{
+    switch (engine)
+    {
+    case ENGINE_AUTO:
+        return "auto";
+    case ENGINE_SERIAL:
+        return "serial";
+    case ENGINE_PARALLEL:
+        return "parallel";
+    case ENGINE_REFLINK:
+        return "reflink";
+    }
+    return "?";
+}
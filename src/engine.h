@@ -0,0 +1,56 @@
+// File: src/engine.h
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include "concat.h"
+
+// Content pass engines --engine selects from. auto samples the start of the traversal.
+typedef enum
+{
+    ENGINE_AUTO,
+    ENGINE_SERIAL,   // The walking thread reads and writes every section
+    ENGINE_PARALLEL, // --jobs workers render sections, written in traversal order
+    ENGINE_REFLINK   // Serial, bodies cloned on copy-on-write filesystems (--reflink)
+} EngineKind;
+
+// What engine_sample() saw: a bounded breadth-first listing of the roots
+typedef struct
+{
+    unsigned long long entries;
+    unsigned long long files;
+    unsigned long long directories;
+    unsigned long long bytes; // Sizes of the files seen
+    int complete;             // Every root was listed to the end within the bounds
+    unsigned long fs_magic;   // statfs f_type of the first root, 0 = unknown
+    int network;              // The first root is on a network filesystem
+    int object_store;         // A root is an s3:// URL, which the sample does not list
+    double stat_us;           // Mean latency of one file's metadata lookup
+    double elapsed_ms;
+} EngineSample;
+
+typedef struct
+{
+    EngineKind engine; // ENGINE_SERIAL or ENGINE_PARALLEL
+    int jobs;
+    const char *reason;
+} EngineChoice;
+
+// Bounds of the sample: entries listed and wall time
+#define ENGINE_SAMPLE_ENTRIES 4096
+#define ENGINE_SAMPLE_BUDGET_MS 50
+
+// Read-ahead budget of a parallel choice when --max-memory is not given: without one, up to
+// jobs x 4 sections of up to 4 MiB each are buffered
+#define ENGINE_AUTO_MEMORY (128ULL * 1024 * 1024)
+
+void engine_sample(const char *const *roots, int root_count, ExcludeList *excludes, EngineSample *sample);
+void engine_choose(const EngineSample *sample, int cpus, EngineChoice *choice);
+
+// Workers for a CPU-bound content pass on this many CPUs
+int engine_parallel_jobs(int cpus);
+int engine_online_cpus(void);
+
+int parse_engine(const char *name, EngineKind *engine);
+const char *engine_name(EngineKind engine);
+
+#endif
@@ -0,0 +1,187 @@
+// File: src/generated.c
+#include <string.h>
+#include <math.h>
+#include "generated.h"
+
+// Dependency lockfiles, matched on the whole file name
+static const char *const lockfile_names[] = {
+    "package-lock.json", "npm-shrinkwrap.json", "yarn.lock",     "pnpm-lock.yaml", "bun.lock",
+    "deno.lock",         "Cargo.lock",          "Gemfile.lock",  "composer.lock",  "poetry.lock",
+    "Pipfile.lock",      "uv.lock",             "pdm.lock",      "go.sum",         "flake.lock",
+    "mix.lock",          "pubspec.lock",        "Podfile.lock",  "Package.resolved",
+    "packages.lock.json", "gradle.lockfile",
+};
+
+// Bundler, source map and code generator output, matched on the end of the file name
+static const char *const generated_suffixes[] = {
+    ".min.js",  ".min.mjs",     ".min.css",    ".js.map",       ".mjs.map",  ".css.map",
+    ".ts.map",  ".pb.go",       ".pb.gw.go",   "_pb2.py",       "_pb2.pyi",  "_pb2_grpc.py",
+    ".pb.h",    ".pb.cc",       "_pb.js",      "_pb.d.ts",      "_grpc_pb.js", ".pb.swift",
+    ".pb.dart", ".pbenum.dart", ".pbjson.dart", ".pbgrpc.dart", ".g.dart",   ".freezed.dart",
+    ".designer.cs", ".g.cs",
+};
+
+// Searched in leading comment lines only, so code that merely mentions them is not caught
+static const char *const generated_markers[] = {
+    "DO NOT EDIT",
+    "@generated",
+    "Generated by the protocol buffer compiler",
+    "Autogenerated by Thrift",
+    "automatically generated",
+    "auto-generated",
+    "AUTO-GENERATED",
+};
+
+static const char *const comment_prefixes[] = {"//", "/*", "*", "#", "<!--", "--", ";"};
+
+#define COUNT_OF(array) (sizeof(array) / sizeof((array)[0]))
+
+static const char *base_name(const char *path)
+{
+    const char *name = path;
+    for (const char *p = path; *p; p++)
+    {
+        if (*p == '/' || *p == '\\')
+            name = p + 1;
+    }
+    return name;
+}
+
+static int has_suffix(const char *name, size_t name_length, const char *suffix)
+{
+    size_t length = strlen(suffix);
+    return name_length > length && memcmp(name + name_length - length, suffix, length) == 0;
+}
+
+static int contains(const unsigned char *text, size_t len, const char *needle)
+{
+    size_t length = strlen(needle);
+    for (size_t i = 0; i + length <= len; i++)
+    {
+        if (text[i] == (unsigned char)needle[0] && memcmp(text + i, needle, length) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+static int has_generated_marker(const unsigned char *sniff, size_t len)
+{
+    size_t start = 0;
+    for (int line = 0; line < GENERATED_MARKER_LINES && start < len; line++)
+    {
+        const unsigned char *newline = memchr(sniff + start, '\n', len - start);
+        size_t end = newline ? (size_t)(newline - sniff) : len;
+
+        size_t text = start;
+        while (text < end && (sniff[text] == ' ' || sniff[text] == '\t'))
+            text++;
+        for (size_t p = 0; p < COUNT_OF(comment_prefixes); p++)
+        {
+            size_t length = strlen(comment_prefixes[p]);
+            if (end - text < length || memcmp(sniff + text, comment_prefixes[p], length) != 0)
+                continue;
+            for (size_t m = 0; m < COUNT_OF(generated_markers); m++)
+            {
+                if (contains(sniff + text, end - text, generated_markers[m]))
+                    return 1;
+            }
+            break;
+        }
+        start = end + 1;
+    }
+    return 0;
+}
+
+GeneratedReason detect_generated(const char *relative_path, const unsigned char *sniff, size_t len,
+                                 GeneratedSignals *signals)
+{
+    GeneratedSignals local;
+    if (!signals)
+        signals = &local;
+    memset(signals, 0, sizeof(*signals));
+
+    const char *name = base_name(relative_path);
+    size_t name_length = strlen(name);
+    for (size_t i = 0; i < COUNT_OF(lockfile_names); i++)
+    {
+        if (strcmp(name, lockfile_names[i]) == 0)
+            return GENERATED_REASON_LOCKFILE;
+    }
+    for (size_t i = 0; i < COUNT_OF(generated_suffixes); i++)
+    {
+        if (has_suffix(name, name_length, generated_suffixes[i]))
+            return GENERATED_REASON_NAME;
+    }
+    if (has_generated_marker(sniff, len))
+        return GENERATED_REASON_MARKER;
+    if (len < GENERATED_MIN_SNIFF)
+        return GENERATED_REASON_NONE;
+
+    // One pass for line lengths, whitespace and the byte histogram
+    size_t histogram[256] = {0};
+    size_t lines = 0, line_length = 0, whitespace = 0, high_bit = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char byte = sniff[i];
+        histogram[byte]++;
+        if (byte == '\n')
+        {
+            if (line_length > signals->max_line)
+                signals->max_line = line_length;
+            lines++;
+            line_length = 0;
+            continue;
+        }
+        line_length++;
+        if (byte == ' ' || byte == '\t')
+            whitespace++;
+        else if (byte > 127)
+            high_bit++;
+    }
+    if (line_length > 0)
+    {
+        // The window may end mid-line: it still counts as a line that long
+        if (line_length > signals->max_line)
+            signals->max_line = line_length;
+        lines++;
+    }
+    signals->average_line = (len - histogram['\n']) / lines;
+
+    double entropy = 0.0;
+    for (int b = 0; b < 256; b++)
+    {
+        if (histogram[b] == 0)
+            continue;
+        double p = (double)histogram[b] / (double)len;
+        entropy -= p * log2(p);
+    }
+    signals->entropy = entropy;
+
+    if (signals->max_line >= GENERATED_LONG_LINE && signals->average_line >= GENERATED_AVERAGE_LINE &&
+        whitespace * 100 < len * GENERATED_MAX_WHITESPACE_PCT)
+        return GENERATED_REASON_MINIFIED;
+    if (entropy >= GENERATED_ENCODED_ENTROPY && whitespace * 100 < len * GENERATED_ENCODED_WHITESPACE_PCT &&
+        high_bit * 100 < len)
+        return GENERATED_REASON_ENCODED;
+    return GENERATED_REASON_NONE;
+}
+
+const char *generated_reason_name(GeneratedReason reason)
+{
+    switch (reason)
+    {
+    case GENERATED_REASON_LOCKFILE:
+        return "lockfile";
+    case GENERATED_REASON_NAME:
+        return "generated name";
+    case GENERATED_REASON_MARKER:
+        return "generated marker";
+    case GENERATED_REASON_MINIFIED:
+        return "minified";
+    case GENERATED_REASON_ENCODED:
+        return "encoded data";
+    case GENERATED_REASON_NONE:
+        break;
+    }
+    return "not generated";
+}
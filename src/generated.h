@@ -0,0 +1,42 @@
+// File: src/generated.h
+#ifndef GENERATED_H
+#define GENERATED_H
+
+#include <stddef.h>
+
+// Content signals need a window at least this large; smaller files are judged by name and markers
+#define GENERATED_MIN_SNIFF 512
+#define GENERATED_MARKER_LINES 5          // Leading lines searched for "generated" markers
+#define GENERATED_LONG_LINE 1000          // Minified: the longest line reaches this...
+#define GENERATED_AVERAGE_LINE 200        // ...the average line reaches this...
+#define GENERATED_MAX_WHITESPACE_PCT 10   // ...and spaces/tabs stay below this share of bytes
+#define GENERATED_ENCODED_ENTROPY 5.5     // Encoded data: bits per byte at or above this,
+#define GENERATED_ENCODED_WHITESPACE_PCT 2 // almost no spaces and only ASCII
+
+typedef enum
+{
+    GENERATED_REASON_NONE,
+    GENERATED_REASON_LOCKFILE, // Name in the lockfile table
+    GENERATED_REASON_NAME,     // Generated-code suffix: .min.js, .pb.go, .js.map, ...
+    GENERATED_REASON_MARKER,   // "Code generated ... DO NOT EDIT", "@generated", ... in a leading comment
+    GENERATED_REASON_MINIFIED, // Long lines with little whitespace
+    GENERATED_REASON_ENCODED   // High-entropy ASCII without whitespace (embedded base64 and the like)
+} GeneratedReason;
+
+// Cheap statistics of a sniff window, reported with the verdict
+typedef struct
+{
+    size_t max_line;
+    size_t average_line;
+    double entropy; // Shannon entropy in bits per byte
+} GeneratedSignals;
+
+// Classify a text file from its path and the first bytes already read for binary detection.
+// Never reads the file; signals may be NULL.
+GeneratedReason detect_generated(const char *relative_path, const unsigned char *sniff, size_t len,
+                                 GeneratedSignals *signals);
+
+// Short label for notes and logs: "lockfile", "minified", ...
+const char *generated_reason_name(GeneratedReason reason);
+
+#endif
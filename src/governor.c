@@ -0,0 +1,56 @@
+// File: src/governor.c
+#include <string.h>
+#include "governor.h"
+
+void governor_init(MemoryGovernor *governor, unsigned long long limit)
+{
+    memset(governor, 0, sizeof(*governor));
+    governor->limit = limit;
+    pthread_mutex_init(&governor->mutex, NULL);
+}
+
+void governor_destroy(MemoryGovernor *governor)
+{
+    pthread_mutex_destroy(&governor->mutex);
+}
+
+static void governor_take(MemoryGovernor *governor, unsigned long long bytes)
+{
+    governor->used += bytes;
+    if (governor->used > governor->high_water)
+        governor->high_water = governor->used;
+}
+
+int governor_try_acquire(MemoryGovernor *governor, unsigned long long bytes)
+{
+    pthread_mutex_lock(&governor->mutex);
+    int fits = governor->limit == 0 || (bytes <= governor->limit && governor->used <= governor->limit - bytes);
+    if (fits)
+        governor_take(governor, bytes);
+    pthread_mutex_unlock(&governor->mutex);
+    return fits ? 0 : -1;
+}
+
+void governor_charge(MemoryGovernor *governor, unsigned long long bytes)
+{
+    pthread_mutex_lock(&governor->mutex);
+    governor_take(governor, bytes);
+    pthread_mutex_unlock(&governor->mutex);
+}
+
+void governor_release(MemoryGovernor *governor, unsigned long long bytes)
+{
+    pthread_mutex_lock(&governor->mutex);
+    governor->used = bytes < governor->used ? governor->used - bytes : 0;
+    pthread_mutex_unlock(&governor->mutex);
+}
+
+void governor_note_throttled(MemoryGovernor *governor)
+{
+    governor->throttled++;
+}
+
+void governor_note_streamed(MemoryGovernor *governor)
+{
+    governor->streamed++;
+}
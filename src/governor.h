@@ -0,0 +1,34 @@
+// File: src/governor.h
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <pthread.h>
+
+// --max-memory: a byte budget that the stages holding file data acquire from. Without a limit
+// it only accounts, so --stats can report the high-water mark.
+typedef struct
+{
+    unsigned long long limit; // 0 = unlimited
+    unsigned long long used;
+    unsigned long long high_water;
+    unsigned long long throttled; // Requests that waited for earlier sections to be written
+    unsigned long long streamed;  // Sections written without buffering because they did not fit
+    pthread_mutex_t mutex;
+} MemoryGovernor;
+
+void governor_init(MemoryGovernor *governor, unsigned long long limit);
+void governor_destroy(MemoryGovernor *governor);
+
+// Take bytes if they fit in the budget: 0 when granted, -1 otherwise
+int governor_try_acquire(MemoryGovernor *governor, unsigned long long bytes);
+
+// Account bytes that are already allocated or cannot be deferred, even past the limit
+void governor_charge(MemoryGovernor *governor, unsigned long long bytes);
+
+void governor_release(MemoryGovernor *governor, unsigned long long bytes);
+
+// Counters for --stats; the walking thread is the only one updating them
+void governor_note_throttled(MemoryGovernor *governor);
+void governor_note_streamed(MemoryGovernor *governor);
+
+#endif
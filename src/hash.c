@@ -0,0 +1,308 @@
+// File: src/hash.c
+#include <string.h>
+#include "hash.h"
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+// Unaligned little-endian loads; memcpy compiles to a single mov
+static inline uint64_t read64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline uint32_t read32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return v;
+}
+
+static inline uint64_t hash_round(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static inline uint64_t hash_merge_round(uint64_t acc, uint64_t val)
+{
+    acc ^= hash_round(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+void content_hash_init(ContentHash *hash)
+{
+    memset(hash, 0, sizeof(*hash));
+    hash->v[0] = PRIME64_1 + PRIME64_2;
+    hash->v[1] = PRIME64_2;
+    hash->v[2] = 0;
+    hash->v[3] = -PRIME64_1;
+}
+
+void content_hash_update(ContentHash *hash, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    const unsigned char *end = p + len;
+
+    hash->total_len += len;
+
+    // Not enough for a full stripe yet, keep it for later
+    if (hash->mem_size + len < 32)
+    {
+        memcpy(hash->mem + hash->mem_size, p, len);
+        hash->mem_size += len;
+        return;
+    }
+
+    // Complete the buffered stripe first
+    if (hash->mem_size > 0)
+    {
+        size_t fill = 32 - hash->mem_size;
+        memcpy(hash->mem + hash->mem_size, p, fill);
+        hash->v[0] = hash_round(hash->v[0], read64(hash->mem));
+        hash->v[1] = hash_round(hash->v[1], read64(hash->mem + 8));
+        hash->v[2] = hash_round(hash->v[2], read64(hash->mem + 16));
+        hash->v[3] = hash_round(hash->v[3], read64(hash->mem + 24));
+        p += fill;
+        hash->mem_size = 0;
+    }
+
+    // Main loop over 32-byte stripes, four independent lanes
+    if (p + 32 <= end)
+    {
+        uint64_t v1 = hash->v[0], v2 = hash->v[1], v3 = hash->v[2], v4 = hash->v[3];
+        const unsigned char *limit = end - 32;
+        do
+        {
+            v1 = hash_round(v1, read64(p));
+            v2 = hash_round(v2, read64(p + 8));
+            v3 = hash_round(v3, read64(p + 16));
+            v4 = hash_round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        hash->v[0] = v1;
+        hash->v[1] = v2;
+        hash->v[2] = v3;
+        hash->v[3] = v4;
+    }
+
+    if (p < end)
+    {
+        memcpy(hash->mem, p, (size_t)(end - p));
+        hash->mem_size = (size_t)(end - p);
+    }
+}
+
+uint64_t content_hash_final(const ContentHash *hash)
+{
+    uint64_t h;
+
+    if (hash->total_len >= 32)
+    {
+        h = rotl64(hash->v[0], 1) + rotl64(hash->v[1], 7) + rotl64(hash->v[2], 12) + rotl64(hash->v[3], 18);
+        h = hash_merge_round(h, hash->v[0]);
+        h = hash_merge_round(h, hash->v[1]);
+        h = hash_merge_round(h, hash->v[2]);
+        h = hash_merge_round(h, hash->v[3]);
+    }
+    else
+    {
+        h = hash->v[2] + PRIME64_5;
+    }
+
+    h += hash->total_len;
+
+    const unsigned char *p = hash->mem;
+    const unsigned char *end = p + hash->mem_size;
+
+    while (p + 8 <= end)
+    {
+        h ^= hash_round(0, read64(p));
+        h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+
+    if (p + 4 <= end)
+    {
+        h ^= (uint64_t)read32(p) * PRIME64_1;
+        h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+
+    while (p < end)
+    {
+        h ^= (*p) * PRIME64_5;
+        h = rotl64(h, 11) * PRIME64_1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t rotr32(uint32_t x, int r)
+{
+    return (x >> r) | (x << (32 - r));
+}
+
+static void sha256_block(Sha256 *sha, const unsigned char *p)
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t)p[i * 4] << 24 | (uint32_t)p[i * 4 + 1] << 16 | (uint32_t)p[i * 4 + 2] << 8 | p[i * 4 + 3];
+    for (int i = 16; i < 64; i++)
+    {
+        uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = sha->state[0], b = sha->state[1], c = sha->state[2], d = sha->state[3];
+    uint32_t e = sha->state[4], f = sha->state[5], g = sha->state[6], h = sha->state[7];
+    for (int i = 0; i < 64; i++)
+    {
+        uint32_t t1 = h + (rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        uint32_t t2 = (rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    sha->state[0] += a;
+    sha->state[1] += b;
+    sha->state[2] += c;
+    sha->state[3] += d;
+    sha->state[4] += e;
+    sha->state[5] += f;
+    sha->state[6] += g;
+    sha->state[7] += h;
+}
+
+void sha256_init(Sha256 *sha)
+{
+    static const uint32_t initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    memcpy(sha->state, initial, sizeof(initial));
+    sha->total_len = 0;
+    sha->block_size = 0;
+}
+
+void sha256_update(Sha256 *sha, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    sha->total_len += len;
+    while (len > 0)
+    {
+        if (sha->block_size == 0 && len >= 64)
+        {
+            sha256_block(sha, p);
+            p += 64;
+            len -= 64;
+            continue;
+        }
+        size_t fill = 64 - sha->block_size < len ? 64 - sha->block_size : len;
+        memcpy(sha->block + sha->block_size, p, fill);
+        sha->block_size += fill;
+        p += fill;
+        len -= fill;
+        if (sha->block_size == 64)
+        {
+            sha256_block(sha, sha->block);
+            sha->block_size = 0;
+        }
+    }
+}
+
+void sha256_final(Sha256 *sha, unsigned char digest[SHA256_DIGEST_SIZE])
+{
+    uint64_t bits = sha->total_len * 8;
+    sha->block[sha->block_size++] = 0x80;
+    if (sha->block_size > 56)
+    {
+        memset(sha->block + sha->block_size, 0, 64 - sha->block_size);
+        sha256_block(sha, sha->block);
+        sha->block_size = 0;
+    }
+    memset(sha->block + sha->block_size, 0, 56 - sha->block_size);
+    for (int i = 0; i < 8; i++)
+        sha->block[56 + i] = (unsigned char)(bits >> (56 - i * 8));
+    sha256_block(sha, sha->block);
+
+    for (int i = 0; i < 8; i++)
+    {
+        digest[i * 4] = (unsigned char)(sha->state[i] >> 24);
+        digest[i * 4 + 1] = (unsigned char)(sha->state[i] >> 16);
+        digest[i * 4 + 2] = (unsigned char)(sha->state[i] >> 8);
+        digest[i * 4 + 3] = (unsigned char)sha->state[i];
+    }
+}
+
+void hmac_sha256(const void *key, size_t key_len, const void *data, size_t len,
+                 unsigned char digest[SHA256_DIGEST_SIZE])
+{
+    unsigned char block[64];
+    unsigned char inner[SHA256_DIGEST_SIZE];
+    memset(block, 0, sizeof(block));
+    if (key_len > sizeof(block))
+    {
+        Sha256 sha;
+        sha256_init(&sha);
+        sha256_update(&sha, key, key_len);
+        sha256_final(&sha, block);
+    }
+    else
+    {
+        memcpy(block, key, key_len);
+    }
+
+    Sha256 sha;
+    for (size_t i = 0; i < sizeof(block); i++)
+        block[i] ^= 0x36;
+    sha256_init(&sha);
+    sha256_update(&sha, block, sizeof(block));
+    sha256_update(&sha, data, len);
+    sha256_final(&sha, inner);
+
+    for (size_t i = 0; i < sizeof(block); i++)
+        block[i] ^= 0x36 ^ 0x5c;
+    sha256_init(&sha);
+    sha256_update(&sha, block, sizeof(block));
+    sha256_update(&sha, inner, sizeof(inner));
+    sha256_final(&sha, digest);
+}
@@ -0,0 +1,38 @@
+// File: src/hash.h
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming 64-bit content hash (XXH64 compatible, seed 0)
+typedef struct
+{
+    uint64_t v[4];
+    uint64_t total_len;
+    unsigned char mem[32];
+    size_t mem_size;
+} ContentHash;
+
+void content_hash_init(ContentHash *hash);
+void content_hash_update(ContentHash *hash, const void *data, size_t len);
+uint64_t content_hash_final(const ContentHash *hash);
+
+// SHA-256 and HMAC-SHA256, for request signing (objstore.c); not used on file content
+#define SHA256_DIGEST_SIZE 32
+
+typedef struct
+{
+    uint32_t state[8];
+    uint64_t total_len;
+    unsigned char block[64];
+    size_t block_size;
+} Sha256;
+
+void sha256_init(Sha256 *sha);
+void sha256_update(Sha256 *sha, const void *data, size_t len);
+void sha256_final(Sha256 *sha, unsigned char digest[SHA256_DIGEST_SIZE]);
+void hmac_sha256(const void *key, size_t key_len, const void *data, size_t len,
+                 unsigned char digest[SHA256_DIGEST_SIZE]);
+
+#endif
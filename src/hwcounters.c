@@ -0,0 +1,201 @@
+// File: src/hwcounters.c
+#include <string.h>
+#include <errno.h>
+#include "hwcounters.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static const struct
+{
+    unsigned type;
+    unsigned long long config;
+} counter_events[HW_COUNTER_COUNT] = {
+    [HW_CYCLES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    [HW_INSTRUCTIONS] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    [HW_CACHE_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    [HW_BRANCH_MISSES] = {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    [HW_CONTEXT_SWITCHES] = {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    [HW_PAGE_FAULTS] = {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+static int open_counter(HwCounter counter, int exclude_kernel)
+{
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = counter_events[counter].type;
+    attr.config = counter_events[counter].config;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.exclude_kernel = exclude_kernel;
+    attr.exclude_hv = 1;
+    // pid 0, cpu -1: this thread on any CPU; threads it creates are not counted
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Value scaled up for the time the kernel multiplexed the counter out
+static void read_counters(HwThreadCounters *counters, unsigned long long *value, unsigned long long *enabled,
+                          unsigned long long *running)
+{
+    for (int i = 0; i < HW_COUNTER_COUNT; i++)
+    {
+        unsigned long long data[3] = {0, 0, 0};
+        if (counters->fds[i] >= 0 && read(counters->fds[i], data, sizeof(data)) != (ssize_t)sizeof(data))
+            memset(data, 0, sizeof(data));
+        value[i] = data[0];
+        enabled[i] = data[1];
+        running[i] = data[2];
+    }
+}
+#endif
+
+void hw_stats_init(HwStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    pthread_mutex_init(&stats->mutex, NULL);
+}
+
+void hw_stats_destroy(HwStats *stats)
+{
+    pthread_mutex_destroy(&stats->mutex);
+}
+
+void hw_thread_open(HwStats *stats, HwThreadCounters *counters)
+{
+    memset(counters, 0, sizeof(*counters));
+    for (int i = 0; i < HW_COUNTER_COUNT; i++)
+    {
+        int fd = -1, error = ENOSYS;
+#ifdef __linux__
+        fd = open_counter((HwCounter)i, 0);
+        // perf_event_paranoid 2 still allows counting user space
+        if (fd < 0 && (errno == EACCES || errno == EPERM))
+            fd = open_counter((HwCounter)i, 1);
+        error = errno;
+#endif
+        counters->fds[i] = fd;
+
+        pthread_mutex_lock(&stats->mutex);
+        if (fd >= 0)
+            stats->available |= 1u << i;
+        else if (stats->open_error[i] == 0)
+            stats->open_error[i] = error;
+        pthread_mutex_unlock(&stats->mutex);
+    }
+}
+
+void hw_thread_close(HwThreadCounters *counters)
+{
+    for (int i = 0; i < HW_COUNTER_COUNT; i++)
+    {
+#ifdef __linux__
+        if (counters->fds[i] >= 0)
+            close(counters->fds[i]);
+#endif
+        counters->fds[i] = -1;
+    }
+}
+
+void hw_stage_begin(HwThreadCounters *counters)
+{
+#ifdef __linux__
+    read_counters(counters, counters->value, counters->enabled, counters->running);
+#else
+    (void)counters;
+#endif
+}
+
+void hw_stage_end(HwStats *stats, HwThreadCounters *counters, HwStage stage, unsigned long long bytes)
+{
+    unsigned long long delta[HW_COUNTER_COUNT];
+    memset(delta, 0, sizeof(delta));
+#ifdef __linux__
+    unsigned long long value[HW_COUNTER_COUNT], enabled[HW_COUNTER_COUNT], running[HW_COUNTER_COUNT];
+    read_counters(counters, value, enabled, running);
+    for (int i = 0; i < HW_COUNTER_COUNT; i++)
+    {
+        unsigned long long counted = value[i] - counters->value[i];
+        unsigned long long time_enabled = enabled[i] - counters->enabled[i];
+        unsigned long long time_running = running[i] - counters->running[i];
+        if (time_running == 0)
+            delta[i] = 0;
+        else if (time_running < time_enabled)
+            delta[i] = (unsigned long long)((double)counted * (double)time_enabled / (double)time_running);
+        else
+            delta[i] = counted;
+    }
+#else
+    (void)counters;
+#endif
+
+    pthread_mutex_lock(&stats->mutex);
+    HwStageTotals *totals = &stats->stages[stage];
+    for (int i = 0; i < HW_COUNTER_COUNT; i++)
+        totals->values[i] += delta[i];
+    totals->bytes += bytes;
+    totals->threads++;
+    pthread_mutex_unlock(&stats->mutex);
+}
+
+const char *hw_counter_name(HwCounter counter)
+{
+    switch (counter)
+    {
+    case HW_CYCLES:
+        return "cycles";
+    case HW_INSTRUCTIONS:
+        return "instructions";
+    case HW_CACHE_MISSES:
+        return "cache misses";
+    case HW_BRANCH_MISSES:
+        return "branch misses";
+    case HW_CONTEXT_SWITCHES:
+        return "context switches";
+    case HW_PAGE_FAULTS:
+        return "page faults";
+    case HW_COUNTER_COUNT:
+        break;
+    }
+    return "?";
+}
+
+const char *hw_stage_name(HwStage stage)
+{
+    switch (stage)
+    {
+    case HW_STAGE_STRUCTURE:
+        return "structure";
+    case HW_STAGE_CONTENT:
+        return "content";
+    case HW_STAGE_RENDER:
+        return "render";
+    case HW_STAGE_SUMMARY:
+        return "summary";
+    case HW_STAGE_COUNT:
+        break;
+    }
+    return "?";
+}
+
+const char *hw_open_error_text(int error)
+{
+    switch (error)
+    {
+    case ENOENT:
+#ifdef EOPNOTSUPP
+    case EOPNOTSUPP:
+#endif
+        return "not supported by this CPU or VM";
+    case EACCES:
+    case EPERM:
+        return "blocked by kernel.perf_event_paranoid or the container's seccomp policy";
+    case ENOSYS:
+        return "perf events are not available on this system";
+    case EMFILE:
+    case ENFILE:
+        return "out of file descriptors";
+    }
+    return strerror(error);
+}
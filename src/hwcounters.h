@@ -0,0 +1,69 @@
+// File: src/hwcounters.h
+#ifndef HWCOUNTERS_H
+#define HWCOUNTERS_H
+
+#include <pthread.h>
+
+// --stats=hw: perf_event_open counters per thread, summed per pipeline stage
+typedef enum
+{
+    HW_CYCLES,
+    HW_INSTRUCTIONS,
+    HW_CACHE_MISSES,
+    HW_BRANCH_MISSES,
+    HW_CONTEXT_SWITCHES,
+    HW_PAGE_FAULTS,
+    HW_COUNTER_COUNT
+} HwCounter;
+
+typedef enum
+{
+    HW_STAGE_STRUCTURE, // Walk and directory structure, on the walking thread
+    HW_STAGE_CONTENT,   // Walk, read and write file sections; only write and large files under --jobs
+    HW_STAGE_RENDER,    // --jobs workers reading and rendering sections into memory
+    HW_STAGE_SUMMARY,   // Plugin aggregation summaries
+    HW_STAGE_COUNT
+} HwStage;
+
+// Counter state of the thread that opened it: perf events count only that thread
+typedef struct
+{
+    int fds[HW_COUNTER_COUNT]; // -1 = unavailable
+    unsigned long long value[HW_COUNTER_COUNT];
+    unsigned long long enabled[HW_COUNTER_COUNT];
+    unsigned long long running[HW_COUNTER_COUNT];
+} HwThreadCounters;
+
+typedef struct
+{
+    unsigned long long values[HW_COUNTER_COUNT];
+    unsigned long long bytes; // Output the stage produced
+    int threads;
+} HwStageTotals;
+
+typedef struct
+{
+    HwStageTotals stages[HW_STAGE_COUNT];
+    unsigned available;            // Bit per counter that opened on some thread
+    int open_error[HW_COUNTER_COUNT]; // errno of the first failed open, 0 = none
+    pthread_mutex_t mutex;
+} HwStats;
+
+void hw_stats_init(HwStats *stats);
+void hw_stats_destroy(HwStats *stats);
+
+// Open the calling thread's counters; counters the kernel refuses stay closed and are reported
+void hw_thread_open(HwStats *stats, HwThreadCounters *counters);
+void hw_thread_close(HwThreadCounters *counters);
+
+// Bracket a stage on the thread that opened the counters; bytes is the output it produced
+void hw_stage_begin(HwThreadCounters *counters);
+void hw_stage_end(HwStats *stats, HwThreadCounters *counters, HwStage stage, unsigned long long bytes);
+
+const char *hw_counter_name(HwCounter counter);
+const char *hw_stage_name(HwStage stage);
+
+// Why a counter did not open: "not supported by this CPU or VM", "blocked by perf_event_paranoid", ...
+const char *hw_open_error_text(int error);
+
+#endif
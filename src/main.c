@@ -15,18 +15,34 @@
 
 #ifdef _WIN32
 #include <windows.h>
+#include <io.h>
 #include <libgen.h>
 #define PATH_MAX 260
 #define strnicmp _strnicmp
 #else
 #include <limits.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/resource.h>
 #endif
 
 #include "concat.h"
+#include "directio.h"
+#include "encode.h"
+#include "engine.h"
+#include "sink.h"
+#include "hash.h"
+#include "metrics.h"
 
 #define FCONCAT_VERSION "0.1.0"
 #define FCONCAT_COPYRIGHT "Copyright (c) 2025 Soroush Khosravi Dehaghi"
 
+// Exit code for a run stopped by SIGINT/SIGTERM after writing its checkpoint
+#define EXIT_INTERRUPTED 2
+
+// Smallest --max-memory budget; at most a quarter of it goes to --direct-io buffers
+#define MIN_MAX_MEMORY (1024ULL * 1024)
+
 static int is_verbose()
 {
     const char *env = getenv("FCONCAT_VERBOSE");
@@ -34,25 +50,81 @@ static int is_verbose()
 }
 
 // Global variables for signal handling
-#ifdef WITH_PLUGINS
-static PluginManager *g_plugin_manager = NULL;
-#endif
 static int g_interactive_mode = 0;
+static volatile sig_atomic_t g_shutdown_signal = 0;
+#if !defined(_WIN32) && !defined(_WIN64)
+static volatile int g_shutdown_pipe = -1; // Write end of the interactive wait's self-pipe
+#endif
 
-// Signal handler for graceful shutdown
+// Interactive shutdown: only flags are set here. The walk stops at the next entry boundary,
+// the interactive wait wakes up, and main() tears down plugins and the metrics endpoint.
 static void signal_handler(int signum)
 {
-    printf("\n🔌 Received signal %d, shutting down plugins...\n", signum);
-#ifdef WITH_PLUGINS
-    if (g_plugin_manager)
+    g_shutdown_signal = signum;
+    request_processing_stop();
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (g_shutdown_pipe >= 0)
     {
-        destroy_plugin_manager(g_plugin_manager);
-        g_plugin_manager = NULL;
+        int saved_errno = errno;
+        ssize_t written = write(g_shutdown_pipe, "", 1);
+        (void)written;
+        errno = saved_errno;
     }
 #endif
-    exit(EXIT_SUCCESS);
 }
 
+// Checkpointed runs stop at the next entry boundary and record their cursor instead of dying
+static void checkpoint_signal_handler(int signum)
+{
+    (void)signum;
+    request_processing_stop();
+}
+
+#if defined(WITH_PLUGINS) && !defined(_WIN32) && !defined(_WIN64)
+// Interactive mode: wait for Enter or SIGINT/SIGTERM. The handler may run on any thread, so it
+// wakes this poll() through a self-pipe. When stdin closes (a service on /dev/null) the wait
+// goes on while metrics are served, else it ends. The pipe stays open until exit, since a late
+// signal may still write to it.
+static void interactive_wait(int serving_metrics)
+{
+    int wake[2] = {-1, -1};
+    if (pipe(wake) == 0)
+    {
+        fcntl(wake[0], F_SETFD, FD_CLOEXEC);
+        fcntl(wake[1], F_SETFD, FD_CLOEXEC);
+        fcntl(wake[1], F_SETFL, O_NONBLOCK);
+        g_shutdown_pipe = wake[1];
+    }
+
+    int stdin_open = 1;
+    while (!g_shutdown_signal)
+    {
+        struct pollfd fds[2] = {{wake[0], POLLIN, 0}, {STDIN_FILENO, POLLIN, 0}};
+        if (poll(fds, stdin_open ? 2 : 1, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[0].revents)
+            break;
+        if (!stdin_open || !fds[1].revents)
+            continue;
+
+        char buffer[256];
+        if (fgets(buffer, sizeof(buffer), stdin) != NULL)
+            break;
+        if (is_verbose())
+            fprintf(stderr, "[fconcat] Input stream closed or error occurred\n");
+        if (!serving_metrics)
+            break;
+        printf("stdin closed; serving metrics until SIGINT or SIGTERM\n");
+        fflush(stdout);
+        stdin_open = 0;
+    }
+}
+#endif
+
 // Get the basename (filename) part of a path
 static char *get_filename(const char *path)
 {
@@ -88,6 +160,217 @@ static char *get_absolute_path(const char *path, char *abs_path, size_t abs_path
     return abs_path;
 }
 
+// Fingerprint of the paths and every output-shaping option, so --resume refuses a changed command line
+static unsigned long long options_fingerprint(int argc, char *argv[], int first_option)
+{
+    ContentHash hash;
+    content_hash_init(&hash);
+    for (int i = 1; i < first_option - 1; i++)
+    {
+        char abs_root[PATH_MAX];
+        get_absolute_path(argv[i], abs_root, sizeof(abs_root));
+        content_hash_update(&hash, abs_root, strlen(abs_root) + 1);
+    }
+    // The output path as given: it may not exist on the first run
+    content_hash_update(&hash, argv[first_option - 1], strlen(argv[first_option - 1]) + 1);
+
+    for (int i = first_option; i < argc; i++)
+    {
+        // Options that do not change the output: a run may resume with a different budget, job count or engine
+        if (strcmp(argv[i], "--resume") == 0 || strcmp(argv[i], "--stats") == 0 || strcmp(argv[i], "--stats=hw") == 0)
+            continue;
+        // --engine reflink pads the bodies as --reflink does; the other engines write the same bytes
+        if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc && strcasecmp(argv[i + 1], "reflink") == 0)
+        {
+            content_hash_update(&hash, "--reflink", sizeof("--reflink"));
+            i++;
+            continue;
+        }
+        if (strcmp(argv[i], "--checkpoint") == 0 || strcmp(argv[i], "--checkpoint-interval") == 0 ||
+            strcmp(argv[i], "--max-memory") == 0 || strcmp(argv[i], "--metrics") == 0 ||
+            strcmp(argv[i], "--s3-connections") == 0 || strcmp(argv[i], "--jobs") == 0 ||
+            strcmp(argv[i], "--engine") == 0)
+        {
+            i++;
+            continue;
+        }
+        content_hash_update(&hash, argv[i], strlen(argv[i]) + 1);
+    }
+
+    return content_hash_final(&hash);
+}
+
+// Sample the roots and set ctx->jobs for the engine that suits them. Returns 1 when it picked
+// the parallel engine.
+static int choose_engine(ProcessingContext *ctx, const char *const *roots, int root_count, ExcludeList *excludes,
+                         int plugins)
+{
+    EngineSample sample;
+    EngineChoice choice;
+    if (plugins > 0)
+    {
+        // Plugin callbacks have only run concurrently when asked for: a plugin with global state
+        // must not start sharing it across workers after an upgrade
+        ctx->jobs = 1;
+        if (is_verbose())
+            fprintf(stderr, "[fconcat] Engine: serial (%d plugin%s loaded); override with --engine parallel or --jobs\n",
+                    plugins, plugins == 1 ? "" : "s");
+        return 0;
+    }
+
+    int cpus = engine_online_cpus();
+    engine_sample(roots, root_count, excludes, &sample);
+    engine_choose(&sample, cpus, &choice);
+    ctx->jobs = choice.jobs;
+
+    if (is_verbose())
+    {
+        int network;
+        const char *fs_name = fs_type_name(sample.fs_magic, &network);
+        char fs_text[32];
+        if (sample.object_store)
+            fs_name = "object store";
+        else if (!fs_name)
+            snprintf(fs_text, sizeof(fs_text), "0x%lx", sample.fs_magic);
+        fprintf(stderr,
+                "[fconcat] Engine sample: %llu entries in %.1f ms (%s), %llu files, %.1f MB, "
+                "filesystem %s, %.1f us per stat, %d CPUs\n",
+                sample.entries, sample.elapsed_ms, sample.complete ? "whole tree" : "partial", sample.files,
+                (double)sample.bytes / (1024.0 * 1024.0), fs_name ? fs_name : fs_text, sample.stat_us, cpus);
+        if (choice.engine == ENGINE_PARALLEL)
+            fprintf(stderr, "[fconcat] Engine: parallel, %d jobs (%s); override with --engine or --jobs\n",
+                    choice.jobs, choice.reason);
+        else
+            fprintf(stderr, "[fconcat] Engine: serial (%s); override with --engine or --jobs\n", choice.reason);
+    }
+    return choice.engine == ENGINE_PARALLEL;
+}
+
+#ifdef WITH_PLUGINS
+// --metrics: time the callbacks of every plugin in a chain
+static void watch_plugins(Metrics *metrics, PluginManager *manager)
+{
+    for (int i = 0; i < manager->count; i++)
+    {
+        StreamingPlugin *plugin = manager->plugins[i];
+        if (plugin)
+            plugin->metrics = metrics_plugin_slot(metrics, plugin->name ? plugin->name : "unnamed");
+    }
+}
+#endif
+
+// One column of the --stats=hw table: the value per MB of output, or n/a for a closed counter
+static void print_hw_column(const HwStats *hw, const HwStageTotals *totals, HwCounter counter, int per_mb,
+                            int width)
+{
+    if (!(hw->available & (1u << counter)))
+        printf(" %*s", width, "n/a");
+    else if (!per_mb)
+        printf(" %*llu", width, totals->values[counter]);
+    else if (totals->bytes == 0)
+        printf(" %*s", width, "-");
+    else
+        printf(" %*.0f", width, (double)totals->values[counter] * (1024.0 * 1024.0) / (double)totals->bytes);
+}
+
+static void print_hw_row(const HwStats *hw, const char *name, const HwStageTotals *totals)
+{
+    printf("   %-10s %7d %9.2f", name, totals->threads, (double)totals->bytes / (1024.0 * 1024.0));
+    unsigned both = (1u << HW_CYCLES) | (1u << HW_INSTRUCTIONS);
+    if ((hw->available & both) == both && totals->values[HW_CYCLES] > 0)
+        printf(" %6.2f", (double)totals->values[HW_INSTRUCTIONS] / (double)totals->values[HW_CYCLES]);
+    else
+        printf(" %6s", "n/a");
+    print_hw_column(hw, totals, HW_CACHE_MISSES, 1, 16);
+    print_hw_column(hw, totals, HW_BRANCH_MISSES, 1, 17);
+    print_hw_column(hw, totals, HW_CONTEXT_SWITCHES, 0, 12);
+    print_hw_column(hw, totals, HW_PAGE_FAULTS, 0, 12);
+    printf("\n");
+}
+
+// --stats=hw: IPC and misses per MB of output for each pipeline stage
+static void print_hw_stats(const HwStats *hw)
+{
+    printf("   Hardware counters per stage (perf events; MB = output produced):\n");
+    if (hw->available == 0)
+    {
+        printf("   Unavailable     : %s\n", hw_open_error_text(hw->open_error[HW_CYCLES]));
+        return;
+    }
+
+    // Closed counters, grouped by the reason the kernel gave
+    for (int i = 0; i < HW_COUNTER_COUNT; i++)
+    {
+        int error = hw->open_error[i];
+        if ((hw->available & (1u << i)) || error == 0)
+            continue;
+        int first = 1;
+        for (int j = 0; j < i && first; j++)
+            first = (hw->available & (1u << j)) || hw->open_error[j] != error;
+        if (!first)
+            continue;
+        printf("   Unavailable     :");
+        for (int j = i; j < HW_COUNTER_COUNT; j++)
+        {
+            if (!(hw->available & (1u << j)) && hw->open_error[j] == error)
+                printf("%s %s", j == i ? "" : ",", hw_counter_name((HwCounter)j));
+        }
+        printf(" (%s)\n", hw_open_error_text(error));
+    }
+
+    printf("   %-10s %7s %9s %6s %16s %17s %12s %12s\n", "Stage", "Threads", "MB", "IPC", "Cache misses/MB",
+           "Branch misses/MB", "Ctx switches", "Page faults");
+    HwStageTotals total;
+    memset(&total, 0, sizeof(total));
+    for (int stage = 0; stage < HW_STAGE_COUNT; stage++)
+    {
+        const HwStageTotals *totals = &hw->stages[stage];
+        if (totals->threads == 0)
+            continue;
+        print_hw_row(hw, hw_stage_name((HwStage)stage), totals);
+        for (int i = 0; i < HW_COUNTER_COUNT; i++)
+            total.values[i] += totals->values[i];
+        total.threads += totals->threads;
+    }
+    // Under --jobs the render and content stages handle the same bytes: the total counts them once
+    total.bytes = hw->stages[HW_STAGE_STRUCTURE].bytes + hw->stages[HW_STAGE_CONTENT].bytes +
+                  hw->stages[HW_STAGE_SUMMARY].bytes;
+    print_hw_row(hw, "total", &total);
+}
+
+// --stats: memory high-water marks of the run, and hardware counters with --stats=hw
+static void print_stats(const MemoryGovernor *governor, const HwStats *hw)
+{
+    char text[32];
+    printf("\n📊 Statistics:\n");
+    format_size(governor->high_water, text, sizeof(text));
+    printf("   Buffered peak   : %s", text);
+    if (governor->limit > 0)
+    {
+        format_size(governor->limit, text, sizeof(text));
+        printf(" of %s budget", text);
+    }
+    printf("\n");
+#if !defined(_WIN32) && !defined(_WIN64)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+#ifdef __APPLE__
+        unsigned long long peak = (unsigned long long)usage.ru_maxrss; // Bytes
+#else
+        unsigned long long peak = (unsigned long long)usage.ru_maxrss * 1024; // KiB
+#endif
+        format_size(peak, text, sizeof(text));
+        printf("   Peak RSS        : %s\n", text);
+    }
+#endif
+    if (governor->throttled > 0 || governor->streamed > 0)
+        printf("   Memory pressure : %llu sections waited, %llu streamed without buffering\n",
+               governor->throttled, governor->streamed);
+    if (hw)
+        print_hw_stats(hw);
+}
+
 // Get relative path from base_dir to target_path
 static char *get_relative_path(const char *base_dir, const char *target_path)
 {
@@ -135,6 +418,181 @@ static char *get_relative_path(const char *base_dir, const char *target_path)
     return NULL;
 }
 
+// Parse a non-negative decimal integer option value
+static int parse_count(const char *text, int *value)
+{
+    char *end;
+    errno = 0;
+    long parsed = strtol(text, &end, 10);
+    if (errno != 0 || end == text || *end != '\0' || parsed < 0 || parsed > INT_MAX)
+        return -1;
+    *value = (int)parsed;
+    return 0;
+}
+
+// Parse a byte size with an optional K, M or G suffix (powers of 1024)
+static int parse_size(const char *text, unsigned long long *value)
+{
+    char *end;
+    errno = 0;
+    unsigned long long parsed = strtoull(text, &end, 10);
+    if (errno != 0 || end == text || text[0] == '-')
+        return -1;
+
+    unsigned long long multiplier = 1;
+    switch (*end)
+    {
+    case '\0':
+        break;
+    case 'k':
+    case 'K':
+        multiplier = 1024ULL;
+        break;
+    case 'm':
+    case 'M':
+        multiplier = 1024ULL * 1024;
+        break;
+    case 'g':
+    case 'G':
+        multiplier = 1024ULL * 1024 * 1024;
+        break;
+    default:
+        return -1;
+    }
+    if (*end != '\0' && end[1] != '\0' && strcasecmp(end + 1, "B") != 0 && strcasecmp(end + 1, "iB") != 0)
+        return -1;
+    if (parsed > ULLONG_MAX / multiplier)
+        return -1;
+
+    *value = parsed * multiplier;
+    return 0;
+}
+
+// Exclude an output file from every input root it lives under, by absolute, relative and base
+// name. Returns the number of patterns added.
+static int auto_exclude_output(ExcludeList *excludes, char *const roots[], int root_count, const char *output_file)
+{
+    char abs_input[PATH_MAX];
+    char abs_output[PATH_MAX];
+    int added = 0;
+    get_absolute_path(output_file, abs_output, sizeof(abs_output));
+
+#ifdef _WIN32
+    // Normalize paths for comparison
+    for (char *p = abs_output; *p; p++)
+    {
+        if (*p == '\\')
+            *p = '/';
+    }
+#endif
+    for (int r = 0; r < root_count; r++)
+    {
+        const char *input_dir = roots[r];
+        get_absolute_path(input_dir, abs_input, sizeof(abs_input));
+        int output_inside_input = 0;
+
+#ifdef _WIN32
+        for (char *p = abs_input; *p; p++)
+        {
+            if (*p == '\\')
+                *p = '/';
+        }
+        // Windows case-insensitive comparison
+        if (strnicmp(abs_output, abs_input, strlen(abs_input)) == 0)
+        {
+            output_inside_input = 1;
+        }
+#else
+        if (strncmp(abs_output, abs_input, strlen(abs_input)) == 0)
+        {
+            output_inside_input = 1;
+        }
+#endif
+
+        if (output_inside_input)
+        {
+            // Add absolute path exclusion
+            if (is_verbose())
+                fprintf(stderr, "[fconcat] Auto-excluding output file by absolute path: %s\n", abs_output);
+            add_exclude_pattern(excludes, abs_output);
+            added++;
+
+            // Add relative path exclusion
+            char *relative_path = get_relative_path(input_dir, output_file);
+            if (relative_path)
+            {
+                if (is_verbose())
+                    fprintf(stderr, "[fconcat] Auto-excluding output file by relative path: %s\n", relative_path);
+                add_exclude_pattern(excludes, relative_path);
+                added++;
+                free(relative_path);
+            }
+        }
+
+        // Special case for current directory
+        if (strcmp(input_dir, ".") == 0)
+        {
+            if (is_verbose())
+                fprintf(stderr, "[fconcat] Auto-excluding output file by path (current dir): %s\n", output_file);
+            add_exclude_pattern(excludes, output_file);
+            added++;
+        }
+    }
+
+    // Always exclude by basename as fallback
+    const char *output_basename = get_filename(output_file);
+    if (is_verbose())
+        fprintf(stderr, "[fconcat] Auto-excluding output file by name: %s\n", output_basename);
+    add_exclude_pattern(excludes, output_basename);
+    added++;
+
+    return added;
+}
+
+// Label for an input root: its last path component, made unique among the earlier roots
+static void make_root_label(const char *root, char *label, size_t label_size, const char **earlier, int earlier_count)
+{
+    char abs_root[PATH_MAX];
+    char name[PATH_MAX];
+    strncpy(name, root, sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+
+    size_t length = strlen(name);
+    while (length > 1 && (name[length - 1] == '/' || name[length - 1] == PATH_SEP))
+        name[--length] = '\0';
+
+    const char *base = get_filename(name);
+    if (strcmp(base, ".") == 0 || strcmp(base, "..") == 0)
+    {
+        get_absolute_path(root, abs_root, sizeof(abs_root));
+        base = get_filename(abs_root);
+    }
+    if (base[0] == '\0' || strcmp(base, "/") == 0)
+        base = "root";
+
+    // Leave room for a "-N" suffix
+    size_t base_length = strlen(base);
+    if (base_length > label_size - 16)
+        base_length = label_size - 16;
+    memcpy(label, base, base_length);
+    label[base_length] = '\0';
+    for (int suffix = 2;; suffix++)
+    {
+        int taken = 0;
+        for (int i = 0; i < earlier_count; i++)
+        {
+            if (strcmp(earlier[i], label) == 0)
+            {
+                taken = 1;
+                break;
+            }
+        }
+        if (!taken)
+            break;
+        snprintf(label + base_length, label_size - base_length, "-%d", suffix);
+    }
+}
+
 void print_header()
 {
     printf("fconcat v%s - File concatenator with plugin engine\n", FCONCAT_VERSION);
@@ -146,14 +604,17 @@ void print_usage(const char *program_name)
 {
     fprintf(stderr,
             "Usage:\n"
-            "  %s <input_directory> <output_file> [options]\n"
+            "  %s <input_directory> [<input_directory>...] <output_file> [options]\n"
             "\n"
             "Description:\n"
             "  fconcat recursively scans <input_directory>, writes a tree view of its structure,\n"
             "  and concatenates the contents of all files into <output_file>.\n"
             "\n"
             "Options:\n"
-            "  <input_directory>     Path to the directory to scan and concatenate.\n"
+            "  <input_directory>     Path to the directory to scan and concatenate. With several,\n"
+            "                        each is labelled by its name and paths are prefixed with it;\n"
+            "                        files reachable from more than one are written once.\n"
+            "                        An s3://bucket/prefix URL reads that prefix as a tree.\n"
             "  <output_file>         Path to the output file to write results.\n"
             "  --exclude <patterns>  Exclude files/directories matching any of the given patterns.\n"
             "                        Patterns support wildcards '*' (any sequence) and '?' (single char).\n"
@@ -162,11 +623,78 @@ void print_usage(const char *program_name)
             "  --binary-skip         Skip binary files entirely (default behavior).\n"
             "  --binary-include      Include binary files in concatenation.\n"
             "  --binary-placeholder  Show placeholder for binary files instead of content.\n"
+            "  --binary-base64       Include binary files base64-encoded, with an xxh64 content hash.\n"
+            "  --binary-hex          Include binary files hex-encoded, with an xxh64 content hash.\n"
+            "  --binary-max-size <n> Size limit for encoded binary files (K/M/G suffixes, default 1M,\n"
+            "                        0 = unlimited). Larger files get a placeholder.\n"
+            "  --generated <mode>    How to handle generated text files: lockfiles, minified\n"
+            "                        bundles, source maps, generated code and embedded data:\n"
+            "                        include     - Treat them like other files (default)\n"
+            "                        skip        - Leave them out\n"
+            "                        placeholder - Show a placeholder with the reason\n"
+            "                        truncate    - Keep the first bytes, then a note\n"
+            "  --generated-keep <n>  Bytes kept by --generated truncate (K/M suffixes, default 2K).\n"
             "  --symlinks <mode>     How to handle symbolic links:\n"
             "                        skip        - Skip all symlinks (default, safe)\n"
             "                        follow      - Follow symlinks with loop detection\n"
             "                        include     - Include symlink targets as files\n"
             "                        placeholder - Show symlinks as placeholders\n"
+            "  --format <name>       File section layout: default ('// File:' headers), markdown\n"
+            "                        (fenced code blocks with language tags), xml (<file> tags), or\n"
+            "                        chunks: JSON Lines records of path, line range, byte range and\n"
+            "                        text, cut at top-level blocks and blank lines where possible.\n"
+            "  --chunk-size <n>      Most bytes of text per chunk record (K/M suffixes, default 2K).\n"
+            "  --chunk-overlap <n>   Whole lines repeated from the previous record, up to <n> bytes\n"
+            "                        (default 256, below half of --chunk-size).\n"
+            "  --header-template <t> Custom file header. Fields: {path} {path:xml} {size} {lines}\n"
+            "                        {hash} {lang} {symlink} {eol}; escapes: \\n \\t \\{ \\}.\n"
+            "  --footer-template <t> Custom file footer, same fields as --header-template.\n"
+            "  --reflink             Share file bodies with the inputs on copy-on-write filesystems\n"
+            "                        (btrfs, XFS): bodies start on block boundaries after a line of\n"
+            "                        padding and are cloned instead of copied (Linux only).\n"
+            "  --sink <spec>         Write another output from the same traversal. <spec> is\n"
+            "                        <file>[,format=<name>][,plugin=<path>]...; every file is read\n"
+            "                        once and fed to all outputs. Repeatable (up to 8).\n"
+            "  --direct-io           Write the output with O_DIRECT through large aligned buffers,\n"
+            "                        bypassing the page cache (Linux only).\n"
+            "  --engine <name>       Content pass engine:\n"
+            "                        auto     - Sample the start of the tree: entry count, sizes,\n"
+            "                                   filesystem and stat latency (default)\n"
+            "                        serial   - One thread\n"
+            "                        parallel - --jobs workers, one per CPU unless --jobs is given\n"
+            "                        reflink  - Serial with --reflink\n"
+            "  --jobs <n>            Read and render file sections on <n> threads (up to 64); the\n"
+            "                        output keeps traversal order (Unix only). Overrides auto.\n"
+            "  --max-memory <n>      Budget for buffered file data (K/M/G suffixes, at least 1M).\n"
+            "                        Near it, --jobs reads ahead less and sections that do not fit\n"
+            "                        are streamed unbuffered; --direct-io buffers shrink to fit.\n"
+            "  --stats[=hw]          Print memory high-water marks after the run. With =hw, also\n"
+            "                        IPC, cache and branch misses per MB, context switches and\n"
+            "                        page faults per pipeline stage from perf events (Linux).\n"
+            "  --metrics <addr>      Serve Prometheus metrics at GET /metrics while running, and\n"
+            "                        in interactive mode until exit. <addr> is unix:<path>,\n"
+            "                        <port>, or a loopback <host>:<port> (Unix only).\n"
+            "  --s3-endpoint <url>   Server for s3://bucket/prefix inputs (default $AWS_ENDPOINT_URL_S3,\n"
+            "                        $AWS_ENDPOINT_URL, else AWS): http:// only, path-style requests\n"
+            "                        signed with AWS_ACCESS_KEY_ID / AWS_SECRET_ACCESS_KEY.\n"
+            "  --s3-connections <n>  Parallel listing requests and ranged reads per large object\n"
+            "                        (1-64, default 8).\n"
+            "  --one-file-system     Do not descend into directories on other filesystems.\n"
+            "  --exclude-fs <types>  Never enter filesystems of the given comma-separated types\n"
+            "                        (e.g. nfs,cifs,proc), the groups 'network' and 'pseudo',\n"
+            "                        or raw statfs magic numbers such as 0x6969 (Linux only).\n"
+            "  --max-depth <n>       Descend at most <n> directory levels (1 = top level only).\n"
+            "  --max-dir-entries <n> List at most <n> entries per directory; the rest are\n"
+            "                        summarized by a placeholder line in the structure.\n"
+            "  --checkpoint <file>   Periodically record progress in <file>. On SIGINT/SIGTERM the\n"
+            "                        run stops after syncing a final checkpoint (exit code 2).\n"
+            "  --checkpoint-interval <s>\n"
+            "                        Seconds between checkpoints (default 10).\n"
+            "  --resume              Continue an interrupted run from its checkpoint\n"
+            "                        (default <output_file>.ckpt) instead of starting over.\n"
+            "  --manifest <file>     Record every file section (path, size, mtime, xxh64) in <file>.\n"
+            "  --delta-from <file>   Write only the files added or modified since the run that wrote\n"
+            "                        manifest <file>, a list of changes and records of deleted files.\n"
 #ifdef WITH_PLUGINS
             "  --plugin <path>       Load a streaming plugin from the specified path.\n"
             "                        Multiple plugins can be loaded and will be chained.\n"
@@ -182,20 +710,35 @@ void print_usage(const char *program_name)
             "  %s ./project result.txt --exclude \"*.log\" \"build/*\" \"temp?.txt\"\n"
             "  %s ./code output.txt --show-size --binary-placeholder\n"
             "  %s ./kernel out.txt --symlinks follow --exclude \"*.o\" \"*.ko\"\n"
+            "  %s ./data out.txt --symlinks follow --exclude-fs network,pseudo --max-depth 8\n"
+            "  %s ./src out.md --format markdown\n"
+            "  %s ./src chunks.jsonl --format chunks --chunk-size 4K --chunk-overlap 512\n"
+            "  %s ./src all.txt --sink all.md,format=markdown --sink all.xml,format=xml\n"
+            "  %s ./frontend ./backend ./shared bundle.txt --exclude \"node_modules\"\n"
+            "  %s ./monorepo out.txt --jobs 8 --max-memory 256M --stats\n"
+            "  %s ./monorepo out.txt --jobs 8 --metrics unix:/run/fconcat.sock\n"
+            "  %s ./monorepo out.txt --checkpoint out.ckpt   (after an interruption: add --resume)\n"
+            "  %s ./repo delta.txt --delta-from repo.manifest --manifest repo.manifest\n"
+            "  %s s3://logs/2024/ logs.txt --s3-endpoint http://127.0.0.1:9000 --jobs 16\n"
+            "  %s ./webapp out.txt --generated truncate --generated-keep 1K\n"
 #ifdef WITH_PLUGINS
             "  %s ./src out.txt --plugin ./syntax_highlighter.so --plugin ./line_numbers.so\n"
             "  %s ./server out.txt --plugin ./tcp_server.so --interactive\n"
+            "  %s ./src raw.txt --sink clean.txt,plugin=./plugins/remove_main.so\n"
 #endif
             "\n"
             "Exit Codes:\n"
             "  0   Success\n"
             "  1   Error (see message)\n"
+            "  2   Interrupted; checkpoint written, continue with --resume\n"
             "\n"
             "For more information, visit: https://github.com/sonemaro/fconcat\n",
-            program_name, program_name, program_name, program_name, program_name
+            program_name, program_name, program_name, program_name, program_name, program_name, program_name,
+            program_name, program_name, program_name, program_name, program_name, program_name, program_name,
+            program_name, program_name
 #ifdef WITH_PLUGINS
             ,
-            program_name, program_name
+            program_name, program_name, program_name
 #endif
     );
 }
@@ -213,20 +756,45 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    const char *input_dir = argv[1];
-    const char *output_file = argv[2];
-    if (!input_dir || !output_file || strlen(input_dir) == 0 || strlen(output_file) == 0)
+    // Leading positional arguments: one or more input roots, then the output file
+    int first_option = 1;
+    while (first_option < argc && argv[first_option][0] != '-')
+        first_option++;
+    int root_count = first_option - 2;
+    if (root_count < 1)
     {
         fprintf(stderr, "Error: Input directory and output file must be specified.\n");
         print_usage(argv[0]);
         return EXIT_FAILURE;
     }
+    if (root_count > MAX_ROOTS)
+    {
+        fprintf(stderr, "Error: At most %d input directories are supported.\n", MAX_ROOTS);
+        return EXIT_FAILURE;
+    }
+
+    const char *input_dir = argv[1];
+    const char *output_file = argv[first_option - 1];
+    for (int r = 0; r <= root_count; r++)
+    {
+        if (strlen(argv[1 + r]) == 0)
+        {
+            fprintf(stderr, "Error: Input directory and output file must be specified.\n");
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Labels shown for each root when there are several
+    const char *root_labels[MAX_ROOTS];
+    char root_label_buffers[MAX_ROOTS][128];
+    for (int r = 0; r < root_count; r++)
+    {
+        make_root_label(argv[1 + r], root_label_buffers[r], sizeof(root_label_buffers[r]), root_labels, r);
+        root_labels[r] = root_label_buffers[r];
+    }
 
     // Get absolute paths for comparison
-    char abs_input[PATH_MAX];
-    char abs_output[PATH_MAX];
-    get_absolute_path(input_dir, abs_input, sizeof(abs_input));
-    get_absolute_path(output_file, abs_output, sizeof(abs_output));
 
     ExcludeList excludes;
     init_exclude_list(&excludes);
@@ -239,19 +807,62 @@ int main(int argc, char *argv[])
         free_exclude_list(&excludes);
         return EXIT_FAILURE;
     }
-
-    // Set up global plugin manager for signal handling
-    g_plugin_manager = &plugin_manager;
 #endif
 
+    // Processing context, filled in while parsing options
+    ProcessingContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.binary_max_size = 1024 * 1024;
+    ctx.generated_keep = GENERATED_KEEP_DEFAULT;
+    ctx.chunking.size = CHUNK_SIZE_DEFAULT;
+    ctx.chunking.overlap = CHUNK_OVERLAP_DEFAULT;
+
+    // Extra outputs from --sink, opened next to the primary output
+    SinkSet sinks;
+    sink_set_init(&sinks);
+
+    // Everything the run sets up below; every error exit after this point jumps to "fail",
+    // which releases what exists and skips what was never set up
+    OutputTemplate header_template, footer_template;
+    Manifest delta_base;
+    ManifestWriter manifest_writer;
+    MemoryGovernor governor;
+    Metrics metrics;
+    ObjectStore object_store;
+    HwStats hw;
+    FILE *output = NULL;
+    int exit_code = EXIT_FAILURE;
+    memset(&header_template, 0, sizeof(header_template));
+    memset(&footer_template, 0, sizeof(footer_template));
+    memset(&delta_base, 0, sizeof(delta_base));
+    memset(&manifest_writer, 0, sizeof(manifest_writer));
+    // The endpoint only reads the governor once started, after governor_init
+    metrics_init(&metrics, &governor);
+
     // Parse command line options
     int exclude_count = 0;
     int show_size = 0;
     int interactive_mode = 0;
     BinaryHandling binary_handling = BINARY_SKIP;
     SymlinkHandling symlink_handling = SYMLINK_SKIP;
+    OutputFormat output_format = OUTPUT_FORMAT_DEFAULT;
+    const char *header_source = NULL;
+    const char *footer_source = NULL;
+    const char *checkpoint_path = NULL;
+    int checkpoint_interval = CHECKPOINT_DEFAULT_INTERVAL;
+    int resume = 0;
+    const char *manifest_path = NULL;
+    const char *delta_path = NULL;
+    int direct_io = 0;
+    unsigned long long max_memory = 0;
+    int show_stats = 0;
+    int hw_stats = 0;
+    const char *metrics_address = NULL;
+    const char *s3_endpoint = NULL;
+    int s3_connections = OBJECT_CONNECTIONS_DEFAULT;
+    EngineKind engine = ENGINE_AUTO;
 
-    for (int i = 3; i < argc; i++)
+    for (int i = first_option; i < argc; i++)
     {
         if (strcmp(argv[i], "--exclude") == 0)
         {
@@ -281,9 +892,7 @@ int main(int argc, char *argv[])
                 if (load_plugin(&plugin_manager, plugin_path) != 0)
                 {
                     fprintf(stderr, "Error: Failed to load plugin: %s\n", plugin_path);
-                    destroy_plugin_manager(&plugin_manager);
-                    free_exclude_list(&excludes);
-                    return EXIT_FAILURE;
+                    goto fail;
                 }
                 if (is_verbose())
                     fprintf(stderr, "[fconcat] Loaded plugin: %s\n", plugin_path);
@@ -291,9 +900,7 @@ int main(int argc, char *argv[])
             else
             {
                 fprintf(stderr, "Error: --plugin requires a path\n");
-                destroy_plugin_manager(&plugin_manager);
-                free_exclude_list(&excludes);
-                return EXIT_FAILURE;
+                goto fail;
             }
         }
         else if (strcmp(argv[i], "--interactive") == 0)
@@ -321,6 +928,279 @@ int main(int argc, char *argv[])
             if (is_verbose())
                 fprintf(stderr, "[fconcat] Binary handling: placeholder\n");
         }
+        else if (strcmp(argv[i], "--binary-base64") == 0)
+        {
+            binary_handling = BINARY_BASE64;
+            if (is_verbose())
+                fprintf(stderr, "[fconcat] Binary handling: base64\n");
+        }
+        else if (strcmp(argv[i], "--binary-hex") == 0)
+        {
+            binary_handling = BINARY_HEX;
+            if (is_verbose())
+                fprintf(stderr, "[fconcat] Binary handling: hex\n");
+        }
+        else if (strcmp(argv[i], "--binary-max-size") == 0)
+        {
+            if (i + 1 >= argc || parse_size(argv[i + 1], &ctx.binary_max_size) != 0)
+            {
+                fprintf(stderr, "Error: --binary-max-size requires a size such as 512K or 4M\n");
+                goto fail;
+            }
+            i++;
+            if (is_verbose())
+                fprintf(stderr, "[fconcat] Encoded binary size limit: %llu bytes\n", ctx.binary_max_size);
+        }
+        else if (strcmp(argv[i], "--generated") == 0)
+        {
+            if (i + 1 < argc && strcmp(argv[i + 1], "include") == 0)
+                ctx.generated_handling = GENERATED_INCLUDE;
+            else if (i + 1 < argc && strcmp(argv[i + 1], "skip") == 0)
+                ctx.generated_handling = GENERATED_SKIP;
+            else if (i + 1 < argc && strcmp(argv[i + 1], "placeholder") == 0)
+                ctx.generated_handling = GENERATED_PLACEHOLDER;
+            else if (i + 1 < argc && strcmp(argv[i + 1], "truncate") == 0)
+                ctx.generated_handling = GENERATED_TRUNCATE;
+            else
+            {
+                fprintf(stderr, "Error: --generated requires one of: include, skip, placeholder, truncate\n");
+                goto fail;
+            }
+            i++;
+            if (is_verbose())
+                fprintf(stderr, "[fconcat] Generated file handling: %s\n", argv[i]);
+        }
+        else if (strcmp(argv[i], "--generated-keep") == 0)
+        {
+            if (i + 1 >= argc || parse_size(argv[i + 1], &ctx.generated_keep) != 0 || ctx.generated_keep == 0)
+            {
+                fprintf(stderr, "Error: --generated-keep requires a non-zero size such as 512 or 4K\n");
+                goto fail;
+            }
+            i++;
+            if (is_verbose())
+                fprintf(stderr, "[fconcat] Generated file truncation: %llu bytes\n", ctx.generated_keep);
+        }
+        else if (strcmp(argv[i], "--format") == 0)
+        {
+            if (i + 1 < argc && strcmp(argv[i + 1], "default") == 0)
+                output_format = OUTPUT_FORMAT_DEFAULT;
+            else if (i + 1 < argc && strcmp(argv[i + 1], "markdown") == 0)
+                output_format = OUTPUT_FORMAT_MARKDOWN;
+            else if (i + 1 < argc && strcmp(argv[i + 1], "xml") == 0)
+                output_format = OUTPUT_FORMAT_XML;
+            else if (i + 1 < argc && strcmp(argv[i + 1], "chunks") == 0)
+                output_format = OUTPUT_FORMAT_CHUNKS;
+            else
+            {
+                fprintf(stderr, "Error: --format requires one of: default, markdown, xml, chunks\n");
+                goto fail;
+            }
+            i++;
+            if (is_verbose())
+                fprintf(stderr, "[fconcat] Output format: %s\n", argv[i]);
+        }
+        else if (strcmp(argv[i], "--header-template") == 0 || strcmp(argv[i], "--footer-template") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                fprintf(stderr, "Error: %s requires a template string\n", argv[i]);
+                goto fail;
+            }
+            if (strcmp(argv[i], "--header-template") == 0)
+                header_source = argv[i + 1];
+            else
+                footer_source = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "--reflink") == 0)
+        {
+            ctx.reflink = 1;
+            if (is_verbose())
+                fprintf(stderr, "[fconcat] Reflink output assembly requested\n");
+        }
+        else if (strcmp(argv[i], "--sink") == 0)
+        {
+            char sink_error[256];
+            if (i + 1 >= argc)
+            {
+                fprintf(stderr, "Error: --sink requires an output specification\n");
+                goto fail;
+            }
+            if (sink_set_add(&sinks, argv[i + 1], sink_error, sizeof(sink_error)) != 0)
+            {
+                fprintf(stderr, "Error: --sink %s: %s\n", argv[i + 1], sink_error);
+                goto fail;
+            }
+            if (is_verbose())
+                fprintf(stderr, "[fconcat] Added sink: %s\n", argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "--direct-io") == 0)
+        {
+            direct_io = 1;
+            if (is_verbose())
+                fprintf(stderr, "[fconcat] Direct I/O output requested\n");
+        }
+        else if (strcmp(argv[i], "--jobs") == 0)
+        {
+            if (i + 1 >= argc || parse_count(argv[i + 1], &ctx.jobs) != 0 || ctx.jobs == 0 || ctx.jobs > MAX_JOBS)
+            {
+                fprintf(stderr, "Error: --jobs requires a number between 1 and %d\n", MAX_JOBS);
+                goto fail;
+            }
+            if (is_verbose())
+                fprintf(stderr, "[fconcat] Content pass threads: %d\n", ctx.jobs);
+            i++;
+        }
+        else if (strcmp(argv[i], "--engine") == 0)
+        {
+            if (i + 1 >= argc || parse_engine(argv[i + 1], &engine) != 0)
+            {
+                fprintf(stderr, "Error: --engine requires auto, serial, parallel or reflink\n");
+                goto fail;
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--max-memory") == 0)
+        {
+            if (i + 1 >= argc || parse_size(argv[i + 1], &max_memory) != 0 || max_memory < MIN_MAX_MEMORY)
+            {
+                fprintf(stderr, "Error: --max-memory requires a size of at least 1M, such as 256M or 2G\n");
+                goto fail;
+            }
+            i++;
+            if (is_verbose())
+                fprintf(stderr, "[fconcat] Memory budget: %llu bytes\n", max_memory);
+        }
+        else if (strcmp(argv[i], "--stats") == 0 || strcmp(argv[i], "--stats=hw") == 0)
+        {
+            show_stats = 1;
+            hw_stats = hw_stats || strcmp(argv[i], "--stats=hw") == 0;
+        }
+        else if (strcmp(argv[i], "--metrics") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                fprintf(stderr, "Error: --metrics requires an address: unix:<path>, <port> or <host>:<port>\n");
+                goto fail;
+            }
+            metrics_address = argv[++i];
+        }
+        else if (strcmp(argv[i], "--chunk-size") == 0 || strcmp(argv[i], "--chunk-overlap") == 0)
+        {
+            int overlap = strcmp(argv[i], "--chunk-overlap") == 0;
+            unsigned long long value = 0;
+            if (i + 1 >= argc || parse_size(argv[i + 1], &value) != 0 || value > 64ULL * 1024 * 1024 ||
+                (!overlap && value < CHUNK_SIZE_MIN))
+            {
+                fprintf(stderr, "Error: %s requires a size such as %s\n", argv[i], overlap ? "0 or 256" : "2K");
+                goto fail;
+            }
+            if (overlap)
+                ctx.chunking.overlap = (size_t)value;
+            else
+                ctx.chunking.size = (size_t)value;
+            i++;
+        }
+        else if (strcmp(argv[i], "--s3-endpoint") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                fprintf(stderr, "Error: --s3-endpoint requires a URL such as http://127.0.0.1:9000\n");
+                goto fail;
+            }
+            s3_endpoint = argv[++i];
+        }
+        else if (strcmp(argv[i], "--s3-connections") == 0)
+        {
+            char *end = NULL;
+            long value = i + 1 < argc ? strtol(argv[i + 1], &end, 10) : 0;
+            if (i + 1 >= argc || *end != '\0' || value < 1 || value > OBJECT_CONNECTIONS_MAX)
+            {
+                fprintf(stderr, "Error: --s3-connections requires a number from 1 to %d\n", OBJECT_CONNECTIONS_MAX);
+                goto fail;
+            }
+            s3_connections = (int)value;
+            i++;
+        }
+        else if (strcmp(argv[i], "--one-file-system") == 0)
+        {
+            ctx.one_file_system = 1;
+            if (is_verbose())
+                fprintf(stderr, "[fconcat] Staying on the input filesystem\n");
+        }
+        else if (strcmp(argv[i], "--exclude-fs") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                fprintf(stderr, "Error: --exclude-fs requires a comma-separated list of filesystem types\n");
+                goto fail;
+            }
+
+            char types[1024];
+            strncpy(types, argv[++i], sizeof(types) - 1);
+            types[sizeof(types) - 1] = '\0';
+
+            char *saveptr = NULL;
+            for (char *type = strtok_r(types, ",", &saveptr); type; type = strtok_r(NULL, ",", &saveptr))
+            {
+                if (add_excluded_fs_type(&ctx, type) != 0)
+                {
+                    fprintf(stderr, "Error: Unknown filesystem type '%s'\n", type);
+                    goto fail;
+                }
+                if (is_verbose())
+                    fprintf(stderr, "[fconcat] Excluding filesystem type: %s\n", type);
+            }
+        }
+        else if (strcmp(argv[i], "--max-depth") == 0 || strcmp(argv[i], "--max-dir-entries") == 0)
+        {
+            int *limit = strcmp(argv[i], "--max-depth") == 0 ? &ctx.max_depth : &ctx.max_dir_entries;
+            if (i + 1 >= argc || parse_count(argv[i + 1], limit) != 0 || *limit == 0)
+            {
+                fprintf(stderr, "Error: %s requires a positive number\n", argv[i]);
+                goto fail;
+            }
+            if (is_verbose())
+                fprintf(stderr, "[fconcat] %s: %d\n", argv[i] + 2, *limit);
+            i++;
+        }
+        else if (strcmp(argv[i], "--checkpoint") == 0)
+        {
+            if (i + 1 >= argc || strlen(argv[i + 1]) >= CHECKPOINT_PATH_MAX)
+            {
+                fprintf(stderr, "Error: --checkpoint requires a file path\n");
+                goto fail;
+            }
+            checkpoint_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--manifest") == 0 || strcmp(argv[i], "--delta-from") == 0)
+        {
+            if (i + 1 >= argc || strlen(argv[i + 1]) >= MANIFEST_PATH_MAX)
+            {
+                fprintf(stderr, "Error: %s requires a file path\n", argv[i]);
+                goto fail;
+            }
+            if (strcmp(argv[i], "--manifest") == 0)
+                manifest_path = argv[i + 1];
+            else
+                delta_path = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "--checkpoint-interval") == 0)
+        {
+            if (i + 1 >= argc || parse_count(argv[i + 1], &checkpoint_interval) != 0 || checkpoint_interval == 0)
+            {
+                fprintf(stderr, "Error: --checkpoint-interval requires a positive number of seconds\n");
+                goto fail;
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--resume") == 0)
+        {
+            resume = 1;
+        }
         else if (strcmp(argv[i], "--symlinks") == 0)
         {
             if (i + 1 < argc)
@@ -345,11 +1225,7 @@ int main(int argc, char *argv[])
                 else
                 {
                     fprintf(stderr, "Error: Invalid symlink mode '%s'. Use: skip, follow, include, or placeholder\n", argv[i]);
-#ifdef WITH_PLUGINS
-                    destroy_plugin_manager(&plugin_manager);
-#endif
-                    free_exclude_list(&excludes);
-                    return EXIT_FAILURE;
+                    goto fail;
                 }
                 if (is_verbose())
                     fprintf(stderr, "[fconcat] Symlink handling: %s\n", argv[i]);
@@ -357,86 +1233,155 @@ int main(int argc, char *argv[])
             else
             {
                 fprintf(stderr, "Error: --symlinks requires a mode (skip, follow, include, placeholder)\n");
-#ifdef WITH_PLUGINS
-                destroy_plugin_manager(&plugin_manager);
-#endif
-                free_exclude_list(&excludes);
-                return EXIT_FAILURE;
+                goto fail;
             }
         }
         else
         {
             fprintf(stderr, "Unknown option: %s\n", argv[i]);
             print_usage(argv[0]);
-#ifdef WITH_PLUGINS
-            destroy_plugin_manager(&plugin_manager);
-#endif
-            free_exclude_list(&excludes);
-            return EXIT_FAILURE;
+            goto fail;
         }
     }
 
-    // Auto-exclude output file
-    int output_inside_input = 0;
+    // An explicit engine is an override: it must agree with --jobs
+    if ((engine == ENGINE_SERIAL || engine == ENGINE_REFLINK) && ctx.jobs > 1)
+    {
+        fprintf(stderr, "Error: --engine %s cannot be combined with --jobs %d\n", engine_name(engine), ctx.jobs);
+        goto fail;
+    }
+    if (engine == ENGINE_REFLINK)
+        ctx.reflink = 1;
+    else if (engine == ENGINE_SERIAL)
+        ctx.jobs = 1;
+    else if (engine == ENGINE_PARALLEL && ctx.jobs == 0)
+        ctx.jobs = engine_parallel_jobs(engine_online_cpus());
 
-#ifdef _WIN32
-    // Normalize paths for comparison
-    for (char *p = abs_input; *p; p++)
+    // Chunk records have no header or footer, and their text is escaped, never cloned
+    ctx.chunked = output_format == OUTPUT_FORMAT_CHUNKS;
+    ctx.xml_escaped = output_format == OUTPUT_FORMAT_XML;
+    if (ctx.chunked && (header_source || footer_source || ctx.reflink))
     {
-        if (*p == '\\')
-            *p = '/';
+        fprintf(stderr, "Error: --format chunks cannot be combined with --header-template, --footer-template or "
+                        "--reflink\n");
+        goto fail;
     }
-    for (char *p = abs_output; *p; p++)
+    if (ctx.chunking.overlap * 2 >= ctx.chunking.size)
     {
-        if (*p == '\\')
-            *p = '/';
+        fprintf(stderr, "Error: --chunk-overlap must be below half of --chunk-size\n");
+        goto fail;
     }
-    // Windows case-insensitive comparison
-    if (strnicmp(abs_output, abs_input, strlen(abs_input)) == 0)
+
+    // Checkpoints record one output offset, so they cannot describe several outputs
+    if (sinks.count > 0 && (checkpoint_path || resume))
     {
-        output_inside_input = 1;
+        fprintf(stderr, "Error: --sink cannot be combined with --checkpoint or --resume\n");
+        goto fail;
     }
-#else
-    if (strncmp(abs_output, abs_input, strlen(abs_input)) == 0)
+
+    // The direct writer is append-only: no checkpoint sync or truncation, no clone into it
+    if (direct_io && (checkpoint_path || resume || ctx.reflink))
     {
-        output_inside_input = 1;
+        fprintf(stderr, "Error: --direct-io cannot be combined with --checkpoint, --resume or --reflink\n");
+        goto fail;
+    }
+
+    // A manifest describes a complete run; the delta compares the walk against one
+    if ((manifest_path || delta_path) && (checkpoint_path || resume))
+    {
+        fprintf(stderr, "Error: --manifest and --delta-from cannot be combined with --checkpoint or --resume\n");
+        goto fail;
+    }
+#if defined(_WIN32) || defined(_WIN64)
+    if (manifest_path || delta_path)
+    {
+        fprintf(stderr, "Error: --manifest and --delta-from are not supported on Windows\n");
+        goto fail;
+    }
+    if (ctx.jobs > 1)
+    {
+        fprintf(stderr, "Error: --jobs is not supported on Windows\n");
+        goto fail;
     }
 #endif
 
-    if (output_inside_input)
+    // Auto-exclude the output files from every root they live under
+    exclude_count += auto_exclude_output(&excludes, &argv[1], root_count, output_file);
+    for (int k = 0; k < sinks.count; k++)
+        exclude_count += auto_exclude_output(&excludes, &argv[1], root_count, sinks.sinks[k].path);
+    if (manifest_path)
     {
-        // Add absolute path exclusion
-        if (is_verbose())
-            fprintf(stderr, "[fconcat] Auto-excluding output file by absolute path: %s\n", abs_output);
-        add_exclude_pattern(&excludes, abs_output);
+        // The manifest is written next to the run as "<file>.tmp" and renamed at the end
+        char manifest_tmp[MANIFEST_PATH_MAX + 8];
+        snprintf(manifest_tmp, sizeof(manifest_tmp), "%s.tmp", get_filename(manifest_path));
+        exclude_count += auto_exclude_output(&excludes, &argv[1], root_count, manifest_path);
+        add_exclude_pattern(&excludes, manifest_tmp);
         exclude_count++;
+    }
+
+    // --engine auto: --jobs and --reflink already decide, otherwise the plugins and the start of
+    // the tree do. The sample skips what the walk excludes, the outputs included.
+    int auto_parallel = 0;
+    if (engine == ENGINE_AUTO && ctx.jobs == 0 && !ctx.reflink)
+    {
+        int plugins = 0;
+#ifdef WITH_PLUGINS
+        plugins = plugin_manager.count;
+        for (int k = 0; k < sinks.count; k++)
+            plugins += sinks.plugin_managers[k].count;
+#endif
+        auto_parallel = choose_engine(&ctx, (const char *const *)&argv[1], root_count, &excludes, plugins);
+    }
+    // Parallel by choice rather than by request: bound its read-ahead unless a budget was given
+    unsigned long long memory_budget = max_memory;
+    if (auto_parallel && memory_budget == 0)
+        memory_budget = ENGINE_AUTO_MEMORY;
 
-        // Add relative path exclusion
-        char *relative_path = get_relative_path(input_dir, output_file);
-        if (relative_path)
+    // Checkpointing is on with --checkpoint, or with --resume and the default checkpoint path
+    char default_checkpoint[CHECKPOINT_PATH_MAX];
+    if (resume && !checkpoint_path)
+    {
+        if (snprintf(default_checkpoint, sizeof(default_checkpoint), "%s.ckpt", output_file) >=
+            (int)sizeof(default_checkpoint))
         {
-            if (is_verbose())
-                fprintf(stderr, "[fconcat] Auto-excluding output file by relative path: %s\n", relative_path);
-            add_exclude_pattern(&excludes, relative_path);
-            exclude_count++;
-            free(relative_path);
+            fprintf(stderr, "Error: output path too long for a default checkpoint path\n");
+            goto fail;
         }
+        checkpoint_path = default_checkpoint;
     }
 
-    // Always exclude by basename as fallback
-    const char *output_basename = get_filename(output_file);
-    if (is_verbose())
-        fprintf(stderr, "[fconcat] Auto-excluding output file by name: %s\n", output_basename);
-    add_exclude_pattern(&excludes, output_basename);
-    exclude_count++;
-
-    // Special case for current directory
-    if (strcmp(input_dir, ".") == 0)
+    Checkpoint checkpoint;
+    memset(&checkpoint, 0, sizeof(checkpoint));
+    if (checkpoint_path)
     {
-        if (is_verbose())
-            fprintf(stderr, "[fconcat] Auto-excluding output file by path (current dir): %s\n", output_file);
-        add_exclude_pattern(&excludes, output_file);
-        exclude_count++;
+        checkpoint.path = checkpoint_path;
+        checkpoint.interval = checkpoint_interval;
+        checkpoint.progress.options_hash = options_fingerprint(argc, argv, first_option);
+
+        // The checkpoint changes during the run, so it must never be part of the output
+        char checkpoint_tmp[CHECKPOINT_PATH_MAX + 8];
+        snprintf(checkpoint_tmp, sizeof(checkpoint_tmp), "%s.tmp", get_filename(checkpoint_path));
+        add_exclude_pattern(&excludes, get_filename(checkpoint_path));
+        add_exclude_pattern(&excludes, checkpoint_tmp);
+        exclude_count += 2;
+
+        if (resume)
+        {
+            if (checkpoint_load(checkpoint_path, &checkpoint.resume) != 0)
+            {
+                printf("No usable checkpoint at '%s', starting a fresh run\n", checkpoint_path);
+            }
+            else if (checkpoint.resume.options_hash != checkpoint.progress.options_hash)
+            {
+                fprintf(stderr, "Error: checkpoint '%s' was written with different paths or options\n",
+                        checkpoint_path);
+                goto fail;
+            }
+            else
+            {
+                checkpoint.resuming = 1;
+            }
+        }
     }
 
     // Set up signal handling for interactive mode
@@ -446,12 +1391,40 @@ int main(int argc, char *argv[])
         signal(SIGTERM, signal_handler);
         g_interactive_mode = 1;
     }
+    if (checkpoint_path)
+    {
+        signal(SIGINT, checkpoint_signal_handler);
+        signal(SIGTERM, checkpoint_signal_handler);
+    }
 
-    printf("Input directory : %s\n", input_dir);
+    if (root_count == 1)
+    {
+        printf("Input directory : %s\n", input_dir);
+    }
+    else
+    {
+        printf("Input roots     : %d\n", root_count);
+        for (int r = 0; r < root_count; r++)
+            printf("  %-15s %s\n", root_labels[r], argv[1 + r]);
+    }
     printf("Output file     : %s\n", output_file);
+    for (int k = 0; k < sinks.count; k++)
+        printf("Sink            : %s\n", sinks.sinks[k].path);
     printf("Binary handling : %s\n",
-           binary_handling == BINARY_SKIP ? "skip" : binary_handling == BINARY_INCLUDE ? "include"
-                                                                                       : "placeholder");
+           binary_handling == BINARY_SKIP      ? "skip"
+           : binary_handling == BINARY_INCLUDE ? "include"
+           : binary_handling == BINARY_BASE64  ? "base64"
+           : binary_handling == BINARY_HEX     ? "hex"
+                                               : "placeholder");
+    if ((binary_handling == BINARY_BASE64 || binary_handling == BINARY_HEX) && is_verbose())
+        fprintf(stderr, "[fconcat] Binary encoder: %s\n", stream_encoder_backend());
+    if (ctx.generated_handling != GENERATED_INCLUDE)
+    {
+        printf("Generated files : %s\n",
+               ctx.generated_handling == GENERATED_SKIP          ? "skip"
+               : ctx.generated_handling == GENERATED_PLACEHOLDER ? "placeholder"
+                                                                 : "truncate");
+    }
     printf("Symlink handling: %s\n",
            symlink_handling == SYMLINK_SKIP ? "skip" : symlink_handling == SYMLINK_FOLLOW ? "follow"
                                                    : symlink_handling == SYMLINK_INCLUDE  ? "include"
@@ -460,6 +1433,46 @@ int main(int argc, char *argv[])
     {
         printf("Exclude patterns: %d patterns loaded\n", exclude_count);
     }
+    if (ctx.reflink)
+    {
+        printf("Output assembly : reflink (block-aligned bodies)\n");
+    }
+    int chunked_outputs = ctx.chunked;
+    for (int k = 0; k < sinks.count; k++)
+        chunked_outputs += sinks.sinks[k].chunked;
+    if (chunked_outputs > 0)
+    {
+        char size_text[32], overlap_text[32];
+        format_size(ctx.chunking.size, size_text, sizeof(size_text));
+        format_size(ctx.chunking.overlap, overlap_text, sizeof(overlap_text));
+        printf("Chunk records   : up to %s, %s overlap\n", size_text, overlap_text);
+    }
+    size_t direct_buffer = DIRECT_BUFFER_SIZE;
+    if (max_memory > 0 && max_memory / 4 / DIRECT_BUFFER_COUNT < direct_buffer)
+        direct_buffer = (size_t)(max_memory / 4 / DIRECT_BUFFER_COUNT);
+    if (direct_io)
+    {
+        char buffer_text[32];
+        format_size(direct_buffer, buffer_text, sizeof(buffer_text));
+        printf("Output writer   : O_DIRECT, %d x %s aligned buffers\n", DIRECT_BUFFER_COUNT, buffer_text);
+    }
+    if (memory_budget > 0)
+    {
+        char budget_text[32];
+        format_size(memory_budget, budget_text, sizeof(budget_text));
+        printf("Memory budget   : %s for buffered file data%s\n", budget_text,
+               max_memory == 0 ? " (--engine auto)" : "");
+    }
+    if (ctx.jobs > 1)
+    {
+        printf("Content workers : %d threads, output in traversal order\n", ctx.jobs);
+    }
+    if (ctx.one_file_system || ctx.excluded_fs_count > 0 || ctx.max_depth > 0 || ctx.max_dir_entries > 0)
+    {
+        printf("Traversal limit : %s%d excluded fs types, depth %d, %d entries per directory\n",
+               ctx.one_file_system ? "one filesystem, " : "", ctx.excluded_fs_count,
+               ctx.max_depth, ctx.max_dir_entries);
+    }
 #ifdef WITH_PLUGINS
     if (plugin_manager.count > 0)
     {
@@ -470,62 +1483,224 @@ int main(int argc, char *argv[])
         printf("Interactive mode: enabled\n");
     }
 #endif
+    if (manifest_path)
+    {
+        printf("Manifest        : %s\n", manifest_path);
+    }
+    if (delta_path)
+    {
+        printf("Delta from      : %s\n", delta_path);
+    }
+    if (checkpoint_path)
+    {
+        printf("Checkpoint      : %s (every %ds)", checkpoint_path, checkpoint_interval);
+        if (checkpoint.resuming)
+            printf(", resuming after %llu entries", checkpoint.resume.entries_done);
+        printf("\n");
+    }
     printf("\n");
 
-    FILE *output = fopen(output_file, "wb");
+    // Compile file header/footer templates once; the emitter never parses them again
+    char template_error[256];
+    if (!header_source)
+        header_source = template_preset_header(output_format);
+    if (!footer_source)
+        footer_source = template_preset_footer(output_format);
+    if (template_compile(&header_template, header_source, template_error, sizeof(template_error)) != 0)
+    {
+        fprintf(stderr, "Error in header template: %s\n", template_error);
+        goto fail;
+    }
+    if (template_compile(&footer_template, footer_source, template_error, sizeof(template_error)) != 0)
+    {
+        fprintf(stderr, "Error in footer template: %s\n", template_error);
+        goto fail;
+    }
+
+    // The previous manifest is loaded whole; a delta run only looks it up
+    if (delta_path && manifest_load(delta_path, &delta_base) != 0)
+    {
+        fprintf(stderr, "Error: cannot read manifest '%s'\n", delta_path);
+        goto fail;
+    }
+    if (delta_path && is_verbose())
+        fprintf(stderr, "[fconcat] Loaded manifest %s: %zu files\n", delta_path, delta_base.count);
+
+    // A resumed run keeps the output up to the checkpointed offset and appends from there
+    governor_init(&governor, memory_budget);
+    ctx.governor = &governor;
+
+    if (direct_io)
+    {
+        output = direct_output_open(output_file, direct_buffer);
+        if (!output)
+            printf("Direct I/O unavailable for '%s' (%s), writing through the page cache\n",
+                   output_file, strerror(errno));
+        else
+            governor_charge(&governor, (unsigned long long)direct_buffer * DIRECT_BUFFER_COUNT);
+    }
+    if (!output)
+        output = fopen(output_file, checkpoint.resuming ? "r+b" : "wb");
+    if (output && checkpoint.resuming)
+    {
+        unsigned long long offset = checkpoint.resume.output_offset;
+        int truncated = fseeko(output, 0, SEEK_END) == 0 && (unsigned long long)ftello(output) >= offset;
+#if defined(_WIN32) || defined(_WIN64)
+        truncated = truncated && _chsize_s(_fileno(output), (long long)offset) == 0;
+#else
+        truncated = truncated && ftruncate(fileno(output), (off_t)offset) == 0;
+#endif
+        truncated = truncated && fseeko(output, (off_t)offset, SEEK_SET) == 0;
+        if (!truncated)
+        {
+            fprintf(stderr, "Error: output file '%s' does not match checkpoint '%s'\n", output_file, checkpoint_path);
+            goto fail;
+        }
+    }
+    else if (checkpoint_path)
+    {
+        // A stale checkpoint from an earlier run must not survive a fresh start
+        remove(checkpoint_path);
+    }
     if (!output)
     {
         fprintf(stderr, "Error opening output file '%s': %s\n", output_file, strerror(errno));
+        goto fail;
+    }
+
+    char sink_error[256] = "";
+    if (sink_set_open(&sinks, sink_error, sizeof(sink_error)) != 0 ||
+        (manifest_path && manifest_writer_open(&manifest_writer, manifest_path) != 0))
+    {
+        if (sinks.count > 0 && sink_error[0])
+            fprintf(stderr, "Error opening sink: %s\n", sink_error);
+        goto fail;
+    }
+
+    if (metrics_address)
+    {
+        char metrics_error[256] = "";
+        if (metrics_start(&metrics, metrics_address, metrics_error, sizeof(metrics_error)) != 0)
+        {
+            fprintf(stderr, "Error: --metrics: %s\n", metrics_error);
+            goto fail;
+        }
+        ctx.metrics = &metrics;
 #ifdef WITH_PLUGINS
-        destroy_plugin_manager(&plugin_manager);
+        watch_plugins(&metrics, &plugin_manager);
+        for (int k = 0; k < sinks.count; k++)
+            watch_plugins(&metrics, &sinks.plugin_managers[k]);
 #endif
-        free_exclude_list(&excludes);
-        return EXIT_FAILURE;
+        printf("Metrics         : %s%s\n", metrics_address, strncmp(metrics_address, "unix:", 5) == 0 ? "" : "/metrics");
+    }
+
+    // s3:// roots share one endpoint, resolved once, and its pool of keep-alive connections
+    int object_roots = 0;
+    for (int r = 0; r < root_count; r++)
+        object_roots += is_object_url(argv[1 + r]);
+    if (object_roots > 0)
+    {
+        char store_error[512] = "";
+        if (object_store_init(&object_store, s3_endpoint, s3_connections, store_error, sizeof(store_error)) != 0)
+        {
+            fprintf(stderr, "Error: %s\n", store_error);
+            goto fail;
+        }
+        ctx.object_store = &object_store;
+        printf("Object store    : %s, %d connections\n", object_store.authority, object_store.connections);
     }
 
     printf("🚀 Processing directory...\n");
     if (is_verbose())
         fprintf(stderr, "[fconcat] Starting processing...\n");
 
-    // Create processing context
-    ProcessingContext ctx = {
-        .base_path = input_dir,
-        .excludes = &excludes,
-        .binary_handling = binary_handling,
-        .symlink_handling = symlink_handling,
-        .show_size = show_size,
-        .output_file = output,
+    // Complete processing context
+    ctx.base_path = input_dir;
+    ctx.roots = (const char **)&argv[1];
+    ctx.root_labels = root_labels;
+    ctx.root_count = root_count;
+    ctx.excludes = &excludes;
+    ctx.binary_handling = binary_handling;
+    ctx.symlink_handling = symlink_handling;
+    ctx.show_size = show_size;
+    ctx.output_file = output;
+    ctx.header_template = &header_template;
+    ctx.footer_template = &footer_template;
 #ifdef WITH_PLUGINS
-        .plugin_manager = &plugin_manager,
+    ctx.plugin_manager = &plugin_manager;
 #endif
-        .interactive_mode = interactive_mode};
+    ctx.interactive_mode = interactive_mode;
+    ctx.extra_sinks = sinks.sinks;
+    ctx.extra_sink_count = sinks.count;
+    if (delta_path)
+        ctx.delta_base = &delta_base;
+    if (manifest_path)
+        ctx.manifest = &manifest_writer;
+    if (checkpoint_path)
+        ctx.checkpoint = &checkpoint;
+
+    if (hw_stats)
+    {
+        hw_stats_init(&hw);
+        ctx.hw_stats = &hw;
+    }
 
     // Process directory
     int result = process_directory(&ctx);
 
+    if (checkpoint_path)
+    {
+        signal(SIGINT, interactive_mode ? signal_handler : SIG_DFL);
+        signal(SIGTERM, interactive_mode ? signal_handler : SIG_DFL);
+    }
+
     if (result == 0)
     {
         printf("✅ Directory processed successfully\n");
+        if (checkpoint_path)
+            remove(checkpoint_path);
+    }
+    else if (result == PROCESS_INTERRUPTED && !checkpoint_path)
+    {
+        printf("\n⏸️  Interrupted; the output is incomplete\n");
+    }
+    else if (result == PROCESS_INTERRUPTED && checkpoint.last_write == 0)
+    {
+        printf("\n⏸️  Interrupted before any file was written; no checkpoint recorded\n");
+    }
+    else if (result == PROCESS_INTERRUPTED)
+    {
+        printf("\n⏸️  Interrupted after %llu entries; checkpoint written to '%s'\n",
+               checkpoint.progress.entries_done, checkpoint_path);
+        printf("Run the same command with --resume to continue.\n");
     }
     else
     {
         fprintf(stderr, "❌ Error during processing\n");
     }
 
-    if (fclose(output) != 0)
+    if (sink_set_close(&sinks) != 0 && result == 0)
+        result = -1;
+
+    // Only a complete run replaces the previous manifest
+    if (manifest_path && result == 0 && manifest_writer_commit(&manifest_writer) != 0)
+        result = -1;
+
+    int close_failed = fclose(output) != 0;
+    output = NULL;
+    if (close_failed)
     {
         fprintf(stderr, "Error closing output file: %s\n", strerror(errno));
-#ifdef WITH_PLUGINS
-        destroy_plugin_manager(&plugin_manager);
-#endif
-        free_exclude_list(&excludes);
-        return EXIT_FAILURE;
+        goto fail;
     }
 
     clock_gettime(CLOCK_MONOTONIC, &end_time);
     double elapsed = (end_time.tv_sec - start_time.tv_sec) +
                      (end_time.tv_nsec - start_time.tv_nsec) / 1000000000.0;
 
+    if (show_stats)
+        print_stats(&governor, ctx.hw_stats);
+
     if (result == 0)
     {
         printf("\n🎉 Success! Output written to '%s'\n", output_file);
@@ -544,14 +1719,17 @@ int main(int argc, char *argv[])
             printf("Plugins are active and ready for use.\n");
             printf("Press Enter to exit, or Ctrl+C to force quit\n");
 
+#if !defined(_WIN32) && !defined(_WIN64)
+            interactive_wait(ctx.metrics != NULL);
+#else
             char buffer[256];
-            if (fgets(buffer, sizeof(buffer), stdin) == NULL)
-            {
-                if (is_verbose())
-                    fprintf(stderr, "[fconcat] Input stream closed or error occurred\n");
-            }
-
-            printf("🔌 Shutting down plugins...\n");
+            if (!g_shutdown_signal && fgets(buffer, sizeof(buffer), stdin) == NULL && is_verbose())
+                fprintf(stderr, "[fconcat] Input stream closed or error occurred\n");
+#endif
+            if (g_shutdown_signal)
+                printf("\n🔌 Received signal %d, shutting down plugins...\n", (int)g_shutdown_signal);
+            else
+                printf("🔌 Shutting down plugins...\n");
         }
 #endif
 
@@ -560,11 +1738,34 @@ int main(int argc, char *argv[])
             fprintf(stderr, "[fconcat] Done.\n");
     }
 
+    if (result == PROCESS_INTERRUPTED)
+        exit_code = EXIT_INTERRUPTED;
+    else
+        exit_code = result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+
+fail:
+    if (output)
+        fclose(output);
+
+    // The endpoint goes first: it reads plugin slots and the governor
+    metrics_destroy(&metrics);
+    if (ctx.object_store)
+        object_store_destroy(ctx.object_store);
+
     // Cleanup plugins
 #ifdef WITH_PLUGINS
     destroy_plugin_manager(&plugin_manager);
 #endif
+    manifest_writer_abort(&manifest_writer);
+    manifest_free(&delta_base);
+    template_free(&header_template);
+    template_free(&footer_template);
+    sink_set_free(&sinks);
     free_exclude_list(&excludes);
+    if (ctx.governor)
+        governor_destroy(&governor);
+    if (ctx.hw_stats)
+        hw_stats_destroy(&hw);
 
-    return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    return exit_code;
 }
\ No newline at end of file
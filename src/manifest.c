@@ -0,0 +1,241 @@
+// File: src/manifest.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "manifest.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#endif
+
+#define MANIFEST_MAGIC "fconcat-manifest 1"
+
+// One line per file section: "<size> <mtime_sec>.<mtime_nsec> <xxh64|-> <path>". The path runs
+// to the end of the line, with '\' and newlines escaped as "\\" and "\n".
+
+static size_t path_hash(const char *path)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++)
+    {
+        hash ^= *p;
+        hash *= 1099511628211ULL;
+    }
+    return (size_t)hash;
+}
+
+static int unescape_path(const char *escaped, char *path, size_t path_size)
+{
+    size_t length = 0;
+    for (const char *p = escaped; *p; p++)
+    {
+        char c = *p;
+        if (c == '\\')
+        {
+            p++;
+            if (*p == 'n')
+                c = '\n';
+            else if (*p == '\\')
+                c = '\\';
+            else
+                return -1;
+        }
+        if (length + 1 >= path_size)
+            return -1;
+        path[length++] = c;
+    }
+    path[length] = '\0';
+    return 0;
+}
+
+static int build_index(Manifest *manifest)
+{
+    size_t size = 16;
+    while (size < manifest->count * 2)
+        size *= 2;
+
+    manifest->index = calloc(size, sizeof(size_t));
+    if (!manifest->index)
+        return -1;
+    manifest->index_size = size;
+
+    for (size_t i = 0; i < manifest->count; i++)
+    {
+        size_t slot = path_hash(manifest->entries[i].path) & (size - 1);
+        while (manifest->index[slot])
+            slot = (slot + 1) & (size - 1);
+        manifest->index[slot] = i + 1;
+    }
+    return 0;
+}
+
+int manifest_load(const char *path, Manifest *manifest)
+{
+    memset(manifest, 0, sizeof(*manifest));
+
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return -1;
+
+    char line[MANIFEST_PATH_MAX * 2 + 96];
+    char entry_path[MANIFEST_PATH_MAX];
+    if (!fgets(line, sizeof(line), file) || strncmp(line, MANIFEST_MAGIC, strlen(MANIFEST_MAGIC)) != 0)
+    {
+        fclose(file);
+        return -1;
+    }
+
+    int failed = 0;
+    while (!failed && fgets(line, sizeof(line), file))
+    {
+        line[strcspn(line, "\n")] = '\0';
+
+        ManifestEntry entry;
+        char hash_text[17];
+        int path_offset = 0;
+        memset(&entry, 0, sizeof(entry));
+        if (sscanf(line, "%llu %lld.%ld %16s%n", &entry.size, &entry.mtime_sec, &entry.mtime_nsec,
+                   hash_text, &path_offset) != 4 ||
+            line[path_offset] != ' ' || unescape_path(line + path_offset + 1, entry_path, sizeof(entry_path)) != 0)
+        {
+            failed = 1;
+            break;
+        }
+        if (strcmp(hash_text, "-") != 0)
+        {
+            char *end;
+            entry.hash = strtoull(hash_text, &end, 16);
+            entry.has_hash = *end == '\0';
+        }
+
+        if (manifest->count == manifest->capacity)
+        {
+            size_t capacity = manifest->capacity ? manifest->capacity * 2 : 256;
+            ManifestEntry *entries = realloc(manifest->entries, capacity * sizeof(*entries));
+            if (!entries)
+            {
+                failed = 1;
+                break;
+            }
+            manifest->entries = entries;
+            manifest->capacity = capacity;
+        }
+        entry.path = strdup(entry_path);
+        if (!entry.path)
+        {
+            failed = 1;
+            break;
+        }
+        manifest->entries[manifest->count++] = entry;
+    }
+
+    fclose(file);
+    if (failed || build_index(manifest) != 0)
+    {
+        manifest_free(manifest);
+        return -1;
+    }
+    return 0;
+}
+
+ManifestEntry *manifest_find(const Manifest *manifest, const char *path)
+{
+    if (!manifest->index_size)
+        return NULL;
+
+    size_t mask = manifest->index_size - 1;
+    for (size_t slot = path_hash(path) & mask; manifest->index[slot]; slot = (slot + 1) & mask)
+    {
+        ManifestEntry *entry = &manifest->entries[manifest->index[slot] - 1];
+        if (strcmp(entry->path, path) == 0)
+            return entry;
+    }
+    return NULL;
+}
+
+void manifest_free(Manifest *manifest)
+{
+    for (size_t i = 0; i < manifest->count; i++)
+        free(manifest->entries[i].path);
+    free(manifest->entries);
+    free(manifest->index);
+    memset(manifest, 0, sizeof(*manifest));
+}
+
+int manifest_writer_open(ManifestWriter *writer, const char *path)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->path = path;
+    if (snprintf(writer->tmp_path, sizeof(writer->tmp_path), "%s.tmp", path) >= (int)sizeof(writer->tmp_path))
+        return -1;
+
+    writer->file = fopen(writer->tmp_path, "wb");
+    if (!writer->file)
+    {
+        fprintf(stderr, "Error writing manifest '%s': %s\n", writer->tmp_path, strerror(errno));
+        return -1;
+    }
+    fprintf(writer->file, "%s\n", MANIFEST_MAGIC);
+    return 0;
+}
+
+void manifest_writer_add(ManifestWriter *writer, const char *path, unsigned long long size,
+                         long long mtime_sec, long mtime_nsec, int has_hash, uint64_t hash)
+{
+    if (!writer->file)
+        return;
+
+    if (has_hash)
+        fprintf(writer->file, "%llu %lld.%09ld %016llx ", size, mtime_sec, mtime_nsec, (unsigned long long)hash);
+    else
+        fprintf(writer->file, "%llu %lld.%09ld - ", size, mtime_sec, mtime_nsec);
+
+    for (const char *p = path; *p; p++)
+    {
+        if (*p == '\\')
+            fputs("\\\\", writer->file);
+        else if (*p == '\n')
+            fputs("\\n", writer->file);
+        else
+            fputc(*p, writer->file);
+    }
+    fputc('\n', writer->file);
+    writer->count++;
+}
+
+// Rename the finished manifest into place; a failed run leaves the previous one untouched
+int manifest_writer_commit(ManifestWriter *writer)
+{
+    if (!writer->file)
+        return -1;
+
+    int failed = fclose(writer->file) != 0;
+    writer->file = NULL;
+
+#if defined(_WIN32) || defined(_WIN64)
+    if (!failed && !MoveFileExA(writer->tmp_path, writer->path, MOVEFILE_REPLACE_EXISTING))
+        failed = 1;
+#else
+    if (!failed && rename(writer->tmp_path, writer->path) != 0)
+        failed = 1;
+#endif
+
+    if (failed)
+    {
+        fprintf(stderr, "Error writing manifest '%s': %s\n", writer->path, strerror(errno));
+        remove(writer->tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+void manifest_writer_abort(ManifestWriter *writer)
+{
+    if (!writer->file)
+        return;
+    fclose(writer->file);
+    writer->file = NULL;
+    remove(writer->tmp_path);
+}
@@ -0,0 +1,61 @@
+// File: src/manifest.h
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MANIFEST_PATH_MAX 4096
+
+// What a --delta-from run decided for a file of the previous manifest
+typedef enum
+{
+    MANIFEST_UNSEEN,    // Not (yet) found in this run: deleted once the structure pass is done
+    MANIFEST_UNCHANGED, // Same size and mtime, or same content hash
+    MANIFEST_MODIFIED
+} ManifestStatus;
+
+// One file section of a run: relative path, the stamp it was written with and, when the
+// content was read, its xxh64 hash
+typedef struct
+{
+    char *path;
+    unsigned long long size;
+    long long mtime_sec;
+    long mtime_nsec;
+    uint64_t hash;
+    int has_hash;
+    ManifestStatus status;
+} ManifestEntry;
+
+// A previous run's manifest, indexed by path
+typedef struct
+{
+    ManifestEntry *entries; // In the previous run's traversal order
+    size_t count;
+    size_t capacity;
+    size_t *index; // Open addressing, entry index + 1, 0 = empty
+    size_t index_size;
+} Manifest;
+
+// This run's manifest, written to "<path>.tmp" and renamed into place once the run succeeds
+typedef struct
+{
+    const char *path;
+    char tmp_path[MANIFEST_PATH_MAX + 8];
+    FILE *file;
+    unsigned long long count;
+} ManifestWriter;
+
+int manifest_load(const char *path, Manifest *manifest);
+ManifestEntry *manifest_find(const Manifest *manifest, const char *path);
+void manifest_free(Manifest *manifest);
+
+int manifest_writer_open(ManifestWriter *writer, const char *path);
+void manifest_writer_add(ManifestWriter *writer, const char *path, unsigned long long size,
+                         long long mtime_sec, long mtime_nsec, int has_hash, uint64_t hash);
+int manifest_writer_commit(ManifestWriter *writer);
+void manifest_writer_abort(ManifestWriter *writer);
+
+#endif
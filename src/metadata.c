@@ -0,0 +1,106 @@
+// File: src/metadata.c
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <errno.h>
+#include "metadata.h"
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
+
+#if defined(__linux__) && defined(STATX_TYPE)
+#define HAVE_STATX 1
+// Cleared when the kernel (or a seccomp filter) rejects statx; fstatat is used from then on
+static int statx_available = 1;
+
+static const unsigned int statx_masks[] = {
+    STATX_TYPE,
+    STATX_TYPE | STATX_SIZE,
+    STATX_TYPE | STATX_SIZE | STATX_MTIME | STATX_INO,
+};
+#endif
+
+static void meta_from_stat(const struct stat *st, EntryMeta *meta)
+{
+    meta->mode = st->st_mode;
+    meta->dev = st->st_dev;
+    meta->ino = st->st_ino;
+    meta->size = (unsigned long long)st->st_size;
+#ifdef __APPLE__
+    meta->mtime_sec = (long long)st->st_mtimespec.tv_sec;
+    meta->mtime_nsec = st->st_mtimespec.tv_nsec;
+#else
+    meta->mtime_sec = (long long)st->st_mtim.tv_sec;
+    meta->mtime_nsec = st->st_mtim.tv_nsec;
+#endif
+}
+
+int entry_metadata(int dir_fd, const char *name, int follow, MetaLevel level, int dont_sync, EntryMeta *meta)
+{
+    memset(meta, 0, sizeof(*meta));
+
+#ifdef HAVE_STATX
+    if (statx_available)
+    {
+        struct statx stx;
+        int flags = AT_NO_AUTOMOUNT | (follow ? 0 : AT_SYMLINK_NOFOLLOW) |
+                    (dont_sync ? AT_STATX_DONT_SYNC : AT_STATX_SYNC_AS_STAT);
+        if (statx(dir_fd, name, flags, statx_masks[level], &stx) == 0)
+        {
+            meta->mode = stx.stx_mode;
+            meta->dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+            meta->ino = (ino_t)stx.stx_ino;
+            meta->size = stx.stx_size;
+            meta->mtime_sec = stx.stx_mtime.tv_sec;
+            meta->mtime_nsec = (long)stx.stx_mtime.tv_nsec;
+            return 0;
+        }
+        if (errno != ENOSYS && errno != EPERM)
+            return -1;
+        statx_available = 0;
+    }
+#else
+    (void)level;
+    (void)dont_sync;
+#endif
+
+    struct stat st;
+    if (fstatat(dir_fd, name, &st, follow ? 0 : AT_SYMLINK_NOFOLLOW) != 0)
+        return -1;
+    meta_from_stat(&st, meta);
+    return 0;
+}
+
+mode_t entry_type_from_dirent(unsigned char d_type)
+{
+#ifdef DT_UNKNOWN
+    switch (d_type)
+    {
+    case DT_REG:
+        return S_IFREG;
+    case DT_DIR:
+        return S_IFDIR;
+    case DT_LNK:
+        return S_IFLNK;
+    case DT_FIFO:
+        return S_IFIFO;
+    case DT_SOCK:
+        return S_IFSOCK;
+    case DT_CHR:
+        return S_IFCHR;
+    case DT_BLK:
+        return S_IFBLK;
+    default:
+        return 0;
+    }
+#else
+    (void)d_type;
+    return 0;
+#endif
+}
+#endif
@@ -0,0 +1,34 @@
+// File: src/metadata.h
+#ifndef METADATA_H
+#define METADATA_H
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <sys/types.h>
+
+// How much of an entry's metadata a caller needs; each level is a superset of the previous
+typedef enum
+{
+    META_TYPE, // File type (and device, which statx always reports)
+    META_SIZE, // + size
+    META_FULL  // + mtime and inode
+} MetaLevel;
+
+typedef struct
+{
+    mode_t mode; // Only the S_IFMT bits are guaranteed
+    dev_t dev;
+    ino_t ino;
+    unsigned long long size;
+    long long mtime_sec;
+    long mtime_nsec;
+} EntryMeta;
+
+// Metadata for <name> relative to dir_fd. With dont_sync, cached attributes are acceptable
+// (AT_STATX_DONT_SYNC), which spares network filesystems a revalidation round trip.
+int entry_metadata(int dir_fd, const char *name, int follow, MetaLevel level, int dont_sync, EntryMeta *meta);
+
+// S_IFMT bits for a dirent d_type, or 0 when the filesystem did not report it
+mode_t entry_type_from_dirent(unsigned char d_type);
+#endif
+
+#endif
@@ -0,0 +1,549 @@
+// File: src/metrics.c
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "metrics.h"
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
+#define METRICS_REQUEST_MAX 4096
+#define METRICS_READ_TIMEOUT_SEC 2 // A client that sends nothing does not hold up the next scrape
+
+// Upper bounds in seconds: file sections are rendered in microseconds to seconds, runs take
+// from a fraction of a second to minutes
+static const double file_bounds[METRICS_BUCKET_COUNT] = {0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005,
+                                                         0.01,   0.025,   0.05,   0.1,   0.25,   1.0};
+static const double run_bounds[METRICS_BUCKET_COUNT] = {0.05, 0.1, 0.25, 0.5, 1.0, 2.5,
+                                                        5.0,  10.0, 30.0, 60.0, 120.0, 300.0};
+
+static const char *const run_result_names[METRICS_RUN_RESULT_COUNT] = {"ok", "failed", "interrupted"};
+
+unsigned long long metrics_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+}
+
+void metrics_init(Metrics *metrics, const MemoryGovernor *governor)
+{
+    memset(metrics, 0, sizeof(*metrics));
+    metrics->governor = governor;
+    metrics->listen_fd = -1;
+    metrics->wake_fds[0] = metrics->wake_fds[1] = -1;
+    pthread_mutex_init(&metrics->mutex, NULL);
+}
+
+void metrics_destroy(Metrics *metrics)
+{
+    metrics_stop(metrics);
+    for (int i = 0; i < metrics->plugin_count; i++)
+        free(metrics->plugins[i].name);
+    pthread_mutex_destroy(&metrics->mutex);
+}
+
+MetricsPluginSlot *metrics_plugin_slot(Metrics *metrics, const char *name)
+{
+    MetricsPluginSlot *slot = NULL;
+    pthread_mutex_lock(&metrics->mutex);
+    for (int i = 0; i < metrics->plugin_count && !slot; i++)
+    {
+        if (strcmp(metrics->plugins[i].name, name) == 0)
+            slot = &metrics->plugins[i];
+    }
+    if (!slot && metrics->plugin_count < METRICS_MAX_PLUGINS)
+    {
+        char *copy = strdup(name);
+        if (copy)
+        {
+            slot = &metrics->plugins[metrics->plugin_count];
+            slot->name = copy;
+            // Published last: the server thread only reads slots below plugin_count
+            __atomic_store_n(&metrics->plugin_count, metrics->plugin_count + 1, __ATOMIC_RELEASE);
+        }
+    }
+    pthread_mutex_unlock(&metrics->mutex);
+    return slot;
+}
+
+static void histogram_observe(MetricsHistogram *histogram, const double *bounds, unsigned long long ns)
+{
+    double seconds = (double)ns / 1e9;
+    int bucket = 0;
+    while (bucket < METRICS_BUCKET_COUNT && seconds > bounds[bucket])
+        bucket++;
+    histogram->buckets[bucket]++;
+    histogram->count++;
+    histogram->sum_ns += ns;
+}
+
+void metrics_run_begin(Metrics *metrics)
+{
+    metrics->run_started_ns = metrics_now_ns();
+    metrics_gauge_set(&metrics->run_active, 1);
+}
+
+void metrics_run_end(Metrics *metrics, MetricsRunResult result)
+{
+    unsigned long long elapsed = metrics_now_ns() - metrics->run_started_ns;
+    metrics_add(&metrics->runs[result], 1);
+    pthread_mutex_lock(&metrics->mutex);
+    histogram_observe(&metrics->run_seconds, run_bounds, elapsed);
+    pthread_mutex_unlock(&metrics->mutex);
+    metrics_gauge_set(&metrics->run_active, 0);
+}
+
+void metrics_file_done(Metrics *metrics, unsigned long long size, int failed, unsigned long long elapsed_ns)
+{
+    metrics_add(&metrics->files, 1);
+    if (failed)
+        metrics_add(&metrics->file_errors, 1);
+    else
+        metrics_add(&metrics->input_bytes, size);
+    pthread_mutex_lock(&metrics->mutex);
+    histogram_observe(&metrics->file_seconds, file_bounds, elapsed_ns);
+    pthread_mutex_unlock(&metrics->mutex);
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+static void write_family(FILE *out, const char *name, const char *type, const char *help)
+{
+    fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void write_counter(FILE *out, const char *name, const char *help, const unsigned long long *counter)
+{
+    write_family(out, name, "counter", help);
+    fprintf(out, "%s %llu\n", name, __atomic_load_n(counter, __ATOMIC_RELAXED));
+}
+
+static void write_gauge(FILE *out, const char *name, const char *help, long long value)
+{
+    write_family(out, name, "gauge", help);
+    fprintf(out, "%s %lld\n", name, value);
+}
+
+// Label values escape backslash, double quote and newline
+static void write_label_value(FILE *out, const char *value)
+{
+    for (; *value; value++)
+    {
+        if (*value == '\\' || *value == '"')
+            fprintf(out, "\\%c", *value);
+        else if (*value == '\n')
+            fputs("\\n", out);
+        else
+            fputc(*value, out);
+    }
+}
+
+static void write_histogram(FILE *out, const char *name, const char *help, const MetricsHistogram *histogram,
+                            const double *bounds)
+{
+    write_family(out, name, "histogram", help);
+    unsigned long long cumulative = 0;
+    for (int i = 0; i < METRICS_BUCKET_COUNT; i++)
+    {
+        cumulative += histogram->buckets[i];
+        fprintf(out, "%s_bucket{le=\"%g\"} %llu\n", name, bounds[i], cumulative);
+    }
+    fprintf(out, "%s_bucket{le=\"+Inf\"} %llu\n", name, histogram->count);
+    fprintf(out, "%s_sum %.9f\n", name, (double)histogram->sum_ns / 1e9);
+    fprintf(out, "%s_count %llu\n", name, histogram->count);
+}
+
+char *metrics_render(Metrics *metrics, size_t *length)
+{
+    char *text = NULL;
+    FILE *out = open_memstream(&text, length);
+    if (!out)
+        return NULL;
+
+    write_family(out, "fconcat_runs_total", "counter", "Runs of the walk and concatenation, by result.");
+    for (int i = 0; i < METRICS_RUN_RESULT_COUNT; i++)
+        fprintf(out, "fconcat_runs_total{result=\"%s\"} %llu\n", run_result_names[i],
+                __atomic_load_n(&metrics->runs[i], __ATOMIC_RELAXED));
+    write_counter(out, "fconcat_files_total", "File sections rendered.", &metrics->files);
+    write_counter(out, "fconcat_file_errors_total", "Files that could not be read.", &metrics->file_errors);
+    write_counter(out, "fconcat_input_bytes_total", "Bytes of the files rendered.", &metrics->input_bytes);
+    write_counter(out, "fconcat_output_bytes_total", "Bytes written to the primary output.", &metrics->output_bytes);
+    write_counter(out, "fconcat_cache_hits_total", "--delta-from files unchanged since the base manifest.",
+                  &metrics->cache_hits);
+    write_counter(out, "fconcat_cache_misses_total", "--delta-from files added or modified.",
+                  &metrics->cache_misses);
+
+    int plugin_count = __atomic_load_n(&metrics->plugin_count, __ATOMIC_ACQUIRE);
+    if (plugin_count > 0)
+    {
+        write_family(out, "fconcat_plugin_seconds_total", "counter", "Time spent in plugin callbacks.");
+        for (int i = 0; i < plugin_count; i++)
+        {
+            fputs("fconcat_plugin_seconds_total{plugin=\"", out);
+            write_label_value(out, metrics->plugins[i].name);
+            fprintf(out, "\"} %.9f\n",
+                    (double)__atomic_load_n(&metrics->plugins[i].busy_ns, __ATOMIC_RELAXED) / 1e9);
+        }
+        write_family(out, "fconcat_plugin_calls_total", "counter", "Plugin callbacks invoked.");
+        for (int i = 0; i < plugin_count; i++)
+        {
+            fputs("fconcat_plugin_calls_total{plugin=\"", out);
+            write_label_value(out, metrics->plugins[i].name);
+            fprintf(out, "\"} %llu\n", __atomic_load_n(&metrics->plugins[i].calls, __ATOMIC_RELAXED));
+        }
+    }
+
+    write_gauge(out, "fconcat_run_active", "1 while a run is in progress.",
+                __atomic_load_n(&metrics->run_active, __ATOMIC_RELAXED));
+    write_family(out, "fconcat_queue_depth", "gauge",
+                 "--jobs sections waiting for a worker (render) or to be written (write).");
+    fprintf(out, "fconcat_queue_depth{queue=\"render\"} %lld\n",
+            __atomic_load_n(&metrics->sections_queued, __ATOMIC_RELAXED));
+    fprintf(out, "fconcat_queue_depth{queue=\"write\"} %lld\n",
+            __atomic_load_n(&metrics->sections_in_flight, __ATOMIC_RELAXED));
+    write_gauge(out, "fconcat_workers", "--jobs worker threads running.",
+                __atomic_load_n(&metrics->workers, __ATOMIC_RELAXED));
+    write_gauge(out, "fconcat_workers_busy", "--jobs worker threads rendering a section.",
+                __atomic_load_n(&metrics->workers_busy, __ATOMIC_RELAXED));
+    if (metrics->governor)
+    {
+        write_gauge(out, "fconcat_memory_bytes", "Buffered file data held, as accounted by --max-memory.",
+                    (long long)__atomic_load_n(&metrics->governor->used, __ATOMIC_RELAXED));
+        if (metrics->governor->limit > 0)
+            write_gauge(out, "fconcat_memory_limit_bytes", "The --max-memory budget.",
+                        (long long)metrics->governor->limit);
+    }
+
+    pthread_mutex_lock(&metrics->mutex);
+    write_histogram(out, "fconcat_run_duration_seconds", "Duration of runs, one per output regeneration.",
+                    &metrics->run_seconds, run_bounds);
+    write_histogram(out, "fconcat_file_duration_seconds", "Time to render a file section.",
+                    &metrics->file_seconds, file_bounds);
+    pthread_mutex_unlock(&metrics->mutex);
+
+    if (fclose(out) != 0)
+    {
+        free(text);
+        return NULL;
+    }
+    return text;
+}
+
+static int send_all(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return -1;
+        data += sent;
+        length -= (size_t)sent;
+    }
+    return 0;
+}
+
+static void send_response(int fd, const char *status, const char *content_type, const char *body, size_t length)
+{
+    char head[256];
+    int head_length = snprintf(head, sizeof(head),
+                               "HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                               status, content_type, length);
+    if (send_all(fd, head, (size_t)head_length) == 0)
+        send_all(fd, body, length);
+}
+
+// One HTTP/1.0 exchange: GET /metrics (or /) gets the exposition, anything else an error
+static void serve_client(Metrics *metrics, int fd)
+{
+    struct timeval timeout = {METRICS_READ_TIMEOUT_SEC, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    char request[METRICS_REQUEST_MAX + 1];
+    size_t used = 0;
+    while (used < METRICS_REQUEST_MAX)
+    {
+        ssize_t got = recv(fd, request + used, METRICS_REQUEST_MAX - used, 0);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            break;
+        used += (size_t)got;
+        request[used] = '\0';
+        if (strstr(request, "\r\n\r\n") || strstr(request, "\n\n"))
+            break;
+    }
+    request[used] = '\0';
+
+    static const char text_type[] = "text/plain; charset=utf-8";
+    if (strncmp(request, "GET ", 4) != 0)
+    {
+        static const char body[] = "Only GET is supported\n";
+        send_response(fd, "405 Method Not Allowed", text_type, body, sizeof(body) - 1);
+        return;
+    }
+    const char *path = request + 4;
+    size_t path_length = strcspn(path, " ?\r\n");
+    if (!(path_length == 1 && path[0] == '/') && !(path_length == 8 && strncmp(path, "/metrics", 8) == 0))
+    {
+        static const char body[] = "Not found, scrape /metrics\n";
+        send_response(fd, "404 Not Found", text_type, body, sizeof(body) - 1);
+        return;
+    }
+
+    size_t length = 0;
+    char *body = metrics_render(metrics, &length);
+    if (!body)
+    {
+        static const char error[] = "Out of memory\n";
+        send_response(fd, "500 Internal Server Error", text_type, error, sizeof(error) - 1);
+        return;
+    }
+    send_response(fd, "200 OK", "text/plain; version=0.0.4; charset=utf-8", body, length);
+    free(body);
+}
+
+static void *metrics_thread(void *arg)
+{
+    Metrics *metrics = arg;
+    struct pollfd fds[2] = {{metrics->listen_fd, POLLIN, 0}, {metrics->wake_fds[0], POLLIN, 0}};
+    for (;;)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[1].revents)
+            break;
+        if (!(fds[0].revents & POLLIN))
+            continue;
+        int client = accept(metrics->listen_fd, NULL, NULL);
+        if (client < 0)
+            continue;
+        serve_client(metrics, client);
+        close(client);
+    }
+    return NULL;
+}
+
+static int listen_unix(Metrics *metrics, const char *path, char *error, size_t error_size)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        snprintf(error, error_size, "socket path is too long: %s", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        snprintf(error, error_size, "socket: %s", strerror(errno));
+        return -1;
+    }
+
+    // A socket left behind by a process that died is replaced; one that still answers is not
+    struct stat st;
+    if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    {
+        if (connect(fd, (struct sockaddr *)&address, sizeof(address)) == 0)
+        {
+            snprintf(error, error_size, "%s is in use by another process", path);
+            close(fd);
+            return -1;
+        }
+        unlink(path);
+    }
+
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, 16) != 0)
+    {
+        snprintf(error, error_size, "cannot listen on %s: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    metrics->unix_path = strdup(path);
+    metrics->listen_fd = fd;
+    return 0;
+}
+
+// Only loopback addresses: the endpoint has no authentication
+static int listen_loopback(Metrics *metrics, const char *address_text, char *error, size_t error_size)
+{
+    char host[64] = "127.0.0.1";
+    const char *port_text = address_text;
+    const char *colon = strrchr(address_text, ':');
+    if (colon)
+    {
+        size_t host_length = (size_t)(colon - address_text);
+        const char *host_start = address_text;
+        if (host_length >= 2 && host_start[0] == '[' && host_start[host_length - 1] == ']')
+        {
+            host_start++;
+            host_length -= 2;
+        }
+        if (host_length == 0 || host_length >= sizeof(host))
+        {
+            snprintf(error, error_size, "invalid address '%s'", address_text);
+            return -1;
+        }
+        memcpy(host, host_start, host_length);
+        host[host_length] = '\0';
+        port_text = colon + 1;
+    }
+    if (strcmp(host, "localhost") == 0)
+        strcpy(host, "127.0.0.1");
+
+    char *end;
+    long port = strtol(port_text, &end, 10);
+    if (*port_text == '\0' || *end != '\0' || port < 1 || port > 65535)
+    {
+        snprintf(error, error_size, "invalid port in '%s'", address_text);
+        return -1;
+    }
+
+    struct sockaddr_storage storage;
+    socklen_t length;
+    memset(&storage, 0, sizeof(storage));
+    struct sockaddr_in *v4 = (struct sockaddr_in *)&storage;
+    struct sockaddr_in6 *v6 = (struct sockaddr_in6 *)&storage;
+    if (inet_pton(AF_INET, host, &v4->sin_addr) == 1)
+    {
+        if ((ntohl(v4->sin_addr.s_addr) >> 24) != 127)
+        {
+            snprintf(error, error_size, "%s is not a loopback address", host);
+            return -1;
+        }
+        v4->sin_family = AF_INET;
+        v4->sin_port = htons((unsigned short)port);
+        length = sizeof(*v4);
+    }
+    else if (inet_pton(AF_INET6, host, &v6->sin6_addr) == 1)
+    {
+        if (!IN6_IS_ADDR_LOOPBACK(&v6->sin6_addr))
+        {
+            snprintf(error, error_size, "%s is not a loopback address", host);
+            return -1;
+        }
+        v6->sin6_family = AF_INET6;
+        v6->sin6_port = htons((unsigned short)port);
+        length = sizeof(*v6);
+    }
+    else
+    {
+        snprintf(error, error_size, "'%s' is not a loopback address (use 127.0.0.1, ::1 or localhost)", host);
+        return -1;
+    }
+
+    int fd = socket(storage.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        snprintf(error, error_size, "socket: %s", strerror(errno));
+        return -1;
+    }
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(fd, (struct sockaddr *)&storage, length) != 0 || listen(fd, 16) != 0)
+    {
+        snprintf(error, error_size, "cannot listen on %s: %s", address_text, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    metrics->listen_fd = fd;
+    return 0;
+}
+
+int metrics_start(Metrics *metrics, const char *address, char *error, size_t error_size)
+{
+    int listening = strncmp(address, "unix:", 5) == 0 ? listen_unix(metrics, address + 5, error, error_size)
+                                                       : listen_loopback(metrics, address, error, error_size);
+    if (listening != 0)
+        return -1;
+
+    if (pipe(metrics->wake_fds) != 0)
+    {
+        snprintf(error, error_size, "pipe: %s", strerror(errno));
+        metrics_stop(metrics);
+        return -1;
+    }
+    // Signals stay with the main thread, whose handlers stop the server
+    sigset_t blocked, previous;
+    sigfillset(&blocked);
+    pthread_sigmask(SIG_SETMASK, &blocked, &previous);
+    int created = pthread_create(&metrics->thread, NULL, metrics_thread, metrics);
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    if (created != 0)
+    {
+        snprintf(error, error_size, "cannot start the server thread");
+        metrics_stop(metrics);
+        return -1;
+    }
+    metrics->serving = 1;
+    return 0;
+}
+
+void metrics_stop(Metrics *metrics)
+{
+    if (metrics->serving)
+    {
+        char wake = 0;
+        while (write(metrics->wake_fds[1], &wake, 1) < 0 && errno == EINTR)
+            ;
+        pthread_join(metrics->thread, NULL);
+        metrics->serving = 0;
+    }
+    for (int i = 0; i < 2; i++)
+    {
+        if (metrics->wake_fds[i] >= 0)
+            close(metrics->wake_fds[i]);
+        metrics->wake_fds[i] = -1;
+    }
+    if (metrics->listen_fd >= 0)
+        close(metrics->listen_fd);
+    metrics->listen_fd = -1;
+    if (metrics->unix_path)
+    {
+        unlink(metrics->unix_path);
+        free(metrics->unix_path);
+        metrics->unix_path = NULL;
+    }
+}
+#else
+char *metrics_render(Metrics *metrics, size_t *length)
+{
+    (void)metrics;
+    *length = 0;
+    return NULL;
+}
+
+int metrics_start(Metrics *metrics, const char *address, char *error, size_t error_size)
+{
+    (void)metrics;
+    (void)address;
+    snprintf(error, error_size, "the metrics endpoint is not available on Windows");
+    return -1;
+}
+
+void metrics_stop(Metrics *metrics)
+{
+    (void)metrics;
+}
+#endif
@@ -0,0 +1,111 @@
+// File: src/metrics.h
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include "governor.h"
+
+#define METRICS_MAX_PLUGINS 64
+#define METRICS_BUCKET_COUNT 12 // Histogram buckets besides +Inf, see metrics.c
+
+typedef enum
+{
+    METRICS_RUN_OK,
+    METRICS_RUN_FAILED,
+    METRICS_RUN_INTERRUPTED,
+    METRICS_RUN_RESULT_COUNT
+} MetricsRunResult;
+
+typedef struct
+{
+    unsigned long long buckets[METRICS_BUCKET_COUNT + 1]; // Per bucket, cumulated when rendered
+    unsigned long long count;
+    unsigned long long sum_ns;
+} MetricsHistogram;
+
+// Callback time of one plugin name; plugins loaded into several chains share a slot
+typedef struct
+{
+    char *name;
+    unsigned long long busy_ns;
+    unsigned long long calls;
+} MetricsPluginSlot;
+
+// --metrics: Prometheus text exposition of the run, served from a background thread over a
+// Unix socket or a loopback TCP port. Counters and gauges are updated with relaxed atomics from
+// any thread, histograms under the mutex.
+typedef struct Metrics
+{
+    // Counters
+    unsigned long long runs[METRICS_RUN_RESULT_COUNT];
+    unsigned long long files;        // File sections rendered
+    unsigned long long file_errors;  // Files that could not be read
+    unsigned long long input_bytes;  // Sizes of the files rendered
+    unsigned long long output_bytes; // Primary output written, counted as each file section lands
+    unsigned long long cache_hits;   // --delta-from: files unchanged since the base manifest
+    unsigned long long cache_misses; // --delta-from: files added or modified
+    MetricsPluginSlot plugins[METRICS_MAX_PLUGINS];
+    int plugin_count;
+
+    // Gauges
+    long long run_active;
+    long long sections_queued;    // --jobs: submitted, not yet picked up by a worker
+    long long sections_in_flight; // --jobs: submitted, not yet written
+    long long workers;
+    long long workers_busy;
+    const MemoryGovernor *governor; // Memory in use, NULL = not exported
+
+    MetricsHistogram run_seconds;  // Whole runs (regenerations of the output)
+    MetricsHistogram file_seconds; // File sections, open to last byte rendered
+    unsigned long long run_started_ns;
+
+    // Endpoint
+    int listen_fd;
+    int wake_fds[2]; // Written to stop the server thread
+    char *unix_path; // Socket file to remove on stop, NULL for TCP
+    pthread_t thread;
+    int serving;
+    pthread_mutex_t mutex;
+} Metrics;
+
+void metrics_init(Metrics *metrics, const MemoryGovernor *governor);
+void metrics_destroy(Metrics *metrics);
+
+// Listen on "unix:<path>", "<host>:<port>" with a loopback host, or "<port>" on 127.0.0.1,
+// and serve GET /metrics until metrics_stop(). Returns 0, or -1 with a message in error.
+int metrics_start(Metrics *metrics, const char *address, char *error, size_t error_size);
+void metrics_stop(Metrics *metrics);
+
+unsigned long long metrics_now_ns(void);
+MetricsPluginSlot *metrics_plugin_slot(Metrics *metrics, const char *name);
+
+static inline void metrics_add(unsigned long long *counter, unsigned long long value)
+{
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static inline void metrics_gauge_add(long long *gauge, long long value)
+{
+    __atomic_fetch_add(gauge, value, __ATOMIC_RELAXED);
+}
+
+static inline void metrics_gauge_set(long long *gauge, long long value)
+{
+    __atomic_store_n(gauge, value, __ATOMIC_RELAXED);
+}
+
+static inline void metrics_plugin_add(MetricsPluginSlot *slot, unsigned long long ns)
+{
+    __atomic_fetch_add(&slot->busy_ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&slot->calls, 1, __ATOMIC_RELAXED);
+}
+
+void metrics_run_begin(Metrics *metrics);
+void metrics_run_end(Metrics *metrics, MetricsRunResult result);
+void metrics_file_done(Metrics *metrics, unsigned long long size, int failed, unsigned long long elapsed_ns);
+
+// The exposition as served, malloc'ed; NULL when out of memory
+char *metrics_render(Metrics *metrics, size_t *length);
+
+#endif
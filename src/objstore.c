@@ -0,0 +1,1604 @@
+// File: src/objstore.c
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include "hash.h"
+#include "objstore.h"
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#ifndef FCONCAT_STATIC
+#include <netdb.h>
+#endif
+#endif
+
+#define OBJECT_BUFFER_SIZE (16 * 1024) // Response headers must fit, body reads go through it
+#define OBJECT_HEAD_SIZE (64 * 1024)   // Start of a small object kept for the rewind after sniffing
+#define OBJECT_RETRIES 4               // Attempts per request on connection errors, 5xx and 429 replies
+#define OBJECT_TIMEOUT_SEC 30
+#define OBJECT_ERROR_BODY_MAX (64 * 1024)
+
+// Hash of an empty payload: every request here is a GET
+#define EMPTY_PAYLOAD_SHA256 "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"
+
+int is_object_url(const char *path)
+{
+    return strncmp(path, OBJECT_URL_SCHEME, sizeof(OBJECT_URL_SCHEME) - 1) == 0;
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+
+static void copy_text(char *dest, size_t dest_size, const char *src, size_t length)
+{
+    if (length >= dest_size)
+        length = dest_size - 1;
+    memcpy(dest, src, length);
+    dest[length] = '\0';
+}
+
+static const char *env_first(const char *name, const char *fallback)
+{
+    const char *value = getenv(name);
+    if (value && value[0])
+        return value;
+    if (fallback)
+    {
+        value = getenv(fallback);
+        if (value && value[0])
+            return value;
+    }
+    return NULL;
+}
+
+// "s3://bucket/key" into the bucket and the key (or prefix), without the leading '/'
+static int split_object_url(const char *url, char *bucket, size_t bucket_size, const char **key)
+{
+    if (!is_object_url(url))
+        return -1;
+    const char *name = url + sizeof(OBJECT_URL_SCHEME) - 1;
+    size_t length = strcspn(name, "/");
+    if (length == 0 || length >= bucket_size)
+        return -1;
+    copy_text(bucket, bucket_size, name, length);
+    *key = name[length] == '/' ? name + length + 1 : name + length;
+    return 0;
+}
+
+// RFC 3986 encoding as SigV4 canonicalizes it: only unreserved characters are left as is
+static int uri_encode(char *dest, size_t dest_size, const char *src, int keep_slash)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    size_t used = 0;
+    for (const unsigned char *p = (const unsigned char *)src; *p; p++)
+    {
+        int plain = (*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z') || (*p >= '0' && *p <= '9') || *p == '-' ||
+                    *p == '_' || *p == '.' || *p == '~' || (keep_slash && *p == '/');
+        if (used + (plain ? 1 : 3) >= dest_size)
+            return -1;
+        if (plain)
+        {
+            dest[used++] = (char)*p;
+        }
+        else
+        {
+            dest[used++] = '%';
+            dest[used++] = hex[*p >> 4];
+            dest[used++] = hex[*p & 15];
+        }
+    }
+    dest[used] = '\0';
+    return 0;
+}
+
+static void hex_encode(char *dest, const unsigned char *data, size_t length)
+{
+    static const char hex[] = "0123456789abcdef";
+    for (size_t i = 0; i < length; i++)
+    {
+        dest[i * 2] = hex[data[i] >> 4];
+        dest[i * 2 + 1] = hex[data[i] & 15];
+    }
+    dest[length * 2] = '\0';
+}
+
+// The x-amz-* and Authorization header lines of a GET. The Range header is not signed, so
+// the parts of an object share everything but the date.
+static int sign_request(ObjectStore *store, const char *canonical_uri, const char *query, char *headers,
+                        size_t headers_size)
+{
+    char amz_date[32], date[16];
+    time_t now = time(NULL);
+    struct tm utc;
+    gmtime_r(&now, &utc);
+    strftime(amz_date, sizeof(amz_date), "%Y%m%dT%H%M%SZ", &utc);
+    copy_text(date, sizeof(date), amz_date, 8);
+
+    int token = store->session_token[0] != '\0';
+    int used = snprintf(headers, headers_size, "x-amz-content-sha256: %s\r\nx-amz-date: %s\r\n",
+                        EMPTY_PAYLOAD_SHA256, amz_date);
+    if (token)
+        used += snprintf(headers + used, headers_size - (size_t)used, "x-amz-security-token: %s\r\n",
+                         store->session_token);
+    if (used < 0 || (size_t)used >= headers_size)
+        return -1;
+    if (!store->access_key[0])
+        return 0;
+
+    const char *signed_headers =
+        token ? "host;x-amz-content-sha256;x-amz-date;x-amz-security-token" : "host;x-amz-content-sha256;x-amz-date";
+    char canonical[8192];
+    int length = snprintf(canonical, sizeof(canonical),
+                          "GET\n%s\n%s\nhost:%s\nx-amz-content-sha256:%s\nx-amz-date:%s\n%s%s%s\n%s\n%s",
+                          canonical_uri, query, store->authority, EMPTY_PAYLOAD_SHA256, amz_date,
+                          token ? "x-amz-security-token:" : "", token ? store->session_token : "", token ? "\n" : "",
+                          signed_headers, EMPTY_PAYLOAD_SHA256);
+    if (length < 0 || (size_t)length >= sizeof(canonical))
+        return -1;
+
+    unsigned char digest[SHA256_DIGEST_SIZE];
+    char digest_hex[SHA256_DIGEST_SIZE * 2 + 1];
+    Sha256 sha;
+    sha256_init(&sha);
+    sha256_update(&sha, canonical, (size_t)length);
+    sha256_final(&sha, digest);
+    hex_encode(digest_hex, digest, sizeof(digest));
+
+    char scope[128];
+    snprintf(scope, sizeof(scope), "%s/%s/s3/aws4_request", date, store->region);
+    char string_to_sign[512];
+    int sign_length = snprintf(string_to_sign, sizeof(string_to_sign), "AWS4-HMAC-SHA256\n%s\n%s\n%s", amz_date,
+                               scope, digest_hex);
+
+    // kSigning = HMAC(HMAC(HMAC(HMAC("AWS4" + secret, date), region), "s3"), "aws4_request")
+    char secret[sizeof(store->secret_key) + 4];
+    int secret_length = snprintf(secret, sizeof(secret), "AWS4%s", store->secret_key);
+    unsigned char key[SHA256_DIGEST_SIZE];
+    hmac_sha256(secret, (size_t)secret_length, date, strlen(date), key);
+    hmac_sha256(key, sizeof(key), store->region, strlen(store->region), key);
+    hmac_sha256(key, sizeof(key), "s3", 2, key);
+    hmac_sha256(key, sizeof(key), "aws4_request", 12, key);
+    hmac_sha256(key, sizeof(key), string_to_sign, (size_t)sign_length, digest);
+    hex_encode(digest_hex, digest, sizeof(digest));
+    memset(secret, 0, sizeof(secret));
+    memset(key, 0, sizeof(key));
+
+    length = snprintf(headers + used, headers_size - (size_t)used,
+                      "Authorization: AWS4-HMAC-SHA256 Credential=%s/%s, SignedHeaders=%s, Signature=%s\r\n",
+                      store->access_key, scope, signed_headers, digest_hex);
+    return length < 0 || (size_t)length >= headers_size - (size_t)used ? -1 : 0;
+}
+
+// Connections
+
+static int parse_endpoint(ObjectStore *store, const char *endpoint, char *error, size_t error_size)
+{
+    if (strncasecmp(endpoint, "https://", 8) == 0)
+    {
+        snprintf(error, error_size, "'%s': https is not supported, this build has no TLS; use an http:// "
+                                    "endpoint (a local S3 server, or a TLS-terminating proxy)", endpoint);
+        return -1;
+    }
+    if (strncasecmp(endpoint, "http://", 7) != 0)
+    {
+        snprintf(error, error_size, "'%s': the endpoint must be an http:// URL", endpoint);
+        return -1;
+    }
+
+    const char *authority = endpoint + 7;
+    size_t authority_length = strcspn(authority, "/");
+    if (authority[authority_length] == '/' && authority[authority_length + 1] != '\0')
+    {
+        snprintf(error, error_size, "'%s': the endpoint must not have a path", endpoint);
+        return -1;
+    }
+    if (authority_length == 0 || authority_length >= sizeof(store->authority))
+    {
+        snprintf(error, error_size, "'%s': missing or overlong host", endpoint);
+        return -1;
+    }
+    copy_text(store->authority, sizeof(store->authority), authority, authority_length);
+
+    const char *host = store->authority;
+    const char *port = NULL;
+    size_t host_length;
+    if (host[0] == '[')
+    {
+        const char *close = strchr(host, ']');
+        if (!close || (close[1] != '\0' && close[1] != ':'))
+        {
+            snprintf(error, error_size, "'%s': malformed IPv6 address", endpoint);
+            return -1;
+        }
+        host++;
+        host_length = (size_t)(close - host);
+        port = close[1] == ':' ? close + 2 : NULL;
+    }
+    else
+    {
+        const char *colon = strrchr(host, ':');
+        host_length = colon ? (size_t)(colon - host) : strlen(host);
+        port = colon ? colon + 1 : NULL;
+    }
+    if (host_length == 0 || host_length >= sizeof(store->host))
+    {
+        snprintf(error, error_size, "'%s': missing host", endpoint);
+        return -1;
+    }
+    copy_text(store->host, sizeof(store->host), host, host_length);
+
+    char *end;
+    long port_number = port ? strtol(port, &end, 10) : 80;
+    if (port && (*port == '\0' || *end != '\0' || port_number < 1 || port_number > 65535))
+    {
+        snprintf(error, error_size, "'%s': invalid port", endpoint);
+        return -1;
+    }
+    snprintf(store->port, sizeof(store->port), "%ld", port_number);
+    return 0;
+}
+
+// The endpoint is resolved once; every connection goes to the same address
+static int resolve_endpoint(ObjectStore *store, char *error, size_t error_size)
+{
+    int port = atoi(store->port);
+    struct sockaddr_storage address;
+    memset(&address, 0, sizeof(address));
+    struct sockaddr_in *v4 = (struct sockaddr_in *)&address;
+    struct sockaddr_in6 *v6 = (struct sockaddr_in6 *)&address;
+    const char *host = strcmp(store->host, "localhost") == 0 ? "127.0.0.1" : store->host;
+    if (inet_pton(AF_INET, host, &v4->sin_addr) == 1)
+    {
+        v4->sin_family = AF_INET;
+        v4->sin_port = htons((unsigned short)port);
+        memcpy(store->address, &address, sizeof(*v4));
+        store->address_length = sizeof(*v4);
+        return 0;
+    }
+    if (inet_pton(AF_INET6, host, &v6->sin6_addr) == 1)
+    {
+        v6->sin6_family = AF_INET6;
+        v6->sin6_port = htons((unsigned short)port);
+        memcpy(store->address, &address, sizeof(*v6));
+        store->address_length = sizeof(*v6);
+        return 0;
+    }
+
+#ifdef FCONCAT_STATIC
+    // A static glibc cannot load the NSS modules getaddrinfo() needs
+    snprintf(error, error_size, "'%s': this static build takes IP addresses only (build with PLUGINS=1 to "
+                                "resolve host names)", store->host);
+    return -1;
+#else
+    struct addrinfo hints, *result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    int status = getaddrinfo(store->host, store->port, &hints, &result);
+    if (status != 0)
+    {
+        snprintf(error, error_size, "cannot resolve '%s': %s", store->host, gai_strerror(status));
+        return -1;
+    }
+    int fits = result->ai_addrlen <= sizeof(store->address);
+    if (fits)
+    {
+        memcpy(store->address, result->ai_addr, result->ai_addrlen);
+        store->address_length = (unsigned int)result->ai_addrlen;
+    }
+    freeaddrinfo(result);
+    if (!fits)
+        snprintf(error, error_size, "cannot resolve '%s': unsupported address", store->host);
+    return fits ? 0 : -1;
+#endif
+}
+
+static int store_connect(ObjectStore *store)
+{
+    const struct sockaddr *address = (const struct sockaddr *)store->address;
+    int fd = socket(address->sa_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    struct timeval timeout = {OBJECT_TIMEOUT_SEC, 0};
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, address, (socklen_t)store->address_length) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// An idle keep-alive connection, or -1 when a new one is needed
+static int store_take_idle(ObjectStore *store)
+{
+    int fd = -1;
+    pthread_mutex_lock(&store->mutex);
+    if (store->idle_count > 0)
+        fd = store->idle[--store->idle_count];
+    pthread_mutex_unlock(&store->mutex);
+    return fd;
+}
+
+static void store_give_idle(ObjectStore *store, int fd)
+{
+    pthread_mutex_lock(&store->mutex);
+    if (store->idle_count < OBJECT_CONNECTIONS_MAX)
+    {
+        store->idle[store->idle_count++] = fd;
+        fd = -1;
+    }
+    pthread_mutex_unlock(&store->mutex);
+    if (fd >= 0)
+        close(fd);
+}
+
+// HTTP/1.1 responses
+
+typedef struct
+{
+    ObjectStore *store;
+    int fd;
+    int status;
+    int keep_alive;
+    int chunked;
+    int has_length;
+    int in_chunk;                 // Chunked: inside a chunk's data, its CRLF still to come
+    int body_done;
+    unsigned long long remaining; // Body bytes, or bytes of the current chunk
+    size_t pos;
+    size_t end;
+    char buffer[OBJECT_BUFFER_SIZE];
+} HttpResponse;
+
+static int send_all(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return -1;
+        data += sent;
+        length -= (size_t)sent;
+    }
+    return 0;
+}
+
+static ssize_t response_fill(HttpResponse *response)
+{
+    if (response->pos == response->end)
+        response->pos = response->end = 0;
+    ssize_t received;
+    do
+        received = recv(response->fd, response->buffer + response->end, sizeof(response->buffer) - 1 - response->end,
+                        0);
+    while (received < 0 && errno == EINTR);
+    if (received > 0)
+        response->end += (size_t)received;
+    return received;
+}
+
+// A CRLF-terminated line of the chunked framing, without the terminator
+static int response_line(HttpResponse *response, char *line, size_t line_size)
+{
+    size_t used = 0;
+    for (;;)
+    {
+        if (response->pos == response->end && response_fill(response) <= 0)
+            return -1;
+        char c = response->buffer[response->pos++];
+        if (c == '\n')
+            break;
+        if (c != '\r' && used + 1 < line_size)
+            line[used++] = c;
+    }
+    line[used] = '\0';
+    return 0;
+}
+
+static int header_is(const char *line, const char *name, const char **value)
+{
+    size_t length = strlen(name);
+    if (strncasecmp(line, name, length) != 0 || line[length] != ':')
+        return 0;
+    *value = line + length + 1;
+    while (**value == ' ' || **value == '\t')
+        (*value)++;
+    return 1;
+}
+
+// Status line and headers; the body is left in the buffer and on the socket
+static int response_read_headers(HttpResponse *response)
+{
+    char *headers_end;
+    for (;;)
+    {
+        response->buffer[response->end] = '\0';
+        headers_end = strstr(response->buffer, "\r\n\r\n");
+        if (headers_end)
+            break;
+        if (response->end + 1 >= sizeof(response->buffer) || response_fill(response) <= 0)
+            return -1;
+    }
+    *headers_end = '\0';
+    response->pos = (size_t)(headers_end + 4 - response->buffer);
+
+    int minor = 0;
+    if (sscanf(response->buffer, "HTTP/1.%d %d", &minor, &response->status) != 2)
+        return -1;
+    response->keep_alive = minor >= 1;
+
+    char *line = strstr(response->buffer, "\r\n");
+    while (line)
+    {
+        line += 2;
+        char *next = strstr(line, "\r\n");
+        if (next)
+            *next = '\0';
+        const char *value;
+        if (header_is(line, "Content-Length", &value))
+        {
+            response->has_length = 1;
+            response->remaining = strtoull(value, NULL, 10);
+        }
+        else if (header_is(line, "Transfer-Encoding", &value) && strstr(value, "chunked"))
+        {
+            response->chunked = 1;
+        }
+        else if (header_is(line, "Connection", &value))
+        {
+            if (strncasecmp(value, "close", 5) == 0)
+                response->keep_alive = 0;
+            else if (strncasecmp(value, "keep-alive", 10) == 0)
+                response->keep_alive = 1;
+        }
+        line = next;
+    }
+
+    if (response->chunked)
+        response->has_length = 0;
+    else if (!response->has_length)
+        response->keep_alive = 0; // The body ends when the server closes
+    if (response->status == 204 || response->status == 304 || (response->has_length && response->remaining == 0))
+        response->body_done = 1;
+    return 0;
+}
+
+// Up to size body bytes: 0 at the end of the body, -1 when the connection failed first
+static ssize_t response_read(HttpResponse *response, char *out, size_t size)
+{
+    if (response->body_done || size == 0)
+        return 0;
+
+    if (response->chunked && response->remaining == 0)
+    {
+        char line[128];
+        if (response->in_chunk && (response_line(response, line, sizeof(line)) != 0 || line[0] != '\0'))
+            return -1;
+        response->in_chunk = 0;
+        if (response_line(response, line, sizeof(line)) != 0)
+            return -1;
+        char *end;
+        unsigned long long chunk = strtoull(line, &end, 16);
+        if (end == line)
+            return -1;
+        if (chunk == 0)
+        {
+            // Trailer fields up to the empty line
+            do
+            {
+                if (response_line(response, line, sizeof(line)) != 0)
+                    return -1;
+            } while (line[0] != '\0');
+            response->body_done = 1;
+            return 0;
+        }
+        response->remaining = chunk;
+        response->in_chunk = 1;
+    }
+
+    int bounded = response->chunked || response->has_length;
+    if (bounded && size > response->remaining)
+        size = (size_t)response->remaining;
+
+    ssize_t got;
+    if (response->pos < response->end)
+    {
+        got = (ssize_t)(response->end - response->pos < size ? response->end - response->pos : size);
+        memcpy(out, response->buffer + response->pos, (size_t)got);
+        response->pos += (size_t)got;
+    }
+    else
+    {
+        // Large reads go straight from the socket into the caller's buffer
+        do
+            got = recv(response->fd, out, size, 0);
+        while (got < 0 && errno == EINTR);
+        if (got == 0 && !bounded)
+        {
+            response->body_done = 1;
+            return 0;
+        }
+        if (got <= 0)
+            return -1;
+    }
+
+    if (bounded)
+    {
+        response->remaining -= (unsigned long long)got;
+        if (!response->chunked && response->remaining == 0)
+            response->body_done = 1;
+    }
+    __atomic_fetch_add(&response->store->bytes, (unsigned long long)got, __ATOMIC_RELAXED);
+    return got;
+}
+
+// Hand the connection back for reuse when the body was read to the end, else close it
+static void response_finish(HttpResponse *response)
+{
+    if (response->fd < 0)
+        return;
+    if (response->body_done && response->keep_alive && response->pos == response->end)
+        store_give_idle(response->store, response->fd);
+    else
+        close(response->fd);
+    response->fd = -1;
+}
+
+static char *response_read_all(HttpResponse *response, size_t limit, size_t *length)
+{
+    size_t capacity = 64 * 1024, used = 0;
+    char *body = malloc(capacity + 1);
+    if (!body)
+        return NULL;
+    for (;;)
+    {
+        if (used == capacity)
+        {
+            if (capacity >= limit)
+                break;
+            char *grown = realloc(body, capacity * 2 + 1);
+            if (!grown)
+            {
+                free(body);
+                return NULL;
+            }
+            body = grown;
+            capacity *= 2;
+        }
+        ssize_t got = response_read(response, body + used, capacity - used);
+        if (got < 0)
+        {
+            free(body);
+            return NULL;
+        }
+        if (got == 0)
+            break;
+        used += (size_t)got;
+    }
+    body[used] = '\0';
+    *length = used;
+    return body;
+}
+
+// GET canonical_uri?query, optionally one byte range. Retries connection failures, 5xx and 429
+// replies with backoff; a reused keep-alive connection that fails is replaced at once. Returns
+// 0 with the status and headers read, -1 when the endpoint could not be reached.
+static int object_get(ObjectStore *store, const char *canonical_uri, const char *query, const char *range,
+                      HttpResponse *response)
+{
+    char signature[4096];
+    char request[8192 + 4096];
+    unsigned int backoff_ms = 100;
+
+    for (int attempt = 0; attempt < OBJECT_RETRIES;)
+    {
+        memset(response, 0, offsetof(HttpResponse, buffer));
+        response->store = store;
+        response->fd = store_take_idle(store);
+        int reused = response->fd >= 0;
+        if (!reused)
+            response->fd = store_connect(store);
+
+        int sent = -1;
+        if (response->fd >= 0 && sign_request(store, canonical_uri, query, signature, sizeof(signature)) == 0)
+        {
+            int length = snprintf(request, sizeof(request), "GET %s%s%s HTTP/1.1\r\nHost: %s\r\n%s%s%s%s\r\n",
+                                  canonical_uri, query[0] ? "?" : "", query, store->authority, signature,
+                                  range ? "Range: bytes=" : "", range ? range : "", range ? "\r\n" : "");
+            if (length > 0 && (size_t)length < sizeof(request))
+                sent = send_all(response->fd, request, (size_t)length);
+        }
+        __atomic_fetch_add(&store->requests, 1, __ATOMIC_RELAXED);
+
+        // The last throttling or 5xx reply is returned, so the caller can report it
+        if (sent == 0 && response_read_headers(response) == 0 &&
+            ((response->status < 500 && response->status != 429) || attempt + 1 == OBJECT_RETRIES))
+            return 0;
+
+        if (response->fd >= 0)
+            close(response->fd);
+        response->fd = -1;
+        if (reused && sent != 0)
+            continue; // The server closed an idle connection: not a failed attempt
+        if (reused && response->status == 0)
+            continue;
+
+        if (++attempt < OBJECT_RETRIES)
+        {
+            __atomic_fetch_add(&store->retries, 1, __ATOMIC_RELAXED);
+            struct timespec pause = {backoff_ms / 1000, (long)(backoff_ms % 1000) * 1000000L};
+            nanosleep(&pause, NULL);
+            backoff_ms *= 2;
+        }
+    }
+    return -1;
+}
+
+// XML: the few elements of ListObjectsV2 and error replies
+
+// Decode the five predefined entities and character references of an element's text
+static char *xml_text(const char *text, size_t length)
+{
+    char *out = malloc(length + 1);
+    if (!out)
+        return NULL;
+    size_t used = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        if (text[i] != '&')
+        {
+            out[used++] = text[i];
+            continue;
+        }
+        static const struct
+        {
+            const char *name;
+            char c;
+        } entities[] = {{"amp;", '&'}, {"lt;", '<'}, {"gt;", '>'}, {"quot;", '"'}, {"apos;", '\''}};
+        const char *rest = text + i + 1;
+        size_t left = length - i - 1;
+        int matched = 0;
+        for (size_t e = 0; e < sizeof(entities) / sizeof(entities[0]) && !matched; e++)
+        {
+            size_t name_length = strlen(entities[e].name);
+            if (left >= name_length && memcmp(rest, entities[e].name, name_length) == 0)
+            {
+                out[used++] = entities[e].c;
+                i += name_length;
+                matched = 1;
+            }
+        }
+        if (!matched && left > 1 && rest[0] == '#')
+        {
+            char *end;
+            unsigned long code = rest[1] == 'x' ? strtoul(rest + 2, &end, 16) : strtoul(rest + 1, &end, 10);
+            if (*end == ';' && code > 0 && code < 0x110000)
+            {
+                // UTF-8 encode the code point
+                if (code < 0x80)
+                    out[used++] = (char)code;
+                else if (code < 0x800)
+                {
+                    out[used++] = (char)(0xC0 | (code >> 6));
+                    out[used++] = (char)(0x80 | (code & 0x3F));
+                }
+                else if (code < 0x10000)
+                {
+                    out[used++] = (char)(0xE0 | (code >> 12));
+                    out[used++] = (char)(0x80 | ((code >> 6) & 0x3F));
+                    out[used++] = (char)(0x80 | (code & 0x3F));
+                }
+                else
+                {
+                    out[used++] = (char)(0xF0 | (code >> 18));
+                    out[used++] = (char)(0x80 | ((code >> 12) & 0x3F));
+                    out[used++] = (char)(0x80 | ((code >> 6) & 0x3F));
+                    out[used++] = (char)(0x80 | (code & 0x3F));
+                }
+                i += (size_t)(end - rest) + 1;
+                matched = 1;
+            }
+        }
+        if (!matched)
+            out[used++] = '&';
+    }
+    out[used] = '\0';
+    return out;
+}
+
+// The text of the first <tag>...</tag> in [from, to), raw; NULL when absent
+static const char *xml_find(const char *from, const char *to, const char *tag, size_t *length,
+                            const char **after)
+{
+    char open[64], close[64];
+    snprintf(open, sizeof(open), "<%s>", tag);
+    snprintf(close, sizeof(close), "</%s>", tag);
+    size_t open_length = strlen(open);
+    const char *start = memmem(from, (size_t)(to - from), open, open_length);
+    if (!start)
+        return NULL;
+    start += open_length;
+    const char *end = memmem(start, (size_t)(to - start), close, strlen(close));
+    if (!end)
+        return NULL;
+    *length = (size_t)(end - start);
+    if (after)
+        *after = end + strlen(close);
+    return start;
+}
+
+// "<Code>: <Message>" of an S3 error reply, or the HTTP status
+static void describe_error(HttpResponse *response, const char *what, char *error, size_t error_size)
+{
+    size_t length = 0;
+    char *body = response_read_all(response, OBJECT_ERROR_BODY_MAX, &length);
+    size_t code_length = 0, message_length = 0;
+    const char *code = body ? xml_find(body, body + length, "Code", &code_length, NULL) : NULL;
+    const char *message = body ? xml_find(body, body + length, "Message", &message_length, NULL) : NULL;
+    if (code)
+        snprintf(error, error_size, "%s: HTTP %d %.*s%s%.*s", what, response->status, (int)code_length, code,
+                 message ? ": " : "", message ? (int)message_length : 0, message ? message : "");
+    else
+        snprintf(error, error_size, "%s: HTTP %d", what, response->status);
+    free(body);
+}
+
+// Listing
+
+static ObjectDir *object_dir_new(const char *prefix, size_t prefix_length, int depth)
+{
+    ObjectDir *dir = calloc(1, sizeof(*dir));
+    if (!dir)
+        return NULL;
+    dir->prefix = malloc(prefix_length + 1);
+    if (!dir->prefix)
+    {
+        free(dir);
+        return NULL;
+    }
+    copy_text(dir->prefix, prefix_length + 1, prefix, prefix_length);
+    dir->depth = depth;
+    return dir;
+}
+
+void object_dir_free(ObjectDir *dir)
+{
+    if (!dir)
+        return;
+    for (size_t i = 0; i < dir->count; i++)
+    {
+        free(dir->entries[i].name);
+        object_dir_free(dir->entries[i].dir);
+    }
+    free(dir->entries);
+    free(dir->prefix);
+    free(dir);
+}
+
+static ObjectEntry *object_dir_add(ObjectDir *dir, const char *name, size_t name_length)
+{
+    if (dir->count == dir->capacity)
+    {
+        size_t capacity = dir->capacity ? dir->capacity * 2 : 16;
+        ObjectEntry *entries = realloc(dir->entries, capacity * sizeof(*entries));
+        if (!entries)
+            return NULL;
+        dir->entries = entries;
+        dir->capacity = capacity;
+    }
+    ObjectEntry *entry = &dir->entries[dir->count];
+    memset(entry, 0, sizeof(*entry));
+    entry->name = malloc(name_length + 1);
+    if (!entry->name)
+        return NULL;
+    copy_text(entry->name, name_length + 1, name, name_length);
+    dir->count++;
+    return entry;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+    return strcmp(((const ObjectEntry *)a)->name, ((const ObjectEntry *)b)->name);
+}
+
+static long long parse_last_modified(const char *text)
+{
+    struct tm utc;
+    memset(&utc, 0, sizeof(utc));
+    if (sscanf(text, "%d-%d-%dT%d:%d:%d", &utc.tm_year, &utc.tm_mon, &utc.tm_mday, &utc.tm_hour, &utc.tm_min,
+               &utc.tm_sec) != 6)
+        return 0;
+    utc.tm_year -= 1900;
+    utc.tm_mon -= 1;
+    return (long long)timegm(&utc);
+}
+
+// Prefixes waiting to be listed, shared by the listing threads
+typedef struct
+{
+    ObjectStore *store;
+    char bucket[256];
+    size_t root_prefix_length;
+    int max_depth;
+    ObjectSkipFn skip;
+    void *skip_arg;
+    ObjectDir **queue;
+    size_t head;
+    size_t count;
+    size_t capacity;
+    int active; // Prefixes being listed: new ones may still be queued
+    int failed;
+    char *error;
+    size_t error_size;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} ListJob;
+
+static int list_job_push(ListJob *job, ObjectDir *dir)
+{
+    pthread_mutex_lock(&job->mutex);
+    if (job->count == job->capacity)
+    {
+        size_t capacity = job->capacity ? job->capacity * 2 : 64;
+        ObjectDir **queue = realloc(job->queue, capacity * sizeof(*queue));
+        if (!queue)
+        {
+            pthread_mutex_unlock(&job->mutex);
+            return -1;
+        }
+        job->queue = queue;
+        job->capacity = capacity;
+    }
+    job->queue[job->count++] = dir;
+    pthread_cond_signal(&job->cond);
+    pthread_mutex_unlock(&job->mutex);
+    return 0;
+}
+
+static void list_job_fail(ListJob *job, const char *message)
+{
+    pthread_mutex_lock(&job->mutex);
+    if (!job->failed)
+    {
+        job->failed = 1;
+        copy_text(job->error, job->error_size, message, strlen(message));
+    }
+    pthread_cond_broadcast(&job->cond);
+    pthread_mutex_unlock(&job->mutex);
+}
+
+// One page of a prefix: its objects and common prefixes. Returns the continuation token
+// (malloc'ed) while the listing is truncated, NULL at the end; sets *failed on errors.
+static char *list_page(ListJob *job, ObjectDir *dir, const char *token, int *failed)
+{
+    char canonical_uri[1024], encoded_prefix[4096], encoded_token[4096], query[8320];
+    char message[1536];
+    *failed = 1;
+    if (uri_encode(encoded_prefix, sizeof(encoded_prefix), dir->prefix, 0) != 0 ||
+        uri_encode(encoded_token, sizeof(encoded_token), token ? token : "", 0) != 0 ||
+        uri_encode(canonical_uri + 1, sizeof(canonical_uri) - 1, job->bucket, 0) != 0)
+    {
+        list_job_fail(job, "prefix or continuation token too long");
+        return NULL;
+    }
+    canonical_uri[0] = '/';
+
+    // Parameters in the sorted order the signature needs
+    snprintf(query, sizeof(query), "%s%s%sdelimiter=%%2F&list-type=2&max-keys=%d&prefix=%s",
+             token ? "continuation-token=" : "", token ? encoded_token : "", token ? "&" : "", OBJECT_LIST_PAGE,
+             encoded_prefix);
+
+    HttpResponse *response = malloc(sizeof(*response));
+    if (!response)
+    {
+        list_job_fail(job, "out of memory");
+        return NULL;
+    }
+    if (object_get(job->store, canonical_uri, query, NULL, response) != 0)
+    {
+        snprintf(message, sizeof(message), "listing s3://%s/%.512s: cannot reach %s", job->bucket, dir->prefix,
+                 job->store->authority);
+        list_job_fail(job, message);
+        free(response);
+        return NULL;
+    }
+    if (response->status != 200)
+    {
+        char what[1024];
+        snprintf(what, sizeof(what), "listing s3://%s/%.512s", job->bucket, dir->prefix);
+        describe_error(response, what, message, sizeof(message));
+        response_finish(response);
+        list_job_fail(job, message);
+        free(response);
+        return NULL;
+    }
+
+    size_t length = 0;
+    char *body = response_read_all(response, (size_t)-1, &length);
+    response_finish(response);
+    free(response);
+    if (!body)
+    {
+        snprintf(message, sizeof(message), "listing s3://%s/%.512s: connection lost", job->bucket, dir->prefix);
+        list_job_fail(job, message);
+        return NULL;
+    }
+
+    const char *end = body + length;
+    const char *cursor = body;
+    size_t prefix_length = strlen(dir->prefix);
+    size_t block_length, field_length;
+    const char *block;
+    int ok = 1;
+
+    while (ok && (block = xml_find(cursor, end, "Contents", &block_length, &cursor)) != NULL)
+    {
+        const char *block_end = block + block_length;
+        const char *raw = xml_find(block, block_end, "Key", &field_length, NULL);
+        char *key = raw ? xml_text(raw, field_length) : NULL;
+        // Keys outside the prefix, directory markers ("dir/") and keys the delimiter did not split are skipped
+        if (key && strncmp(key, dir->prefix, prefix_length) == 0 && key[prefix_length] != '\0' &&
+            !strchr(key + prefix_length, '/'))
+        {
+            ObjectEntry *entry = object_dir_add(dir, key + prefix_length, strlen(key + prefix_length));
+            if (!entry)
+                ok = 0;
+            else
+            {
+                const char *size = xml_find(block, block_end, "Size", &field_length, NULL);
+                const char *modified = xml_find(block, block_end, "LastModified", &field_length, NULL);
+                entry->size = size ? strtoull(size, NULL, 10) : 0;
+                entry->mtime_sec = modified ? parse_last_modified(modified) : 0;
+            }
+        }
+        free(key);
+    }
+
+    cursor = body;
+    while (ok && (block = xml_find(cursor, end, "CommonPrefixes", &block_length, &cursor)) != NULL)
+    {
+        const char *raw = xml_find(block, block + block_length, "Prefix", &field_length, NULL);
+        char *prefix = raw ? xml_text(raw, field_length) : NULL;
+        size_t child_length = prefix ? strlen(prefix) : 0;
+        if (prefix && child_length > prefix_length + 1 && strncmp(prefix, dir->prefix, prefix_length) == 0 &&
+            prefix[child_length - 1] == '/')
+        {
+            // The walk sees "<relative>" without the trailing slash
+            prefix[child_length - 1] = '\0';
+            if (!job->skip || !job->skip(prefix + job->root_prefix_length, job->skip_arg))
+            {
+                prefix[child_length - 1] = '/';
+                ObjectEntry *entry = object_dir_add(dir, prefix + prefix_length, child_length - prefix_length - 1);
+                ObjectDir *child = entry ? object_dir_new(prefix, child_length, dir->depth + 1) : NULL;
+                if (!child)
+                    ok = 0;
+                else
+                {
+                    entry->is_dir = 1;
+                    entry->dir = child;
+                    if ((job->max_depth == 0 || child->depth < job->max_depth) && list_job_push(job, child) != 0)
+                        ok = 0;
+                }
+            }
+        }
+        free(prefix);
+    }
+
+    char *next = NULL;
+    const char *truncated = xml_find(body, end, "IsTruncated", &field_length, NULL);
+    if (ok && truncated && field_length == 4 && memcmp(truncated, "true", 4) == 0)
+    {
+        const char *raw = xml_find(body, end, "NextContinuationToken", &field_length, NULL);
+        next = raw ? xml_text(raw, field_length) : NULL;
+        if (!next)
+            ok = 0;
+    }
+    free(body);
+
+    if (!ok)
+    {
+        snprintf(message, sizeof(message), "listing s3://%s/%.512s: malformed reply or out of memory", job->bucket,
+                 dir->prefix);
+        list_job_fail(job, message);
+        free(next);
+        return NULL;
+    }
+    *failed = 0;
+    return next;
+}
+
+static void *list_thread(void *arg)
+{
+    ListJob *job = arg;
+    pthread_mutex_lock(&job->mutex);
+    for (;;)
+    {
+        while (!job->failed && job->head == job->count && job->active > 0)
+            pthread_cond_wait(&job->cond, &job->mutex);
+        if (job->failed || job->head == job->count)
+            break;
+        ObjectDir *dir = job->queue[job->head++];
+        job->active++;
+        pthread_mutex_unlock(&job->mutex);
+
+        // Pages of one prefix follow each other; prefixes are listed side by side
+        char *token = NULL;
+        int failed = 0;
+        do
+        {
+            char *next = list_page(job, dir, token, &failed);
+            free(token);
+            token = next;
+        } while (token && !failed);
+        free(token);
+        if (dir->count > 1)
+            qsort(dir->entries, dir->count, sizeof(*dir->entries), compare_entries);
+
+        pthread_mutex_lock(&job->mutex);
+        job->active--;
+        if (job->active == 0 && job->head == job->count)
+            pthread_cond_broadcast(&job->cond);
+    }
+    pthread_cond_broadcast(&job->cond);
+    pthread_mutex_unlock(&job->mutex);
+    return NULL;
+}
+
+ObjectDir *object_store_list(ObjectStore *store, const char *url, int max_depth, ObjectSkipFn skip, void *skip_arg,
+                             char *error, size_t error_size)
+{
+    ListJob job;
+    memset(&job, 0, sizeof(job));
+    const char *prefix;
+    if (split_object_url(url, job.bucket, sizeof(job.bucket), &prefix) != 0)
+    {
+        snprintf(error, error_size, "'%s': expected s3://bucket[/prefix]", url);
+        return NULL;
+    }
+
+    // A prefix is a directory: "s3://bucket/src" lists the keys under "src/"
+    char root_prefix[1024];
+    size_t prefix_length = strlen(prefix);
+    while (prefix_length > 0 && prefix[prefix_length - 1] == '/')
+        prefix_length--;
+    if (prefix_length + 2 > sizeof(root_prefix))
+    {
+        snprintf(error, error_size, "'%s': prefix too long", url);
+        return NULL;
+    }
+    copy_text(root_prefix, sizeof(root_prefix), prefix, prefix_length);
+    if (prefix_length > 0)
+        root_prefix[prefix_length++] = '/';
+    root_prefix[prefix_length] = '\0';
+
+    ObjectDir *root = object_dir_new(root_prefix, prefix_length, 0);
+    if (!root)
+    {
+        snprintf(error, error_size, "out of memory");
+        return NULL;
+    }
+
+    job.store = store;
+    job.root_prefix_length = prefix_length;
+    job.max_depth = max_depth;
+    job.skip = skip;
+    job.skip_arg = skip_arg;
+    job.error = error;
+    job.error_size = error_size;
+    pthread_mutex_init(&job.mutex, NULL);
+    pthread_cond_init(&job.cond, NULL);
+
+    pthread_t threads[OBJECT_CONNECTIONS_MAX];
+    int started = 0;
+    if (list_job_push(&job, root) == 0)
+    {
+        for (; started < store->connections; started++)
+        {
+            if (pthread_create(&threads[started], NULL, list_thread, &job) != 0)
+                break;
+        }
+        if (started == 0)
+            list_thread(&job);
+    }
+    else
+    {
+        job.failed = 1;
+        snprintf(error, error_size, "out of memory");
+    }
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    pthread_cond_destroy(&job.cond);
+    pthread_mutex_destroy(&job.mutex);
+    free(job.queue);
+    if (job.failed)
+    {
+        object_dir_free(root);
+        return NULL;
+    }
+    return root;
+}
+
+// Reading
+
+typedef enum
+{
+    PART_EMPTY,
+    PART_FETCHING,
+    PART_READY,
+    PART_FAILED
+} PartState;
+
+typedef struct
+{
+    unsigned long long index;
+    PartState state;
+    char *data;
+    size_t length;
+} ObjectPart;
+
+typedef struct
+{
+    ObjectStore *store;
+    char *uri; // Canonical: "/bucket/key", encoded
+    unsigned long long size;
+    unsigned long long position;
+
+    // Objects up to OBJECT_PART_SIZE: one GET streamed from the socket
+    HttpResponse *response;             // NULL when no request is open
+    unsigned long long response_offset; // Object offset of the response's next byte
+    char *head;                         // The first OBJECT_HEAD_SIZE bytes as they were read
+    size_t head_length;
+
+    // Larger objects: a window of parts fetched by helper threads with ranged GETs
+    ObjectPart *parts;
+    int window;
+    unsigned long long part_count;
+    unsigned long long next_fetch; // Next part a helper claims
+    unsigned long long read_part;  // Part the reader is in; earlier ones are released
+    pthread_t helpers[OBJECT_CONNECTIONS_MAX];
+    int helper_count;
+    int stopping;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} ObjectStream;
+
+// Open a GET of the object from offset on; 0 when the body follows
+static int stream_request(ObjectStream *stream, unsigned long long offset)
+{
+    if (!stream->response)
+    {
+        stream->response = malloc(sizeof(*stream->response));
+        if (!stream->response)
+            return -1;
+        stream->response->fd = -1;
+    }
+    response_finish(stream->response);
+
+    char range[48];
+    snprintf(range, sizeof(range), "%llu-", offset);
+    if (object_get(stream->store, stream->uri, "", offset > 0 ? range : NULL, stream->response) != 0)
+        return -1;
+    int expected = offset > 0 ? 206 : 200;
+    if (stream->response->status != expected)
+    {
+        response_finish(stream->response);
+        errno = stream->response->status == 404 ? ENOENT : stream->response->status == 403 ? EACCES : EIO;
+        return -1;
+    }
+    stream->response_offset = offset;
+    return 0;
+}
+
+static ssize_t stream_read_single(ObjectStream *stream, char *buffer, size_t size)
+{
+    if (stream->position < stream->head_length)
+    {
+        size_t n = stream->head_length - (size_t)stream->position;
+        if (n > size)
+            n = size;
+        memcpy(buffer, stream->head + stream->position, n);
+        stream->position += n;
+        return (ssize_t)n;
+    }
+
+    for (int attempt = 0;; attempt++)
+    {
+        int current = stream->response && stream->response->fd >= 0 && stream->response_offset == stream->position;
+        if (!current && stream_request(stream, stream->position) != 0)
+            return -1;
+        ssize_t got = response_read(stream->response, buffer, size);
+        if (got >= 0)
+        {
+            // Keep the start of the object for a rewind
+            if (stream->head && stream->response_offset == stream->head_length &&
+                stream->head_length < OBJECT_HEAD_SIZE)
+            {
+                size_t keep = OBJECT_HEAD_SIZE - stream->head_length < (size_t)got ? OBJECT_HEAD_SIZE - stream->head_length
+                                                                                   : (size_t)got;
+                memcpy(stream->head + stream->head_length, buffer, keep);
+                stream->head_length += keep;
+            }
+            stream->response_offset += (unsigned long long)got;
+            stream->position += (unsigned long long)got;
+            if (stream->response->body_done)
+                response_finish(stream->response);
+            return got;
+        }
+        // The connection dropped mid-body: continue with a ranged GET from here
+        response_finish(stream->response);
+        if (attempt + 1 >= OBJECT_RETRIES)
+        {
+            errno = EIO;
+            return -1;
+        }
+        __atomic_fetch_add(&stream->store->retries, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static int fetch_part(ObjectStream *stream, ObjectPart *part)
+{
+    unsigned long long first = part->index * OBJECT_PART_SIZE;
+    unsigned long long last = first + OBJECT_PART_SIZE - 1;
+    if (last >= stream->size)
+        last = stream->size - 1;
+    size_t length = (size_t)(last - first + 1);
+    if (!part->data)
+        part->data = malloc(OBJECT_PART_SIZE);
+    if (!part->data)
+        return -1;
+
+    char range[64];
+    snprintf(range, sizeof(range), "%llu-%llu", first, last);
+    HttpResponse *response = malloc(sizeof(*response));
+    if (!response)
+        return -1;
+    int result = -1;
+    for (int attempt = 0; attempt < OBJECT_RETRIES && result != 0 && !__atomic_load_n(&stream->stopping, __ATOMIC_RELAXED);
+         attempt++)
+    {
+        if (object_get(stream->store, stream->uri, "", range, response) != 0)
+            break;
+        if (response->status != 206)
+        {
+            response_finish(response);
+            break;
+        }
+        size_t used = 0;
+        ssize_t got = 1;
+        while (used < length && (got = response_read(response, part->data + used, length - used)) > 0)
+            used += (size_t)got;
+        response_finish(response);
+        if (used == length)
+        {
+            part->length = used;
+            result = 0;
+        }
+        else
+        {
+            __atomic_fetch_add(&stream->store->retries, 1, __ATOMIC_RELAXED);
+        }
+    }
+    free(response);
+    return result;
+}
+
+static void *part_helper_thread(void *arg)
+{
+    ObjectStream *stream = arg;
+    pthread_mutex_lock(&stream->mutex);
+    for (;;)
+    {
+        while (!stream->stopping && !(stream->next_fetch < stream->part_count &&
+                                      stream->next_fetch < stream->read_part + (unsigned long long)stream->window))
+            pthread_cond_wait(&stream->cond, &stream->mutex);
+        if (stream->stopping)
+            break;
+
+        ObjectPart *part = &stream->parts[stream->next_fetch % (unsigned long long)stream->window];
+        part->index = stream->next_fetch++;
+        part->state = PART_FETCHING;
+        pthread_mutex_unlock(&stream->mutex);
+
+        int result = fetch_part(stream, part);
+
+        pthread_mutex_lock(&stream->mutex);
+        part->state = result == 0 ? PART_READY : PART_FAILED;
+        pthread_cond_broadcast(&stream->cond);
+    }
+    pthread_mutex_unlock(&stream->mutex);
+    return NULL;
+}
+
+static void stream_stop_helpers(ObjectStream *stream)
+{
+    pthread_mutex_lock(&stream->mutex);
+    stream->stopping = 1;
+    pthread_cond_broadcast(&stream->cond);
+    pthread_mutex_unlock(&stream->mutex);
+    for (int i = 0; i < stream->helper_count; i++)
+        pthread_join(stream->helpers[i], NULL);
+    stream->helper_count = 0;
+    stream->stopping = 0;
+}
+
+// (Re)start the window at a part: a seek outside it throws the fetched parts away
+static int stream_start_helpers(ObjectStream *stream, unsigned long long first_part)
+{
+    for (int i = 0; i < stream->window; i++)
+        stream->parts[i].state = PART_EMPTY;
+    stream->next_fetch = first_part;
+    stream->read_part = first_part;
+    for (int i = 0; i < stream->window; i++)
+    {
+        if (pthread_create(&stream->helpers[stream->helper_count], NULL, part_helper_thread, stream) != 0)
+            break;
+        stream->helper_count++;
+    }
+    return stream->helper_count > 0 ? 0 : -1;
+}
+
+static ObjectPart *stream_wait_part(ObjectStream *stream, unsigned long long index)
+{
+    ObjectPart *part = &stream->parts[index % (unsigned long long)stream->window];
+    pthread_mutex_lock(&stream->mutex);
+    while (!(part->index == index && (part->state == PART_READY || part->state == PART_FAILED)))
+        pthread_cond_wait(&stream->cond, &stream->mutex);
+    pthread_mutex_unlock(&stream->mutex);
+    return part;
+}
+
+static ssize_t stream_read_parts(ObjectStream *stream, char *buffer, size_t size)
+{
+    unsigned long long index = stream->position / OBJECT_PART_SIZE;
+    if (index < stream->read_part || index >= stream->read_part + (unsigned long long)stream->window)
+    {
+        stream_stop_helpers(stream);
+        if (stream_start_helpers(stream, index) != 0)
+            return -1;
+    }
+    else if (index > stream->read_part)
+    {
+        // Parts behind the reader free their slots for the helpers
+        pthread_mutex_lock(&stream->mutex);
+        stream->read_part = index;
+        pthread_cond_broadcast(&stream->cond);
+        pthread_mutex_unlock(&stream->mutex);
+    }
+
+    ObjectPart *part = stream_wait_part(stream, index);
+    if (part->state == PART_FAILED)
+    {
+        errno = EIO;
+        return -1;
+    }
+    size_t offset = (size_t)(stream->position - index * OBJECT_PART_SIZE);
+    size_t n = part->length - offset < size ? part->length - offset : size;
+    memcpy(buffer, part->data + offset, n);
+    stream->position += n;
+    return (ssize_t)n;
+}
+
+static ssize_t stream_read(void *cookie, char *buffer, size_t size)
+{
+    ObjectStream *stream = cookie;
+    if (stream->position >= stream->size || size == 0)
+        return 0;
+    if (size > stream->size - stream->position)
+        size = (size_t)(stream->size - stream->position);
+    return stream->parts ? stream_read_parts(stream, buffer, size) : stream_read_single(stream, buffer, size);
+}
+
+static int stream_seek(void *cookie, off64_t *offset, int whence)
+{
+    ObjectStream *stream = cookie;
+    long long base = whence == SEEK_SET   ? 0
+                     : whence == SEEK_CUR ? (long long)stream->position
+                                          : (long long)stream->size;
+    if (base + *offset < 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    stream->position = (unsigned long long)(base + *offset);
+    *offset = (off64_t)stream->position;
+    return 0;
+}
+
+static int stream_close(void *cookie)
+{
+    ObjectStream *stream = cookie;
+    if (stream->parts)
+    {
+        stream_stop_helpers(stream);
+        for (int i = 0; i < stream->window; i++)
+            free(stream->parts[i].data);
+        free(stream->parts);
+        pthread_cond_destroy(&stream->cond);
+        pthread_mutex_destroy(&stream->mutex);
+    }
+    if (stream->response)
+    {
+        response_finish(stream->response);
+        free(stream->response);
+    }
+    free(stream->head);
+    free(stream->uri);
+    free(stream);
+    return 0;
+}
+
+FILE *object_store_open(ObjectStore *store, const char *url, unsigned long long size)
+{
+    char bucket[256], encoded_bucket[1024], encoded_key[4096];
+    const char *key;
+    if (split_object_url(url, bucket, sizeof(bucket), &key) != 0 || key[0] == '\0' ||
+        uri_encode(encoded_bucket, sizeof(encoded_bucket), bucket, 0) != 0 ||
+        uri_encode(encoded_key, sizeof(encoded_key), key, 1) != 0)
+    {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    ObjectStream *stream = calloc(1, sizeof(*stream));
+    if (!stream)
+        return NULL;
+    stream->store = store;
+    stream->size = size;
+    size_t uri_size = strlen(encoded_bucket) + strlen(encoded_key) + 3;
+    stream->uri = malloc(uri_size);
+    if (!stream->uri)
+    {
+        free(stream);
+        return NULL;
+    }
+    snprintf(stream->uri, uri_size, "/%s/%s", encoded_bucket, encoded_key);
+
+    int opened;
+    if (size > OBJECT_PART_SIZE)
+    {
+        stream->part_count = (size + OBJECT_PART_SIZE - 1) / OBJECT_PART_SIZE;
+        stream->window = store->connections < (int)stream->part_count ? store->connections : (int)stream->part_count;
+        stream->parts = calloc((size_t)stream->window, sizeof(*stream->parts));
+        pthread_mutex_init(&stream->mutex, NULL);
+        pthread_cond_init(&stream->cond, NULL);
+        // The first part tells whether the object is still there
+        opened = stream->parts && stream_start_helpers(stream, 0) == 0 &&
+                 stream_wait_part(stream, 0)->state == PART_READY;
+        if (!opened && !stream->parts)
+        {
+            pthread_cond_destroy(&stream->cond);
+            pthread_mutex_destroy(&stream->mutex);
+        }
+    }
+    else
+    {
+        stream->head = size > 0 ? malloc(size < OBJECT_HEAD_SIZE ? (size_t)size : OBJECT_HEAD_SIZE) : NULL;
+        opened = (size == 0 || stream->head) && (size == 0 || stream_request(stream, 0) == 0);
+    }
+
+    cookie_io_functions_t functions = {stream_read, NULL, stream_seek, stream_close};
+    FILE *file = opened ? fopencookie(stream, "rb", functions) : NULL;
+    if (!file)
+    {
+        int saved = errno;
+        stream_close(stream);
+        errno = saved;
+        return NULL;
+    }
+    setvbuf(file, NULL, _IOFBF, 64 * 1024);
+    return file;
+}
+
+int object_store_init(ObjectStore *store, const char *endpoint, int connections, char *error, size_t error_size)
+{
+    memset(store, 0, sizeof(*store));
+    pthread_mutex_init(&store->mutex, NULL);
+    store->connections = connections < 1                        ? OBJECT_CONNECTIONS_DEFAULT
+                         : connections > OBJECT_CONNECTIONS_MAX ? OBJECT_CONNECTIONS_MAX
+                                                                : connections;
+
+    const char *region = env_first("AWS_REGION", "AWS_DEFAULT_REGION");
+    copy_text(store->region, sizeof(store->region), region ? region : "us-east-1",
+              strlen(region ? region : "us-east-1"));
+
+    char default_endpoint[128];
+    if (!endpoint)
+        endpoint = env_first("AWS_ENDPOINT_URL_S3", "AWS_ENDPOINT_URL");
+    if (!endpoint)
+    {
+        snprintf(default_endpoint, sizeof(default_endpoint), "http://s3.%s.amazonaws.com", store->region);
+        endpoint = default_endpoint;
+    }
+    if (parse_endpoint(store, endpoint, error, error_size) != 0 || resolve_endpoint(store, error, error_size) != 0)
+    {
+        pthread_mutex_destroy(&store->mutex);
+        return -1;
+    }
+
+    // Without both keys requests go out unsigned, which public buckets accept
+    const char *access_key = getenv("AWS_ACCESS_KEY_ID");
+    const char *secret_key = getenv("AWS_SECRET_ACCESS_KEY");
+    const char *token = getenv("AWS_SESSION_TOKEN");
+    if (access_key && secret_key && access_key[0] && secret_key[0])
+    {
+        if (strlen(access_key) >= sizeof(store->access_key) || strlen(secret_key) >= sizeof(store->secret_key) ||
+            (token && strlen(token) >= sizeof(store->session_token)))
+        {
+            snprintf(error, error_size, "AWS credentials too long");
+            pthread_mutex_destroy(&store->mutex);
+            return -1;
+        }
+        copy_text(store->access_key, sizeof(store->access_key), access_key, strlen(access_key));
+        copy_text(store->secret_key, sizeof(store->secret_key), secret_key, strlen(secret_key));
+        if (token)
+            copy_text(store->session_token, sizeof(store->session_token), token, strlen(token));
+    }
+    return 0;
+}
+
+void object_store_destroy(ObjectStore *store)
+{
+    for (int i = 0; i < store->idle_count; i++)
+        close(store->idle[i]);
+    store->idle_count = 0;
+    memset(store->secret_key, 0, sizeof(store->secret_key));
+    pthread_mutex_destroy(&store->mutex);
+}
+
+#else
+
+int object_store_init(ObjectStore *store, const char *endpoint, int connections, char *error, size_t error_size)
+{
+    (void)endpoint;
+    (void)connections;
+    memset(store, 0, sizeof(*store));
+    snprintf(error, error_size, "s3:// inputs are not supported on Windows");
+    return -1;
+}
+
+void object_store_destroy(ObjectStore *store)
+{
+    (void)store;
+}
+
+ObjectDir *object_store_list(ObjectStore *store, const char *url, int max_depth, ObjectSkipFn skip, void *skip_arg,
+                             char *error, size_t error_size)
+{
+    (void)store;
+    (void)max_depth;
+    (void)skip;
+    (void)skip_arg;
+    snprintf(error, error_size, "'%s': s3:// inputs are not supported on Windows", url);
+    return NULL;
+}
+
+void object_dir_free(ObjectDir *dir)
+{
+    (void)dir;
+}
+
+FILE *object_store_open(ObjectStore *store, const char *url, unsigned long long size)
+{
+    (void)store;
+    (void)url;
+    (void)size;
+    return NULL;
+}
+
+#endif
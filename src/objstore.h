@@ -0,0 +1,78 @@
+// File: src/objstore.h
+#ifndef OBJSTORE_H
+#define OBJSTORE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <pthread.h>
+
+// s3:// input roots: a bucket prefix read as a tree over the S3 REST API (ListObjectsV2 and
+// GET), signed with AWS Signature Version 4. Any S3-compatible server works, such as MinIO.
+#define OBJECT_URL_SCHEME "s3://"
+#define OBJECT_CONNECTIONS_DEFAULT 8
+#define OBJECT_CONNECTIONS_MAX 64
+#define OBJECT_PART_SIZE (4ULL * 1024 * 1024) // Larger objects are read as concurrent ranged GETs
+#define OBJECT_LIST_PAGE 1000                  // Keys per ListObjectsV2 page, the S3 maximum
+
+typedef struct ObjectDir ObjectDir;
+
+typedef struct
+{
+    char *name; // Last component of the key, without the trailing '/' of a prefix
+    int is_dir; // A common prefix
+    unsigned long long size;
+    long long mtime_sec; // LastModified
+    ObjectDir *dir;      // The prefix's listing, empty when beyond the depth limit
+} ObjectEntry;
+
+struct ObjectDir
+{
+    char *prefix; // Full key prefix: "" or ending in '/'
+    int depth;    // 0 for the root
+    ObjectEntry *entries; // Sorted by name once listed
+    size_t count;
+    size_t capacity;
+};
+
+// Prefixes the walk would not enter are not listed: returns nonzero to skip one
+typedef int (*ObjectSkipFn)(const char *relative_path, void *arg);
+
+typedef struct
+{
+    char host[256];
+    char port[8];
+    char authority[300]; // Host header, as signed
+    char region[64];
+    char access_key[128]; // Empty = anonymous requests
+    char secret_key[128];
+    char session_token[2048];
+    unsigned char address[128]; // struct sockaddr of the endpoint, resolved once
+    unsigned int address_length;
+    int connections; // Listing threads, and ranged GETs in flight per large object
+    int idle[OBJECT_CONNECTIONS_MAX]; // Keep-alive sockets ready for the next request
+    int idle_count;
+    pthread_mutex_t mutex;
+
+    // Totals for the verbose summary
+    unsigned long long requests;
+    unsigned long long retries;
+    unsigned long long bytes;
+} ObjectStore;
+
+int is_object_url(const char *path);
+
+// endpoint: "http://host[:port]", NULL for $AWS_ENDPOINT_URL_S3, $AWS_ENDPOINT_URL or AWS itself.
+// Credentials and region come from the usual AWS_* variables. Returns 0, or -1 with a message.
+int object_store_init(ObjectStore *store, const char *endpoint, int connections, char *error, size_t error_size);
+void object_store_destroy(ObjectStore *store);
+
+// The tree under an s3://bucket/prefix URL. Prefixes are listed on store->connections threads,
+// every one paginated; max_depth (0 = unlimited) and skip bound what is listed.
+ObjectDir *object_store_list(ObjectStore *store, const char *url, int max_depth, ObjectSkipFn skip, void *skip_arg,
+                             char *error, size_t error_size);
+void object_dir_free(ObjectDir *dir);
+
+// A read stream over one object (s3://bucket/key) of the listed size; seekable, NULL on error
+FILE *object_store_open(ObjectStore *store, const char *url, unsigned long long size);
+
+#endif
@@ -0,0 +1,93 @@
+// File: src/probes.h
+#ifndef PROBES_H
+#define PROBES_H
+
+// USDT (SDT) static probes for bpftrace, perf and SystemTap, in provider "fconcat". A probe
+// that nobody attached to is a single nop plus an ELF note: only its arguments are moved into
+// registers. Every argument is passed as a 64-bit integer; paths and names are C strings.
+//
+//   dir_enter(path, level, structure_pass)   dir_exit(path, level, entries)
+//   dir_blocked(path, note)                  StructureNote that kept the walk out
+//   exclude(path, match, pattern)            match: 0 = kept, 1 = full path, 2 = basename
+//   file_open(path, size)
+//   file_classify(path, binary, generated)   generated: GeneratedReason, 0 when not checked
+//   plugin_enter(plugin, callback, path, bytes)
+//   plugin_exit(plugin, callback, bytes, result)
+//   chunk_write(path, bytes, spans)
+//
+// e.g. bpftrace -e 'usdt:./fconcat:fconcat:file_open { @[str(arg0)] = arg1; }'
+//
+// <sys/sdt.h> is used when it is installed. Without it, x86-64 and arm64 ELF builds emit the
+// same version 3 notes themselves; other targets and -DFCONCAT_NO_PROBES compile them out.
+
+#if defined(__has_include) && !defined(FCONCAT_NO_PROBES)
+#if __has_include(<sys/sdt.h>)
+#define FCONCAT_HAVE_SYS_SDT 1
+#endif
+#endif
+
+#if defined(FCONCAT_NO_PROBES)
+#define FCONCAT_PROBES_ENABLED 0
+#elif defined(FCONCAT_HAVE_SYS_SDT)
+#define FCONCAT_PROBES_ENABLED 1
+#include <sys/sdt.h>
+#define FCONCAT_PROBE2(name, a1, a2) DTRACE_PROBE2(fconcat, name, a1, a2)
+#define FCONCAT_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(fconcat, name, a1, a2, a3)
+#define FCONCAT_PROBE4(name, a1, a2, a3, a4) DTRACE_PROBE4(fconcat, name, a1, a2, a3, a4)
+#elif defined(__GNUC__) && defined(__ELF__) && (defined(__x86_64__) || defined(__aarch64__))
+#define FCONCAT_PROBES_ENABLED 1
+#include <stdint.h>
+
+// The note <sys/sdt.h> writes: probe address, base address for prelink adjustment, no
+// semaphore, then provider, name and argument specs such as "-8@%rdi"
+#define FCONCAT_SDT_ASM(name, args)                                                                \
+    "990: nop\n"                                                                                   \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n"                                                  \
+    ".balign 4\n"                                                                                  \
+    ".4byte 992f-991f, 994f-993f, 3\n"                                                             \
+    "991: .asciz \"stapsdt\"\n"                                                                    \
+    "992: .balign 4\n"                                                                             \
+    "993: .8byte 990b\n"                                                                           \
+    ".8byte _.stapsdt.base\n"                                                                      \
+    ".8byte 0\n"                                                                                   \
+    ".asciz \"fconcat\"\n"                                                                         \
+    ".asciz \"" #name "\"\n"                                                                       \
+    ".asciz \"" args "\"\n"                                                                        \
+    "994: .balign 4\n"                                                                             \
+    ".popsection\n"                                                                                \
+    ".ifndef _.stapsdt.base\n"                                                                     \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"                        \
+    ".weak _.stapsdt.base\n"                                                                       \
+    ".hidden _.stapsdt.base\n"                                                                     \
+    "_.stapsdt.base: .space 1\n"                                                                   \
+    ".size _.stapsdt.base, 1\n"                                                                    \
+    ".popsection\n"                                                                                \
+    ".endif\n"
+
+#define FCONCAT_SDT_ARG(x) ((long long)(intptr_t)(x))
+
+#define FCONCAT_PROBE2(name, a1, a2)                                                               \
+    __asm__ __volatile__(FCONCAT_SDT_ASM(name, "-8@%[arg1] -8@%[arg2]")                            \
+                         :                                                                         \
+                         : [arg1] "nor"(FCONCAT_SDT_ARG(a1)), [arg2] "nor"(FCONCAT_SDT_ARG(a2)))
+#define FCONCAT_PROBE3(name, a1, a2, a3)                                                           \
+    __asm__ __volatile__(FCONCAT_SDT_ASM(name, "-8@%[arg1] -8@%[arg2] -8@%[arg3]")                 \
+                         :                                                                         \
+                         : [arg1] "nor"(FCONCAT_SDT_ARG(a1)), [arg2] "nor"(FCONCAT_SDT_ARG(a2)),   \
+                           [arg3] "nor"(FCONCAT_SDT_ARG(a3)))
+#define FCONCAT_PROBE4(name, a1, a2, a3, a4)                                                       \
+    __asm__ __volatile__(FCONCAT_SDT_ASM(name, "-8@%[arg1] -8@%[arg2] -8@%[arg3] -8@%[arg4]")      \
+                         :                                                                         \
+                         : [arg1] "nor"(FCONCAT_SDT_ARG(a1)), [arg2] "nor"(FCONCAT_SDT_ARG(a2)),   \
+                           [arg3] "nor"(FCONCAT_SDT_ARG(a3)), [arg4] "nor"(FCONCAT_SDT_ARG(a4)))
+#else
+#define FCONCAT_PROBES_ENABLED 0
+#endif
+
+#if !FCONCAT_PROBES_ENABLED
+#define FCONCAT_PROBE2(name, a1, a2) ((void)0)
+#define FCONCAT_PROBE3(name, a1, a2, a3) ((void)0)
+#define FCONCAT_PROBE4(name, a1, a2, a3, a4) ((void)0)
+#endif
+
+#endif
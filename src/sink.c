@@ -0,0 +1,189 @@
+// File: src/sink.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "sink.h"
+
+void sink_set_init(SinkSet *set)
+{
+    memset(set, 0, sizeof(*set));
+}
+
+static int parse_format(const char *name, OutputFormat *format)
+{
+    if (strcmp(name, "default") == 0)
+        *format = OUTPUT_FORMAT_DEFAULT;
+    else if (strcmp(name, "markdown") == 0)
+        *format = OUTPUT_FORMAT_MARKDOWN;
+    else if (strcmp(name, "xml") == 0)
+        *format = OUTPUT_FORMAT_XML;
+    else if (strcmp(name, "chunks") == 0)
+        *format = OUTPUT_FORMAT_CHUNKS;
+    else
+        return -1;
+    return 0;
+}
+
+// Parse "<file>[,format=<name>][,plugin=<path>]..." into the next sink
+int sink_set_add(SinkSet *set, const char *spec, char *error, size_t error_size)
+{
+    if (set->count >= MAX_SINKS)
+    {
+        snprintf(error, error_size, "at most %d --sink outputs are supported", MAX_SINKS);
+        return -1;
+    }
+
+    char *copy = strdup(spec);
+    if (!copy)
+    {
+        snprintf(error, error_size, "out of memory");
+        return -1;
+    }
+
+    int index = set->count;
+    OutputSink *sink = &set->sinks[index];
+    memset(sink, 0, sizeof(*sink));
+#ifdef WITH_PLUGINS
+    if (init_plugin_manager(&set->plugin_managers[index]) != 0)
+    {
+        snprintf(error, error_size, "cannot initialize the plugin manager");
+        free(copy);
+        return -1;
+    }
+    sink->plugin_manager = &set->plugin_managers[index];
+#endif
+
+    // Counted from here on, so sink_set_free() releases whatever was set up
+    set->count++;
+
+    char *field = strchr(copy, ',');
+    if (field)
+        *field++ = '\0';
+    if (copy[0] == '\0')
+    {
+        snprintf(error, error_size, "--sink requires an output file");
+        free(copy);
+        return -1;
+    }
+    set->paths[index] = strdup(copy);
+    sink->path = set->paths[index];
+    if (!sink->path)
+    {
+        snprintf(error, error_size, "out of memory");
+        free(copy);
+        return -1;
+    }
+
+    while (field && *field)
+    {
+        char *next = strchr(field, ',');
+        if (next)
+            *next++ = '\0';
+
+        if (strncmp(field, "format=", 7) == 0)
+        {
+            OutputFormat format;
+            char template_error[128];
+            if (set->has_templates[index] || parse_format(field + 7, &format) != 0)
+            {
+                snprintf(error, error_size, "--sink format must be given once as default, markdown, xml or chunks");
+                free(copy);
+                return -1;
+            }
+            if (template_compile(&set->header_templates[index], template_preset_header(format),
+                                 template_error, sizeof(template_error)) != 0)
+            {
+                snprintf(error, error_size, "%s", template_error);
+                free(copy);
+                return -1;
+            }
+            if (template_compile(&set->footer_templates[index], template_preset_footer(format),
+                                 template_error, sizeof(template_error)) != 0)
+            {
+                template_free(&set->header_templates[index]);
+                snprintf(error, error_size, "%s", template_error);
+                free(copy);
+                return -1;
+            }
+            set->has_templates[index] = 1;
+            sink->chunked = format == OUTPUT_FORMAT_CHUNKS;
+            sink->xml_escaped = format == OUTPUT_FORMAT_XML;
+            sink->header_template = &set->header_templates[index];
+            sink->footer_template = &set->footer_templates[index];
+        }
+        else if (strncmp(field, "plugin=", 7) == 0)
+        {
+#ifdef WITH_PLUGINS
+            if (load_plugin(sink->plugin_manager, field + 7) != 0)
+            {
+                snprintf(error, error_size, "failed to load plugin: %s", field + 7);
+                free(copy);
+                return -1;
+            }
+#else
+            snprintf(error, error_size, "plugin support is not compiled in (rebuild with PLUGINS=1)");
+            free(copy);
+            return -1;
+#endif
+        }
+        else
+        {
+            snprintf(error, error_size, "unknown --sink option '%s' (expected format= or plugin=)", field);
+            free(copy);
+            return -1;
+        }
+        field = next;
+    }
+
+    free(copy);
+    return 0;
+}
+
+int sink_set_open(SinkSet *set, char *error, size_t error_size)
+{
+    for (int i = 0; i < set->count; i++)
+    {
+        set->sinks[i].file = fopen(set->sinks[i].path, "wb");
+        if (!set->sinks[i].file)
+        {
+            snprintf(error, error_size, "cannot open '%s': %s", set->sinks[i].path, strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Close every open sink file; -1 if any of them failed to flush
+int sink_set_close(SinkSet *set)
+{
+    int result = 0;
+    for (int i = 0; i < set->count; i++)
+    {
+        if (set->sinks[i].file && fclose(set->sinks[i].file) != 0)
+        {
+            fprintf(stderr, "Error closing sink '%s': %s\n", set->sinks[i].path, strerror(errno));
+            result = -1;
+        }
+        set->sinks[i].file = NULL;
+    }
+    return result;
+}
+
+void sink_set_free(SinkSet *set)
+{
+    sink_set_close(set);
+    for (int i = 0; i < set->count; i++)
+    {
+        if (set->has_templates[i])
+        {
+            template_free(&set->header_templates[i]);
+            template_free(&set->footer_templates[i]);
+        }
+#ifdef WITH_PLUGINS
+        destroy_plugin_manager(&set->plugin_managers[i]);
+#endif
+        free(set->paths[i]);
+    }
+    set->count = 0;
+}
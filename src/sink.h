@@ -0,0 +1,29 @@
+// File: src/sink.h
+#ifndef SINK_H
+#define SINK_H
+
+#include <stddef.h>
+#include "concat.h"
+
+// Extra outputs declared with --sink "<file>[,format=<name>][,plugin=<path>]...". Each owns its
+// destination, its compiled layout (when format= is given) and its own plugin chain.
+typedef struct
+{
+    OutputSink sinks[MAX_SINKS];
+    OutputTemplate header_templates[MAX_SINKS];
+    OutputTemplate footer_templates[MAX_SINKS];
+    int has_templates[MAX_SINKS];
+#ifdef WITH_PLUGINS
+    PluginManager plugin_managers[MAX_SINKS];
+#endif
+    char *paths[MAX_SINKS];
+    int count;
+} SinkSet;
+
+void sink_set_init(SinkSet *set);
+int sink_set_add(SinkSet *set, const char *spec, char *error, size_t error_size);
+int sink_set_open(SinkSet *set, char *error, size_t error_size);
+int sink_set_close(SinkSet *set);
+void sink_set_free(SinkSet *set);
+
+#endif
@@ -0,0 +1,256 @@
+// File: src/structure.c
+#include <stdlib.h>
+#include <string.h>
+#include "concat.h"
+#include "structure.h"
+
+static const struct
+{
+    const char *text;
+    size_t length;
+} structure_notes[] = {
+    {"", 0},
+    {" -> [BROKEN LINK]", 17},
+    {" -> [SYMLINK SKIPPED]", 21},
+    {" -> [SYMLINK TO DIR]", 20},
+    {" -> [SYMLINK]", 13},
+    {" -> [LOOP DETECTED]", 19},
+    {" -> [FOLLOWING]", 15},
+    {" -> [MAX DEPTH]", 15},
+    {" -> [OTHER FILESYSTEM]", 22},
+    {" -> [EXCLUDED FILESYSTEM]", 25},
+};
+
+// Icon plus the separating space, as UTF-8
+static const struct
+{
+    const char *text;
+    size_t length;
+} structure_icons[] = {
+    {"📁 ", 5},
+    {"📄 ", 5},
+    {"🔗 ", 5},
+    {"… ", 4},
+    {"📦 ", 5},
+};
+
+void structure_tree_init(StructureTree *tree)
+{
+    memset(tree, 0, sizeof(*tree));
+}
+
+void structure_tree_free(StructureTree *tree)
+{
+    free(tree->nodes);
+    free(tree->names);
+    free(tree->last_at_depth);
+    memset(tree, 0, sizeof(*tree));
+}
+
+static int structure_tree_reserve(StructureTree *tree, unsigned depth, size_t name_length)
+{
+    if (tree->count == tree->capacity)
+    {
+        size_t capacity = tree->capacity ? tree->capacity * 2 : 1024;
+        StructureNode *nodes = realloc(tree->nodes, capacity * sizeof(StructureNode));
+        if (!nodes)
+            return -1;
+        tree->nodes = nodes;
+        tree->capacity = capacity;
+    }
+
+    if (tree->names_used + name_length > tree->names_capacity)
+    {
+        size_t capacity = tree->names_capacity ? tree->names_capacity * 2 : 64 * 1024;
+        while (capacity < tree->names_used + name_length)
+            capacity *= 2;
+        if (capacity > UINT32_MAX)
+            return -1;
+        char *names = realloc(tree->names, capacity);
+        if (!names)
+            return -1;
+        tree->names = names;
+        tree->names_capacity = capacity;
+    }
+
+    if (depth >= tree->depth_capacity)
+    {
+        size_t capacity = tree->depth_capacity ? tree->depth_capacity * 2 : 64;
+        while (capacity <= depth)
+            capacity *= 2;
+        uint32_t *last = realloc(tree->last_at_depth, capacity * sizeof(uint32_t));
+        if (!last)
+            return -1;
+        tree->last_at_depth = last;
+        tree->depth_capacity = capacity;
+    }
+
+    return 0;
+}
+
+// Nodes arrive in depth-first order, so the parent of a node at depth d is the last node seen at d-1
+int structure_tree_add(StructureTree *tree, unsigned depth, StructureKind kind, const char *name,
+                       unsigned flags, unsigned long long size, StructureNote note)
+{
+    depth += tree->base_depth;
+    size_t name_length = strlen(name);
+    if (structure_tree_reserve(tree, depth, name_length) != 0)
+    {
+        fprintf(stderr, "Memory allocation failed for structure entry: %s\n", name);
+        return -1;
+    }
+
+    uint32_t index = (uint32_t)tree->count++;
+    StructureNode *node = &tree->nodes[index];
+    node->size = (flags & STRUCTURE_FLAG_SIZED) ? size : 0;
+    node->files = (flags & STRUCTURE_FLAG_SIZED) ? 1 : 0;
+    node->name_offset = (uint32_t)tree->names_used;
+    node->name_length = (uint32_t)name_length;
+    node->parent = depth > 0 ? tree->last_at_depth[depth - 1] : STRUCTURE_NO_PARENT;
+    node->depth = depth;
+    node->kind = (uint8_t)kind;
+    node->note = (uint8_t)note;
+    node->flags = (uint8_t)flags;
+
+    memcpy(tree->names + tree->names_used, name, name_length);
+    tree->names_used += name_length;
+    tree->last_at_depth[depth] = index;
+    return 0;
+}
+
+int structure_tree_add_omitted(StructureTree *tree, unsigned depth, unsigned long omitted)
+{
+    char text[64];
+    snprintf(text, sizeof(text), "[%lu more entries not shown]", omitted);
+    return structure_tree_add(tree, depth, STRUCTURE_OMITTED, text, 0, 0, STRUCTURE_NOTE_NONE);
+}
+
+// One reverse sweep: every child comes after its parent, so children are final before they are folded in
+void structure_tree_aggregate(StructureTree *tree)
+{
+    tree->total_size = 0;
+    tree->total_files = 0;
+
+    for (size_t i = tree->count; i-- > 0;)
+    {
+        const StructureNode *node = &tree->nodes[i];
+        if (node->parent == STRUCTURE_NO_PARENT)
+        {
+            tree->total_size += node->size;
+            tree->total_files += node->files;
+        }
+        else
+        {
+            StructureNode *parent = &tree->nodes[node->parent];
+            parent->size += node->size;
+            parent->files += node->files;
+        }
+    }
+}
+
+// Buffered line writer; lines are assembled with memcpy and flushed in large blocks
+#define RENDER_BUFFER_SIZE (256 * 1024)
+#define RENDER_LINE_MAX 512
+
+typedef struct
+{
+    char *buffer;
+    size_t used;
+    FILE *out;
+} RenderBuffer;
+
+static void render_flush(RenderBuffer *rb)
+{
+    if (rb->used > 0)
+        fwrite(rb->buffer, 1, rb->used, rb->out);
+    rb->used = 0;
+}
+
+static inline void render_append(RenderBuffer *rb, const char *data, size_t length)
+{
+    if (rb->used + length > RENDER_BUFFER_SIZE)
+    {
+        render_flush(rb);
+        if (length > RENDER_BUFFER_SIZE)
+        {
+            fwrite(data, 1, length, rb->out);
+            return;
+        }
+    }
+    memcpy(rb->buffer + rb->used, data, length);
+    rb->used += length;
+}
+
+static void render_indent(RenderBuffer *rb, unsigned depth)
+{
+    static const char spaces[128] =
+        "                                                                "
+        "                                                               ";
+    size_t remaining = (size_t)depth * 2;
+    while (remaining > 0)
+    {
+        size_t chunk = remaining < sizeof(spaces) ? remaining : sizeof(spaces);
+        render_append(rb, spaces, chunk);
+        remaining -= chunk;
+    }
+}
+
+static char *format_count(unsigned long long value, char *end)
+{
+    do
+    {
+        *--end = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    return end;
+}
+
+void structure_tree_render(const StructureTree *tree, FILE *out, int show_size)
+{
+    RenderBuffer rb = {malloc(RENDER_BUFFER_SIZE), 0, out};
+    if (!rb.buffer)
+    {
+        fprintf(stderr, "Memory allocation failed for structure rendering\n");
+        return;
+    }
+
+    char field[RENDER_LINE_MAX];
+    for (size_t i = 0; i < tree->count; i++)
+    {
+        const StructureNode *node = &tree->nodes[i];
+
+        render_indent(&rb, node->depth);
+        render_append(&rb, structure_icons[node->kind].text, structure_icons[node->kind].length);
+
+        if (show_size && (node->flags & (STRUCTURE_FLAG_SIZED | STRUCTURE_FLAG_CONTAINER)))
+        {
+            size_t length = 0;
+            field[length++] = '[';
+            length += format_size_into(node->size, field + length);
+            if (node->flags & STRUCTURE_FLAG_CONTAINER)
+            {
+                char digits[24];
+                char *start = format_count(node->files, digits + sizeof(digits));
+                size_t digit_count = (size_t)(digits + sizeof(digits) - start);
+                memcpy(field + length, ", ", 2);
+                length += 2;
+                memcpy(field + length, start, digit_count);
+                length += digit_count;
+                memcpy(field + length, node->files == 1 ? " file" : " files", node->files == 1 ? 5 : 6);
+                length += node->files == 1 ? 5 : 6;
+            }
+            field[length++] = ']';
+            field[length++] = ' ';
+            render_append(&rb, field, length);
+        }
+
+        render_append(&rb, tree->names + node->name_offset, node->name_length);
+        if (node->flags & STRUCTURE_FLAG_SLASH)
+            render_append(&rb, "/", 1);
+        render_append(&rb, structure_notes[node->note].text, structure_notes[node->note].length);
+        render_append(&rb, "\n", 1);
+    }
+
+    render_flush(&rb);
+    free(rb.buffer);
+}
@@ -0,0 +1,76 @@
+// File: src/structure.h
+#ifndef STRUCTURE_H
+#define STRUCTURE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum
+{
+    STRUCTURE_DIR,
+    STRUCTURE_FILE,
+    STRUCTURE_SYMLINK,
+    STRUCTURE_OMITTED, // Placeholder for entries past --max-dir-entries
+    STRUCTURE_ROOT     // Label of one input root when several are given
+} StructureKind;
+
+// Bracketed annotation after the name, e.g. "-> [FOLLOWING]"
+typedef enum
+{
+    STRUCTURE_NOTE_NONE,
+    STRUCTURE_NOTE_BROKEN_LINK,
+    STRUCTURE_NOTE_SYMLINK_SKIPPED,
+    STRUCTURE_NOTE_SYMLINK_TO_DIR,
+    STRUCTURE_NOTE_SYMLINK,
+    STRUCTURE_NOTE_LOOP_DETECTED,
+    STRUCTURE_NOTE_FOLLOWING,
+    STRUCTURE_NOTE_MAX_DEPTH,
+    STRUCTURE_NOTE_OTHER_FILESYSTEM,
+    STRUCTURE_NOTE_EXCLUDED_FILESYSTEM
+} StructureNote;
+
+#define STRUCTURE_FLAG_SLASH 0x01     // Name is printed with a trailing '/'
+#define STRUCTURE_FLAG_SIZED 0x02     // Entry has a size and counts as a file
+#define STRUCTURE_FLAG_CONTAINER 0x04 // Entered directory, shows aggregates
+
+typedef struct
+{
+    unsigned long long size; // Own size, or aggregate for containers
+    unsigned long long files;
+    uint32_t name_offset;
+    uint32_t name_length;
+    uint32_t parent; // Index of the parent node, STRUCTURE_NO_PARENT at top level
+    uint32_t depth;
+    uint8_t kind;
+    uint8_t note;
+    uint8_t flags;
+} StructureNode;
+
+#define STRUCTURE_NO_PARENT UINT32_MAX
+
+// Tree model of the structure section; nodes are stored in traversal (pre-)order
+typedef struct
+{
+    StructureNode *nodes;
+    size_t count;
+    size_t capacity;
+    char *names;
+    size_t names_used;
+    size_t names_capacity;
+    uint32_t *last_at_depth; // Most recent node per depth, gives each new node its parent
+    size_t depth_capacity;
+    unsigned base_depth; // Added to every depth, 1 below a root label
+    unsigned long long total_size;
+    unsigned long long total_files;
+} StructureTree;
+
+void structure_tree_init(StructureTree *tree);
+void structure_tree_free(StructureTree *tree);
+int structure_tree_add(StructureTree *tree, unsigned depth, StructureKind kind, const char *name,
+                       unsigned flags, unsigned long long size, StructureNote note);
+int structure_tree_add_omitted(StructureTree *tree, unsigned depth, unsigned long omitted);
+void structure_tree_aggregate(StructureTree *tree);
+void structure_tree_render(const StructureTree *tree, FILE *out, int show_size);
+
+#endif
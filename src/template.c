@@ -0,0 +1,358 @@
+// File: src/template.c
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "template.h"
+
+typedef struct
+{
+    const char *name;
+    TemplateOpKind kind;
+} TemplateField;
+
+static const TemplateField template_fields[] = {
+    {"path", TEMPLATE_PATH},
+    {"path:xml", TEMPLATE_PATH_XML},
+    {"size", TEMPLATE_SIZE},
+    {"lines", TEMPLATE_LINES},
+    {"hash", TEMPLATE_HASH},
+    {"lang", TEMPLATE_LANG},
+    {"symlink", TEMPLATE_SYMLINK},
+    {"eol", TEMPLATE_EOL},
+    {"fence", TEMPLATE_FENCE},
+};
+
+#define TEMPLATE_FIELD_COUNT (sizeof(template_fields) / sizeof(template_fields[0]))
+
+// Extension (or exact file name) to fenced-code language tag
+typedef struct
+{
+    const char *suffix;
+    const char *lang;
+} LanguageEntry;
+
+static const LanguageEntry language_names[] = {
+    {"Makefile", "makefile"},
+    {"GNUmakefile", "makefile"},
+    {"Dockerfile", "dockerfile"},
+    {"CMakeLists.txt", "cmake"},
+};
+
+static const LanguageEntry language_extensions[] = {
+    {"c", "c"}, {"h", "c"}, {"cc", "cpp"}, {"cpp", "cpp"}, {"cxx", "cpp"}, {"hh", "cpp"}, {"hpp", "cpp"}, {"hxx", "cpp"}, {"m", "objectivec"}, {"mm", "objectivec"}, {"cs", "csharp"}, {"java", "java"}, {"kt", "kotlin"}, {"kts", "kotlin"}, {"scala", "scala"}, {"go", "go"}, {"rs", "rust"}, {"swift", "swift"}, {"zig", "zig"}, {"py", "python"}, {"pyi", "python"}, {"rb", "ruby"}, {"pl", "perl"}, {"pm", "perl"}, {"php", "php"}, {"lua", "lua"}, {"r", "r"}, {"jl", "julia"}, {"hs", "haskell"}, {"ml", "ocaml"}, {"ex", "elixir"}, {"exs", "elixir"}, {"erl", "erlang"}, {"clj", "clojure"}, {"dart", "dart"}, {"js", "javascript"}, {"mjs", "javascript"}, {"cjs", "javascript"}, {"jsx", "jsx"}, {"ts", "typescript"}, {"tsx", "tsx"}, {"vue", "vue"}, {"svelte", "svelte"}, {"html", "html"}, {"htm", "html"}, {"css", "css"}, {"scss", "scss"}, {"less", "less"}, {"json", "json"}, {"yaml", "yaml"}, {"yml", "yaml"}, {"toml", "toml"}, {"ini", "ini"}, {"xml", "xml"}, {"svg", "xml"}, {"md", "markdown"}, {"rst", "rst"}, {"tex", "latex"}, {"sql", "sql"}, {"sh", "bash"}, {"bash", "bash"}, {"zsh", "zsh"}, {"fish", "fish"}, {"ps1", "powershell"}, {"bat", "batch"}, {"cmd", "batch"}, {"mk", "makefile"}, {"cmake", "cmake"}, {"proto", "protobuf"}, {"graphql", "graphql"}, {"tf", "hcl"}, {"nix", "nix"}, {"asm", "asm"}, {"s", "asm"}, {"diff", "diff"}, {"patch", "diff"}, {"txt", "text"},
+};
+
+const char *language_for_path(const char *path)
+{
+    const char *base = strrchr(path, '/');
+#if defined(_WIN32) || defined(_WIN64)
+    const char *base_win = strrchr(path, '\\');
+    if (base_win && (!base || base_win > base))
+        base = base_win;
+#endif
+    base = base ? base + 1 : path;
+
+    for (size_t i = 0; i < sizeof(language_names) / sizeof(language_names[0]); i++)
+    {
+        if (strcmp(base, language_names[i].suffix) == 0)
+            return language_names[i].lang;
+    }
+
+    const char *ext = strrchr(base, '.');
+    if (!ext || ext == base)
+        return "";
+    ext++;
+
+    for (size_t i = 0; i < sizeof(language_extensions) / sizeof(language_extensions[0]); i++)
+    {
+        if (strcasecmp(ext, language_extensions[i].suffix) == 0)
+            return language_extensions[i].lang;
+    }
+    return "";
+}
+
+static int template_append(OutputTemplate *tmpl, size_t *capacity, TemplateOpKind kind,
+                           size_t offset, size_t length)
+{
+    // Adjacent literals collapse into one op
+    if (kind == TEMPLATE_LITERAL && tmpl->count > 0 && tmpl->ops[tmpl->count - 1].kind == TEMPLATE_LITERAL &&
+        tmpl->ops[tmpl->count - 1].offset + tmpl->ops[tmpl->count - 1].length == offset)
+    {
+        tmpl->ops[tmpl->count - 1].length += length;
+        return 0;
+    }
+
+    if (tmpl->count == *capacity)
+    {
+        size_t new_capacity = *capacity ? *capacity * 2 : 8;
+        TemplateOp *ops = realloc(tmpl->ops, new_capacity * sizeof(TemplateOp));
+        if (!ops)
+            return -1;
+        tmpl->ops = ops;
+        *capacity = new_capacity;
+    }
+
+    tmpl->ops[tmpl->count].kind = kind;
+    tmpl->ops[tmpl->count].offset = offset;
+    tmpl->ops[tmpl->count].length = length;
+    tmpl->count++;
+    return 0;
+}
+
+// Syntax: literal text, {field} references, and \n \t \\ \{ \} escapes
+int template_compile(OutputTemplate *tmpl, const char *source, char *error, size_t error_size)
+{
+    memset(tmpl, 0, sizeof(*tmpl));
+
+    size_t source_len = strlen(source);
+    tmpl->literals = malloc(source_len + 1);
+    if (!tmpl->literals)
+    {
+        snprintf(error, error_size, "out of memory");
+        return -1;
+    }
+
+    size_t capacity = 0;
+    size_t literal_len = 0;
+    const char *p = source;
+
+    while (*p)
+    {
+        if (*p == '{')
+        {
+            const char *close = strchr(p + 1, '}');
+            if (!close)
+            {
+                snprintf(error, error_size, "unterminated field at '%s'", p);
+                template_free(tmpl);
+                return -1;
+            }
+
+            size_t name_len = (size_t)(close - p - 1);
+            const TemplateField *field = NULL;
+            for (size_t i = 0; i < TEMPLATE_FIELD_COUNT; i++)
+            {
+                if (strlen(template_fields[i].name) == name_len &&
+                    strncmp(template_fields[i].name, p + 1, name_len) == 0)
+                {
+                    field = &template_fields[i];
+                    break;
+                }
+            }
+
+            if (!field)
+            {
+                snprintf(error, error_size, "unknown field '{%.*s}'", (int)name_len, p + 1);
+                template_free(tmpl);
+                return -1;
+            }
+
+            if (template_append(tmpl, &capacity, field->kind, 0, 0) != 0)
+            {
+                snprintf(error, error_size, "out of memory");
+                template_free(tmpl);
+                return -1;
+            }
+
+            tmpl->needs_lines |= field->kind == TEMPLATE_LINES;
+            tmpl->needs_hash |= field->kind == TEMPLATE_HASH;
+            tmpl->needs_fence |= field->kind == TEMPLATE_FENCE;
+            p = close + 1;
+            continue;
+        }
+
+        char c = *p++;
+        if (c == '\\' && *p)
+        {
+            char escaped = *p++;
+            switch (escaped)
+            {
+            case 'n':
+                c = '\n';
+                break;
+            case 't':
+                c = '\t';
+                break;
+            default:
+                c = escaped;
+                break;
+            }
+        }
+
+        tmpl->literals[literal_len] = c;
+        if (template_append(tmpl, &capacity, TEMPLATE_LITERAL, literal_len, 1) != 0)
+        {
+            snprintf(error, error_size, "out of memory");
+            template_free(tmpl);
+            return -1;
+        }
+        literal_len++;
+    }
+
+    tmpl->literals[literal_len] = '\0';
+    return 0;
+}
+
+void template_free(OutputTemplate *tmpl)
+{
+    free(tmpl->ops);
+    free(tmpl->literals);
+    memset(tmpl, 0, sizeof(*tmpl));
+}
+
+// Format an unsigned value right-aligned ending at 'end', returns the first digit
+static char *format_decimal(unsigned long long value, char *end)
+{
+    do
+    {
+        *--end = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    return end;
+}
+
+static void render_bytes(const char *data, size_t len, TemplateFields *fields, FILE *out)
+{
+    if (len == 0)
+        return;
+    fwrite(data, 1, len, out);
+    fields->last_byte = (unsigned char)data[len - 1];
+}
+
+// Entity for a byte that XML text cannot hold as is, NULL otherwise. Quotes only need one
+// inside attribute values.
+static const char *xml_entity(char c, int attribute)
+{
+    switch (c)
+    {
+    case '&':
+        return "&amp;";
+    case '<':
+        return "&lt;";
+    case '>':
+        return "&gt;";
+    case '"':
+        return attribute ? "&quot;" : NULL;
+    case '\'':
+        return attribute ? "&apos;" : NULL;
+    default:
+        return NULL;
+    }
+}
+
+void template_write_xml(const char *data, size_t len, int attribute, FILE *out)
+{
+    const char *run = data;
+    const char *end = data + len;
+    for (const char *p = data; p < end; p++)
+    {
+        const char *entity = xml_entity(*p, attribute);
+        if (!entity)
+            continue;
+        if (p > run)
+            fwrite(run, 1, (size_t)(p - run), out);
+        fputs(entity, out);
+        run = p + 1;
+    }
+    if (end > run)
+        fwrite(run, 1, (size_t)(end - run), out);
+}
+
+static void render_xml_escaped(const char *text, TemplateFields *fields, FILE *out)
+{
+    size_t len = strlen(text);
+    if (len == 0)
+        return;
+    template_write_xml(text, len, 1, out);
+    fields->last_byte = xml_entity(text[len - 1], 1) ? ';' : (unsigned char)text[len - 1];
+}
+
+void template_render(const OutputTemplate *tmpl, TemplateFields *fields, FILE *out)
+{
+    char number[24];
+    char *end = number + sizeof(number);
+    static const char hex_digits[] = "0123456789abcdef";
+
+    for (size_t i = 0; i < tmpl->count; i++)
+    {
+        const TemplateOp *op = &tmpl->ops[i];
+        switch (op->kind)
+        {
+        case TEMPLATE_LITERAL:
+            render_bytes(tmpl->literals + op->offset, op->length, fields, out);
+            break;
+        case TEMPLATE_PATH:
+            render_bytes(fields->path, strlen(fields->path), fields, out);
+            break;
+        case TEMPLATE_PATH_XML:
+            render_xml_escaped(fields->path, fields, out);
+            break;
+        case TEMPLATE_SIZE:
+        case TEMPLATE_LINES:
+        {
+            char *start = format_decimal(op->kind == TEMPLATE_SIZE ? fields->size : fields->lines, end);
+            render_bytes(start, (size_t)(end - start), fields, out);
+            break;
+        }
+        case TEMPLATE_HASH:
+            for (int nibble = 0; nibble < 16; nibble++)
+                number[nibble] = hex_digits[(fields->hash >> (60 - nibble * 4)) & 0x0F];
+            render_bytes(number, 16, fields, out);
+            break;
+        case TEMPLATE_LANG:
+        {
+            const char *lang = language_for_path(fields->path);
+            render_bytes(lang, strlen(lang), fields, out);
+            break;
+        }
+        case TEMPLATE_SYMLINK:
+            if (fields->is_symlink)
+                render_bytes(" (symlink)", 10, fields, out);
+            break;
+        case TEMPLATE_EOL:
+            if (fields->last_byte != -1 && fields->last_byte != '\n')
+                render_bytes("\n", 1, fields, out);
+            break;
+        case TEMPLATE_FENCE:
+        {
+            unsigned int fence = fields->fence > TEMPLATE_FENCE_MIN ? fields->fence : TEMPLATE_FENCE_MIN;
+            for (unsigned int n = 0; n < fence; n++)
+                fputc('`', out);
+            fields->last_byte = '`';
+            break;
+        }
+        }
+    }
+}
+
+const char *template_preset_header(OutputFormat format)
+{
+    switch (format)
+    {
+    case OUTPUT_FORMAT_MARKDOWN:
+        return "## {path}{symlink}\\n\\n{fence}{lang}\\n";
+    case OUTPUT_FORMAT_XML:
+        return "<file path=\"{path:xml}\" size=\"{size}\">\\n";
+    case OUTPUT_FORMAT_CHUNKS:
+        return "";
+    case OUTPUT_FORMAT_DEFAULT:
+    default:
+        return "// File: {path}{symlink}\\n";
+    }
+}
+
+const char *template_preset_footer(OutputFormat format)
+{
+    switch (format)
+    {
+    case OUTPUT_FORMAT_MARKDOWN:
+        return "{eol}{fence}\\n\\n";
+    case OUTPUT_FORMAT_XML:
+        return "{eol}</file>\\n\\n";
+    case OUTPUT_FORMAT_CHUNKS:
+        return "";
+    case OUTPUT_FORMAT_DEFAULT:
+    default:
+        return "\\n\\n";
+    }
+}
@@ -0,0 +1,73 @@
+// File: src/template.h
+#ifndef TEMPLATE_H
+#define TEMPLATE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Header/footer templates are compiled once into a flat list of literal and field ops
+typedef enum
+{
+    TEMPLATE_LITERAL,
+    TEMPLATE_PATH,     // {path}      relative path
+    TEMPLATE_PATH_XML, // {path:xml}  relative path with XML escaping
+    TEMPLATE_SIZE,     // {size}      file size in bytes
+    TEMPLATE_LINES,    // {lines}     number of lines in the file
+    TEMPLATE_HASH,     // {hash}      xxh64 of the file content, 16 hex digits
+    TEMPLATE_LANG,     // {lang}      language tag from the extension table
+    TEMPLATE_SYMLINK,  // {symlink}   " (symlink)" for followed symlinks, empty otherwise
+    TEMPLATE_EOL,      // {eol}       newline unless the output already ends with one
+    TEMPLATE_FENCE     // {fence}     backticks outnumbering every backtick run in the file, at least 3
+} TemplateOpKind;
+
+typedef struct
+{
+    TemplateOpKind kind;
+    size_t offset; // Literal text offset into OutputTemplate.literals
+    size_t length;
+} TemplateOp;
+
+typedef struct
+{
+    TemplateOp *ops;
+    size_t count;
+    char *literals;
+    int needs_lines;
+    int needs_hash;
+    int needs_fence;
+} OutputTemplate;
+
+// Per-file values consumed by the field ops
+typedef struct
+{
+    const char *path;
+    unsigned long long size;
+    unsigned long long lines;
+    uint64_t hash;
+    int is_symlink;
+    int last_byte;      // Last byte written for this file, -1 if none yet
+    unsigned int fence; // Backticks in {fence}, 0 = TEMPLATE_FENCE_MIN
+} TemplateFields;
+
+#define TEMPLATE_FENCE_MIN 3
+
+typedef enum
+{
+    OUTPUT_FORMAT_DEFAULT,
+    OUTPUT_FORMAT_MARKDOWN,
+    OUTPUT_FORMAT_XML,
+    OUTPUT_FORMAT_CHUNKS // JSON Lines chunk records (chunk.h): no header or footer
+} OutputFormat;
+
+int template_compile(OutputTemplate *tmpl, const char *source, char *error, size_t error_size);
+void template_free(OutputTemplate *tmpl);
+void template_render(const OutputTemplate *tmpl, TemplateFields *fields, FILE *out);
+const char *template_preset_header(OutputFormat format);
+const char *template_preset_footer(OutputFormat format);
+const char *language_for_path(const char *path);
+
+// Write text with &, < and > as entities, and quotes too when it is an attribute value
+void template_write_xml(const char *data, size_t len, int attribute, FILE *out);
+
+#endif
@@ -0,0 +1,228 @@
+// File: src/walk_kernel.h
+// Directory walk kernel for the Unix traversal. This file has no include guard: concat.c
+// includes it once per specialization, with these macros defined beforehand:
+//
+//   WALK_KERNEL_NAME  name of the generated function
+//   WALK_STRUCTURE    1 = structure pass (records the tree), 0 = content pass (emits files)
+//   WALK_SYMLINKS     the SymlinkHandling mode the variant is compiled for
+//
+// Every mode test below is on a constant, so each variant keeps only its own branches and
+// recurses into itself directly. concat.c picks the variant once per pass.
+
+#define WALK_DESCEND(relative_path, device)                                   \
+    do                                                                        \
+    {                                                                         \
+        dev_t parent_dev = state->dir_dev;                                    \
+        state->dir_dev = (device);                                            \
+        WALK_KERNEL_NAME(ctx, state, (relative_path), level + 1);             \
+        state->dir_dev = parent_dev;                                          \
+    } while (0)
+
+static void WALK_KERNEL_NAME(ProcessingContext *ctx, TraversalState *state, const char *current_path, int level)
+{
+    // Relative paths carry the root label; the filesystem and exclude patterns see them without it
+    char path[MAX_PATH];
+    if (safe_path_join(path, sizeof(path), ctx->base_path,
+                       current_path + (current_path[0] ? state->label_length : 0)) < 0)
+        return;
+
+    DirReader dir;
+    if (dir_reader_open(&dir, path) != 0)
+        return;
+
+    int dir_fd = dir.fd;
+    int dont_sync = is_network_filesystem(state, path, state->dir_dev);
+    int listed = 0;
+    FCONCAT_PROBE3(dir_enter, path, level, WALK_STRUCTURE);
+    DirEntry de;
+    EntryMeta entry;
+
+    while (!g_stop_requested && dir_reader_next(&dir, &de))
+    {
+        char new_relative_path[MAX_PATH];
+        char new_full_path[MAX_PATH];
+
+        if (child_relative_path(state, new_relative_path, sizeof(new_relative_path), current_path, de.name) < 0)
+            continue;
+
+        if (safe_path_join(new_full_path, sizeof(new_full_path), path, de.name) < 0)
+            continue;
+
+        if (is_excluded(new_relative_path + state->label_length, ctx->excludes))
+            continue;
+
+        // Per-directory entry cap: the rest of the directory is counted, never stat'ed
+        if (ctx->max_dir_entries > 0 && listed >= ctx->max_dir_entries)
+        {
+#if WALK_STRUCTURE
+            unsigned long omitted = 1;
+            while (dir_reader_next(&dir, &de))
+                omitted++;
+            structure_tree_add_omitted(state->tree, level, omitted);
+#else
+            if (is_verbose())
+                fprintf(stderr, "[fconcat] Entry limit reached in: %s\n", path);
+#endif
+            break;
+        }
+        listed++;
+
+        // Symlinks are not followed here; their targets are looked up where needed
+        if (lookup_entry(ctx, WALK_STRUCTURE, state, dir_fd, &de, dont_sync, &entry) != 0)
+        {
+            if (is_verbose())
+                fprintf(stderr, "[fconcat] Cannot access: %s (%s)\n", new_full_path, strerror(errno));
+            continue;
+        }
+
+#if WALK_STRUCTURE
+        // Record the entry in the structure tree
+        StructureTree *tree = state->tree;
+
+        if (S_ISLNK(entry.mode))
+        {
+            EntryMeta target;
+            if (entry_metadata(dir_fd, de.name, 1, symlink_target_level(WALK_SYMLINKS), dont_sync, &target) == -1)
+            {
+                // Broken symlink
+                structure_tree_add(tree, level, STRUCTURE_SYMLINK, de.name, 0, 0, STRUCTURE_NOTE_BROKEN_LINK);
+            }
+            else if (WALK_SYMLINKS == SYMLINK_SKIP)
+            {
+                structure_tree_add(tree, level, STRUCTURE_SYMLINK, de.name, 0, 0, STRUCTURE_NOTE_SYMLINK_SKIPPED);
+            }
+            else if (WALK_SYMLINKS == SYMLINK_PLACEHOLDER)
+            {
+                if (S_ISDIR(target.mode))
+                {
+                    structure_tree_add(tree, level, STRUCTURE_SYMLINK, de.name, STRUCTURE_FLAG_SLASH,
+                                       0, STRUCTURE_NOTE_SYMLINK_TO_DIR);
+                }
+                else
+                {
+                    structure_tree_add(tree, level, STRUCTURE_SYMLINK, de.name, STRUCTURE_FLAG_SIZED,
+                                       target.size, STRUCTURE_NOTE_SYMLINK);
+                }
+            }
+            else if (has_inode(state->inode_tracker, target.dev, target.ino))
+            {
+                // Follow or include: check for loops
+                structure_tree_add(tree, level, STRUCTURE_SYMLINK, de.name, 0, 0, STRUCTURE_NOTE_LOOP_DETECTED);
+            }
+            else
+            {
+                add_inode(state->inode_tracker, target.dev, target.ino);
+
+                if (S_ISDIR(target.mode) && WALK_SYMLINKS == SYMLINK_FOLLOW)
+                {
+                    StructureNote blocked = descend_blocked_reason(ctx, state, new_full_path, target.dev, level);
+                    if (blocked)
+                    {
+                        structure_tree_add(tree, level, STRUCTURE_SYMLINK, de.name, STRUCTURE_FLAG_SLASH, 0, blocked);
+                    }
+                    else
+                    {
+                        structure_tree_add(tree, level, STRUCTURE_SYMLINK, de.name,
+                                           STRUCTURE_FLAG_SLASH | STRUCTURE_FLAG_CONTAINER, 0,
+                                           STRUCTURE_NOTE_FOLLOWING);
+
+                        // Recurse into symlinked directory
+                        WALK_DESCEND(new_relative_path, target.dev);
+                    }
+                }
+                else if (!S_ISDIR(target.mode))
+                {
+                    structure_tree_add(tree, level, STRUCTURE_SYMLINK, de.name, STRUCTURE_FLAG_SIZED,
+                                       target.size, STRUCTURE_NOTE_NONE);
+                    delta_classify(ctx, state, new_full_path, new_relative_path, &target);
+                }
+            }
+        }
+        else if (S_ISDIR(entry.mode))
+        {
+            StructureNote blocked = descend_blocked_reason(ctx, state, new_full_path, entry.dev, level);
+            if (blocked)
+            {
+                structure_tree_add(tree, level, STRUCTURE_DIR, de.name, STRUCTURE_FLAG_SLASH, 0, blocked);
+            }
+            else
+            {
+                structure_tree_add(tree, level, STRUCTURE_DIR, de.name,
+                                   STRUCTURE_FLAG_SLASH | STRUCTURE_FLAG_CONTAINER, 0, STRUCTURE_NOTE_NONE);
+
+                // Recurse into subdirectory
+                WALK_DESCEND(new_relative_path, entry.dev);
+            }
+        }
+        else
+        {
+            structure_tree_add(tree, level, STRUCTURE_FILE, de.name, STRUCTURE_FLAG_SIZED,
+                               entry.size, STRUCTURE_NOTE_NONE);
+            delta_classify(ctx, state, new_full_path, new_relative_path, &entry);
+        }
+#else
+        // File content processing
+        if (S_ISLNK(entry.mode))
+        {
+            if (WALK_SYMLINKS == SYMLINK_SKIP)
+                continue;
+
+            // Check if symlink is valid
+            EntryMeta target;
+            if (entry_metadata(dir_fd, de.name, 1, symlink_target_level(WALK_SYMLINKS), dont_sync, &target) == -1)
+            {
+                // Broken symlink; a delta carries file sections only
+                if (WALK_SYMLINKS == SYMLINK_PLACEHOLDER && !ctx->delta_base)
+                    emit_note_entry(ctx, state, new_relative_path, 0, "// [Broken symlink - target not accessible]");
+                continue;
+            }
+
+            if (WALK_SYMLINKS == SYMLINK_PLACEHOLDER)
+            {
+                if (!ctx->delta_base)
+                    emit_note_entry(ctx, state, new_relative_path, target.size, "// [Symlink - content not followed]");
+                continue;
+            }
+
+            // Follow or include: check for loops
+            if (has_inode(state->inode_tracker, target.dev, target.ino))
+            {
+                if (is_verbose())
+                    fprintf(stderr, "[fconcat] Symlink loop detected: %s\n", new_relative_path);
+                continue;
+            }
+
+            add_inode(state->inode_tracker, target.dev, target.ino);
+
+            if (S_ISDIR(target.mode) && WALK_SYMLINKS == SYMLINK_FOLLOW)
+            {
+                if (!descend_blocked_reason(ctx, state, new_full_path, target.dev, level))
+                    WALK_DESCEND(new_relative_path, target.dev);
+            }
+            else if (!S_ISDIR(target.mode))
+            {
+                // Process symlinked file
+                emit_entry(ctx, state, new_full_path, new_relative_path, 1, &target);
+            }
+        }
+        else if (S_ISDIR(entry.mode))
+        {
+            if (!descend_blocked_reason(ctx, state, new_full_path, entry.dev, level))
+                WALK_DESCEND(new_relative_path, entry.dev);
+        }
+        else
+        {
+            // Process regular file
+            emit_entry(ctx, state, new_full_path, new_relative_path, 0, &entry);
+        }
+#endif
+    }
+
+    dir_reader_close(&dir);
+    FCONCAT_PROBE3(dir_exit, path, level, listed);
+}
+
+#undef WALK_DESCEND
+#undef WALK_KERNEL_NAME
+#undef WALK_STRUCTURE
+#undef WALK_SYMLINKS